@@ -98,14 +98,15 @@ LOCAL_CFLAGS += -DLIBSVG_EXPAT -DCONFIG_DIR=\"/\" -I../../asio/include -DHAVE_CO
 -I../libkamoflage/prereqs/include/gnuVG \
 -I../prereqs/include/ \
 -I../build/ \
--Wall \
-#-D__DO_TIME_MEASURE
+-Wall
 
 LOCAL_CPPFLAGS += -DASIO_STANDALONE -std=c++11
 
 LOCAL_SRC_FILES := \
 android_java_interface.cc android_java_interface.hh \
 static_signal_preview.cc static_signal_preview.hh \
+static_signal_stream.cc static_signal_stream.hh \
+static_signal_file.cc static_signal_file.hh \
 wavloader.cc wavloader.hh \
 signal.cc signal.hh \
 machine.cc machine.hh machine_project_entry.cc \
@@ -116,15 +117,22 @@ machine_sequencer.cc machine_sequencer.hh \
 midi_export.cc midi_export.hh \
 vuknob_android_audio.cc vuknob_android_audio.hh \
 fixedpointmathlib.cc \
+convolution.cc convolution.hh \
 satan_project_entry.cc satan_project_entry.hh \
 graph_project_entry.cc graph_project_entry.hh \
 vorbis_encoder.cc vorbis_encoder.hh \
+recording_sink.cc recording_sink.hh \
+offline_render.cc \
 whistle_analyzer.cc \
 async_operations.cc \
 remote_interface.cc remote_interface.hh \
 scales.cc scales.hh \
 serialize.cc serialize.hh \
-time_measure.cc \
+performance_trace.cc performance_trace.hh \
+performance_monitor.cc performance_monitor.hh \
+object_snapshot.cc object_snapshot.hh \
+render_chain_scheduler.cc render_chain_scheduler.hh \
+premix_kernels.cc premix_kernels.hh \
 engine_code/pad.cc engine_code/pad.hh \
 engine_code/controller_envelope.cc engine_code/controller_envelope.hh \
 \
@@ -157,7 +165,7 @@ ui_code/scale_editor.cc ui_code/scale_editor.hh
 
 LOCAL_STATIC_LIBRARIES := cpufeatures libvorbis libogg libvorbisenc libkissfft
 LOCAL_LDFLAGS += -Xlinker --threads
-LOCAL_LDLIBS += -ldl -llog
+LOCAL_LDLIBS += -ldl -llog -lz
 LOCAL_SHARED_LIBRARIES := libsvgandroid libgnuVG libkamoflage libpathvariable
 
 include $(BUILD_SHARED_LIBRARY)
@@ -17,140 +17,416 @@
  * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  */
 
-#include <jngldrum/jthread.hh>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <stdexcept>
+
+#include <jngldrum/jexception.hh>
+
 #include "async_operations.hh"
-#include "readerwriterqueue/readerwriterqueue.h"
 
 //#define __DO_SATAN_DEBUG
 #include "satan_debug.hh"
 
-#include <unistd.h>
+// slots in each lock-free queue, must be a power of two
+#define ASYNC_QUEUE_SIZE 1024
+
+// maximum number of items a strand executes before it lets others run
+#define ASYNC_STRAND_BATCH 32
+
+#define ASYNC_MAX_WORKERS 8
+
+/************************
+ *
+ * Work items
+ *
+ * A work item is a tagged pointer, so AsyncOps from the
+ * MachineTable can be queued without allocating memory.
+ *
+ ************************/
+
+typedef uintptr_t AsyncItem;
+
+#define ASYNC_ITEM_TASK 0
+#define ASYNC_ITEM_OPERATION 1
+#define ASYNC_ITEM_STRAND 2
+#define ASYNC_ITEM_TAG_MASK 3
+
+class AsyncTask {
+public:
+	std::function<void()> function;
+
+	AsyncTask(std::function<void()> f) : function(f) {}
+};
+
+static inline AsyncItem make_item(void *p, int tag) {
+	return ((AsyncItem)p) | tag;
+}
+
+static inline void *item_pointer(AsyncItem item) {
+	return (void *)(item & ~((AsyncItem)ASYNC_ITEM_TAG_MASK));
+}
 
 /************************
  *
- * AsyncOperationsThread
+ * AsyncQueue - bounded multi producer, multi consumer queue with per cell
+ * sequence numbers, as in MachineOperationQueue. When it is full items go to
+ * an overflow list instead, and stay there until the queue has been emptied,
+ * so the items from one producer are always popped in order.
  *
  ************************/
 
-class AsyncOperationsThread : public jThread {	
+class AsyncQueue {
+public:
+	AsyncQueue() : enqueue_position(0), dequeue_position(0), overflow_count(0), overflowed(0) {
+		for(unsigned int k = 0; k < ASYNC_QUEUE_SIZE; k++)
+			cells[k].sequence.store(k, std::memory_order_relaxed);
+	}
+
+	void push(AsyncItem item) {
+		if(overflow_count.load() == 0 && try_push(item))
+			return;
+
+		// slow path, only taken when ASYNC_QUEUE_SIZE items are waiting
+		std::lock_guard<std::mutex> lock(overflow_lock);
+		overflow.push_back(item);
+		overflow_count.fetch_add(1);
+		overflowed.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	bool pop(AsyncItem &item) {
+		if(try_pop(item))
+			return true;
+		if(overflow_count.load() == 0)
+			return false;
+
+		std::lock_guard<std::mutex> lock(overflow_lock);
+		if(try_pop(item)) // something may have been pushed before the overflow started
+			return true;
+		if(overflow.empty())
+			return false;
+		item = overflow.front();
+		overflow.pop_front();
+		overflow_count.fetch_sub(1);
+		return true;
+	}
+
+	bool is_empty() {
+		return overflow_count.load() == 0 &&
+			enqueue_position.load() == dequeue_position.load();
+	}
+
+	int64_t get_overflowed() {
+		return overflowed.load(std::memory_order_relaxed);
+	}
+
 private:
-	struct AsyncEventData {
-		AsyncOp *operation_pointer;
-		std::function<void()> function;
+	class Cell {
+	public:
+		std::atomic<unsigned int> sequence;
+		AsyncItem item;
 	};
 
-	enum AsyncEventType {
-		aop_pointer, aop_function
-	};
-	
-	class AsyncEvent : public jThread::Event {
-	public:
-		AsyncEventType type;
-		AsyncEventData data;
-		
-		AsyncEvent() {}
-		virtual ~AsyncEvent() {} // we must have a virtual destructor
-
-		void set_operation(AsyncOp *op) {
-			data.operation_pointer = op;
-			type = aop_pointer;
+	Cell cells[ASYNC_QUEUE_SIZE];
+	std::atomic<unsigned int> enqueue_position, dequeue_position;
+
+	std::mutex overflow_lock;
+	std::deque<AsyncItem> overflow;
+	std::atomic<int> overflow_count;
+	std::atomic<int64_t> overflowed;
+
+	bool try_push(AsyncItem item) {
+		Cell *c;
+		unsigned int pos = enqueue_position.load(std::memory_order_relaxed);
+		while(1) {
+			c = &cells[pos & (ASYNC_QUEUE_SIZE - 1)];
+			unsigned int seq = c->sequence.load(std::memory_order_acquire);
+			int diff = (int)seq - (int)pos;
+			if(diff == 0) {
+				if(enqueue_position.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if(diff < 0) {
+				return false;
+			} else {
+				pos = enqueue_position.load(std::memory_order_relaxed);
+			}
 		}
-		
-		void set_operation(std::function<void()> func) {
-			data.function = func;
-			type = aop_function;
+		c->item = item;
+		c->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool try_pop(AsyncItem &item) {
+		Cell *c;
+		unsigned int pos = dequeue_position.load(std::memory_order_relaxed);
+		while(1) {
+			c = &cells[pos & (ASYNC_QUEUE_SIZE - 1)];
+			unsigned int seq = c->sequence.load(std::memory_order_acquire);
+			int diff = (int)seq - (int)(pos + 1);
+			if(diff == 0) {
+				if(dequeue_position.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if(diff < 0) {
+				return false;
+			} else {
+				pos = dequeue_position.load(std::memory_order_relaxed);
+			}
 		}
+		item = c->item;
+		c->sequence.store(pos + ASYNC_QUEUE_SIZE, std::memory_order_release);
+		return true;
+	}
+};
+
+/************************
+ *
+ * AsyncExecutor
+ *
+ ************************/
 
-		virtual void dummy_event_function() {}
+class AsyncExecutor {
+public:
+	AsyncExecutor(int worker_count);
+
+	void submit(AsyncItem item, AsyncOperations::Priority priority);
+	void submit_ordered(AsyncItem item, bool is_operation);
+
+	AsyncOperations::Statistics get_statistics();
+
+private:
+	// executes its items one at a time, in order, on any worker
+	class Strand {
+	public:
+		AsyncQueue queue;
+		std::atomic<bool> scheduled;
+
+		Strand() : scheduled(false) {}
+	};
+
+	class Worker {
+	public:
+		AsyncExecutor *executor;
+		int index;
+		pthread_t thread;
+
+		// items submitted by this worker - the worker pops from
+		// the back, other workers steal from the front
+		std::mutex local_lock;
+		std::deque<AsyncItem> local[2];
 	};
 
-	
-	AsyncOperationsThread() : jThread("AsyncOperationsThread") {
+	std::vector<Worker *> workers;
+	AsyncQueue injection[2];
+	Strand operations_strand, functions_strand;
+
+	sem_t wake_up;
+	std::atomic<int> idle_workers;
+	std::atomic<int> bulk_running;
+	int max_bulk_running;
+
+	std::atomic<int64_t> executed[2];
+	std::atomic<int64_t> stolen;
+
+	static thread_local Worker *current_worker;
+
+	void wake();
+	bool take_bulk_slot();
+	bool find_work(Worker *self, AsyncItem &item, int &priority);
+	void execute(AsyncItem item);
+	void run_strand(Strand *strand);
+
+	static void *worker_entry(void *w);
+	void worker_body(Worker *self);
+};
+
+thread_local AsyncExecutor::Worker *AsyncExecutor::current_worker = NULL;
+
+AsyncExecutor::AsyncExecutor(int worker_count)
+	: idle_workers(0), bulk_running(0), stolen(0)
+{
+	executed[0].store(0);
+	executed[1].store(0);
+
+	// keep one worker free for _io work
+	max_bulk_running = worker_count > 1 ? worker_count - 1 : 1;
+
+	sem_init(&wake_up, 0, 0);
+
+	for(int k = 0; k < worker_count; k++) {
+		Worker *w = new Worker();
+		w->executor = this;
+		w->index = k;
+		workers.push_back(w);
 	}
 
-	static jThread::EventQueue eq;
-	static AsyncOperationsThread *thrd;
-	static moodycamel::ReaderWriterQueue<AsyncEvent *> *free_events;
+	for(auto w : workers) {
+		if(pthread_create(&w->thread, NULL, worker_entry, w) != 0)
+			throw jException("Failed to create async operations worker thread.",
+					 jException::syscall_error);
+	}
+}
 
-public:
-	
-	void thread_body() {
-		while(1) {
-			AsyncEvent *ae = (AsyncEvent *)eq.wait_for_event();
+void AsyncExecutor::wake() {
+	if(idle_workers.load() > 0)
+		sem_post(&wake_up);
+}
 
-			switch(ae->type) {
+void AsyncExecutor::submit(AsyncItem item, AsyncOperations::Priority priority) {
+	Worker *w = current_worker;
+	if(w != NULL && w->executor == this) {
+		std::lock_guard<std::mutex> lock(w->local_lock);
+		w->local[priority].push_back(item);
+	} else {
+		injection[priority].push(item);
+	}
+	wake();
+}
 
-			case aop_pointer:
-			{
-				ae->data.operation_pointer->func(ae->data.operation_pointer);
-				ae->data.operation_pointer->finished = -1;
-			}
-			break;
+void AsyncExecutor::submit_ordered(AsyncItem item, bool is_operation) {
+	Strand *s = is_operation ? &operations_strand : &functions_strand;
 
-			case aop_function:
-			{
-				ae->data.function();
-			}
-			break;
-			
-			}
-			
-			// put back into the free event pool
-			free_events->enqueue(ae);
+	s->queue.push(item);
+	if(!s->scheduled.exchange(true))
+		submit(make_item(s, ASYNC_ITEM_STRAND), AsyncOperations::_io);
+}
+
+void AsyncExecutor::run_strand(Strand *s) {
+	AsyncItem item;
+	for(int k = 0; k < ASYNC_STRAND_BATCH && s->queue.pop(item); k++)
+		execute(item);
+
+	s->scheduled.store(false);
+
+	// if something was pushed after our last pop we must run again
+	if(!s->queue.is_empty() && !s->scheduled.exchange(true))
+		submit(make_item(s, ASYNC_ITEM_STRAND), AsyncOperations::_io);
+}
+
+void AsyncExecutor::execute(AsyncItem item) {
+	switch(item & ASYNC_ITEM_TAG_MASK) {
+	case ASYNC_ITEM_OPERATION:
+	{
+		AsyncOp *op = (AsyncOp *)item_pointer(item);
+		op->func(op);
+		std::atomic_thread_fence(std::memory_order_release);
+		op->finished = -1;
+	}
+	break;
+
+	case ASYNC_ITEM_TASK:
+	{
+		AsyncTask *t = (AsyncTask *)item_pointer(item);
+		try {
+			t->function();
+		} catch(std::exception &e) {
+			SATAN_ERROR("AsyncOperations - function threw an exception: %s\n", e.what());
+		} catch(jException &e) {
+			SATAN_ERROR("AsyncOperations - function threw an exception: %s\n", e.message.c_str());
+		} catch(...) {
+			SATAN_ERROR("AsyncOperations - function threw an unknown exception.\n");
 		}
+		delete t;
 	}
+	break;
 
-	static void queue_event(AsyncOp *op) {
-		AsyncEvent *ev = NULL;
-		do {
-			if(free_events->try_dequeue(ev)) {
-				ev->set_operation(op);
-				eq.push_event(ev);
-			} else {
-				ev = NULL;
-				usleep(1000); // this will cause performance drops if the number of total pre-allocated AsyncEvents is too small
-				SATAN_ERROR("AsyncOperation error, pre-allocated event not available, delay injected.\n");
-			}
-		} while(ev == NULL);
+	case ASYNC_ITEM_STRAND:
+		run_strand((Strand *)item_pointer(item));
+		break;
 	}
+}
 
-	static void queue_event(std::function<void()> f) {
-		AsyncEvent *ev = NULL;
-		do {
-			if(free_events->try_dequeue(ev)) {
-				ev->set_operation(f);
-				eq.push_event(ev);
-			} else {
-				ev = NULL;
-				usleep(1000); // this will cause performance drops if the number of total pre-allocated AsyncEvents is too small
-				SATAN_ERROR("AsyncOperation error, pre-allocated event not available, delay injected.\n");
+bool AsyncExecutor::take_bulk_slot() {
+	if(bulk_running.fetch_add(1) < max_bulk_running)
+		return true;
+	bulk_running.fetch_sub(1);
+	return false;
+}
+
+bool AsyncExecutor::find_work(Worker *self, AsyncItem &item, int &priority) {
+	for(priority = AsyncOperations::_io; priority <= AsyncOperations::_bulk; priority++) {
+		if(priority == AsyncOperations::_bulk && !take_bulk_slot())
+			return false;
+
+		{
+			std::lock_guard<std::mutex> lock(self->local_lock);
+			if(!self->local[priority].empty()) {
+				item = self->local[priority].back();
+				self->local[priority].pop_back();
+				return true;
 			}
-		} while(ev == NULL);
-	}
+		}
 
-	static void start_me_up() {
-		free_events = new moodycamel::ReaderWriterQueue<AsyncEvent *>(100);
+		if(injection[priority].pop(item))
+			return true;
 
-		// fill upp the queue
-		AsyncEvent *ev = NULL;
-		do {
-			ev = new AsyncEvent();
-			if(ev) {
-				if(free_events->try_enqueue(ev) == false) {
-					delete ev;
-					ev = NULL;
-				}
+		for(unsigned int k = 1; k < workers.size(); k++) {
+			Worker *victim = workers[(self->index + k) % workers.size()];
+			std::lock_guard<std::mutex> lock(victim->local_lock);
+			if(!victim->local[priority].empty()) {
+				item = victim->local[priority].front();
+				victim->local[priority].pop_front();
+				stolen.fetch_add(1, std::memory_order_relaxed);
+				return true;
 			}
-		} while(ev != NULL);
-		
-		thrd->run();
+		}
+
+		if(priority == AsyncOperations::_bulk)
+			bulk_running.fetch_sub(1);
 	}
-	
-};
+	return false;
+}
+
+void *AsyncExecutor::worker_entry(void *w) {
+	Worker *self = (Worker *)w;
+	current_worker = self;
+	self->executor->worker_body(self);
+	return NULL;
+}
+
+void AsyncExecutor::worker_body(Worker *self) {
+	while(1) {
+		AsyncItem item;
+		int priority;
+
+		bool found = find_work(self, item, priority);
+		if(!found) {
+			// announce that we are going to sleep, then look again so
+			// that we do not miss an item pushed in between
+			idle_workers.fetch_add(1);
+			found = find_work(self, item, priority);
+			if(!found)
+				while(sem_wait(&wake_up) != 0 && errno == EINTR);
+			idle_workers.fetch_sub(1);
+			if(!found) continue;
+		}
+
+		execute(item);
+		executed[priority].fetch_add(1, std::memory_order_relaxed);
+
+		if(priority == AsyncOperations::_bulk)
+			bulk_running.fetch_sub(1);
+	}
+}
+
+AsyncOperations::Statistics AsyncExecutor::get_statistics() {
+	AsyncOperations::Statistics s;
 
-jThread::EventQueue AsyncOperationsThread::eq;
-AsyncOperationsThread * AsyncOperationsThread::thrd = new AsyncOperationsThread();
-moodycamel::ReaderWriterQueue<AsyncOperationsThread::AsyncEvent *> * AsyncOperationsThread::free_events = NULL;
+	s.workers = workers.size();
+	s.executed[0] = executed[0].load();
+	s.executed[1] = executed[1].load();
+	s.stolen = stolen.load();
+	s.overflowed =
+		injection[0].get_overflowed() + injection[1].get_overflowed() +
+		operations_strand.queue.get_overflowed() + functions_strand.queue.get_overflowed();
+
+	return s;
+}
 
 /************************
  *
@@ -158,14 +434,21 @@ moodycamel::ReaderWriterQueue<AsyncOperationsThread::AsyncEvent *> * AsyncOperat
  *
  ************************/
 static AsyncOperations *token_object = NULL;
+static AsyncExecutor *executor = NULL;
 
 // empty default constructor - this is used to prevent creation of illegal AsyncOperations objects
 AsyncOperations::AsyncOperations() {}
 
-AsyncOperations * AsyncOperations::start_async_operations_thread() {
+AsyncOperations * AsyncOperations::start_async_operations_thread(int worker_count) {
 	if(!token_object) {
+		if(worker_count < 1) {
+			long cpus = sysconf(_SC_NPROCESSORS_CONF);
+			worker_count = cpus > 2 ? (int)cpus - 1 : 2;
+		}
+		if(worker_count > ASYNC_MAX_WORKERS) worker_count = ASYNC_MAX_WORKERS;
+
+		executor = new AsyncExecutor(worker_count);
 		token_object = new AsyncOperations();
-		AsyncOperationsThread::start_me_up();
 		return token_object;
 	}
 	return NULL;
@@ -173,7 +456,14 @@ AsyncOperations * AsyncOperations::start_async_operations_thread() {
 
 void AsyncOperations::run_async_operation(AsyncOp *op) {
 	if(this == token_object) {
-		AsyncOperationsThread::queue_event(op);
+		executor->submit_ordered(make_item(op, ASYNC_ITEM_OPERATION), true);
+	} else
+		throw YouDontHaveTheToken();
+}
+
+void AsyncOperations::run_async_operation(AsyncOp *op, Priority priority) {
+	if(this == token_object) {
+		executor->submit(make_item(op, ASYNC_ITEM_OPERATION), priority);
 	} else
 		throw YouDontHaveTheToken();
 }
@@ -181,7 +471,19 @@ void AsyncOperations::run_async_operation(AsyncOp *op) {
 void AsyncOperations::run_async_function(std::function<void()> f) {
 	if(this == token_object) {
 		SATAN_DEBUG(" will queue AsyncOperation function event.\n");
-		AsyncOperationsThread::queue_event(f);
+		executor->submit_ordered(make_item(new AsyncTask(f), ASYNC_ITEM_TASK), false);
+	} else
+		throw YouDontHaveTheToken();
+}
+
+void AsyncOperations::run_async_function(std::function<void()> f, Priority priority) {
+	if(this == token_object) {
+		executor->submit(make_item(new AsyncTask(f), ASYNC_ITEM_TASK), priority);
 	} else
 		throw YouDontHaveTheToken();
 }
+
+AsyncOperations::Statistics AsyncOperations::get_statistics() {
+	if(this != token_object) throw YouDontHaveTheToken();
+	return executor->get_statistics();
+}
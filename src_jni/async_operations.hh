@@ -23,22 +23,59 @@
 #include "dynlib/dynlib.h"
 #include <functional>
 
+/*
+ * Background work is executed by a small pool of worker threads.
+ *
+ * There are two priority classes. _io is for work that something realtime
+ * is waiting for, like writing recorded data to disk, and for the engine
+ * notifications. _bulk is for everything that can take a while - loading,
+ * encoding, analysis. Bulk work never occupies all workers, so there is
+ * always a worker free for _io work.
+ *
+ * run_async_operation(op) and run_async_function(f) keep the old
+ * guarantee - they are executed one at a time, in the order they were
+ * submitted (AsyncOps and functions are ordered separately). The variants
+ * that take a priority are executed in parallel, in no particular order.
+ *
+ * Submitting never blocks, sleeps or waits for a free slot.
+ */
 class AsyncOperations {
 private:
 	// private constructor prevents creation of illegal objects
 	AsyncOperations();
 public:
 	class YouDontHaveTheToken {};
-	
-	/// start up the AsyncOperationsThread - this will return a valid pointer only once, subsequent calls will return NULL
-	static AsyncOperations *start_async_operations_thread();
 
-	// Async Operations - if not called through a valid object it will throw YouDontHaveTheToken
+	enum Priority {
+		_io = ASYNC_PRIORITY_IO,
+		_bulk = ASYNC_PRIORITY_BULK
+	};
+
+	class Statistics {
+	public:
+		int workers;
+		int64_t executed[2]; // per priority
+		int64_t stolen; // taken from the local queue of another worker
+		int64_t overflowed; // queued on the slow path because a queue was full
+	};
+
+	/// start up the workers - this will return a valid pointer only once, subsequent calls will return NULL
+	/// worker_count < 1 selects a count based on the number of CPUs
+	static AsyncOperations *start_async_operations_thread(int worker_count = 0);
+
+	// Async Operations - if not called through a valid object they will throw YouDontHaveTheToken
+
+	// ordered, executed with _io priority
 	void run_async_operation(AsyncOp *op);
+	// unordered
+	void run_async_operation(AsyncOp *op, Priority priority);
 
-	// Async Operations - if not called through a valid object it will throw YouDontHaveTheToken
+	// ordered, executed with _io priority
 	void run_async_function(std::function<void()> function);
+	// unordered
+	void run_async_function(std::function<void()> function, Priority priority);
+
+	Statistics get_statistics();
 };
 
 #endif
-
@@ -23,7 +23,12 @@
 #include <set>
 #include <vector>
 #include <stack>
+#include <mutex>
+#include <atomic>
+#include <new>
+#include <type_traits>
 #include <stdint.h>
+#include <stddef.h>
 #include <stdexcept>
 
 /***************************
@@ -83,30 +88,267 @@ public:
 	}
 };
 
-template <class T>
+/*
+ * Slab allocator for small objects that are linked together, like the
+ * notes of a Sequence pattern.
+ *
+ * Objects are carved out of chunks of OBJECTS_PER_CHUNK and never move, so
+ * pointers stay valid until the allocator is destroyed. Recycled objects go
+ * on an intrusive free list, allocate() and recycle() are O(1) and do not
+ * copy anything. An object is constructed the first time it is handed out
+ * and stays constructed when recycled - the caller must set the members it
+ * uses after allocate().
+ *
+ * The allocator is not thread safe unless THREAD_CACHED is set. Then each
+ * thread keeps a small cache of free objects and only takes the lock to
+ * refill or drain it in batches. A thread has one cache per type T, if
+ * several thread cached allocators of the same T are used by the same thread
+ * only the first one gets the cache and the others always take the lock.
+ * The cache is given back when the thread exits or the allocator is
+ * destroyed, then the next allocator used by the thread can claim it.
+ */
+template <class T, bool THREAD_CACHED = false, size_t OBJECTS_PER_CHUNK = 64>
 class ObjectAllocator {
 private:
-	std::vector<T> allocated_objects;
-	std::stack<T*> free_objects;
+	struct Slot {
+		T object; // must be first, a T* is also a Slot*
+		Slot *next_free;
+	};
+
+	struct Chunk {
+		Chunk *next;
+		size_t carved; // slots constructed so far
+		typename std::aligned_storage<sizeof(Slot), alignof(Slot)>::type slots[OBJECTS_PER_CHUNK];
+	};
+
+	static constexpr size_t CACHE_BATCH = 16;
+
+	struct ThreadCache {
+		// owner and next_cache are protected by registry_mutex(), owner_id is
+		// also cleared by the destructor of the owner from another thread
+		ObjectAllocator *owner = NULL;
+		std::atomic<uint64_t> owner_id{0};
+		ThreadCache *next_cache = NULL; // in owner->caches
+		unsigned epoch = 0;
+		Slot *head = NULL;
+		size_t count = 0;
+
+		// the thread exits
+		~ThreadCache() {
+			std::lock_guard<std::mutex> lock(registry_mutex());
+			if(owner) owner->release_thread_cache(this);
+		}
+	};
+
+	Chunk *chunks = NULL; // newest first, only the newest has uncarved slots
+	Slot *free_list = NULL;
+	std::atomic<unsigned> epoch{0}; // bumped by recycle_all(), invalidates the thread caches
+	std::mutex central_mutex; // only used when THREAD_CACHED
+
+	// unique for every allocator of this type, so a cache is never mistaken
+	// for belonging to a new allocator that got the address of a destroyed one
+	const uint64_t instance_id = next_instance_id();
+	ThreadCache *caches = NULL; // claimed by threads, protected by registry_mutex()
+
+	static uint64_t next_instance_id() {
+		static std::atomic<uint64_t> last_instance_id{0};
+		return ++last_instance_id;
+	}
+
+	static std::mutex &registry_mutex() {
+		static std::mutex mtx;
+		return mtx;
+	}
+
+	static ThreadCache &thread_cache() {
+		static thread_local ThreadCache cache;
+		return cache;
+	}
+
+	// returns NULL if this thread's cache belongs to another allocator
+	ThreadCache *claim_thread_cache() {
+		auto &cache = thread_cache();
+		uint64_t owner_id = cache.owner_id.load(std::memory_order_relaxed);
+		if(owner_id != instance_id) {
+			if(owner_id != 0) return NULL;
+
+			std::lock_guard<std::mutex> lock(registry_mutex());
+			cache.owner = this;
+			cache.owner_id.store(instance_id, std::memory_order_relaxed);
+			cache.next_cache = caches;
+			caches = &cache;
+			cache.epoch = epoch.load();
+			cache.head = NULL;
+			cache.count = 0;
+		}
+		if(cache.epoch != epoch.load()) {
+			// recycle_all() already put these back on the free list
+			cache.epoch = epoch.load();
+			cache.head = NULL;
+			cache.count = 0;
+		}
+		return &cache;
+	}
+
+	Slot *central_allocate() {
+		if(free_list) {
+			Slot *retval = free_list;
+			free_list = retval->next_free;
+			return retval;
+		}
+
+		if(chunks == NULL || chunks->carved == OBJECTS_PER_CHUNK) {
+			Chunk *new_chunk = new Chunk;
+			new_chunk->next = chunks;
+			new_chunk->carved = 0;
+			chunks = new_chunk;
+		}
+		return new (&(chunks->slots[chunks->carved++])) Slot();
+	}
+
+	void central_recycle(Slot *first, Slot *last) {
+		last->next_free = free_list;
+		free_list = first;
+	}
+
+	// give the slots in a thread's cache back, and unlink it - registry_mutex() must be held
+	void release_thread_cache(ThreadCache *cache) {
+		{
+			std::lock_guard<std::mutex> lock(central_mutex);
+			if(cache->head != NULL && cache->epoch == epoch.load()) {
+				Slot *last = cache->head;
+				while(last->next_free != NULL)
+					last = last->next_free;
+				central_recycle(cache->head, last);
+			}
+		}
+
+		for(ThreadCache **c = &caches; *c != NULL; c = &((*c)->next_cache)) {
+			if(*c == cache) {
+				*c = cache->next_cache;
+				break;
+			}
+		}
+		cache->owner = NULL;
+		cache->owner_id.store(0, std::memory_order_relaxed);
+		cache->next_cache = NULL;
+		cache->head = NULL;
+		cache->count = 0;
+	}
 
 public:
+	ObjectAllocator() {}
+	ObjectAllocator(const ObjectAllocator&) = delete;
+	ObjectAllocator& operator=(const ObjectAllocator&) = delete;
+
+	~ObjectAllocator() {
+		if(THREAD_CACHED) {
+			// the cached slots are freed with the chunks below, the
+			// threads will see that their cache is free to claim again
+			std::lock_guard<std::mutex> lock(registry_mutex());
+			for(ThreadCache *c = caches; c != NULL; c = c->next_cache) {
+				c->owner = NULL;
+				c->owner_id.store(0, std::memory_order_relaxed);
+			}
+			caches = NULL;
+		}
+
+		while(chunks) {
+			Chunk *to_delete = chunks;
+			chunks = chunks->next;
+			for(size_t k = 0; k < to_delete->carved; k++)
+				reinterpret_cast<Slot *>(&(to_delete->slots[k]))->~Slot();
+			delete to_delete;
+		}
+	}
+
 	T* allocate() {
-		T* retval = NULL;
-		if(free_objects.size() > 0) {
-			retval = free_objects.top();
-			free_objects.pop();
-		} else {
-			T new_obj;
-			auto last_index = allocated_objects.size();
-			allocated_objects.push_back(new_obj);
-			retval = &(allocated_objects.data()[last_index]);
+		if(!THREAD_CACHED)
+			return &(central_allocate()->object);
+
+		ThreadCache *cache = claim_thread_cache();
+		if(cache == NULL) {
+			std::lock_guard<std::mutex> lock(central_mutex);
+			return &(central_allocate()->object);
 		}
 
-		return retval;
+		if(cache->head == NULL) {
+			std::lock_guard<std::mutex> lock(central_mutex);
+			for(; cache->count < CACHE_BATCH; cache->count++) {
+				Slot *s = central_allocate();
+				s->next_free = cache->head;
+				cache->head = s;
+			}
+		}
+
+		Slot *retval = cache->head;
+		cache->head = retval->next_free;
+		cache->count--;
+		return &(retval->object);
 	}
 
 	void recycle(T* obj) {
-		free_objects.push(obj);
+		Slot *s = reinterpret_cast<Slot *>(obj);
+
+		if(!THREAD_CACHED) {
+			central_recycle(s, s);
+			return;
+		}
+
+		ThreadCache *cache = claim_thread_cache();
+		if(cache == NULL) {
+			std::lock_guard<std::mutex> lock(central_mutex);
+			central_recycle(s, s);
+			return;
+		}
+
+		s->next_free = cache->head;
+		cache->head = s;
+		if(++(cache->count) >= 2 * CACHE_BATCH) {
+			// give a batch back so other threads can use them
+			Slot *first = cache->head, *last = first;
+			for(size_t k = 1; k < CACHE_BATCH; k++)
+				last = last->next_free;
+			cache->head = last->next_free;
+			cache->count -= CACHE_BATCH;
+
+			std::lock_guard<std::mutex> lock(central_mutex);
+			central_recycle(first, last);
+		}
+	}
+
+	// Recycles a whole chain linked through T::next, like LinkedList<T>::head,
+	// taking the lock once.
+	void recycle_chain(T* head) {
+		if(head == NULL) return;
+
+		Slot *first = reinterpret_cast<Slot *>(head), *last = first;
+		for(T* current = head->next; current != NULL; current = current->next) {
+			Slot *s = reinterpret_cast<Slot *>(current);
+			last->next_free = s;
+			last = s;
+		}
+
+		std::unique_lock<std::mutex> lock(central_mutex, std::defer_lock);
+		if(THREAD_CACHED) lock.lock();
+		central_recycle(first, last);
+	}
+
+	// Returns every object to the free list, the memory is kept for
+	// reuse. Only call when no object from this allocator is in use.
+	void recycle_all() {
+		std::unique_lock<std::mutex> lock(central_mutex, std::defer_lock);
+		if(THREAD_CACHED) lock.lock();
+
+		free_list = NULL;
+		for(Chunk *c = chunks; c != NULL; c = c->next) {
+			for(size_t k = 0; k < c->carved; k++) {
+				Slot *s = reinterpret_cast<Slot *>(&(c->slots[k]));
+				s->next_free = free_list;
+				free_list = s;
+			}
+		}
+		epoch++;
 	}
 };
 
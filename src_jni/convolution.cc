@@ -0,0 +1,342 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "convolution.hh"
+
+#define CONVOLVER_MAX_PARTITION 8192
+
+// how long convolver_load_signal() waits for a streamed page, in milliseconds
+#define CONVOLVER_STREAM_TIMEOUT 2000
+
+#ifdef __SATAN_USES_FXP
+/* In fixed point kiss scales the forward transform by 1/N and the inverse
+ * by 1/N too. The response is multiplied by 2^CONVOLVER_IR_HEADROOM before it
+ * is transformed to keep some precision in the spectra, it must still fit in fp8p24.
+ * The product of two spectra is shifted down so that the inverse FFT gets Y / N,
+ * the output is then multiplied with N.
+ */
+#define CONVOLVER_IR_HEADROOM 6
+#endif
+
+static ConvolverIR *convolver_ir_create(Convolver *c, int partitions) {
+	ConvolverIR *ir = (ConvolverIR *)calloc(1, sizeof(ConvolverIR));
+	if(ir == NULL) return NULL;
+
+	size_t scalars = (size_t)partitions * 2 * (c->partition_size + 1);
+	ir->partitions = partitions;
+	ir->filter = (kiss_fft_scalar *)calloc(scalars, sizeof(kiss_fft_scalar));
+	ir->fdl = (kiss_fft_scalar *)calloc(scalars, sizeof(kiss_fft_scalar));
+
+	if(ir->filter == NULL || ir->fdl == NULL) {
+		free(ir->filter);
+		free(ir->fdl);
+		free(ir);
+		return NULL;
+	}
+	return ir;
+}
+
+static void convolver_ir_free(ConvolverIR *ir) {
+	while(ir) {
+		ConvolverIR *next = ir->next;
+		free(ir->filter);
+		free(ir->fdl);
+		free(ir);
+		ir = next;
+	}
+}
+
+Convolver *convolver_create(int partition_size) {
+	Convolver *c;
+	int size = 16, bits = 5;
+
+	while(size < partition_size && size < CONVOLVER_MAX_PARTITION) {
+		size <<= 1; bits++;
+	}
+
+	c = (Convolver *)calloc(1, sizeof(Convolver));
+	if(c == NULL) return NULL;
+
+	c->partition_size = size;
+	c->fft_size = size << 1;
+	c->fft_bits = bits;
+	c->forward = kiss_fftr_alloc(c->fft_size, 0, NULL, NULL);
+	c->inverse = kiss_fftr_alloc(c->fft_size, 1, NULL, NULL);
+	c->input = (FTYPE *)calloc(c->fft_size, sizeof(FTYPE));
+	c->output = (FTYPE *)calloc(c->partition_size, sizeof(FTYPE));
+	c->time = (FTYPE *)calloc(c->fft_size, sizeof(FTYPE));
+	c->spectrum = (kiss_fft_cpx *)calloc(c->partition_size + 1, sizeof(kiss_fft_cpx));
+	c->acc = (convolver_acc_t *)calloc(2 * (c->partition_size + 1), sizeof(convolver_acc_t));
+
+	if(c->forward == NULL || c->inverse == NULL ||
+	   c->input == NULL || c->output == NULL || c->time == NULL ||
+	   c->spectrum == NULL || c->acc == NULL) {
+		convolver_delete(c);
+		return NULL;
+	}
+
+	return c;
+}
+
+void convolver_delete(Convolver *c) {
+	if(c == NULL) return;
+
+	convolver_ir_free(c->current);
+	convolver_ir_free(c->pending);
+	convolver_ir_free(c->retired);
+
+	free(c->forward);
+	free(c->inverse);
+	free(c->input);
+	free(c->output);
+	free(c->time);
+	free(c->spectrum);
+	free(c->acc);
+	free(c);
+}
+
+int convolver_load_ir(Convolver *c, const FTYPE *ir, int frames) {
+	int B = c->partition_size;
+	int bins = B + 1;
+	int partitions = frames > 0 ? (frames + B - 1) / B : 1;
+	int p, k;
+
+	// free what the audio thread has dropped since last time
+	convolver_ir_free(__sync_lock_test_and_set(&(c->retired), (ConvolverIR *)NULL));
+
+	ConvolverIR *n = convolver_ir_create(c, partitions);
+	// kiss configurations contain scratch buffers, so we can't share the one used by process
+	kiss_fftr_cfg forward = kiss_fftr_alloc(c->fft_size, 0, NULL, NULL);
+	FTYPE *time = (FTYPE *)malloc(sizeof(FTYPE) * c->fft_size);
+	kiss_fft_cpx *H = (kiss_fft_cpx *)malloc(sizeof(kiss_fft_cpx) * bins);
+
+	if(n == NULL || forward == NULL || time == NULL || H == NULL) {
+		convolver_ir_free(n);
+		free(forward);
+		free(time);
+		free(H);
+		return -1;
+	}
+
+	for(p = 0; p < partitions; p++) {
+		kiss_fft_scalar *h_re = &(n->filter[p * 2 * bins]);
+		kiss_fft_scalar *h_im = &(h_re[bins]);
+
+		memset(time, 0, sizeof(FTYPE) * c->fft_size);
+		for(k = 0; k < B && p * B + k < frames; k++) {
+#ifdef __SATAN_USES_FXP
+			time[k] = ir[p * B + k] << CONVOLVER_IR_HEADROOM;
+#else
+			time[k] = ir[p * B + k];
+#endif
+		}
+
+		kiss_fftr(forward, time, H);
+
+		for(k = 0; k < bins; k++) {
+#ifdef __SATAN_USES_FXP
+			h_re[k] = H[k].r;
+			h_im[k] = H[k].i;
+#else
+			// the inverse transform is not normalized, do it here once
+			h_re[k] = H[k].r / (float)c->fft_size;
+			h_im[k] = H[k].i / (float)c->fft_size;
+#endif
+		}
+	}
+
+	free(forward);
+	free(time);
+	free(H);
+
+	// if the previous one was never picked up we own it again
+	convolver_ir_free(__sync_lock_test_and_set(&(c->pending), n));
+
+	return 0;
+}
+
+int convolver_load_signal(Convolver *c,
+			  void *signal, int channels, int resolution, int frames,
+			  int (*read)(void *signal, int frame, void **data)) {
+	FTYPE *ir;
+	int frame = 0, k, retval, waited = 0;
+
+	if(frames <= 0 || channels <= 0) return -1;
+
+	ir = (FTYPE *)calloc(frames, sizeof(FTYPE));
+	if(ir == NULL) return -1;
+
+	while(frame < frames) {
+		void *data = NULL;
+		int n = read(signal, frame, &data);
+
+		if(n == 0) break; // the signal is shorter than it claimed
+		if(data == NULL) {
+			// a streamed page, our read requested it - wait for it
+			if(waited++ < CONVOLVER_STREAM_TIMEOUT) {
+				usleep(1000);
+				continue;
+			}
+			frame += -n; // give up on it, leave it silent
+			continue;
+		}
+
+		if(n > frames - frame) n = frames - frame;
+		for(k = 0; k < n; k++) {
+			int o = k * channels;
+			FTYPE v;
+
+			switch(resolution) {
+			case _8bit: v = ftoFTYPE(((int8_t *)data)[o] / 128.0f); break;
+			case _16bit: v = ftoFTYPE(((int16_t *)data)[o] / 32768.0f); break;
+			case _32bit: v = ftoFTYPE(((int32_t *)data)[o] / 2147483648.0f); break;
+			case _fl32bit: v = ftoFTYPE(((float *)data)[o]); break;
+#ifdef __SATAN_USES_FXP
+			case _fx8p24bit: v = ((int32_t *)data)[o]; break;
+#else
+			case _fx8p24bit: v = ((int32_t *)data)[o] / 16777216.0f; break;
+#endif
+			default:
+				free(ir);
+				return -1;
+			}
+			ir[frame + k] = v;
+		}
+		frame += n;
+	}
+
+	retval = convolver_load_ir(c, ir, frames);
+	free(ir);
+
+	return retval;
+}
+
+// a full partition is in c->input, transform it and calculate the next output partition
+static void convolver_partition(Convolver *c, ConvolverIR *ir) {
+	int B = c->partition_size;
+	int bins = B + 1;
+	int p, k;
+
+	kiss_fft_scalar *X = &(ir->fdl[ir->fdl_head * 2 * bins]);
+	kiss_fftr(c->forward, c->input, c->spectrum);
+	for(k = 0; k < bins; k++) {
+		X[k] = c->spectrum[k].r;
+		X[bins + k] = c->spectrum[k].i;
+	}
+
+	convolver_acc_t *a_re = c->acc;
+	convolver_acc_t *a_im = &(c->acc[bins]);
+	memset(c->acc, 0, sizeof(convolver_acc_t) * 2 * bins);
+
+	// the newest input spectrum goes with the first partition, and so on
+	int slot = ir->fdl_head;
+	for(p = 0; p < ir->partitions; p++) {
+		const kiss_fft_scalar *x_re = &(ir->fdl[slot * 2 * bins]);
+		const kiss_fft_scalar *x_im = &(x_re[bins]);
+		const kiss_fft_scalar *h_re = &(ir->filter[p * 2 * bins]);
+		const kiss_fft_scalar *h_im = &(h_re[bins]);
+
+		for(k = 0; k < bins; k++) {
+#ifdef __SATAN_USES_FXP
+			a_re[k] += (int64_t)x_re[k] * h_re[k] - (int64_t)x_im[k] * h_im[k];
+			a_im[k] += (int64_t)x_re[k] * h_im[k] + (int64_t)x_im[k] * h_re[k];
+#else
+			a_re[k] += x_re[k] * h_re[k] - x_im[k] * h_im[k];
+			a_im[k] += x_re[k] * h_im[k] + x_im[k] * h_re[k];
+#endif
+		}
+
+		slot = slot == 0 ? ir->partitions - 1 : slot - 1;
+	}
+
+	ir->fdl_head = ir->fdl_head + 1 == ir->partitions ? 0 : ir->fdl_head + 1;
+
+#ifdef __SATAN_USES_FXP
+	{
+		// the spectra are X / N and H * 2^HEADROOM / N, both fp8p24
+		// we want (X * H) / N in fp8p24
+		int shift = 24 + CONVOLVER_IR_HEADROOM - c->fft_bits;
+		int64_t round = (int64_t)1 << (shift - 1);
+
+		for(k = 0; k < bins; k++) {
+			c->spectrum[k].r = (kiss_fft_scalar)((a_re[k] + round) >> shift);
+			c->spectrum[k].i = (kiss_fft_scalar)((a_im[k] + round) >> shift);
+		}
+		kiss_fftri(c->inverse, c->spectrum, c->time);
+		for(k = 0; k < B; k++)
+			c->output[k] = c->time[B + k] << c->fft_bits;
+	}
+#else
+	for(k = 0; k < bins; k++) {
+		c->spectrum[k].r = a_re[k];
+		c->spectrum[k].i = a_im[k];
+	}
+	kiss_fftri(c->inverse, c->spectrum, c->time);
+	memcpy(c->output, &(c->time[B]), sizeof(FTYPE) * B);
+#endif
+
+	// overlap-save, the current partition is the previous one next time
+	memcpy(c->input, &(c->input[B]), sizeof(FTYPE) * B);
+}
+
+void convolver_process(Convolver *c, const FTYPE *in, FTYPE *out, int frames) {
+	int B = c->partition_size;
+	int done = 0;
+
+	while(done < frames) {
+		int n = B - c->position;
+		if(n > frames - done) n = frames - done;
+
+		// the output of the previous partition, then collect the input - in may be out
+		memcpy(&(c->input[B + c->position]), &(in[done]), sizeof(FTYPE) * n);
+		memcpy(&(out[done]), &(c->output[c->position]), sizeof(FTYPE) * n);
+
+		c->position += n;
+		done += n;
+
+		if(c->position == B) {
+			c->position = 0;
+
+			ConvolverIR *n_ir = __sync_lock_test_and_set(&(c->pending), (ConvolverIR *)NULL);
+			if(n_ir) {
+				ConvolverIR *old = c->current;
+				c->current = n_ir;
+				if(old) {
+					// push it on the retired list
+					ConvolverIR *head;
+					do {
+						head = c->retired;
+						old->next = head;
+					} while(!__sync_bool_compare_and_swap(&(c->retired), head, old));
+				}
+			}
+
+			if(c->current) {
+				convolver_partition(c, c->current);
+			} else {
+				memcpy(c->input, &(c->input[B]), sizeof(FTYPE) * B);
+				memset(c->output, 0, sizeof(FTYPE) * B);
+			}
+		}
+	}
+}
@@ -0,0 +1,98 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __CONVOLUTION
+#define __CONVOLUTION
+
+#include "dynlib/dynlib.h"
+
+/*
+ * Uniformly partitioned overlap-save convolution, the engine side of
+ * the MachineTable convolution service.
+ *
+ * The impulse response is cut into partitions of partition_size frames,
+ * each one is transformed once when loaded. For each partition_size frames
+ * of input we do one forward and one inverse FFT of twice that size, the
+ * spectra of earlier input blocks are kept in a frequency domain delay line
+ * and multiplied with the matching partitions. The cost per frame is
+ * proportional to the number of partitions, so a response of several
+ * seconds is fine even with small buffers.
+ *
+ * The output is delayed by partition_size frames.
+ *
+ * This file is plain C, the dynlib test benches include it directly.
+ */
+
+#ifdef __SATAN_USES_FXP
+typedef int64_t convolver_acc_t;
+#else
+typedef float convolver_acc_t;
+#endif
+
+/* The spectra are stored with the real parts of all bins first, then the
+ * imaginary parts - not interleaved like kiss_fft_cpx - so that the
+ * multiply-accumulate loop can be vectorized.
+ */
+typedef struct _ConvolverIR {
+	int partitions;
+	kiss_fft_scalar *filter; // partitions * 2 * (partition_size + 1)
+	kiss_fft_scalar *fdl; // frequency domain delay line, same size as filter
+	int fdl_head; // the newest input spectrum
+
+	struct _ConvolverIR *next; // in the retired list
+} ConvolverIR;
+
+typedef struct _Convolver {
+	int partition_size, fft_size;
+	int fft_bits; // log2(fft_size)
+	kiss_fftr_cfg forward, inverse;
+
+	FTYPE *input; // fft_size frames, the previous and the current partition
+	FTYPE *output; // partition_size frames, delivered during the next partition
+	FTYPE *time; // fft_size frames scratch
+	kiss_fft_cpx *spectrum; // partition_size + 1 bins scratch
+	convolver_acc_t *acc; // 2 * (partition_size + 1), split like the spectra
+	int position; // frames collected in the current partition
+
+	// convolver_load_ir() publishes in pending, convolver_process() moves
+	// it to current and pushes the previous one on retired - to be freed
+	// by the next load, so the audio thread never calls free()
+	ConvolverIR *volatile current;
+	ConvolverIR *volatile pending;
+	ConvolverIR *volatile retired;
+} Convolver;
+
+// partition_size is rounded up to a power of two, returns NULL on failure
+Convolver *convolver_create(int partition_size);
+void convolver_delete(Convolver *c);
+
+// Not realtime safe, call from another thread than the one calling convolver_process().
+// The new response replaces the old at the start of the next partition. Returns 0 on success.
+int convolver_load_ir(Convolver *c, const FTYPE *ir, int frames);
+
+// Loads the first channel of a static signal through read(), which has the
+// semantics of MachineTable::read_static_signal(). Missing streamed parts are waited for.
+int convolver_load_signal(Convolver *c,
+			  void *signal, int channels, int resolution, int frames,
+			  int (*read)(void *signal, int frame, void **data));
+
+// Realtime safe, in and out are mono and may be the same buffer.
+void convolver_process(Convolver *c, const FTYPE *in, FTYPE *out, int frames);
+
+#endif
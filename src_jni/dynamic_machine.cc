@@ -44,6 +44,8 @@
 #include <kamogui.hh>
 
 #include "dynamic_machine.hh"
+#include "convolution.hh"
+#include "recording_sink.hh"
 #include "machine_sequencer.hh"
 #include "common.hh"
 
@@ -960,6 +962,7 @@ void DynamicMachine::setup_dynamic_machine() {
 	dt.do_fft = &(DynamicMachine::do_fft);
 	dt.inverse_fft = &(DynamicMachine::inverse_fft);
 	dt.run_async_operation = &(Machine::run_async_operation);
+	dt.run_async_operation_priority = &(Machine::run_async_operation_priority);
 
 #ifdef ANDROID
 	dt.VuknobAndroidAudio__CLEANUP_STUFF = VuknobAndroidAudio__CLEANUP_STUFF;
@@ -967,6 +970,35 @@ void DynamicMachine::setup_dynamic_machine() {
 	dt.VuknobAndroidAudio__get_native_audio_configuration_data = VuknobAndroidAudio__get_native_audio_configuration_data;
 #endif
 
+	dt.version = MACHINE_TABLE_VERSION;
+
+	dt.get_input_port = &(DynamicMachine::get_input_port);
+	dt.get_output_port = &(DynamicMachine::get_output_port);
+	dt.get_port_signal = &(DynamicMachine::get_port_signal);
+	dt.get_port_buffer = &(DynamicMachine::get_port_buffer);
+	dt.get_port_samples = &(DynamicMachine::get_port_samples);
+	dt.get_port_channels = &(DynamicMachine::get_port_channels);
+
+	dt.enable_parameter_events = &(DynamicMachine::enable_parameter_events);
+	dt.get_parameter_index = &(DynamicMachine::get_parameter_index);
+	dt.get_parameter_events = &(DynamicMachine::get_parameter_events);
+	dt.get_parameter_ramp = &(DynamicMachine::get_parameter_ramp);
+
+	dt.enable_midi_event_lists = &(DynamicMachine::enable_midi_event_lists);
+
+	dt.get_static_signal_frames = &(DynamicMachine::get_static_signal_frames);
+	dt.read_static_signal = &(DynamicMachine::read_static_signal);
+
+	dt.create_convolver = &(DynamicMachine::create_convolver);
+	dt.convolver_set_ir = &(DynamicMachine::convolver_set_ir);
+	dt.convolver_process = &(DynamicMachine::convolver_process);
+	dt.get_convolver_latency = &(DynamicMachine::get_convolver_latency);
+	dt.delete_convolver = &(DynamicMachine::delete_convolver);
+
+	dt.open_recording_sink = &(DynamicMachine::open_recording_sink);
+	dt.write_recording_sink = &(DynamicMachine::write_recording_sink);
+	dt.close_recording_sink = &(DynamicMachine::close_recording_sink);
+
 	init_dynamic *init = ((Handle *)dh)->init;
 
 	dynamic_data =
@@ -982,6 +1014,9 @@ void DynamicMachine::setup_dynamic_machine() {
 					       dh->get_controller_title(k).c_str(), // the "name" tag in the XML is actually called title in our internal structure... while the "name" variable is actually group + ":" + title
 					       dh->get_controller_group(k).c_str()
 				);
+		register_parameter(controller_ptr[k],
+				   dh->get_controller_type(k),
+				   dh->get_controller_is_FTYPE(k));
 	}
 }
 
@@ -994,6 +1029,49 @@ void DynamicMachine::reset() {
 	(*(((Handle *)dh)->rset))(&dt, dynamic_data);
 }
 
+void DynamicMachine::inputs_changed() {
+	for(auto &p : ports) {
+		if(p.is_input)
+			p.signal = find_input(p.name);
+	}
+}
+
+Machine::Signal *DynamicMachine::find_input(const std::string &nam) {
+	std::map<std::string, Signal *>::iterator i;
+	if((i = premixed_input.find(nam)) ==
+	   premixed_input.end()) {
+		i = input.find(nam);
+
+		if(i == input.end()) {
+			return NULL;
+		}
+	}
+	return (*i).second;
+}
+
+PortHandle DynamicMachine::resolve_port(const char *nam, bool is_input) {
+	for(unsigned int k = 0; k < ports.size(); k++) {
+		if(ports[k].is_input == is_input && ports[k].name == nam)
+			return (PortHandle)k;
+	}
+
+	Signal *s = NULL;
+	if(is_input) {
+		if(input_descriptor.find(nam) == input_descriptor.end())
+			return INVALID_PORT;
+		s = find_input(nam);
+	} else {
+		std::map<std::string, Signal *>::iterator i;
+		i = output.find(nam);
+		if(i == output.end())
+			return INVALID_PORT;
+		s = (*i).second;
+	}
+
+	ports.push_back(Port(nam, is_input, s));
+	return (PortHandle)(ports.size() - 1);
+}
+
 bool DynamicMachine::detach_and_destroy() {
 	detach_all_inputs();
 	detach_all_outputs();
@@ -1071,13 +1149,7 @@ void DynamicMachine::instance_from_xml(const KXMLDoc &_dyn_xml) {
 int DynamicMachine::fill_sink(MachineTable *mt,
 			      int (*fill_sink_callback)(int status, void *cbd),
 			      void *cbdata) {
-//	DECLARE_TIME_MEASURE_OBJECT_STATIC(filler_sinker, "fill_sink", 5000);
-	int retval;
-//	START_TIME_MEASURE(filler_sinker);
-	retval = fill_this_sink((DynamicMachine *)(mt->mp), fill_sink_callback, cbdata);
-//	STOP_TIME_MEASURE(filler_sinker, "sink filled");
-
-	return retval;
+	return fill_this_sink((DynamicMachine *)(mt->mp), fill_sink_callback, cbdata);
 }
 
 void DynamicMachine::enable_low_latency_mode() {
@@ -1121,16 +1193,7 @@ SignalPointer *DynamicMachine::get_output_signal(MachineTable *mt, const char *n
 SignalPointer *DynamicMachine::get_input_signal(MachineTable *mt, const char *nam) {
 	DynamicMachine *m = (DynamicMachine *)(mt->mp);
 
-	std::map<std::string, Signal *>::iterator i;
-	if((i = m->premixed_input.find(nam)) ==
-	   m->premixed_input.end()) {
-		i = m->input.find(nam);
-
-		if(i == m->input.end()) {
-			return NULL;
-		}
-	}
-	return (SignalPointer *)((*i).second);
+	return (SignalPointer *)m->find_input(nam);
 }
 
 SignalPointer *DynamicMachine::get_next_signal(MachineTable *mt, SignalPointer *s) {
@@ -1174,6 +1237,112 @@ void *DynamicMachine::get_signal_buffer(SignalPointer *s) {
 	return sig->get_buffer();
 }
 
+PortHandle DynamicMachine::get_input_port(MachineTable *mt, const char *nam) {
+	DynamicMachine *m = (DynamicMachine *)(mt->mp);
+	return m->resolve_port(nam, true);
+}
+
+PortHandle DynamicMachine::get_output_port(MachineTable *mt, const char *nam) {
+	DynamicMachine *m = (DynamicMachine *)(mt->mp);
+	return m->resolve_port(nam, false);
+}
+
+SignalPointer *DynamicMachine::get_port_signal(MachineTable *mt, PortHandle p) {
+	DynamicMachine *m = (DynamicMachine *)(mt->mp);
+	if(p < 0 || p >= (PortHandle)m->ports.size()) return NULL;
+	return (SignalPointer *)m->ports[p].signal;
+}
+
+void *DynamicMachine::get_port_buffer(MachineTable *mt, PortHandle p) {
+	Signal *sig = (Signal *)get_port_signal(mt, p);
+	return sig == NULL ? NULL : sig->get_buffer();
+}
+
+int DynamicMachine::get_port_samples(MachineTable *mt, PortHandle p) {
+	Signal *sig = (Signal *)get_port_signal(mt, p);
+	return sig == NULL ? 0 : sig->get_samples();
+}
+
+int DynamicMachine::get_port_channels(MachineTable *mt, PortHandle p) {
+	Signal *sig = (Signal *)get_port_signal(mt, p);
+	return sig == NULL ? 0 : sig->get_channels();
+}
+
+void DynamicMachine::enable_parameter_events(MachineTable *mt) {
+	DynamicMachine *m = (DynamicMachine *)(mt->mp);
+	m->Machine::enable_parameter_events();
+}
+
+int DynamicMachine::get_parameter_index(MachineTable *mt, void *controller_ptr) {
+	DynamicMachine *m = (DynamicMachine *)(mt->mp);
+	return m->Machine::get_parameter_index(controller_ptr);
+}
+
+int DynamicMachine::get_parameter_events(MachineTable *mt, const ParameterEvent **events) {
+	DynamicMachine *m = (DynamicMachine *)(mt->mp);
+	return m->Machine::get_parameter_events(events);
+}
+
+const float *DynamicMachine::get_parameter_ramp(MachineTable *mt, int index) {
+	DynamicMachine *m = (DynamicMachine *)(mt->mp);
+	return m->Machine::get_parameter_ramp(index);
+}
+
+void DynamicMachine::enable_midi_event_lists(MachineTable *mt) {
+	DynamicMachine *m = (DynamicMachine *)(mt->mp);
+	m->Machine::enable_midi_event_lists();
+}
+
+int DynamicMachine::get_static_signal_frames(SignalPointer *s) {
+	StaticSignal *sig = (StaticSignal *)s;
+	return sig->get_total_samples();
+}
+
+int DynamicMachine::read_static_signal(SignalPointer *s, int frame, void **data) {
+	StaticSignal *sig = (StaticSignal *)s;
+	return sig->read_samples(frame, data);
+}
+
+ConvolverPointer *DynamicMachine::create_convolver(int partition_size) {
+	return (ConvolverPointer *)convolver_create(partition_size);
+}
+
+int DynamicMachine::convolver_set_ir(ConvolverPointer *c, int static_signal_index, int max_frames) {
+	StaticSignal *sig = StaticSignal::get_signal(static_signal_index);
+	if(sig == NULL || sig->get_dimension() != _0D) return -1;
+
+	int frames = sig->get_total_samples();
+	if(max_frames > 0 && max_frames < frames) frames = max_frames;
+
+	return convolver_load_signal((Convolver *)c, (void *)sig,
+				     sig->get_channels(), sig->get_resolution(), frames,
+				     DynamicMachine::read_static_signal);
+}
+
+void DynamicMachine::convolver_process(ConvolverPointer *c, FTYPE *in, FTYPE *out, int frames) {
+	::convolver_process((Convolver *)c, in, out, frames);
+}
+
+int DynamicMachine::get_convolver_latency(ConvolverPointer *c) {
+	return ((Convolver *)c)->partition_size;
+}
+
+void DynamicMachine::delete_convolver(ConvolverPointer *c) {
+	convolver_delete((Convolver *)c);
+}
+
+int DynamicMachine::open_recording_sink(struct _MachineTable *, const char *file_name, int rate, int channels) {
+	return RecordingSink::open(file_name, rate, channels) ? 0 : -1;
+}
+
+void DynamicMachine::write_recording_sink(struct _MachineTable *, const int16_t *data, int frames) {
+	RecordingSink::write(data, frames);
+}
+
+void DynamicMachine::close_recording_sink(struct _MachineTable *) {
+	RecordingSink::close();
+}
+
 class DynamicMachineSimpleThread : public jThread {
 private:
 	void (*funcbod)(void *);
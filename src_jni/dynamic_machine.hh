@@ -183,6 +183,17 @@ private:
 		static std::string get_handle_hint(std::string name);
 	};
 
+	/* Pre-resolved input/output, see get_input_port() */
+	class Port {
+	public:
+		std::string name;
+		bool is_input;
+		Signal *signal; // NULL if nothing is attached to an input
+
+		Port(const std::string &_name, bool _is_input, Signal *_signal) :
+			name(_name), is_input(_is_input), signal(_signal) {}
+	};
+
 	/* Dynamic machine data */
 	bool has_failed;
 	std::string failure_notice;
@@ -190,6 +201,7 @@ private:
 	const char *module_name;
 	MachineTable dt;
 	std::map<std::string, void *> controller_ptr;
+	std::vector<Port> ports; // indexed by PortHandle
 	
 	Handle *dh;
 		
@@ -200,6 +212,10 @@ private:
 	// setup_dynamic_machine is called from the constructor
 	void setup_dynamic_machine();
 
+	// find the signal currently attached to the named input
+	Signal *find_input(const std::string &nam);
+	PortHandle resolve_port(const char *nam, bool is_input);
+
 protected:
 	/**** inheritance - virtual ***/
 	/// Returns a set of controller groups
@@ -214,6 +230,7 @@ protected:
 	
 	virtual void fill_buffers();
 	virtual void reset();
+	virtual void inputs_changed();
 	virtual bool detach_and_destroy();
 	
 	// used to get a XML serialized version of
@@ -281,6 +298,33 @@ private:
 	static int get_signal_samples(SignalPointer *);
 	static void *get_signal_buffer(SignalPointer *);
 
+	static PortHandle get_input_port(MachineTable *, const char *);
+	static PortHandle get_output_port(MachineTable *, const char *);
+	static SignalPointer *get_port_signal(MachineTable *, PortHandle);
+	static void *get_port_buffer(MachineTable *, PortHandle);
+	static int get_port_samples(MachineTable *, PortHandle);
+	static int get_port_channels(MachineTable *, PortHandle);
+
+	static void enable_parameter_events(MachineTable *);
+	static int get_parameter_index(MachineTable *, void *controller_ptr);
+	static int get_parameter_events(MachineTable *, const ParameterEvent **events);
+	static const float *get_parameter_ramp(MachineTable *, int index);
+
+	static void enable_midi_event_lists(MachineTable *);
+
+	static int get_static_signal_frames(SignalPointer *);
+	static int read_static_signal(SignalPointer *, int frame, void **data);
+
+	static ConvolverPointer *create_convolver(int partition_size);
+	static int convolver_set_ir(ConvolverPointer *, int static_signal_index, int max_frames);
+	static void convolver_process(ConvolverPointer *, FTYPE *in, FTYPE *out, int frames);
+	static int get_convolver_latency(ConvolverPointer *);
+	static void delete_convolver(ConvolverPointer *);
+
+	static int open_recording_sink(struct _MachineTable *, const char *file_name, int rate, int channels);
+	static void write_recording_sink(struct _MachineTable *, const int16_t *data, int frames);
+	static void close_recording_sink(struct _MachineTable *);
+
 	static void run_simple_thread(void (*thread_function)(void *), void *);
 	
 	static int get_recording_filename(
@@ -19,7 +19,7 @@ LOCAL_PATH := $(call my-dir)
 ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
 LOCAL_CFLAGS += -O3 -D__SATAN_USES_FLOATS -DHAVE_CONFIG_H -Wall -I../ -mfloat-abi=softfp -mfpu=neon
 else
-LOCAL_CFLAGS += -O3 -D__SATAN_USES_FXP -DHAVE_CONFIG_H -Wall -I../
+LOCAL_CFLAGS += -O3 -D__SATAN_USES_FXP -DFIXED_POINT=32 -DHAVE_CONFIG_H -Wall -I../
 endif
 
 #LOCAL_CFLAGS += -fstack-protector -fno-omit-frame-pointer -fno-optimize-sibling-calls -O0 -g
@@ -95,6 +95,11 @@ LOCAL_MODULE_FILENAME    := librewerb
 LOCAL_SRC_FILES := rewerb.c $(FRAMEWORK_SOURCES)
 include $(BUILD_SHARED_LIBRARY)
 
+LOCAL_MODULE    := convolver
+LOCAL_MODULE_FILENAME    := libconvolver
+LOCAL_SRC_FILES := convolver.c $(FRAMEWORK_SOURCES)
+include $(BUILD_SHARED_LIBRARY)
+
 LOCAL_MODULE    := flanger
 LOCAL_MODULE_FILENAME    := libflanger
 LOCAL_SRC_FILES := flanger.c $(FRAMEWORK_SOURCES)
@@ -0,0 +1,560 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * Benchmark driver for dynamic machines, built on top of the mockery testbench.
+ *
+ * The machine declaration (XML) is read to find the inputs and outputs, MIDI
+ * inputs are fed a repeating chord pattern and audio inputs a saw tone with
+ * some noise. The machine is then executed for a number of buffers for each
+ * combination of buffer size and sample rate, and the execution time of each
+ * buffer is measured.
+ *
+ * Build with "make <machine>.bench" (floating point) or "make <machine>.fx.bench"
+ * (fixed point). "make benchmark" builds and runs all machines and collects the
+ * results in benchmark.json.
+ *
+ * usage: <machine>.bench [-x <machine>.xml] [-b 64,256,1024] [-r 44100,48000]
+ *                        [-n buffers] [-w warmup buffers] [-o output.json]
+ *                        [-c controller=value ...] [-i instances]
+ *
+ * -c sets a controller before the measurement, e.g. "convolver.bench -c Engine=1"
+ * measures the direct convolution instead of the partitioned FFT.
+ *
+ * -i runs several instances of the machine on the same input signals, the
+ * time reported is for all of them. This shows the effect of state that the
+ * instances share, like the vocoder modulator analysis.
+ */
+
+#ifndef BENCHMARK_MACHINE_SOURCE
+#error "You must define BENCHMARK_MACHINE_SOURCE, e.g. -DBENCHMARK_MACHINE_SOURCE=\"sampler.c\""
+#endif
+
+#include <unistd.h>
+
+#include "libtestbench_timer.c"
+#include BENCHMARK_MACHINE_SOURCE
+#include "libtestbench.c"
+
+#ifdef __SATAN_USES_FXP
+#define BENCHMARK_ARITHMETIC "fixed"
+#else
+#define BENCHMARK_ARITHMETIC "float"
+#endif
+
+#define BENCHMARK_MAX_SIGNALS 16
+#define BENCHMARK_MAX_CONTROLLERS 64
+#define BENCHMARK_MAX_SETTINGS 16
+#define BENCHMARK_MAX_INSTANCES 16
+#define BENCHMARK_MAX_CONFIGURATIONS 16
+#define BENCHMARK_NAME_LENGTH 64
+
+// seconds of stimuli to generate, they are looped if we run for longer
+#define BENCHMARK_STIMULI_LENGTH 2
+
+struct bench_signal {
+	char name[BENCHMARK_NAME_LENGTH];
+	int is_input, is_midi, channels;
+	void *data;
+};
+
+struct bench_controller {
+	char name[BENCHMARK_NAME_LENGTH];
+	char group[BENCHMARK_NAME_LENGTH];
+	int is_float;
+};
+
+// a controller value given on the command line
+struct bench_setting {
+	const char *name;
+	const char *value;
+};
+
+struct bench_declaration {
+	char name[BENCHMARK_NAME_LENGTH];
+	int signal_count;
+	struct bench_signal signal[BENCHMARK_MAX_SIGNALS];
+	int controller_count;
+	struct bench_controller controller[BENCHMARK_MAX_CONTROLLERS];
+	int setting_count;
+	struct bench_setting setting[BENCHMARK_MAX_SETTINGS];
+	int instances;
+};
+
+struct bench_result {
+	int buffer_size, sample_rate, buffers;
+	double ns_per_sample, mean_ns, realtime_factor;
+	int64_t p50_ns, p99_ns, max_ns;
+};
+
+/*********************************************
+ *
+ *     Machine declaration
+ *
+ *********************************************/
+
+static void copy_trimmed(char *dst, const char *start, const char *stop) {
+	while(start < stop && (*start == ' ' || *start == '\t' || *start == '\n' || *start == '\r')) start++;
+	while(stop > start && (stop[-1] == ' ' || stop[-1] == '\t' || stop[-1] == '\n' || stop[-1] == '\r')) stop--;
+
+	int len = stop - start;
+	if(len >= BENCHMARK_NAME_LENGTH) len = BENCHMARK_NAME_LENGTH - 1;
+	memcpy(dst, start, len);
+	dst[len] = '\0';
+}
+
+static int get_xml_attribute(const char *tag, const char *tag_end,
+			     const char *attribute, char *dst) {
+	char pattern[BENCHMARK_NAME_LENGTH];
+	snprintf(pattern, sizeof(pattern), "%s=\"", attribute);
+
+	const char *p = tag;
+	while((p = strstr(p, pattern)) != NULL && p < tag_end) {
+		// make sure we did not match the end of another attribute name
+		if(p == tag || p[-1] == ' ' || p[-1] == '\t' || p[-1] == '\n') {
+			const char *start = p + strlen(pattern);
+			const char *stop = strchr(start, '"');
+			if(stop == NULL || stop > tag_end) return -1;
+			copy_trimmed(dst, start, stop);
+			return 0;
+		}
+		p++;
+	}
+	return -1;
+}
+
+static int parse_signals(const char *xml, const char *element, int is_input,
+			 struct bench_declaration *d) {
+	char open_tag[BENCHMARK_NAME_LENGTH];
+	snprintf(open_tag, sizeof(open_tag), "<%s ", element);
+
+	const char *p = xml;
+	while((p = strstr(p, open_tag)) != NULL) {
+		const char *tag_end = strchr(p, '>');
+		const char *content_end = tag_end ? strchr(tag_end, '<') : NULL;
+		if(content_end == NULL) return -1;
+		if(d->signal_count >= BENCHMARK_MAX_SIGNALS) return -1;
+
+		struct bench_signal *s = &(d->signal[d->signal_count++]);
+		char value[BENCHMARK_NAME_LENGTH];
+
+		memset(s, 0, sizeof(struct bench_signal));
+		s->is_input = is_input;
+		copy_trimmed(s->name, tag_end + 1, content_end);
+
+		if(get_xml_attribute(p, tag_end, "dimension", value)) return -1;
+		s->is_midi = strcmp(value, "midi") == 0;
+		if(!(s->is_midi || strcmp(value, "0") == 0)) {
+			fprintf(stderr, "Signal %s has an unsupported dimension (%s).\n", s->name, value);
+			return -1;
+		}
+
+		s->channels = 1;
+		if(get_xml_attribute(p, tag_end, "channels", value) == 0)
+			s->channels = atoi(value);
+
+		p = content_end;
+	}
+	return 0;
+}
+
+static void parse_controllers(const char *xml, struct bench_declaration *d) {
+	const char *p = xml;
+	while((p = strstr(p, "<controller ")) != NULL && d->controller_count < BENCHMARK_MAX_CONTROLLERS) {
+		const char *tag_end = strchr(p, '>');
+		if(tag_end == NULL) return;
+
+		struct bench_controller *c = &(d->controller[d->controller_count]);
+		char type[BENCHMARK_NAME_LENGTH];
+
+		memset(c, 0, sizeof(struct bench_controller));
+		if(get_xml_attribute(p, tag_end, "name", c->name) == 0 &&
+		   get_xml_attribute(p, tag_end, "type", type) == 0) {
+			(void)get_xml_attribute(p, tag_end, "group", c->group);
+			c->is_float = strcmp(type, "float") == 0;
+			d->controller_count++;
+		}
+		p = tag_end;
+	}
+}
+
+static int parse_declaration(const char *path, struct bench_declaration *d) {
+	FILE *f = fopen(path, "r");
+	if(f == NULL) {
+		fprintf(stderr, "Failed to open machine declaration %s.\n", path);
+		return -1;
+	}
+
+	char xml[65536];
+	size_t len = fread(xml, 1, sizeof(xml) - 1, f);
+	fclose(f);
+	xml[len] = '\0';
+
+	memset(d, 0, sizeof(struct bench_declaration));
+
+	const char *name = strstr(xml, "<name>");
+	const char *name_end = name ? strstr(name, "</name>") : NULL;
+	if(name_end == NULL) {
+		fprintf(stderr, "Machine declaration %s has no name.\n", path);
+		return -1;
+	}
+	copy_trimmed(d->name, name + strlen("<name>"), name_end);
+
+	if(parse_signals(xml, "input", -1, d) || parse_signals(xml, "output", 0, d)) {
+		fprintf(stderr, "Failed to parse the signals in %s.\n", path);
+		return -1;
+	}
+	parse_controllers(xml, d);
+	return 0;
+}
+
+// only float and integer like controllers (integer, enumerated, boolean, signalid) are supported
+static int apply_settings(struct bench_declaration *d, struct mockery *m) {
+	int k, c;
+
+	for(k = 0; k < d->setting_count; k++) {
+		struct bench_setting *s = &(d->setting[k]);
+
+		for(c = 0; c < d->controller_count; c++)
+			if(strcmp(d->controller[c].name, s->name) == 0) break;
+
+		void *ptr = c < d->controller_count ?
+			get_controller(m, s->name, d->controller[c].group) : NULL;
+		if(ptr == NULL) {
+			fprintf(stderr, "%s has no controller named %s.\n", d->name, s->name);
+			return -1;
+		}
+
+		if(d->controller[c].is_float)
+			*((float *)ptr) = atof(s->value);
+		else
+			*((int *)ptr) = atoi(s->value);
+	}
+	return 0;
+}
+
+/*********************************************
+ *
+ *     Stimuli
+ *
+ *********************************************/
+
+struct bench_midi_event {
+	MidiEvent event;
+	uint8_t data[4]; // room for the data following the event
+};
+static struct bench_midi_event note_on_data[128], note_off_data[128];
+
+static MidiEvent *get_note_event(int note, int on) {
+	MidiEvent *mev = on ? &(note_on_data[note].event) : &(note_off_data[note].event);
+	mev->length = 3;
+	if(on) {
+		SET_MIDI_DATA_3(mev, MIDI_NOTE_ON, note, 100);
+	} else {
+		SET_MIDI_DATA_3(mev, MIDI_NOTE_OFF, note, 0);
+	}
+	return mev;
+}
+
+// a three note chord every quarter of a second, held for an eighth of a second
+static void fill_midi_stimuli(void **data, int frames, int rate) {
+	static const int root[] = {48, 53, 55, 57};
+	static const int interval[] = {0, 4, 7};
+	int period = rate / 4;
+	int k, chord;
+
+	memset(data, 0, sizeof(void *) * frames);
+	for(chord = 0; chord * period < frames; chord++) {
+		int start = chord * period;
+		for(k = 0; k < 3; k++) {
+			int note = root[chord % 4] + interval[k];
+			// only one event per frame in this format, so we stagger them
+			if(start + k < frames)
+				data[start + k] = get_note_event(note, -1);
+			if(start + period / 2 + k < frames)
+				data[start + period / 2 + k] = get_note_event(note, 0);
+		}
+	}
+}
+
+static void fill_audio_stimuli(FTYPE *data, int frames, int channels, int rate) {
+	uint32_t noise = 0x1234567;
+	float phase = 0.0f;
+	float step = 110.0f / (float)rate;
+	int k, c;
+
+	for(k = 0; k < frames; k++) {
+		phase += step;
+		if(phase >= 1.0f) phase -= 1.0f;
+
+		for(c = 0; c < channels; c++) {
+			noise = noise * 1664525 + 1013904223;
+			float n = ((float)(noise >> 8) / (float)(1 << 24)) - 0.5f;
+			data[k * channels + c] = ftoFTYPE(0.4f * (2.0f * phase - 1.0f) + 0.1f * n);
+		}
+	}
+}
+
+/*********************************************
+ *
+ *     Measurement
+ *
+ *********************************************/
+
+static int64_t now_ns() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+	return ((int64_t)t.tv_sec) * 1000000000LL + (int64_t)t.tv_nsec;
+}
+
+static int compare_times(const void *a, const void *b) {
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static int run_benchmark(struct bench_declaration *d,
+			 int buffer_size, int rate, int buffers, int warmup,
+			 struct bench_result *r) {
+	struct mockery m;
+	void *instance[BENCHMARK_MAX_INSTANCES];
+	int instance_count = 0;
+	int steps = (BENCHMARK_STIMULI_LENGTH * rate + buffer_size - 1) / buffer_size;
+	int frames = steps * buffer_size;
+	int k, retval = -1;
+
+	if(create_mockery(&m, buffer_size)) {
+		fprintf(stderr, "Failed to create mockery.\n");
+		return -1;
+	}
+
+	for(k = 0; k < d->signal_count; k++) {
+		struct bench_signal *bs = &(d->signal[k]);
+		size_t element_size = bs->is_midi ? sizeof(void *) : sizeof(FTYPE);
+
+		bs->data = calloc((size_t)frames * bs->channels, element_size);
+		if(bs->data == NULL) goto done;
+
+		if(bs->is_input && bs->is_midi)
+			fill_midi_stimuli((void **)bs->data, frames, rate);
+		else if(bs->is_input)
+			fill_audio_stimuli((FTYPE *)bs->data, frames, bs->channels, rate);
+
+		struct signus *s = create_mock_signal(
+			bs->name,
+			bs->is_midi ? _MIDI : _0D,
+			bs->channels,
+			bs->is_midi ? _PTR : FTYPE_RESOLUTION,
+			rate, frames, bs->data, &m);
+		if(s == NULL) goto done;
+
+		if(bs->is_input) {
+			s->next = m.inputs;
+			m.inputs = s;
+		} else {
+			s->next = m.outputs;
+			m.outputs = s;
+		}
+	}
+
+	// the machine might look at its signals in init()
+	if(start_mockery(&m, d->name)) {
+		fprintf(stderr, "Failed to initiate mockery of %s.\n", d->name);
+		goto done;
+	}
+	if(apply_settings(d, &m)) goto done;
+	instance[instance_count++] = m.machine_data;
+
+	// the mockery only knows about the first one, the others are deleted below
+	while(instance_count < d->instances) {
+		m.machine_data = init(&(m.mt), d->name);
+		if(m.machine_data == NULL) {
+			m.machine_data = instance[0];
+			fprintf(stderr, "Failed to create instance %d of %s.\n", instance_count, d->name);
+			goto done;
+		}
+		instance[instance_count++] = m.machine_data;
+		if(apply_settings(d, &m)) {
+			m.machine_data = instance[0];
+			goto done;
+		}
+	}
+	m.machine_data = instance[0];
+
+	int64_t *t = (int64_t *)malloc(sizeof(int64_t) * buffers);
+	if(t == NULL) goto done;
+
+	int64_t total = 0;
+	for(k = -warmup; k < buffers; k++) {
+		m.current_test_step = (k + warmup) % steps;
+
+		int64_t before = now_ns();
+		int i;
+		for(i = 0; i < instance_count; i++)
+			execute(&(m.mt), instance[i]);
+		int64_t after = now_ns();
+
+		if(k >= 0) {
+			t[k] = after - before;
+			total += t[k];
+		}
+	}
+
+	qsort(t, buffers, sizeof(int64_t), compare_times);
+
+	r->buffer_size = buffer_size;
+	r->sample_rate = rate;
+	r->buffers = buffers;
+	r->ns_per_sample = (double)total / ((double)buffers * buffer_size);
+	r->mean_ns = (double)total / (double)buffers;
+	r->p50_ns = t[(buffers - 1) * 50 / 100];
+	r->p99_ns = t[(buffers - 1) * 99 / 100];
+	r->max_ns = t[buffers - 1];
+	// how many times faster than real time we are
+	r->realtime_factor = total > 0 ?
+		((double)buffers * buffer_size * 1000000000.0 / (double)rate) / (double)total : 0.0;
+
+	free(t);
+	retval = 0;
+
+done:
+	for(k = 1; k < instance_count; k++)
+		delete(instance[k]);
+	destroy_mockery(&m);
+	for(k = 0; k < d->signal_count; k++) {
+		if(d->signal[k].data) free(d->signal[k].data);
+		d->signal[k].data = NULL;
+	}
+	return retval;
+}
+
+/*********************************************
+ *
+ *     Main
+ *
+ *********************************************/
+
+static int parse_list(const char *arg, int *list) {
+	int count = 0;
+	const char *p = arg;
+
+	while(*p && count < BENCHMARK_MAX_CONFIGURATIONS) {
+		int v = atoi(p);
+		if(v <= 0) return -1;
+		list[count++] = v;
+
+		p = strchr(p, ',');
+		if(p == NULL) break;
+		p++;
+	}
+	return count;
+}
+
+static void write_json(FILE *f, struct bench_declaration *d,
+		       struct bench_result *r, int count) {
+	int k;
+
+	fprintf(f, "{\n  \"machine\": \"%s\",\n  \"arithmetic\": \"%s\",\n  \"instances\": %d,\n  \"runs\": [",
+		d->name, BENCHMARK_ARITHMETIC, d->instances);
+	for(k = 0; k < count; k++) {
+		fprintf(f, "%s\n    {\"buffer_size\": %d, \"sample_rate\": %d, \"buffers\": %d, "
+			"\"ns_per_sample\": %.3f, \"mean_ns\": %.1f, "
+			"\"p50_ns\": %lld, \"p99_ns\": %lld, \"max_ns\": %lld, "
+			"\"realtime_factor\": %.2f}",
+			k == 0 ? "" : ",",
+			r[k].buffer_size, r[k].sample_rate, r[k].buffers,
+			r[k].ns_per_sample, r[k].mean_ns,
+			(long long)r[k].p50_ns, (long long)r[k].p99_ns, (long long)r[k].max_ns,
+			r[k].realtime_factor);
+	}
+	fprintf(f, "\n  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+	const char *xml_path = BENCHMARK_MACHINE_XML;
+	const char *output_path = NULL;
+	int sizes[BENCHMARK_MAX_CONFIGURATIONS] = {64, 256, 1024};
+	int rates[BENCHMARK_MAX_CONFIGURATIONS] = {44100, 48000};
+	int size_count = 3, rate_count = 2;
+	int buffers = 1000, warmup = 50;
+	struct bench_setting setting[BENCHMARK_MAX_SETTINGS];
+	int setting_count = 0;
+	int instances = 1;
+	int opt;
+
+	while((opt = getopt(argc, argv, "x:b:r:n:w:o:c:i:")) != -1) {
+		switch(opt) {
+		case 'x': xml_path = optarg; break;
+		case 'b': size_count = parse_list(optarg, sizes); break;
+		case 'r': rate_count = parse_list(optarg, rates); break;
+		case 'n': buffers = atoi(optarg); break;
+		case 'w': warmup = atoi(optarg); break;
+		case 'o': output_path = optarg; break;
+		case 'i': instances = atoi(optarg); break;
+		case 'c': {
+			char *eq = strchr(optarg, '=');
+			if(eq == NULL || setting_count >= BENCHMARK_MAX_SETTINGS) {
+				fprintf(stderr, "Invalid controller setting %s.\n", optarg);
+				return 1;
+			}
+			*eq = '\0';
+			setting[setting_count].name = optarg;
+			setting[setting_count].value = eq + 1;
+			setting_count++;
+			break;
+		}
+		default:
+			fprintf(stderr, "usage: %s [-x machine.xml] [-b sizes] [-r rates] "
+				"[-n buffers] [-w warmup] [-o output.json] [-c controller=value ...] [-i instances]\n", argv[0]);
+			return 1;
+		}
+	}
+	if(size_count <= 0 || rate_count <= 0 || buffers <= 0 || warmup < 0 ||
+	   instances < 1 || instances > BENCHMARK_MAX_INSTANCES) {
+		fprintf(stderr, "Invalid benchmark configuration.\n");
+		return 1;
+	}
+
+	struct bench_declaration d;
+	if(parse_declaration(xml_path, &d)) return 2;
+	memcpy(d.setting, setting, sizeof(struct bench_setting) * setting_count);
+	d.setting_count = setting_count;
+	d.instances = instances;
+
+	mockery_quiet = -1;
+
+	struct bench_result r[BENCHMARK_MAX_CONFIGURATIONS * BENCHMARK_MAX_CONFIGURATIONS];
+	int s, q, count = 0;
+	for(s = 0; s < size_count; s++) {
+		for(q = 0; q < rate_count; q++) {
+			if(run_benchmark(&d, sizes[s], rates[q], buffers, warmup, &r[count])) return 3;
+			count++;
+		}
+	}
+
+	FILE *f = stdout;
+	if(output_path != NULL && (f = fopen(output_path, "w")) == NULL) {
+		fprintf(stderr, "Failed to open %s.\n", output_path);
+		return 4;
+	}
+	write_json(f, &d, r, count);
+	if(f != stdout) fclose(f);
+
+	return 0;
+}
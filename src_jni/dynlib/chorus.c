@@ -55,6 +55,10 @@ typedef struct _ChorusData {
 	int time[MAX_CHORUS_VOICES]; // current time index, in samples.. between 0 and period length..
 
 	int Fs_CURRENT ;
+
+	PortHandle in_mono, out_mono, out_stereo;
+
+	int gain_index; // -2 until resolved
 } ChorusData;
 
 void *init(MachineTable *mt, const char *name) {
@@ -68,6 +72,14 @@ void *init(MachineTable *mt, const char *name) {
 	d->voices = MAX_CHORUS_VOICES;
 	d->general_gain = ftoFTYPE(1.0);
 
+	d->in_mono = mt->get_input_port(mt, "Mono");
+	d->out_mono = mt->get_output_port(mt, "Mono");
+	d->out_stereo = mt->get_output_port(mt, "Stereo");
+
+	// ramp the general gain to avoid zipper noise
+	mt->enable_parameter_events(mt);
+	d->gain_index = -2;
+
 	int k = 0;
 	for(k = 0; k < MAX_CHORUS_VOICES; k++) {
 		d->depth[k] = 0.5f;
@@ -144,9 +156,9 @@ void reset(MachineTable *mt, void *data) {
 void execute(MachineTable *mt, void *data) {
 	ChorusData *d = (ChorusData *)data;
 
-	SignalPointer *s = mt->get_input_signal(mt, "Mono");
-	SignalPointer *os = mt->get_output_signal(mt, "Mono");
-	SignalPointer *os_stereo = mt->get_output_signal(mt, "Stereo");
+	SignalPointer *s = mt->get_port_signal(mt, d->in_mono);
+	SignalPointer *os = mt->get_port_signal(mt, d->out_mono);
+	SignalPointer *os_stereo = mt->get_port_signal(mt, d->out_stereo);
 
 	if(os == NULL) return;
 
@@ -224,6 +236,12 @@ void execute(MachineTable *mt, void *data) {
 		period[k] = (int)periodf;
 	}
 
+	// the controllers are registered after init() so we resolve this here
+	if(d->gain_index == -2)
+		d->gain_index = mt->get_parameter_index(mt, &(d->general_gain));
+	const float *gain_ramp = mt->get_parameter_ramp(mt, d->gain_index);
+	FTYPE general_gain = d->general_gain;
+
 	int i, i_s;
 
 	for(i = 0, i_s = 0; i < ol; i++, i_s += 2) {
@@ -278,8 +296,9 @@ void execute(MachineTable *mt, void *data) {
 		(void) delayLineMonoGet(d->dl1);
 
 		// mix in dry
-		ou[i] = mulFTYPE(d->general_gain, current[0] + x);
-		ou_stereo[i_s + 0] = mulFTYPE(d->general_gain, current[1] + x);
-		ou_stereo[i_s + 1] = mulFTYPE(d->general_gain, current[2] + x);
+		if(gain_ramp) general_gain = ftoFTYPE(gain_ramp[i]);
+		ou[i] = mulFTYPE(general_gain, current[0] + x);
+		ou_stereo[i_s + 0] = mulFTYPE(general_gain, current[1] + x);
+		ou_stereo[i_s + 1] = mulFTYPE(general_gain, current[2] + x);
 	}
 }
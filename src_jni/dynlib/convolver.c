@@ -0,0 +1,300 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * Convolution reverb/cabinet - a static signal is used as the impulse response.
+ *
+ * The normal engine is the partitioned FFT convolver in the MachineTable,
+ * the direct engine is a plain time domain FIR. It is only here as a
+ * reference to benchmark against, it is far too slow for long responses.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#else
+#error "CAN'T FIND config.h"
+#endif
+
+//#define __DO_DYNLIB_DEBUG
+#include "dynlib_debug.h"
+
+#include "dynlib.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// frames, the latency of the FFT engine
+#define CONVOLVER_PARTITION 128
+
+typedef struct _ConvolverData {
+	MachineTable *mt;
+	PortHandle in_port, out_port;
+
+	int ir_index, engine;
+	float length, wet_level, dry_level;
+
+	ConvolverPointer *conv;
+
+	// the response is loaded by an AsyncOp, these are
+	// only touched by execute() while no operation is running
+	AsyncOp op;
+	int loading, loaded_index;
+	float loaded_length;
+
+	// direct engine
+	FTYPE *fir; // reversed response
+	int fir_length;
+	FTYPE *history; // 2 * fir_length, every frame is written twice so the window is contiguous
+	int history_position;
+
+	// handed over by the AsyncOp, which also frees the old ones
+	FTYPE *next_fir, *old_fir;
+	FTYPE *next_history, *old_history;
+	int next_fir_length;
+} ConvolverData;
+
+static void load_impulse_response(AsyncOp *op) {
+	ConvolverData *d = (ConvolverData *)op->data;
+	MachineTable *mt = d->mt;
+	int index = op->i_data1;
+	int k;
+
+	free(d->old_fir);
+	free(d->old_history);
+	d->old_fir = NULL;
+	d->old_history = NULL;
+	d->next_fir = NULL;
+	d->next_history = NULL;
+	d->next_fir_length = 0;
+
+	SignalPointer *s = mt->get_static_signal(index);
+	if(s == NULL) return;
+
+	int Fs = mt->get_signal_frequency(s);
+	int frames = (int)(d->loaded_length * (float)Fs);
+
+	if(d->conv)
+		(void)mt->convolver_set_ir(d->conv, index, frames);
+
+	// the direct engine gets its own copy
+	StaticSignalReader r;
+	if(!static_signal_reader_init(&r, mt, s)) return;
+	if(frames > r.frames) frames = r.frames;
+	if(frames <= 0) return;
+
+	FTYPE *fir = (FTYPE *)calloc(frames, sizeof(FTYPE));
+	if(fir == NULL) return;
+
+	// allocated here, execute() must not
+	FTYPE *history = (FTYPE *)calloc(2 * frames, sizeof(FTYPE));
+	if(history == NULL) {
+		free(fir);
+		return;
+	}
+
+	int resolution = mt->get_signal_resolution(s);
+	for(k = 0; k < frames; k++) {
+		void *frame = static_signal_reader_at(&r, mt, k);
+		FTYPE v = itoFTYPE(0);
+
+		if(frame != NULL) {
+			switch(resolution) {
+			case _8bit: v = ftoFTYPE(*((int8_t *)frame) / 128.0f); break;
+			case _16bit: v = ftoFTYPE(*((int16_t *)frame) / 32768.0f); break;
+			case _32bit: v = ftoFTYPE(*((int32_t *)frame) / 2147483648.0f); break;
+			case _fl32bit: v = ftoFTYPE(*((float *)frame)); break;
+			}
+		}
+		fir[frames - 1 - k] = v;
+	}
+
+	d->next_fir = fir;
+	d->next_history = history;
+	d->next_fir_length = frames;
+}
+
+static void install_direct_response(ConvolverData *d) {
+	// the next AsyncOp frees the old response
+	d->old_fir = d->fir;
+	d->old_history = d->history;
+
+	d->fir = d->next_fir;
+	d->fir_length = d->fir ? d->next_fir_length : 0;
+	d->history = d->next_history;
+	d->history_position = 0;
+	d->next_fir = NULL;
+	d->next_history = NULL;
+}
+
+static void execute_direct(ConvolverData *d, FTYPE *in, FTYPE *out, int frames) {
+	int L = d->fir_length;
+	int i, k;
+
+	if(d->fir == NULL) {
+		memset(out, 0, sizeof(FTYPE) * frames);
+		return;
+	}
+
+	for(i = 0; i < frames; i++) {
+		int p = d->history_position;
+		d->history[p] = d->history[p + L] = in[i];
+
+		// the L latest frames, oldest first, are at p + 1 ... p + L
+		const FTYPE *x = &(d->history[p + 1]);
+#ifdef __SATAN_USES_FXP
+		int64_t acc = 0;
+		for(k = 0; k < L; k++)
+			acc += (int64_t)d->fir[k] * x[k];
+		out[i] = (FTYPE)(acc >> 24);
+#else
+		FTYPE acc = 0.0f;
+		for(k = 0; k < L; k++)
+			acc += d->fir[k] * x[k];
+		out[i] = acc;
+#endif
+
+		d->history_position = p + 1 == L ? 0 : p + 1;
+	}
+}
+
+void *init(MachineTable *mt, const char *name) {
+	ConvolverData *d = (ConvolverData *)calloc(1, sizeof(ConvolverData));
+	if(d == NULL) return NULL;
+
+	d->mt = mt;
+	d->in_port = mt->get_input_port(mt, "Mono");
+	d->out_port = mt->get_output_port(mt, "Mono");
+
+	d->length = 2.0f;
+	d->wet_level = 1.0f;
+	d->dry_level = 0.0f;
+	d->loaded_index = -1;
+
+	d->op.func = load_impulse_response;
+	d->op.data = d;
+	d->op.finished = -1;
+
+	if(mt->version >= MACHINE_TABLE_VERSION_CONVOLUTION)
+		d->conv = mt->create_convolver(CONVOLVER_PARTITION);
+
+	return d;
+}
+
+void *get_controller_ptr(MachineTable *mt, void *data,
+			 const char *name,
+			 const char *group) {
+	ConvolverData *d = (ConvolverData *)data;
+
+	if(strcmp("Impulse", name) == 0)
+		return &(d->ir_index);
+	if(strcmp("Length", name) == 0)
+		return &(d->length);
+	if(strcmp("WetLevel", name) == 0)
+		return &(d->wet_level);
+	if(strcmp("DryLevel", name) == 0)
+		return &(d->dry_level);
+	if(strcmp("Engine", name) == 0)
+		return &(d->engine);
+
+	return NULL;
+}
+
+void reset(MachineTable *mt, void *data) {
+	ConvolverData *d = (ConvolverData *)data;
+
+	if(d->history)
+		memset(d->history, 0, sizeof(FTYPE) * 2 * d->fir_length);
+}
+
+void execute(MachineTable *mt, void *data) {
+	ConvolverData *d = (ConvolverData *)data;
+
+	FTYPE *ou = (FTYPE *)mt->get_port_buffer(mt, d->out_port);
+	if(ou == NULL) return;
+	int ol = mt->get_port_samples(mt, d->out_port);
+
+	FTYPE *in = (FTYPE *)mt->get_port_buffer(mt, d->in_port);
+	if(in == NULL) {
+		// just clear output, then return
+		memset(ou, 0, sizeof(FTYPE) * ol);
+		return;
+	}
+
+	if(d->loading && d->op.finished) {
+		install_direct_response(d);
+		d->loading = 0;
+	}
+
+	if(!d->loading && (d->ir_index != d->loaded_index || d->length != d->loaded_length)) {
+		d->loaded_index = d->ir_index;
+		d->loaded_length = d->length;
+		d->loading = -1;
+
+		d->op.i_data1 = d->ir_index;
+		d->op.finished = 0;
+		// the transform of a long response can take a while, nothing else waits for it
+		if(mt->version >= MACHINE_TABLE_VERSION_ASYNC_PRIORITY)
+			mt->run_async_operation_priority(&(d->op), ASYNC_PRIORITY_BULK);
+		else
+			mt->run_async_operation(&(d->op));
+
+		// it might be done already, the test bench runs it directly
+		if(d->op.finished) {
+			install_direct_response(d);
+			d->loading = 0;
+		}
+	}
+
+	FTYPE wet = ftoFTYPE(d->wet_level);
+	FTYPE dry = ftoFTYPE(d->dry_level);
+	int i;
+
+	if(d->engine == 1) {
+		execute_direct(d, in, ou, ol);
+	} else if(d->conv) {
+		mt->convolver_process(d->conv, in, ou, ol);
+	} else {
+		memset(ou, 0, sizeof(FTYPE) * ol);
+	}
+
+	for(i = 0; i < ol; i++) {
+		ou[i] = mulFTYPE(ou[i], wet) + mulFTYPE(in[i], dry);
+	}
+}
+
+void delete(void *data) {
+	ConvolverData *d = (ConvolverData *)data;
+
+	// the AsyncOp has a pointer to us, wait for it
+	while(d->loading && !d->op.finished) {
+		usleep(1000);
+	}
+
+	if(d->conv)
+		d->mt->delete_convolver(d->conv);
+
+	free(d->next_fir);
+	free(d->old_fir);
+	free(d->fir);
+	free(d->next_history);
+	free(d->old_history);
+	free(d->history);
+	free(d);
+}
@@ -47,6 +47,9 @@
 #define SAMPLER_CHANNEL 0
 #define POLYPHONY 12
 
+// the play position is an ufp24p8_t, so we can't play more than 24 bits worth of frames
+#define STATIC_SIGNAL_MAX_FRAMES 0xffffff
+
 typedef enum Resolution _Resolution;
 
 typedef struct note_struct {
@@ -58,7 +61,7 @@ typedef struct note_struct {
 	FTYPE amplitude; /* 0<1 */
 
 	int channels;
-	void *data;
+	StaticSignalReader reader;
 
 	int i; /* which static signal to play */
 
@@ -194,7 +197,7 @@ void execute(MachineTable *mt, void *void_sampler) {
 				sampler->sample_index[sampler->note[n_k].i]
 				);
 
-			sampler->note[n_k].data = (sp == NULL) ? NULL : mt->get_signal_buffer(sp);
+			static_signal_reader_init(&(sampler->note[n_k].reader), mt, sp);
 		}
 	}
 
@@ -236,14 +239,17 @@ void execute(MachineTable *mt, void *void_sampler) {
 					sample =
 						mt->get_static_signal(sampler->sample_index[n->i]);
 
-					if(sample != NULL && (mt->get_signal_dimension(sample) == _0D)) {
+					if(sample != NULL && (mt->get_signal_dimension(sample) == _0D) &&
+					   static_signal_reader_init(&(n->reader), mt, sample)) {
 						n->t = itoufp24p8(0);
 						
 						n->channels =
 							mt->get_signal_channels(sample);
 
 						n->resolution = mt->get_signal_resolution(sample);
-						n->t_max = itoufp24p8(mt->get_signal_samples(sample));
+						n->t_max = itoufp24p8(
+							n->reader.frames > STATIC_SIGNAL_MAX_FRAMES ?
+							STATIC_SIGNAL_MAX_FRAMES : n->reader.frames);
 
 						fp24p8_t A = itofp24p8(sampler->sample_frequency[n->i]);
 						
@@ -252,9 +258,6 @@ void execute(MachineTable *mt, void *void_sampler) {
 								A,
 								FS_q
 								);
-
-						n->data =
-							mt->get_signal_buffer(sample);
 					} else {
 						n->active = 0;
 					}
@@ -288,12 +291,13 @@ void execute(MachineTable *mt, void *void_sampler) {
 		/* process active notes */
 		for(n_k = 0; n_k < POLYPHONY; n_k++) {
 			note_t *n = &(sampler->note[n_k]);
-			int channels = n->channels;
-			if(n->active && n->data != NULL) {
+			if(n->active && n->reader.signal != NULL) {
 
 				FTYPE val = 0;
-				switch(n->resolution) {
+				void *frame = static_signal_reader_at(&(n->reader), mt, ufp24p8toi(n->t));
+				if(frame != NULL) switch(n->resolution) {
 				case _PTR:
+				case _MIDI_EVENTS:
 				case _MAX_R:
 					/* don't care */
 					break;
@@ -303,14 +307,14 @@ void execute(MachineTable *mt, void *void_sampler) {
 					break;
 				case _fl32bit:
 				{
-					float *d = (float *)(n->data);
-					val = ftoFTYPE(d[ufp24p8toi(n->t) * (int)channels]);
+					float *d = (float *)frame;
+					val = ftoFTYPE(d[0]);
 				}
 					break;
 				case _fx8p24bit:
 				{
-					fp8p24_t *d = (fp8p24_t *)(n->data);
-					fp8p24_t tmp = d[ufp24p8toi(n->t) * (int)channels];
+					fp8p24_t *d = (fp8p24_t *)frame;
+					fp8p24_t tmp = d[0];
 
 #ifdef __SATAN_USES_FXP
 					val = tmp;
@@ -322,13 +326,13 @@ void execute(MachineTable *mt, void *void_sampler) {
 				case _16bit:
 				{
 #ifdef __SATAN_USES_FXP
-					int16_t *d = (int16_t *)(n->data);
+					int16_t *d = (int16_t *)frame;
 					int32_t *tmp = (int32_t *)&val;
-					*tmp = (int32_t)d[ufp24p8toi(n->t) * (int)channels];
+					*tmp = (int32_t)d[0];
 					*tmp = *tmp << 7;
 #else
-					int16_t *d = (int16_t *)(n->data);
-					val = (float)d[ufp24p8toi(n->t) * (int)channels];
+					int16_t *d = (int16_t *)frame;
+					val = (float)d[0];
 					val = val / (8.0f * 32768.0f); // the 8.0f is because I made a misstake in the fixed point math block.. so to make sure I don't break the behavior for current users who are transfering from the fixed point to floating point I must compensate here.. If I correct the misstake in the fixed point code the songs users have already produced will sound bad...
 #endif
 				}
@@ -63,6 +63,8 @@ void *init(MachineTable *mt, const char *name) {
 
 //	clear_stats(&timebob);
 
+	mt->enable_midi_event_lists(mt);
+
 	if (!hexter_synth.initialized) {
 
 		hexter_synth.instance_count = 0;
@@ -164,8 +166,8 @@ void execute(MachineTable *mt, void *void_instance) {
 	if(outsig == NULL)
 		return;
 
-	void **midi_in = (void **)mt->get_signal_buffer(insig);
-	if(midi_in == NULL)
+	MidiEventIterator midi_in;
+	if(!midi_iterator_init(&midi_in, mt, insig))
 		return;
 
 	int midi_l = mt->get_signal_samples(insig);
@@ -221,7 +223,7 @@ void execute(MachineTable *mt, void *void_instance) {
 		unsigned int k, k_max = samples_done + burst_size;
 
 		for(k = samples_done; k < k_max; k++) {
-			mev = midi_in[k];
+			mev = midi_iterator_at(&midi_in, k);
 			if(mev != NULL) {
 				switch((mev->data[0] & 0xf0)) {
 				case MIDI_NOTE_ON:
@@ -73,6 +73,26 @@ extern "C" {
 
 #define VALUE_NOT_SET 0xffffffff
 
+/* version of the MachineTable structure, new fields are only appended
+ * at the end of the structure - check mt->version before using them.
+ *
+ * version 2 - port handles
+ * version 3 - sample accurate parameter events
+ * version 4 - MIDI event lists
+ * version 5 - streamed static signals
+ * version 6 - partitioned convolution
+ * version 7 - recording sink
+ * version 8 - async operation priorities
+ */
+#define MACHINE_TABLE_VERSION 8
+#define MACHINE_TABLE_VERSION_PORTS 2
+#define MACHINE_TABLE_VERSION_PARAMETER_EVENTS 3
+#define MACHINE_TABLE_VERSION_MIDI_EVENTS 4
+#define MACHINE_TABLE_VERSION_STATIC_STREAMS 5
+#define MACHINE_TABLE_VERSION_CONVOLUTION 6
+#define MACHINE_TABLE_VERSION_RECORDING_SINK 7
+#define MACHINE_TABLE_VERSION_ASYNC_PRIORITY 8
+
 #define STRING_CONTROLLER_SIZE 2048
 
 // low latency treshold, in seconds - this is where it is useful to enable low latency related features
@@ -123,7 +143,8 @@ extern "C" {
 		_fl32bit = 4,
 		_fx8p24bit = 5,
 		_PTR = 6,
-		_MAX_R = 7
+		_MIDI_EVENTS = 7, // MidiEventList, see below
+		_MAX_R = 8
 	};
 
 	enum SinkStatus {
@@ -143,8 +164,21 @@ extern "C" {
 
 	typedef void MachinePointer;
 	typedef void SignalPointer;
+	typedef void ConvolverPointer;
 	typedef uint32_t Parameter;
 
+	/* A PortHandle is a pre-resolved input or output, see get_input_port() */
+	typedef int PortHandle;
+#define INVALID_PORT -1
+
+	/* A controller change inside the current buffer, see get_parameter_events() */
+	typedef struct _ParameterEvent {
+		int offset; // sample offset in the current buffer
+		int index; // controller index, see get_parameter_index()
+		int ramp_length; // if > 0, ramp linearly to value over ramp_length samples
+		float value; // int, enum and boolean controllers are converted to float
+	} ParameterEvent;
+
 	typedef struct _AsyncOp {
 		void (*func)(struct _AsyncOp *a_op);
 		void *data; // generic data pointer
@@ -152,6 +186,10 @@ extern "C" {
 		int finished; // indicate if operation is finished
 	} AsyncOp;
 
+	// priority classes for run_async_operation_priority()
+#define ASYNC_PRIORITY_IO 0 // something realtime waits for it, like a disk write of recorded data
+#define ASYNC_PRIORITY_BULK 1 // loading, encoding, analysis
+
 	typedef struct _MachineTable {
 		MachinePointer *mp;
 
@@ -229,6 +267,138 @@ extern "C" {
 		int (*VuknobAndroidAudio__get_native_audio_configuration_data)(int *frequency, int *buffersize);
 #endif
 
+		/* Everything below this line must be guarded by a version check */
+		int version;
+
+		/* Port handles - MACHINE_TABLE_VERSION_PORTS
+		 *
+		 * get_input_signal()/get_output_signal() must look up the name
+		 * each time you call them. Instead you can resolve the name once,
+		 * in init(), and then use the handle in execute(). The handle stays
+		 * valid for the lifetime of the machine - it will automatically
+		 * refer to the new signal when connections to the input change.
+		 *
+		 * Returns INVALID_PORT if there is no such input/output.
+		 */
+		PortHandle (*get_input_port)(struct _MachineTable *, const char *);
+		PortHandle (*get_output_port)(struct _MachineTable *, const char *);
+
+		/* these are all O(1) and never allocate memory - safe to call from execute()
+		 *
+		 * if nothing is connected to an input port get_port_signal() and get_port_buffer()
+		 * returns NULL, get_port_samples() and get_port_channels() returns 0.
+		 * For a non-premixed input get_port_signal() returns the first signal, use
+		 * get_next_signal() to get the rest.
+		 */
+		SignalPointer *(*get_port_signal)(struct _MachineTable *, PortHandle);
+		void *(*get_port_buffer)(struct _MachineTable *, PortHandle);
+		int (*get_port_samples)(struct _MachineTable *, PortHandle);
+		int (*get_port_channels)(struct _MachineTable *, PortHandle);
+
+		/* Parameter events - MACHINE_TABLE_VERSION_PARAMETER_EVENTS
+		 *
+		 * By default controller changes are written to your controller
+		 * pointers between calls to execute(). If you call enable_parameter_events()
+		 * in init() you can get the changes with a sample offset inside the buffer,
+		 * in that case the new values are written to the controller pointers
+		 * after execute() has returned.
+		 *
+		 * get_parameter_index() maps a pointer returned from your get_controller_ptr()
+		 * to the index used in ParameterEvent, or -1 if it's not a known controller.
+		 *
+		 * get_parameter_events() returns the number of events in the current buffer
+		 * and points *events to them, they are sorted on offset. Only valid during execute().
+		 *
+		 * get_parameter_ramp() returns the value of a float controller for each sample
+		 * in the current buffer, or NULL if it doesn't change. The buffer is owned by
+		 * the machine and is overwritten by the next call to get_parameter_ramp().
+		 */
+		void (*enable_parameter_events)(struct _MachineTable *);
+		int (*get_parameter_index)(struct _MachineTable *, void *controller_ptr);
+		int (*get_parameter_events)(struct _MachineTable *, const ParameterEvent **events);
+		const float *(*get_parameter_ramp)(struct _MachineTable *, int index);
+
+		/* MIDI event lists - MACHINE_TABLE_VERSION_MIDI_EVENTS
+		 *
+		 * MIDI signals used to be a void pointer per sample frame, with a
+		 * MidiEvent pointer in the frames that contains an event. Now they are
+		 * normally a MidiEventList (resolution _MIDI_EVENTS). If you have not
+		 * called enable_midi_event_lists() in init() your MIDI inputs will
+		 * still be converted into the old pointer format (resolution _PTR)
+		 * before execute() is called.
+		 *
+		 * Use the midi_iterator_*() functions below to read a MIDI input,
+		 * they work with both formats.
+		 */
+		void (*enable_midi_event_lists)(struct _MachineTable *);
+
+		/* Streamed static signals - MACHINE_TABLE_VERSION_STATIC_STREAMS
+		 *
+		 * Long static signals are not loaded into RAM, only the first part
+		 * is. For those get_signal_buffer() and get_signal_samples() only
+		 * cover the resident part, the rest is loaded from disk in the
+		 * background while playing.
+		 *
+		 * get_static_signal_frames() returns the length of the complete signal.
+		 *
+		 * read_static_signal() returns the number of contiguous frames available at
+		 * frame, and points *data to the first one. If they are not loaded yet *data
+		 * is set to NULL and the negated number of missing frames is returned, play
+		 * silence for those. It returns 0 if frame is out of range. Safe to call
+		 * from execute(), the data pointer is valid until execute() returns.
+		 *
+		 * Use the static_signal_reader_*() functions below, they work with all versions.
+		 */
+		int (*get_static_signal_frames)(SignalPointer *);
+		int (*read_static_signal)(SignalPointer *, int frame, void **data);
+
+		/* Convolution - MACHINE_TABLE_VERSION_CONVOLUTION
+		 *
+		 * Uniformly partitioned FFT convolution with a static signal as
+		 * the impulse response, cheap enough for responses of several seconds.
+		 *
+		 * create_convolver() rounds partition_size up to a power of two,
+		 * get_convolver_latency() returns it - the output is delayed that many frames.
+		 * Smaller partitions give less latency but cost more CPU.
+		 *
+		 * convolver_set_ir() loads the first channel of a static signal, at most
+		 * max_frames of it (0 means all). It is NOT realtime safe - call it from init()
+		 * or from an AsyncOp. The new response is used from the next partition,
+		 * it is fine to call it while execute() is running convolver_process().
+		 * Returns 0 on success.
+		 *
+		 * convolver_process() is realtime safe, in and out are mono and may be the same buffer.
+		 */
+		ConvolverPointer *(*create_convolver)(int partition_size);
+		int (*convolver_set_ir)(ConvolverPointer *, int static_signal_index, int max_frames);
+		void (*convolver_process)(ConvolverPointer *, FTYPE *in, FTYPE *out, int frames);
+		int (*get_convolver_latency)(ConvolverPointer *);
+		void (*delete_convolver)(ConvolverPointer *);
+
+		/* Recording sink - MACHINE_TABLE_VERSION_RECORDING_SINK
+		 *
+		 * Lets the sink machine hand its final 16 bit output to the engine, which
+		 * encodes it to Ogg/Vorbis and/or RIFF/WAVE on a background thread.
+		 *
+		 * open_recording_sink() takes the name returned by get_recording_filename(),
+		 * the engine adds the extensions. It returns 0 if the engine records, otherwise
+		 * the machine should write the file by itself.
+		 *
+		 * All three are realtime safe, call them from the sink callback. data is
+		 * interleaved with the channels given to open_recording_sink().
+		 */
+		int (*open_recording_sink)(struct _MachineTable *, const char *file_name, int rate, int channels);
+		void (*write_recording_sink)(struct _MachineTable *, const int16_t *data, int frames);
+		void (*close_recording_sink)(struct _MachineTable *);
+
+		/* Async operation priorities - MACHINE_TABLE_VERSION_ASYNC_PRIORITY
+		 *
+		 * run_async_operation() executes the operations one at a time in the
+		 * order they were queued, with ASYNC_PRIORITY_IO. Operations queued with
+		 * run_async_operation_priority() are executed in parallel, in no particular
+		 * order. Both are realtime safe.
+		 */
+		void (*run_async_operation_priority)(AsyncOp *op, int priority);
 
 	} MachineTable;
 
@@ -274,6 +444,194 @@ extern "C" {
 			mev->data[1] = b; \
 			mev->data[2] = c;
 
+#define MIDI_EVENT_MAX_LENGTH 4
+#define MIDI_EVENT_LIST_CAPACITY 256
+
+	/* a _MIDI_EVENTS signal buffer contains one MidiEventList. The entries
+	 * are sorted on offset, which is the sample frame in the current buffer.
+	 * Several entries may share the same offset.
+	 *
+	 * The event is stored by value - cast &entry->event to a MidiEvent pointer.
+	 */
+	typedef struct _MidiEventListEntry {
+		int offset;
+		struct {
+			size_t length;
+			uint8_t data[MIDI_EVENT_MAX_LENGTH];
+		} event;
+	} MidiEventListEntry;
+
+	typedef struct _MidiEventList {
+		int count;
+		int capacity;
+		MidiEventListEntry entry[MIDI_EVENT_LIST_CAPACITY];
+	} MidiEventList;
+
+	/* returns 0 if the list is full */
+	static inline int midi_event_list_append(MidiEventList *list, int offset,
+						 size_t length, const uint8_t *data) {
+		if(list->count >= list->capacity || length > MIDI_EVENT_MAX_LENGTH)
+			return 0;
+
+		MidiEventListEntry *e = &(list->entry[list->count++]);
+		e->offset = offset;
+		e->event.length = length;
+		memcpy(e->event.data, data, length);
+
+		return 1;
+	}
+
+	/* iterate over the events in a MIDI signal, regardless of format:
+	 *
+	 *   MidiEventIterator it;
+	 *   if(midi_iterator_init(&it, mt, sig)) {
+	 *       int offset; MidiEvent *mev;
+	 *       while((mev = midi_iterator_next(&it, &offset)) != NULL) { ... }
+	 *   }
+	 *
+	 * If you process the buffer frame by frame, use midi_iterator_at() instead.
+	 */
+	typedef struct _MidiEventIterator {
+		void **pointers; // _PTR format
+		MidiEventList *list; // _MIDI_EVENTS format
+		int position;
+		int frames;
+	} MidiEventIterator;
+
+	/* returns 0 if there is nothing to iterate over */
+	static inline int midi_iterator_init(MidiEventIterator *it, struct _MachineTable *mt, SignalPointer *s) {
+		it->pointers = NULL;
+		it->list = NULL;
+		it->position = 0;
+		it->frames = 0;
+
+		if(s == NULL) return 0;
+
+		void *buffer = mt->get_signal_buffer(s);
+		if(buffer == NULL) return 0;
+
+		if(mt->get_signal_resolution(s) == _MIDI_EVENTS)
+			it->list = (MidiEventList *)buffer;
+		else
+			it->pointers = (void **)buffer;
+		it->frames = mt->get_signal_samples(s);
+
+		return 1;
+	}
+
+	/* returns the next event in the buffer, or NULL when there are no more */
+	static inline MidiEvent *midi_iterator_next(MidiEventIterator *it, int *offset) {
+		if(it->list) {
+			if(it->position >= it->list->count) return NULL;
+			MidiEventListEntry *e = &(it->list->entry[it->position++]);
+			*offset = e->offset;
+			return (MidiEvent *)&(e->event);
+		}
+		while(it->position < it->frames) {
+			int k = it->position++;
+			if(it->pointers[k] != NULL) {
+				*offset = k;
+				return (MidiEvent *)it->pointers[k];
+			}
+		}
+		return NULL;
+	}
+
+	/* for frame by frame processing, call once for each frame in order.
+	 * Returns at most one event per frame - if several events share
+	 * the same offset the rest are returned in the following frames.
+	 * That is the same behavior as the old pointer format.
+	 */
+	static inline MidiEvent *midi_iterator_at(MidiEventIterator *it, int frame) {
+		if(it->list) {
+			if(it->position >= it->list->count) return NULL;
+			MidiEventListEntry *e = &(it->list->entry[it->position]);
+			if(e->offset > frame) return NULL;
+			it->position++;
+			return (MidiEvent *)&(e->event);
+		}
+		if(it->pointers == NULL || frame >= it->frames) return NULL;
+		return (MidiEvent *)it->pointers[frame];
+	}
+
+/*******************************************
+ *
+ *     static signal stuff
+ *
+ *******************************************/
+
+	/* read a static signal, frame by frame, regardless if it is streamed or not:
+	 *
+	 *   StaticSignalReader r;
+	 *   if(static_signal_reader_init(&r, mt, sig)) {
+	 *       int16_t *frame = (int16_t *)static_signal_reader_at(&r, mt, t);
+	 *       if(frame != NULL) { ... } // NULL means silence
+	 *   }
+	 *
+	 * Call static_signal_reader_init() again at the start of each execute(),
+	 * the data is only valid until execute() returns.
+	 */
+	typedef struct _StaticSignalReader {
+		SignalPointer *signal;
+		uint8_t *block; // NULL if the block is not available
+		int block_start, block_frames;
+		int frame_size; // in bytes
+		int frames; // length of the complete signal
+	} StaticSignalReader;
+
+	/* returns 0 if there is nothing to read */
+	static inline int static_signal_reader_init(StaticSignalReader *r, struct _MachineTable *mt, SignalPointer *s) {
+		r->signal = s;
+		r->block = NULL;
+		r->block_start = 0;
+		r->block_frames = 0;
+		r->frame_size = 0;
+		r->frames = 0;
+
+		if(s == NULL) return 0;
+
+		switch(mt->get_signal_resolution(s)) {
+		case _8bit: r->frame_size = sizeof(int8_t); break;
+		case _16bit: r->frame_size = sizeof(int16_t); break;
+		case _32bit: r->frame_size = sizeof(int32_t); break;
+		case _fl32bit: r->frame_size = sizeof(float); break;
+		case _fx8p24bit: r->frame_size = sizeof(int32_t); break;
+		default: r->signal = NULL; return 0;
+		}
+		r->frame_size *= mt->get_signal_channels(s);
+
+		if(mt->version >= MACHINE_TABLE_VERSION_STATIC_STREAMS) {
+			r->frames = mt->get_static_signal_frames(s);
+		} else {
+			r->block = (uint8_t *)mt->get_signal_buffer(s);
+			r->block_frames = mt->get_signal_samples(s);
+			r->frames = r->block_frames;
+		}
+
+		return 1;
+	}
+
+	/* returns a pointer to the first channel of the frame, or NULL if it is not available */
+	static inline void *static_signal_reader_at(StaticSignalReader *r, struct _MachineTable *mt, int frame) {
+		int offset = frame - r->block_start;
+		if(offset < 0 || offset >= r->block_frames) {
+			void *data = NULL;
+			int n;
+
+			if(r->signal == NULL || mt->version < MACHINE_TABLE_VERSION_STATIC_STREAMS)
+				return NULL;
+			n = mt->read_static_signal(r->signal, frame, &data);
+			if(n == 0) return NULL;
+
+			r->block = (uint8_t *)data;
+			r->block_start = frame;
+			r->block_frames = n < 0 ? -n : n;
+			offset = 0;
+		}
+		if(r->block == NULL) return NULL;
+		return &(r->block[offset * r->frame_size]);
+	}
+
 /********************************************
  *
  *     Satan's "portable" math library
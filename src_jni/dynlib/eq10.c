@@ -43,22 +43,36 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "libfilter.h"
-
 USE_SATANS_MATH
 
+#include "libfilter.c"
+
 #define CHANNELS 2
+#define BANDS 10
+
+// alpha, beta and ypsilon of the bands at
+// 31, 62, 125, 250, 500, 1000, 2000, 4000, 8000 and 16000 Hz
+static const float eq10_bands[BANDS][3] = {
+	{0.000723575, 0.49855285, 0.998544628},
+	{0.001445062, 0.497109876, 0.997077038},
+	{0.002904926, 0.494190149, 0.994057064},
+	{0.005776487, 0.488447026, 0.987917799},
+	{0.011422552, 0.477154897, 0.975062733},
+	{0.02234653, 0.455306941, 0.947134157},
+	{0.04286684, 0.414266319, 0.88311345},
+	{0.079552886, 0.340894228, 0.728235763},
+	{0.1199464, 0.2601072, 0.3176087},
+	{0.159603, 0.1800994, 0.4435172},
+};
 
 typedef struct _EQ10Data {
 	int midiC;
 	float B0, B1, B2, B3, B4, B5, B6, B7, B8, B9;
 
-	struct bandPassCoeff bpc0, bpc1, bpc2, bpc3, bpc4, bpc5, bpc6 ,bpc7, bpc8, bpc9;
+	// the bands run in parallel, each one filtering the stereo input
+	biquadFilter_t band[BANDS];
 
-	struct bandPassMem
-	bpm0[CHANNELS], bpm1[CHANNELS], bpm2[CHANNELS], bpm3[CHANNELS], bpm4[CHANNELS],
-		bpm5[CHANNELS], bpm6[CHANNELS], bpm7[CHANNELS], bpm8[CHANNELS], bpm9[CHANNELS];
-	
+	PortHandle in_port, out_port;
 } EQ10Data;
 
 void *init(MachineTable *mt, const char *name) {
@@ -68,60 +82,33 @@ void *init(MachineTable *mt, const char *name) {
 
 	data->midiC = 0;
 
+	data->in_port = mt->get_input_port(mt, "Stereo");
+	data->out_port = mt->get_output_port(mt, "Stereo");
+
 	// filter stuff
 	SETUP_SATANS_MATH(mt);
 
-/* 31 Hz */
-	data->B0 = 1.0;
-	data->bpc0.alpha = ftoFTYPE(0.000723575);
-	data->bpc0.beta = ftoFTYPE(0.49855285);
-	data->bpc0.ypsilon = ftoFTYPE(0.998544628);
-/* 62 Hz */
-	data->B1 = 1.0;
-	data->bpc1.alpha = ftoFTYPE(0.001445062);
-	data->bpc1.beta = ftoFTYPE(0.497109876);
-	data->bpc1.ypsilon = ftoFTYPE(0.997077038);
-/* 125 Hz */
-	data->B2 = 1.0;
-	data->bpc2.alpha = ftoFTYPE(0.002904926);
-	data->bpc2.beta = ftoFTYPE(0.494190149);
-	data->bpc2.ypsilon = ftoFTYPE(0.994057064);
-/* 250 Hz */
-	data->B3 = 1.0;
-	data->bpc3.alpha = ftoFTYPE(0.005776487);
-	data->bpc3.beta = ftoFTYPE(0.488447026);
-	data->bpc3.ypsilon = ftoFTYPE(0.987917799);
-/* 500 Hz */
-	data->B4 = 1.0;
-	data->bpc4.alpha = ftoFTYPE(0.011422552);
-	data->bpc4.beta = ftoFTYPE(0.477154897);
-	data->bpc4.ypsilon = ftoFTYPE(0.975062733);
-/* 1000 Hz */
-	data->B5 = 1.0;
-	data->bpc5.alpha = ftoFTYPE(0.02234653);
-	data->bpc5.beta = ftoFTYPE(0.455306941);
-	data->bpc5.ypsilon = ftoFTYPE(0.947134157);
-/* 2000 Hz */
-	data->B6 = 1.0;
-	data->bpc6.alpha = ftoFTYPE(0.04286684);
-	data->bpc6.beta = ftoFTYPE(0.414266319);
-	data->bpc6.ypsilon = ftoFTYPE(0.88311345);
-/* 4000 Hz */
-	data->B7 = 1.0;
-	data->bpc7.alpha = ftoFTYPE(0.079552886);
-	data->bpc7.beta = ftoFTYPE(0.340894228);
-	data->bpc7.ypsilon = ftoFTYPE(0.728235763);
-/* 8000 Hz */
-	data->B8 = 1.0;
-	data->bpc8.alpha = ftoFTYPE(0.1199464);
-	data->bpc8.beta = ftoFTYPE(0.2601072);
-	data->bpc8.ypsilon = ftoFTYPE(0.3176087);
-/* 16000 Hz */
-	data->B9 = 1.0;
-	data->bpc9.alpha = ftoFTYPE(0.159603);
-	data->bpc9.beta = ftoFTYPE(0.1800994);
-	data->bpc9.ypsilon = ftoFTYPE(0.4435172);
-	
+	data->B0 = data->B1 = data->B2 = data->B3 = data->B4 = 1.0;
+	data->B5 = data->B6 = data->B7 = data->B8 = data->B9 = 1.0;
+
+	int k;
+	for(k = 0; k < BANDS; k++) {
+		float alpha = eq10_bands[k][0];
+		float beta = eq10_bands[k][1];
+		float ypsilon = eq10_bands[k][2];
+		FTYPE coef[5];
+
+		// y = 2 * (alpha * (x[n] - x[n-2]) + ypsilon * y[n-1] - beta * y[n-2])
+		coef[0] = ftoFTYPE(2.0f * alpha);
+		coef[1] = ftoFTYPE(0.0f);
+		coef[2] = ftoFTYPE(-2.0f * alpha);
+		coef[3] = ftoFTYPE(2.0f * ypsilon);
+		coef[4] = ftoFTYPE(-2.0f * beta);
+
+		biquadFilterInit(&(data->band[k]), CHANNELS);
+		biquadFilterSetCoefficients(&(data->band[k]), coef, 0);
+	}
+
 	/* return pointer to instance data */
 	return (void *)data;
 }
@@ -167,8 +154,8 @@ void reset(MachineTable *mt, void *data) {
 void execute(MachineTable *mt, void *data) {
 	EQ10Data *ld = (EQ10Data *)data;
 
-	SignalPointer *s = mt->get_input_signal(mt, "Stereo");
-	SignalPointer *os = mt->get_output_signal(mt, "Stereo");
+	SignalPointer *s = mt->get_port_signal(mt, ld->in_port);
+	SignalPointer *os = mt->get_port_signal(mt, ld->out_port);
 
 	if(os == NULL )
 		return;
@@ -190,79 +177,20 @@ void execute(MachineTable *mt, void *data) {
 	FTYPE *in = mt->get_signal_buffer(s);
 	int ic = mt->get_signal_channels(s);
 
-	int c;
-	int i;
-	FTYPE d;
-
-	FTYPE y0, y1, y2, y3, y4, y5, y6, y7, y8, y9;
-	FTYPE
-		fxB0,
-		fxB1,
-		fxB2,
-		fxB3,
-		fxB4,
-		fxB5,
-		fxB6,
-		fxB7,
-		fxB8,
-		fxB9;
-	
-	fxB0 = ftoFTYPE(ld->B0);
-	fxB1 = ftoFTYPE(ld->B1);
-	fxB2 = ftoFTYPE(ld->B2);
-	fxB3 = ftoFTYPE(ld->B3);
-	fxB4 = ftoFTYPE(ld->B4);
-	fxB5 = ftoFTYPE(ld->B5);
-	fxB6 = ftoFTYPE(ld->B6);
-	fxB7 = ftoFTYPE(ld->B7);
-	fxB8 = ftoFTYPE(ld->B8);
-	fxB9 = ftoFTYPE(ld->B9);
-	
-	for(i = 0; i < ol; i++) {		
-		for(c = 0; c < oc; c++) {
-			d = in[i * ic + c];
-
-			y0 = BANDPASS_IIR_FTYPE_CALC(d,ld->bpc0,ld->bpm0[c]);
-			BANDPASS_IIR_FTYPE_SAVE(d,y0,ld->bpm0[c]);
-			
-			y1 = BANDPASS_IIR_FTYPE_CALC(d,ld->bpc1,ld->bpm1[c]);
-			BANDPASS_IIR_FTYPE_SAVE(d,y1,ld->bpm1[c]);
-
-			y2 = BANDPASS_IIR_FTYPE_CALC(d,ld->bpc2,ld->bpm2[c]);
-			BANDPASS_IIR_FTYPE_SAVE(d,y2,ld->bpm2[c]);
-
-			y3 = BANDPASS_IIR_FTYPE_CALC(d,ld->bpc3,ld->bpm3[c]);
-			BANDPASS_IIR_FTYPE_SAVE(d,y3,ld->bpm3[c]);
-
-			y4 = BANDPASS_IIR_FTYPE_CALC(d,ld->bpc4,ld->bpm4[c]);
-			BANDPASS_IIR_FTYPE_SAVE(d,y4,ld->bpm4[c]);
-
-			y5 = BANDPASS_IIR_FTYPE_CALC(d,ld->bpc5,ld->bpm5[c]);
-			BANDPASS_IIR_FTYPE_SAVE(d,y5,ld->bpm5[c]);
-
-			y6 = BANDPASS_IIR_FTYPE_CALC(d,ld->bpc6,ld->bpm6[c]);
-			BANDPASS_IIR_FTYPE_SAVE(d,y6,ld->bpm6[c]);
+	if(ic != CHANNELS || oc != CHANNELS)
+		return;
 
-			y7 = BANDPASS_IIR_FTYPE_CALC(d,ld->bpc7,ld->bpm7[c]);
-			BANDPASS_IIR_FTYPE_SAVE(d,y7,ld->bpm7[c]);
+	float gain[BANDS] = {
+		ld->B0, ld->B1, ld->B2, ld->B3, ld->B4,
+		ld->B5, ld->B6, ld->B7, ld->B8, ld->B9
+	};
 
-			y8 = BANDPASS_IIR_FTYPE_CALC(d,ld->bpc8,ld->bpm8[c]);
-			BANDPASS_IIR_FTYPE_SAVE(d,y8,ld->bpm8[c]);
+	memset(ou, 0, sizeof(FTYPE) * ol * oc);
 
-			y9 = BANDPASS_IIR_FTYPE_CALC(d,ld->bpc9,ld->bpm9[c]);
-			BANDPASS_IIR_FTYPE_SAVE(d,y9,ld->bpm9[c]);
-			
-			ou[i * oc + c]  = mulFTYPE(fxB0, y0);
-			ou[i * oc + c] += mulFTYPE(fxB1, y1);
-			ou[i * oc + c] += mulFTYPE(fxB2, y2);
-			ou[i * oc + c] += mulFTYPE(fxB3, y3);
-			ou[i * oc + c] += mulFTYPE(fxB4, y4);
-			ou[i * oc + c] += mulFTYPE(fxB5, y5);
-			ou[i * oc + c] += mulFTYPE(fxB6, y6);
-			ou[i * oc + c] += mulFTYPE(fxB7, y7);
-			ou[i * oc + c] += mulFTYPE(fxB8, y8);
-			ou[i * oc + c] += mulFTYPE(fxB9, y9);
-		}
+	// one band at a time over the whole buffer, the band outputs are summed into ou
+	int k;
+	for(k = 0; k < BANDS; k++) {
+		biquadFilterMix(&(ld->band[k]), in, ou, ol, ftoFTYPE(gain[k]));
 	}
 }
 
@@ -41,12 +41,12 @@
 USE_SATANS_MATH
 
 #include "liboscillator.c"
-#include "libfilter.c"
-#include "libenvelope.c"
+#include "libvoicebank.c"
 
 // keys and voices must be equal size...
 #define E4_NR_VOICES 6
 #define E4_NR_KEYS E4_NR_VOICES
+#define E4_NR_GROUPS LVB_GROUPS(E4_NR_VOICES)
 
 // define how often we recalculate the filters
 #define FILTER_RECALC_PERIOD 1024
@@ -69,29 +69,32 @@ static FTYPE note_table[NOTE_TABLE_LENGTH];
 
 static FTYPE vco_2_low_frequency;
 
-typedef struct europa4_voice {
-	FTYPE velocity;
+// the signal processing state of all voices, one lane per voice
+typedef struct europa4_voice_bank {
+	lvb_osc_bank_t vco_1;
+	lvb_osc_bank_t vco_2;
 
-	FILTER_RECALC_PART;
+	lvb_env_bank_t env_1;
+	lvb_env_bank_t env_2;
 
-	oscillator_t vco_1;
-	oscillator_t vco_2;
+	lvb_biquad_bank_t lpf;
+	lvb_biquad_bank_t hpf;
 
-	envelope_t env_1;
-	envelope_t env_2;
+	lvb_osc_bank_t lfo;
+	lvb_biquad_bank_t lfo_lpf; // used to filter in noise mode
 
-	xPassFilterMono_t *lpf;
-	xPassFilterMono_t *hpf;
+	lvb_lanes_t velocity;
+	lvb_lanes_t unison_detune;
 
-	oscillator_t lfo;
-	xPassFilterMono_t *lfo_lpf; // used to filter in noise mode
+	// smoothing memory
+	lvb_lanes_t vco_2_mem;
+	lvb_lanes_t lfo_mem;
+} e4bank_t;
 
-	FTYPE unison_detune;
+typedef struct europa4_voice {
+	FTYPE velocity;
 
-	// smoothing memory
-	FTYPE vco_1_mem;
-	FTYPE vco_2_mem;
-	FTYPE lfo_mem;
+	FTYPE unison_detune;
 
 	struct europa4_voice *next_voice;
 } e4voice_t;
@@ -109,6 +112,7 @@ typedef struct europa4_key {
 } e4key_t;
 
 typedef struct europa4_instance {
+	e4bank_t *bank; // the voice lanes
 	e4voice_t voice[E4_NR_VOICES];
 	e4key_t key[E4_NR_KEYS]; // key "store"
 
@@ -118,6 +122,9 @@ typedef struct europa4_instance {
 	// in unison mode we also need to chain voices
 	e4voice_t *free_voice;
 
+	int filter_recalc_step;
+	unsigned int filter_recalc_pending; // voices triggered since the last sample, one bit per voice
+
 	FTYPE general_mix;
 	FTYPE general_volume;
 	int last_general_mode; // we must reset all voices in case we do a change of the general_mode parameter. We use the last_general_mode to keep track of this.
@@ -183,34 +190,17 @@ typedef struct europa4_instance {
 	FTYPE env_2_release;
 
 	int midi_channel;
-} europa4_t;
 
-int init_voice(MachineTable *mt, e4voice_t *v) {
-	los_init_oscillator(&(v->vco_1));
-	los_init_oscillator(&(v->vco_2));
-	los_init_oscillator(&(v->lfo));
-
-	v->lpf = create_xPassFilterMono(mt, 0);
-	if(v->lpf == NULL) return -1;
-	v->hpf = create_xPassFilterMono(mt, 1);
-	if(v->hpf == NULL) return -1;
-	v->lfo_lpf = create_xPassFilterMono(mt, 0);
-	if(v->lfo_lpf == NULL) return -1;
-	return 0;
-}
+	PortHandle midi_in_port, mono_out_port;
+} europa4_t;
 
-void free_voice(e4voice_t *v) {
-	if(v->lpf) xPassFilterMonoFree(v->lpf);
-	if(v->hpf) xPassFilterMonoFree(v->hpf);
-	if(v->lfo_lpf) xPassFilterMonoFree(v->lfo_lpf);
-}
+// the lane of a voice in the voice bank
+#define VOICE_LANE(europa4, v) ((int)((v) - (europa4)->voice))
 
 void delete(void *void_europa4) {
 	europa4_t *europa4 = (europa4_t *)void_europa4;
-	int k;
-	for(k = 0; k < E4_NR_VOICES; k++) {
-		free_voice(&(europa4->voice[k]));
-	}
+
+	if(europa4->bank) lvb_free(europa4->bank);
 
 	/* free instance data here */
 	free(europa4);
@@ -256,12 +246,15 @@ void *init(MachineTable *mt, const char *name) {
 
 	memset(europa4, 0, sizeof(europa4_t));
 
+	mt->enable_midi_event_lists(mt);
+	europa4->midi_in_port = mt->get_input_port(mt, "midi");
+	europa4->mono_out_port = mt->get_output_port(mt, "Mono");
+
+	europa4->bank = (e4bank_t *)lvb_alloc(sizeof(e4bank_t));
+	if(europa4->bank == NULL)
+		goto fail;
+
 	int k;
-	for(k = 0; k < E4_NR_VOICES; k++) {
-		if(init_voice(mt, &(europa4->voice[k]))) {
-			goto fail;
-		}
-	}
 
 	// set up key chains
 	for(k = 0; k < E4_NR_KEYS - 1; k++) {
@@ -412,10 +405,8 @@ void reset(MachineTable *mt, void *void_europa4) {
 
 	int l;
 	for(l = 0; l < E4_NR_VOICES; l++) {
-		e4voice_t *v = &(europa4->voice[l]);
-
-		envelope_reset(&(v->env_1));
-		envelope_reset(&(v->env_2));
+		lvb_env_reset(&(europa4->bank->env_1), l);
+		lvb_env_reset(&(europa4->bank->env_2), l);
 	}
 
 	// set up key chains
@@ -446,57 +437,81 @@ void calc_note_freq() {
 	vco_2_low_frequency = LOS_CALC_FREQUENCY(VCO_2_LOW_FREQUENCY);
 }
 
-inline void trigger_voice_envelope(envelope_t *env, int Fs,
+inline void trigger_voice_envelope(lvb_env_bank_t *env, int lane, int Fs,
 				   FTYPE a, FTYPE d, FTYPE s, FTYPE r) {
-	envelope_init(env, Fs);
+	lvb_env_trigger(env, lane, Fs,
+			FTYPEtof(a), 0.001f, FTYPEtof(d), FTYPEtof(s), FTYPEtof(r));
+}
+
+inline void release_voice(europa4_t *europa4, e4voice_t *voice) {
+	lvb_env_release(&(europa4->bank->env_1), VOICE_LANE(europa4, voice));
+	lvb_env_release(&(europa4->bank->env_2), VOICE_LANE(europa4, voice));
+}
 
-	envelope_set_attack(env, a);
-	envelope_set_hold(env, ftoFTYPE(0.001));
-	envelope_set_decay(env, d);
-	envelope_set_sustain(env, s);
-	envelope_set_release(env, r);
+inline int voice_is_active(europa4_t *europa4, e4voice_t *voice) {
+	unsigned int active = europa4->bank->env_1.active | europa4->bank->env_2.active;
+	return (active >> VOICE_LANE(europa4, voice)) & 1;
+}
 
-	envelope_hold(env);
+// noise for the LFO, one value per lane
+static inline lvb_vf lfo_noise(void) {
+	union { lvb_vf v; float f[LVB_LANES]; } u;
+	int l;
+	for(l = 0; l < LVB_LANES; l++)
+		u.f[l] = FTYPEtof(los_src_noise(itoFTYPE(0)));
+	return u.v;
 }
 
-inline void set_voice_to_key(europa4_t *europa4, e4voice_t *voice, int key, int do_glide, FTYPE glide_time) {
+// copy the per voice settings to the voice bank
+inline void update_voice_lanes(europa4_t *europa4) {
+	int l;
+	for(l = 0; l < E4_NR_VOICES; l++) {
+		europa4->bank->velocity.f[l] = FTYPEtof(europa4->voice[l].velocity);
+		europa4->bank->unison_detune.f[l] = FTYPEtof(europa4->voice[l].unison_detune);
+	}
+}
+
+inline void set_voice_to_key(europa4_t *europa4, e4voice_t *voice, int key, int do_glide, FTYPE glide_time, int Fs) {
+	lvb_osc_bank_t *vco_1 = &(europa4->bank->vco_1);
+	lvb_osc_bank_t *vco_2 = &(europa4->bank->vco_2);
+	int lane = VOICE_LANE(europa4, voice);
 	int v1_key = key + europa4->vco_1_range;
 	int v2_key = key + europa4->vco_2_range;
 	FTYPE frequency_1 = note_table[v1_key];
 	FTYPE frequency_2 = note_table[v2_key];
 
 #ifdef THIS_IS_A_MOCKERY
-	printf("modulation: %f, frequency: %f\n",
-	       FTYPEtof(frequency_1_modulation),
-	       FTYPEtof(frequency_1));
+	printf("frequency 1: %f, frequency 2: %f\n",
+	       FTYPEtof(frequency_1),
+	       FTYPEtof(frequency_2));
 #endif
 
 	if(do_glide) {
-		los_glide_frequency(
-			&(voice->vco_1),
-			frequency_1,
-			glide_time);
-
-		los_glide_frequency(
-			&(voice->vco_2),
-			frequency_2,
-			glide_time);
+		lvb_osc_glide_frequency(
+			vco_1, lane,
+			FTYPEtof(frequency_1),
+			FTYPEtof(glide_time), Fs);
+
+		lvb_osc_glide_frequency(
+			vco_2, lane,
+			FTYPEtof(frequency_2),
+			FTYPEtof(glide_time), Fs);
 	} else {
-		los_set_base_frequency(
-			&(voice->vco_1),
-			frequency_1);
+		lvb_osc_set_frequency(
+			vco_1, lane,
+			FTYPEtof(frequency_1));
 
-		los_set_base_frequency(
-			&(voice->vco_2),
-			frequency_2);
+		lvb_osc_set_frequency(
+			vco_2, lane,
+			FTYPEtof(frequency_2));
 	}
 
 	// if VCO-2 range is set to low frequency - we will set it again now
 	// but to a lower one - static
 	if(europa4->vco_2_range_type == 1) {
-		los_set_base_frequency(
-			&(voice->vco_2),
-			vco_2_low_frequency
+		lvb_osc_set_frequency(
+			vco_2, lane,
+			FTYPEtof(vco_2_low_frequency)
 			);
 	}
 }
@@ -513,15 +528,15 @@ void execute(MachineTable *mt, void *void_europa4) {
 	SignalPointer *outsig = NULL;
 	SignalPointer *insig = NULL;
 
-	insig = mt->get_input_signal(mt, "midi");
+	insig = mt->get_port_signal(mt, europa4->midi_in_port);
 	if(insig == NULL)
 		return;
-	outsig = mt->get_output_signal(mt, "Mono");
+	outsig = mt->get_port_signal(mt, europa4->mono_out_port);
 	if(outsig == NULL)
 		return;
 
-	void **midi_in = (void **)mt->get_signal_buffer(insig);
-	if(midi_in == NULL)
+	MidiEventIterator midi_in;
+	if(!midi_iterator_init(&midi_in, mt, insig))
 		return;
 
 	FTYPE *out =
@@ -530,7 +545,6 @@ void execute(MachineTable *mt, void *void_europa4) {
 	int Fs = mt->get_signal_frequency(outsig);
 
 	los_set_Fs(mt, Fs);
-	libfilter_set_Fs(Fs);
 
 	static int Fs_CURRENT = 0;
 	if(Fs_CURRENT != Fs) {
@@ -540,25 +554,29 @@ void execute(MachineTable *mt, void *void_europa4) {
 
 	FTYPE _10Hz = LOS_CALC_FREQUENCY(HERTZ(10.0f));
 	FTYPE lfo_frequency = (europa4->lfo_frequency);
-	FTYPE vco_mod_lfo = (europa4->vco_mod_lfo);
-	FTYPE vco_mod_env_1 = (europa4->vco_mod_env_1);
 	FTYPE glide_time = (europa4->glide_time);
 
-	FTYPE vco_1_vco2_ring_mod = (europa4->vco_1_vco2_ring_mod);
-	FTYPE vco_1_cross_mod_manual = mulFTYPE(itoFTYPE(24), europa4->vco_1_cross_mod_manual);
-	FTYPE vco_1_cross_mod_env_1 = mulFTYPE(itoFTYPE(24), europa4->vco_1_cross_mod_env_1);
+	// the voices are processed in float, also when FTYPE is fixed point
+	float vco_mod_lfo = FTYPEtof(europa4->vco_mod_lfo);
+	float vco_mod_env_1 = FTYPEtof(europa4->vco_mod_env_1);
+
+	float vco_1_vco2_ring_mod = FTYPEtof(europa4->vco_1_vco2_ring_mod);
+	float vco_1_vco2_ring_mod_inverse = FTYPEtof(1 - europa4->vco_1_vco2_ring_mod);
+	float vco_1_cross_mod_manual = FTYPEtof(mulFTYPE(itoFTYPE(24), europa4->vco_1_cross_mod_manual));
+	float vco_1_cross_mod_env_1 = FTYPEtof(mulFTYPE(itoFTYPE(24), europa4->vco_1_cross_mod_env_1));
+	float vco_2_fine_tune = FTYPEtof(europa4->vco_2_fine_tune);
 
-	FTYPE vca_env_2 = (europa4->vca_env_2);
-	FTYPE vca_lfo = (europa4->vca_lfo);
+	float vca_env_2 = FTYPEtof(europa4->vca_env_2);
+	float vca_lfo = FTYPEtof(europa4->vca_lfo);
 
-	FTYPE vcf_cutoff = mulFTYPE(europa4->vcf_cutoff, ftoFTYPE(0.45)); // 45% of Fs
-	FTYPE vcf_resonance = europa4->vcf_resonance;
-	FTYPE vcf_env = mulFTYPE(ftoFTYPE(0.999), europa4->vcf_env);
-	FTYPE vcf_lfo = europa4->vcf_lfo;
-	FTYPE vcf_kybd = europa4->vcf_kybd;
+	float vcf_cutoff = FTYPEtof(mulFTYPE(europa4->vcf_cutoff, ftoFTYPE(0.45))); // 45% of Fs
+	float vcf_resonance = FTYPEtof(europa4->vcf_resonance);
+	float vcf_env = FTYPEtof(mulFTYPE(ftoFTYPE(0.999), europa4->vcf_env));
+	float vcf_lfo = FTYPEtof(europa4->vcf_lfo);
+	float vcf_kybd = FTYPEtof(europa4->vcf_kybd);
 
-	FTYPE pwm_pw = (europa4->pwm_pw);
-	FTYPE pwm_pwm = (europa4->pwm_pwm);
+	float pwm_pw = FTYPEtof(europa4->pwm_pw);
+	float pwm_pwm = FTYPEtof(europa4->pwm_pwm);
 
 	FTYPE env1_a, env1_d, env1_s, env1_r;
 	env1_a = europa4->env_1_attack;
@@ -585,6 +603,11 @@ void execute(MachineTable *mt, void *void_europa4) {
 
 	FTYPE volume = (europa4->general_volume);
 
+	lvb_vf gain_VCO_1 = lvb_splat(FTYPEtof(mulFTYPE(volume, mix_VCO_1)));
+	lvb_vf gain_VCO_2 = lvb_splat(FTYPEtof(mulFTYPE(volume, mix_VCO_2)));
+	lvb_vf zero = lvb_splat(0.0f);
+	lvb_vf one = lvb_splat(1.0f);
+
 #ifdef THIS_IS_A_MOCKERY
 	SignalPointer *int_sig_a = NULL;
 	SignalPointer *int_sig_b = NULL;
@@ -598,21 +621,19 @@ void execute(MachineTable *mt, void *void_europa4) {
 #endif
 
 	// pre-calculate filter coefficients, and other frame statics
+	e4bank_t *v = europa4->bank;
 	{
 		int l;
 		for(l = 0; l < E4_NR_VOICES; l++) {
-			e4voice_t *v = &(europa4->voice[l]);
-
-			los_set_base_frequency(
-				&(v->lfo),
-				mulFTYPE(lfo_frequency, _10Hz));
-
-			xPassFilterMonoSetCutoff(v->lfo_lpf,
-						 mulFTYPE(lfo_frequency,
-							  ftoFTYPE(0.45f / MAX_LFO_SETTING))); // 45% of Fs
-			xPassFilterMonoSetResonance(v->lfo_lpf, ftoFTYPE(0.0f));
-			xPassFilterMonoRecalc(v->lfo_lpf);
+			lvb_osc_set_frequency(
+				&(v->lfo), l,
+				FTYPEtof(mulFTYPE(lfo_frequency, _10Hz)));
 		}
+
+		lvb_biquad_set_all(&(v->lfo_lpf), LVB_LOWPASS,
+				   FTYPEtof(mulFTYPE(lfo_frequency,
+						     ftoFTYPE(0.45f / MAX_LFO_SETTING))), // 45% of Fs
+				   0.0f);
 	}
 
 #ifdef THIS_IS_A_MOCKERY
@@ -621,7 +642,7 @@ void execute(MachineTable *mt, void *void_europa4) {
 #endif
 	int t;
 	for(t = 0; t < out_l; t++) {
-		MidiEvent *mev = (MidiEvent *)midi_in[t];
+		MidiEvent *mev = midi_iterator_at(&midi_in, t);
 #ifdef THIS_IS_A_MOCKERY
 		if(mev)
 			printf(" midi event %d at %d\n", mev->data[0] & 0xf0, t);
@@ -642,7 +663,7 @@ void execute(MachineTable *mt, void *void_europa4) {
 #endif
 			europa4->vcf_cutoff = ftoFTYPE(0.01f) + mulFTYPE(ftoFTYPE(0.94f), valu);
 
-			vcf_cutoff = mulFTYPE(europa4->vcf_cutoff, ftoFTYPE(0.45)); // 45% of Fs
+			vcf_cutoff = FTYPEtof(mulFTYPE(europa4->vcf_cutoff, ftoFTYPE(0.45))); // 45% of Fs
 		}
 
 		if((mev != NULL)
@@ -694,8 +715,7 @@ void execute(MachineTable *mt, void *void_europa4) {
 
 							for(v = voices_per_key; v < a->unison_voices; v++) {
 								if(a->voice[v]) {
-									envelope_release(&(a->voice[v]->env_1));
-									envelope_release(&(a->voice[v]->env_2));
+									release_voice(europa4, a->voice[v]);
 
 									a->voice[v]->next_voice = europa4->free_voice;
 									europa4->free_voice = a->voice[v];
@@ -723,20 +743,21 @@ void execute(MachineTable *mt, void *void_europa4) {
 								voice->velocity = unison_velocity;
 								unison_velocity = divFTYPE(unison_velocity, itoFTYPE(2));
 
-								trigger_voice_envelope(&(voice->env_1),
+								trigger_voice_envelope(&(europa4->bank->env_1), VOICE_LANE(europa4, voice),
 										       Fs,
 										       env1_a, env1_d, env1_s, env1_r);
 
-								trigger_voice_envelope(&(voice->env_2),
+								trigger_voice_envelope(&(europa4->bank->env_2), VOICE_LANE(europa4, voice),
 										       Fs,
 										       env2_a, env2_d, env2_s, env2_r);
+								europa4->filter_recalc_pending |= 1 << VOICE_LANE(europa4, voice);
 
 								set_voice_to_key(europa4,
 										 voice, new_key->key,
-										 0, itoFTYPE(0));
+										 0, itoFTYPE(0), Fs);
 
 								if(europa4->lfo_sync_to_key_press)
-									los_reset_oscillator(&(voice->lfo));
+									lvb_osc_reset(&(europa4->bank->lfo), VOICE_LANE(europa4, voice));
 
 								if(v % 2 == 0) {
 									voice->unison_detune = -last_unison_detune;
@@ -756,7 +777,7 @@ void execute(MachineTable *mt, void *void_europa4) {
 						set_voice_to_key(europa4,
 								 new_key->voice[0], new_key->key,
 								 europa4->glide_mode,
-								 glide_time);
+								 glide_time, Fs);
 					} else {
 						if(europa4->general_mode == 0) {
 							// solo mode
@@ -772,13 +793,14 @@ void execute(MachineTable *mt, void *void_europa4) {
 						}
 						new_key->voice[0]->velocity = new_key->velocity;
 
-						trigger_voice_envelope(&(new_key->voice[0]->env_1),
+						trigger_voice_envelope(&(europa4->bank->env_1), VOICE_LANE(europa4, new_key->voice[0]),
 								       Fs,
 								       env1_a, env1_d, env1_s, env1_r);
 
-						trigger_voice_envelope(&(new_key->voice[0]->env_2),
+						trigger_voice_envelope(&(europa4->bank->env_2), VOICE_LANE(europa4, new_key->voice[0]),
 								       Fs,
 								       env2_a, env2_d, env2_s, env2_r);
+						europa4->filter_recalc_pending |= 1 << VOICE_LANE(europa4, new_key->voice[0]);
 
 						if(europa4->general_mode == 0) {
 
@@ -786,23 +808,24 @@ void execute(MachineTable *mt, void *void_europa4) {
 							set_voice_to_key(europa4,
 									 new_key->voice[0], new_key->key,
 									 europa4->glide_mode == 1 ? 1 : 0,
-									 glide_time);
+									 glide_time, Fs);
 
 						} else {
 
 							// polyphony mode
 							set_voice_to_key(europa4,
 									 new_key->voice[0], new_key->key,
-									 0, itoFTYPE(0));
+									 0, itoFTYPE(0), Fs);
 
 						}
 
 						if(europa4->lfo_sync_to_key_press)
-							los_reset_oscillator(&(new_key->voice[0]->lfo));
+							lvb_osc_reset(&(europa4->bank->lfo), VOICE_LANE(europa4, new_key->voice[0]));
 
 					}
 				}
 			}
+			update_voice_lanes(europa4);
 #ifdef THIS_IS_A_MOCKERY
 			{
 				e4key_t *k = europa4->active_key;
@@ -861,11 +884,7 @@ void execute(MachineTable *mt, void *void_europa4) {
 					e4voice_t *v = &(europa4->voice[l]);
 
 					// if both envelopes are non-active, skip processing this voice
-					if(
-						(!envelope_is_active(&(v->env_1)))
-						&&
-						(!envelope_is_active(&(v->env_2)))
-						) {
+					if(!voice_is_active(europa4, v)) {
 						printf(" voice %p is inactive.\n", v);
 						continue;
 					}
@@ -892,15 +911,14 @@ void execute(MachineTable *mt, void *void_europa4) {
 								set_voice_to_key(europa4,
 										 crnt_key->voice[0],
 										 crnt_key->next_key->key,
-										 europa4->glide_mode, glide_time);
+										 europa4->glide_mode, glide_time, Fs);
 
 								crnt_key->next_key->voice[0] = crnt_key->voice[0];
 							} else {
 								// if we cannot pass to the next
 								// one, or if general mode is polyphony
 								// we shall just release the voice.
-								envelope_release(&(crnt_key->voice[0]->env_1));
-								envelope_release(&(crnt_key->voice[0]->env_2));
+								release_voice(europa4, crnt_key->voice[0]);
 							}
 							crnt_key->voice[0] = NULL;
 						}
@@ -910,8 +928,7 @@ void execute(MachineTable *mt, void *void_europa4) {
 						for(v = 0; v < E4_NR_VOICES; v++) {
 
 							if(crnt_key->voice[v] != NULL) {
-								envelope_release(&(crnt_key->voice[v]->env_1));
-								envelope_release(&(crnt_key->voice[v]->env_2));
+								release_voice(europa4, crnt_key->voice[v]);
 
 								crnt_key->voice[v]->next_voice = europa4->free_voice;
 								europa4->free_voice = crnt_key->voice[v];
@@ -962,62 +979,58 @@ void execute(MachineTable *mt, void *void_europa4) {
 
 		}
 
-		// set the current output sample to 0
-		out[t] = itoFTYPE(0);
+		float output = 0.0f;
 
-		// process voices
+		// process voices, LVB_LANES at a time
 		{
-			int l;
-			for(l = 0; l < E4_NR_VOICES; l++) {
-				e4voice_t *v = &(europa4->voice[l]);
-
-				// if both envelopes are non-active, skip processing this voice
-				if(
-					(!envelope_is_active(&(v->env_1)))
-				   &&
-					(!envelope_is_active(&(v->env_2)))
-					) {
+			// a voice is processed as long as one of the envelopes is active
+			unsigned int active = v->env_1.active | v->env_2.active;
+
+			int g;
+			for(g = 0; g < E4_NR_GROUPS; g++) {
+				unsigned int bits = LVB_GROUP_BITS(active, g);
+
+				// skip the group if all voices are idle
+				if(!bits)
 					continue;
-				}
 
 				// otherwise, process it hereafter!
 
-				FTYPE vco_1 = itoFTYPE(0), vco_2 = itoFTYPE(0);
-				FTYPE lfo = itoFTYPE(0);
-				FTYPE env_1 = itoFTYPE(0), env_2 = itoFTYPE(0);
-				FTYPE vca = itoFTYPE(0);
-				FTYPE pwm;
+				lvb_vi mask = lvb_lane_mask(bits);
+				lvb_vf vco_1 = zero, vco_2 = zero;
+				lvb_vf lfo = zero;
+				lvb_vf env_1, env_2;
+				lvb_vf vca;
+				lvb_vf pwm;
 
 				{ // process ENV 1
-					env_1 = envelope_get_sample(&(v->env_1));
-					envelope_step(&(v->env_1));
+					env_1 = lvb_env_sample(&(v->env_1), g);
+					lvb_env_step(&(v->env_1), g);
 
 					if(europa4->env_1_polarity) { // reverse polarity
-						env_1 = itoFTYPE(1) - env_1;
+						env_1 = one - env_1;
 					}
 				}
 
 				{ // process ENV 2
-					env_2 = envelope_get_sample(&(v->env_2));
-					envelope_step(&(v->env_2));
+					env_2 = lvb_env_sample(&(v->env_2), g);
+					lvb_env_step(&(v->env_2), g);
 				}
 
 
 				{ // process LFO
 					switch(europa4->lfo_wave) {
 					case 0:
-						lfo = los_get_alternate_sample(&(v->lfo), los_src_sin);
+						lfo = lvb_osc_sin(&(v->lfo), g);
 						break;
 					case 1:
-						lfo = los_get_alternate_sample(&(v->lfo), los_src_saw);
+						lfo = lvb_osc_saw(&(v->lfo), g);
 						break;
 					case 2:
-						lfo = los_get_alternate_sample(&(v->lfo), los_src_square);
+						lfo = lvb_osc_square(&(v->lfo), g);
 						break;
 					case 3:
-						lfo = los_get_alternate_sample(&(v->lfo), los_src_noise);
-						xPassFilterMonoPut(v->lfo_lpf, lfo);
-						lfo = xPassFilterMonoGet(v->lfo_lpf);
+						lfo = lvb_biquad_put(&(v->lfo_lpf), g, lfo_noise());
 						break;
 					}
 					switch(europa4->lfo_envelope) {
@@ -1025,228 +1038,204 @@ void execute(MachineTable *mt, void *void_europa4) {
 						/* no-operation */
 						break;
 					case 1:
-						lfo = mulFTYPE(lfo, env_1);
+						lfo = lfo * env_1;
 						break;
 					case 2:
-						lfo = mulFTYPE(lfo, env_2);
+						lfo = lfo * env_2;
 						break;
 					}
-					los_step_oscillator(&(v->lfo), itoFTYPE(0), itoFTYPE(0));
+					lvb_osc_step(&(v->lfo), g, NULL);
 
-					v->lfo_mem =
-						mulFTYPE(ftoFTYPE(LFO_SMOOTH_FACTOR), v->lfo_mem)
+					v->lfo_mem.v[g] =
+						lvb_splat(LFO_SMOOTH_FACTOR) * v->lfo_mem.v[g]
 						+
-						mulFTYPE(ftoFTYPE(1.0f - LFO_SMOOTH_FACTOR), lfo);
-					lfo = v->lfo_mem;
+						lvb_splat(1.0f - LFO_SMOOTH_FACTOR) * lfo;
+					lfo = v->lfo_mem.v[g];
 				}
 
 				{ // calculate PWM here
-					FTYPE mod = itoFTYPE(1);
+					lvb_vf mod;
 
 					if(europa4->pwm_selector == 0) { // LFO
-						mod = divFTYPE(lfo + itoFTYPE(1),
-							       itoFTYPE(2));
+						mod = (lfo + one) * lvb_splat(0.5f);
 					} else {
 						mod = env_1;
 					}
-					mod = itoFTYPE(1) - pwm_pwm +
-						mulFTYPE(
-							pwm_pwm,
-							mod);
+					mod = lvb_splat(1.0f - pwm_pwm) + lvb_splat(pwm_pwm) * mod;
 
-					mod = mulFTYPE(mod, pwm_pw);
-					pwm = mulFTYPE(mod, ftoFTYPE(0.5f));
+					pwm = mod * lvb_splat(pwm_pw * 0.5f);
 				}
 
-				FTYPE vco_mod_BASE;
+				lvb_vf vco_mod_BASE;
 
-				vco_mod_BASE = mulFTYPE(lfo, vco_mod_lfo);
+				vco_mod_BASE = lfo * lvb_splat(vco_mod_lfo);
 				if(europa4->env_1_polarity)
-					vco_mod_BASE += mulFTYPE(env_1, vco_mod_env_1);
+					vco_mod_BASE += env_1 * lvb_splat(vco_mod_env_1);
 				else
-					vco_mod_BASE += mulFTYPE(env_1 - itoFTYPE(1), vco_mod_env_1);
+					vco_mod_BASE += (env_1 - one) * lvb_splat(vco_mod_env_1);
 
 
 				{ // process VCO-2
-					FTYPE saw = los_get_alternate_sample(&(v->vco_2), los_src_saw);
+					lvb_vf saw = lvb_osc_blep_saw(&(v->vco_2), g);
 					if(europa4->vco_2_sin)
-						vco_2 += los_get_alternate_sample(&(v->vco_2), los_src_sin);
+						vco_2 += lvb_osc_sin(&(v->vco_2), g);
 					if(europa4->vco_2_sawsmooth)
-						vco_2 += los_get_alternate_sample(&(v->vco_2), los_src_sawsmooth);
+						vco_2 += lvb_osc_sawsmooth(&(v->vco_2), g);
 					if(europa4->vco_2_saw)
 						vco_2 += saw;
 					if(europa4->vco_2_pulse) {
 						if(europa4->vco_2_pulse_mode) {
-							if(saw < pwm)
-								vco_2 += itoFTYPE(1);
-							else
-								vco_2 -= itoFTYPE(1);
+							// high while the saw is below pwm
+							vco_2 += lvb_osc_blep_pulse(&(v->vco_2), g, (pwm + one) * lvb_splat(0.5f));
 						} else {
-							vco_2 += los_get_alternate_sample(
-								&(v->vco_2), los_src_square);
+							vco_2 += lvb_osc_blep_square(&(v->vco_2), g);
 						}
 					}
 
 					if(europa4->vco_2_range_type == 0) {
-						FTYPE vco_mod = itoFTYPE(0);
+						lvb_vf vco_mod = zero;
 
 						if(europa4->vco_mod_vco_2) {
 							vco_mod += vco_mod_BASE;
 						}
 
-						vco_mod += europa4->vco_2_fine_tune;
+						vco_mod += lvb_splat(vco_2_fine_tune);
 
 						if(europa4->general_mode == 1) { // unison mode
-							los_step_oscillator(&(v->vco_2),
-									    vco_mod + v->unison_detune,
-									    itoFTYPE(0));
-						} else {
-							los_step_oscillator(&(v->vco_2), vco_mod, itoFTYPE(0));
+							vco_mod += v->unison_detune.v[g];
 						}
+						lvb_osc_step(&(v->vco_2), g, &vco_mod);
 					} else {
-						los_step_oscillator(&(v->vco_2), itoFTYPE(0), itoFTYPE(0));
+						lvb_osc_step(&(v->vco_2), g, NULL);
 					}
 
-					v->vco_2_mem =
-						mulFTYPE(ftoFTYPE(VCO_SMOOTH_FACTOR), v->vco_2_mem)
+					v->vco_2_mem.v[g] =
+						lvb_splat(VCO_SMOOTH_FACTOR) * v->vco_2_mem.v[g]
 						+
-						mulFTYPE(ftoFTYPE(1.0f - VCO_SMOOTH_FACTOR), vco_2);
-					vco_2 = v->vco_2_mem;
+						lvb_splat(1.0f - VCO_SMOOTH_FACTOR) * vco_2;
+					vco_2 = v->vco_2_mem.v[g];
 
 #ifdef THIS_IS_A_MOCKERY
-					if(l == 0) {
-						int_out_a[t] = mulFTYPE(ftoFTYPE(0.5f), vco_2);
+					if(g == 0 && (bits & 1)) {
+						int_out_a[t] = ftoFTYPE(0.5f * lvb_lane(vco_2, 0));
 					}
 #endif
 				}
 
 				{ // process VCO-1
-					FTYPE vco_mod = itoFTYPE(0);
+					lvb_vf vco_mod = zero;
 					if(europa4->vco_mod_vco_1) {
 						vco_mod += vco_mod_BASE;
 					}
 
-					FTYPE xmod_env1 = mulFTYPE(vco_1_cross_mod_env_1, env_1);
-					vco_mod += mulFTYPE(vco_2 + itoFTYPE(1), vco_1_cross_mod_manual);
-					vco_mod += mulFTYPE(vco_2 + itoFTYPE(1), xmod_env1);
+					lvb_vf xmod_env1 = lvb_splat(vco_1_cross_mod_env_1) * env_1;
+					vco_mod += (vco_2 + one) * lvb_splat(vco_1_cross_mod_manual);
+					vco_mod += (vco_2 + one) * xmod_env1;
 
-					FTYPE saw = los_get_alternate_sample(&(v->vco_1), los_src_saw);
+					lvb_vf saw = lvb_osc_blep_saw(&(v->vco_1), g);
 					if(europa4->vco_1_sin)
-						vco_1 += los_get_alternate_sample(&(v->vco_1), los_src_sin);
+						vco_1 += lvb_osc_sin(&(v->vco_1), g);
 					if(europa4->vco_1_sawsmooth)
-						vco_1 += los_get_alternate_sample(&(v->vco_1), los_src_sawsmooth);
+						vco_1 += lvb_osc_sawsmooth(&(v->vco_1), g);
 					if(europa4->vco_1_saw)
 						vco_1 += saw;
 					if(europa4->vco_1_pulse) {
 						if(europa4->vco_1_pulse_mode) {
-							if(saw < pwm)
-								vco_1 += itoFTYPE(1);
-							else
-								vco_1 -= itoFTYPE(1);
+							// high while the saw is below pwm
+							vco_1 += lvb_osc_blep_pulse(&(v->vco_1), g, (pwm + one) * lvb_splat(0.5f));
 						} else {
-							vco_1 += los_get_alternate_sample(
-								&(v->vco_1), los_src_square);
+							vco_1 += lvb_osc_blep_square(&(v->vco_1), g);
 						}
 					}
 
-					FTYPE ring_mod = mulFTYPE(vco_1, vco_2);
+					lvb_vf ring_mod = vco_1 * vco_2;
 
-					vco_1 = mulFTYPE(vco_1_vco2_ring_mod, ring_mod)
+					vco_1 = lvb_splat(vco_1_vco2_ring_mod) * ring_mod
 						+
-						mulFTYPE(1 - vco_1_vco2_ring_mod, vco_1);
+						lvb_splat(vco_1_vco2_ring_mod_inverse) * vco_1;
 
 					if(europa4->general_mode == 1) { // unison mode
-						los_step_oscillator(&(v->vco_1),
-								    vco_mod + v->unison_detune, itoFTYPE(0));
-					} else {
-						los_step_oscillator(&(v->vco_1), vco_mod, itoFTYPE(0));
+						vco_mod += v->unison_detune.v[g];
 					}
+					lvb_osc_step(&(v->vco_1), g, &vco_mod);
 
 				}
 
 				{ // process VCF parameters
-					FTYPE env;
-					FTYPE kybd_env;
-					FTYPE lfo_env;
-					FTYPE cutoff;
-
-					if(DO_FILTER_RECALC(v)) {
-						env = europa4->vcf_env_selector ? env_2 : env_1;
+					if(europa4->filter_recalc_step == g * (FILTER_RECALC_PERIOD / E4_NR_GROUPS) ||
+					   LVB_GROUP_BITS(europa4->filter_recalc_pending, g)) {
+						lvb_vf env = europa4->vcf_env_selector ? env_2 : env_1;
+						lvb_vf kybd_env;
+						lvb_vf lfo_env;
+						lvb_vf cutoff;
 
-						cutoff = mulFTYPE(vcf_cutoff,
-								  itoFTYPE(1) - vcf_env + mulFTYPE(env, vcf_env));
+						cutoff = lvb_splat(vcf_cutoff) *
+							(lvb_splat(1.0f - vcf_env) + env * lvb_splat(vcf_env));
 
-						kybd_env = mulFTYPE(vcf_kybd, v->velocity);
-						kybd_env = itoFTYPE(1) - vcf_kybd + kybd_env;
+						kybd_env = lvb_splat(vcf_kybd) * v->velocity.v[g];
+						kybd_env = lvb_splat(1.0f - vcf_kybd) + kybd_env;
 
-						lfo_env = divFTYPE(lfo + itoFTYPE(1), itoFTYPE(2)); // make it vary from 0 to 1
-						lfo_env = mulFTYPE(vcf_lfo, lfo_env);
-						lfo_env = itoFTYPE(1) - vcf_lfo + lfo_env;
+						lfo_env = (lfo + one) * lvb_splat(0.5f); // make it vary from 0 to 1
+						lfo_env = lvb_splat(vcf_lfo) * lfo_env;
+						lfo_env = lvb_splat(1.0f - vcf_lfo) + lfo_env;
 
-						cutoff = mulFTYPE(lfo_env, cutoff);
-						cutoff = mulFTYPE(kybd_env, cutoff);
+						cutoff = lfo_env * cutoff;
+						cutoff = kybd_env * cutoff;
 
-						xPassFilterMonoSetCutoff(v->lpf, cutoff);
-						xPassFilterMonoSetResonance(v->lpf, vcf_resonance);
-						xPassFilterMonoRecalc(v->lpf);
-						xPassFilterMonoSetCutoff(v->hpf, cutoff);
-						xPassFilterMonoSetResonance(v->hpf, vcf_resonance);
-						xPassFilterMonoRecalc(v->hpf);
+						lvb_biquad_set_group(&(v->lpf), g, LVB_LOWPASS, cutoff, vcf_resonance);
+						lvb_biquad_set_group(&(v->hpf), g, LVB_HIGHPASS, cutoff, vcf_resonance);
 					}
 				}
 
 				{ // process VCA
-					FTYPE ve2 = itoFTYPE(1);
-					FTYPE vlf = itoFTYPE(1);
+					lvb_vf ve2 = lvb_splat(1.0f - vca_env_2) + lvb_splat(vca_env_2) * env_2;
+					lvb_vf vlf = lvb_splat(1.0f - vca_lfo) + lvb_splat(vca_lfo) * lfo;
 
-					ve2 = ve2 - vca_env_2 + mulFTYPE(vca_env_2, env_2);
-					vlf = vlf - vca_lfo + mulFTYPE(vca_lfo, lfo);
-
-					vca = mulFTYPE(v->velocity, mulFTYPE(ve2, vlf));
+					vca = v->velocity.v[g] * (ve2 * vlf);
 				}
 
 				{ // process end result
-					FTYPE output_v = mulFTYPE(
-						volume,
-						mulFTYPE(mix_VCO_1, vco_1) + mulFTYPE(mix_VCO_2, vco_2)
-						);
+					lvb_vf output_v = gain_VCO_1 * vco_1 + gain_VCO_2 * vco_2;
 
+					// idle voices in the group are masked out before filtering
 					if(europa4->vcf_mode == 1 ||
 					   europa4->vcf_mode == 3) {
-						xPassFilterMonoPut(v->lpf, output_v);
-						output_v = xPassFilterMonoGet(v->lpf);
+						output_v = lvb_biquad_put(&(v->lpf), g, lvb_select(mask, output_v, zero));
 					}
 
-					output_v = mulFTYPE(output_v, vca);
+					output_v = output_v * vca;
 					if(europa4->vcf_mode == 2 ||
 					   europa4->vcf_mode == 3) {
-						xPassFilterMonoPut(v->hpf, output_v);
-						output_v = xPassFilterMonoGet(v->hpf);
+						output_v = lvb_biquad_put(&(v->hpf), g, lvb_select(mask, output_v, zero));
 					}
 
 #ifdef THIS_IS_A_MOCKERY
-					if(l == 0) {
-						int_out_b[t] = mulFTYPE(ftoFTYPE(0.9f), output_v);
+					if(g == 0 && (bits & 1)) {
+						int_out_b[t] = ftoFTYPE(0.9f * lvb_lane(output_v, 0));
 					}
 #endif
 
-					out[t] += output_v;
+					output += lvb_sum(lvb_select(mask, output_v, zero));
 				}
-				STEP_FILTER_RECALC(v);
+			}
 
 #ifdef THIS_IS_A_MOCKERY
-				{
-					if(
-						(!envelope_is_active(&(v->env_1)))
-						&&
-						(!envelope_is_active(&(v->env_2)))
-						) {
-						printf(" !!!! voice %p ended by autonomy.\n", v);
+			{
+				unsigned int ended = active & ~(v->env_1.active | v->env_2.active);
+				int l;
+				for(l = 0; l < E4_NR_VOICES; l++) {
+					if(ended & (1 << l)) {
+						printf(" !!!! voice %p ended by autonomy.\n", &(europa4->voice[l]));
 					}
 				}
-#endif
 			}
+#endif
 		}
+		europa4->filter_recalc_pending = 0;
+		europa4->filter_recalc_step = (europa4->filter_recalc_step + 1) % FILTER_RECALC_PERIOD;
+
+		out[t] = ftoFTYPE(output);
+
 #ifdef THIS_IS_A_MOCKERY
 		if(out[t] > max_mock)
 			max_mock = out[t];
@@ -32,9 +32,6 @@
 #error "CAN'T FIND config.h"
 #endif
 
-// this define forces grooveiator to do additional calculations in fixed point mode that are otherwise still floating.
-#define FILTER_USING_FIXED_POINT
-
 #include <math.h>
 #include "dynlib.h"
 #include <stdio.h>
@@ -43,28 +40,23 @@
 
 USE_SATANS_MATH
 
+#include "libfilter.c"
+
 typedef struct _FboxData {
 	int midiC;
 
 	int filter_type; // 0 = lopass, 1 = hipass
 	
 	float cutoff, resonance;
-	FTYPE coef[5];
 	float freq;
-	FTYPE hist_x[2*2];
-	FTYPE hist_y[2*2];
+	biquadFilter_t filter;
 } FboxData;
 
 #define __DO_NON_LINEAR_CUTOFF
 
-void calc_filter(FboxData *ld) {
-	float alpha, omega, sn, cs;
-
-#ifdef FILTER_USING_FIXED_POINT
-	FTYPE fx_b0, fx_b1, fx_b2, fx_a0, fx_a1, fx_a2, fx_alpha, fx_cs;;
-#else
-	float a0, a1, a2, b0, b1, b2;
-#endif
+// ramp is the number of samples over which we move to the new coefficients
+void calc_filter(FboxData *ld, int ramp) {
+	float frequency;
 
 	// These limits the cutoff frequency and resonance to
 	// reasoneable values.
@@ -74,69 +66,15 @@ void calc_filter(FboxData *ld) {
 	if (ld->resonance > 127.0f) { ld->resonance = 127.0f; };
 
 #ifdef __DO_NON_LINEAR_CUTOFF
-	omega = (ld->cutoff / 118.32); omega *= omega;
-	omega /= ld->freq;
+	frequency = (ld->cutoff / 118.32); frequency *= frequency;
 #else
-	omega = ld->cutoff / ld->freq;
+	frequency = ld->cutoff;
 #endif
-	
-	sn = SAT_SIN_SCALAR(omega);
-	cs = SAT_COS_SCALAR(omega);
-
-	alpha = sn / ld->resonance;
-
-	if(alpha < 0.0f) {
-		alpha = 0.0; // if alpha is < 0.0 we will get bad sounds...
-	}
-
-#ifdef FILTER_USING_FIXED_POINT
-	fx_cs = ftoFTYPE(cs);
-	fx_alpha = ftoFTYPE(alpha);
-	
-	switch(ld->filter_type) {
-	case 0:
-	default:
-		fx_b1 = ftoFTYPE(1.0f) - fx_cs;
-		fx_b0 = fx_b2 = divFTYPE(fx_b1, ftoFTYPE(2.0f));
-		break;
-	case 1:
-		fx_b1 = -(ftoFTYPE(1.0f) + fx_cs);
-		fx_b0 = fx_b2 = -(divFTYPE(fx_b1, ftoFTYPE(2.0f)));
-		break;
-	}		
-	
-	fx_a0 = ftoFTYPE(1.0f) + fx_alpha;
-	fx_a1 = mulFTYPE(ftoFTYPE(-2.0), fx_cs);
-	fx_a2 = ftoFTYPE(1.0f) - fx_alpha;
 
-	ld->coef[0] = divFTYPE(fx_b0, fx_a0);
-	ld->coef[1] = divFTYPE(fx_b1, fx_a0);
-	ld->coef[2] = divFTYPE(fx_b2, fx_a0);
-	ld->coef[3] = divFTYPE(-fx_a1, fx_a0);
-	ld->coef[4] = divFTYPE(-fx_a2, fx_a0);
-#else
-	switch(ld->filter_type) {
-	case 0:
-	default:
-		b1 = 1.0f - cs;
-		b0 = b2 = b1 / 2.0f;
-		break;
-	case 1:
-		b1 = -(1.0f + cs);
-		b0 = b2 = -b1 / 2.0f;
-		break;
-	}
-	
-	a0 = 1.0f + alpha;
-	a1 = -2.0f * cs;
-	a2 = 1.0f - alpha;
-
-	ld->coef[0] = ftoFTYPE(b0 / a0);
-	ld->coef[1] = ftoFTYPE(b1 / a0);
-	ld->coef[2] = ftoFTYPE(b2 / a0);
-	ld->coef[3] = ftoFTYPE(-a1 / a0);
-	ld->coef[4] = ftoFTYPE(-a2 / a0);
-#endif
+	// alpha = sin(omega) / resonance
+	biquadFilterSet(&(ld->filter),
+			ld->filter_type == 1 ? BIQUAD_HIGHPASS : BIQUAD_LOWPASS,
+			frequency, ld->resonance / 2.0f, (int)ld->freq, ramp);
 }
 
 void *init(MachineTable *mt, const char *name) {
@@ -152,7 +90,8 @@ void *init(MachineTable *mt, const char *name) {
 	data->resonance = 2.0;
 	data->freq = 44100.0;
 	data->filter_type = 0;
-	calc_filter(data);
+	biquadFilterInit(&(data->filter), 2);
+	calc_filter(data, 0);
 	
 	/* return pointer to instance data */
 	return (void *)data;
@@ -217,15 +156,18 @@ void execute(MachineTable *mt, void *data) {
 	
 	ld->freq = (float)mt->get_signal_frequency(os);
 
-	int c;
 	int i;
 	int new_valu = -1;
-	FTYPE d, tmp;
 
-	calc_filter(ld);
+	// interpolate to the new settings over this buffer
+	calc_filter(ld, ol);
+
+	if(ic == 2 && oc == 2) {
+		biquadFilterProcess(&(ld->filter), in, ou, ol);
+	}
 
-	for(i = 0; i < ol; i++) {		
-		if(midi != NULL && midi[i] != NULL) {
+	for(i = 0; midi != NULL && i < ol; i++) {
+		if(midi[i] != NULL) {
 			MidiEvent *mev = (MidiEvent *)midi[i];
 
 			if(
@@ -238,24 +180,6 @@ void execute(MachineTable *mt, void *data) {
 				new_valu = mev->data[2];				
 			}
 		}
-
-		for(c = 0; c < oc; c++) {
-			d = in[i * ic + c];
-
-			tmp =
-				mulFTYPE(ld->coef[0], d) +
-				mulFTYPE(ld->coef[1], ld->hist_x[c * 2]) +
-				mulFTYPE(ld->coef[2], ld->hist_x[c * 2 + 1]) +
-				mulFTYPE(ld->coef[3], ld->hist_y[c * 2]) +
-				mulFTYPE(ld->coef[4], ld->hist_y[c * 2 + 1]);
-
-			ld->hist_y[c * 2 + 1] = ld->hist_y[c * 2];
-			ld->hist_y[c * 2] = tmp;
-			ld->hist_x[c * 2 + 1] = ld->hist_x[c * 2];
-			ld->hist_x[c * 2] = d;
-
-			ou[i * oc + c] = tmp;
-		}
 	}
 	if(new_valu != -1) {
 		ld->cutoff =
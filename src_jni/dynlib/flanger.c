@@ -151,6 +151,12 @@ void execute(MachineTable *mt, void *data) {
 	int i;
 
 #ifdef __SATAN_USES_FLOATS
+	// restored after execute(), in case we are compiled together with other code
+#pragma push_macro("ftofp16p16")
+#pragma push_macro("itofp16p16")
+#pragma push_macro("fp16p16_t")
+#pragma push_macro("fp16p16toi")
+#pragma push_macro("mulfp16p16")
 #undef ftofp16p16
 #undef itofp16p16
 #undef fp16p16_t
@@ -224,3 +230,11 @@ void execute(MachineTable *mt, void *data) {
 	}	
 }
 
+#ifdef __SATAN_USES_FLOATS
+#pragma pop_macro("ftofp16p16")
+#pragma pop_macro("itofp16p16")
+#pragma pop_macro("fp16p16_t")
+#pragma pop_macro("fp16p16toi")
+#pragma pop_macro("mulfp16p16")
+#endif
+
@@ -35,9 +35,6 @@
 //#define __DO_DYNLIB_DEBUG
 #include "dynlib_debug.h"
 
-// this define forces grooveiator to do additional calculations in fixed point mode that are otherwise still floating.
-#define FILTER_USING_FIXED_POINT
-
 #include "dynlib.h"
 
 #include <math.h>
@@ -49,51 +46,39 @@
 
 #define GROOVEIATOR_CHANNEL 0
 #define POLYPHONY 6
+#define GROOVEIATOR_NR_GROUPS LVB_GROUPS(POLYPHONY)
+#define SAMPLES_PER_FILTER_UPDATE 1024
 
 USE_SATANS_MATH
 
+#include "libvoicebank.c"
+
 typedef enum Resolution _Resolution;
 
-typedef struct note_struct {
-	int active; /* !0 == active, 0 == inactive */
-	int note; /* midi note */
-	int note_on; // boolean value. This is used to make sure we only care for the FIRST received note off
-
-	int period_A, period_B;
-
-	// Amplitude
-	int amp_phase;
-	FTYPE amplitude; /* 0<1 */
-	int amp_attack_steps;
-	FTYPE amp_attack_step;
-	int amp_hold_steps;
-	int amp_decay_steps;
-	FTYPE amp_decay_step;
-	int amp_release_steps;
-	FTYPE amp_release_step;
-	
-	// Filter
-	int fil_phase;
-	FTYPE filter;
-	int fil_attack_steps;
-	FTYPE fil_attack_step;
-	int fil_hold_steps;
-	int fil_decay_steps;
-	FTYPE fil_decay_step;
-	int fil_release_steps;
-	FTYPE fil_release_step;
-
-	FTYPE hist_x[2];
-	FTYPE hist_y[2];
-	FTYPE coef[5];
-	
-	int t;
-} note_t;
+// the state of all voices, one lane per voice
+typedef struct grooveiator_voice_bank {
+	lvb_osc_bank_t osc_A;
+	lvb_osc_bank_t osc_B;
+
+	lvb_biquad_bank_t lpf;
+
+	lvb_env_bank_t amp;
+	lvb_env_bank_t fil;
+
+	lvb_lanes_t velocity;
+} grooveiatorVoiceBank_t;
 
 typedef struct grooveiator_instance {
 	int midi_channel;
 	float volume;
-	note_t note[POLYPHONY]; // POLYPHONY concurrent tones
+
+	grooveiatorVoiceBank_t *voice; // POLYPHONY concurrent tones
+	int note[POLYPHONY]; /* midi note of each voice */
+	int note_on[POLYPHONY]; // boolean value. This is used to make sure we only care for the FIRST received note off
+
+	int filter_recalc_step;
+	unsigned int filter_recalc_pending; // voices triggered since the last sample, one bit per voice
+
 	int program; // current program, use in the future?
 
 	int enable_filter; 
@@ -112,15 +97,8 @@ typedef struct grooveiator_instance {
 
 float note_table[257]; // freqency table for standard MIDI notes, 257 is because we need a "spare" when calculating centi-notes
 
-inline void calc_filter(grooveiator_t *ld, note_t *coef) {
-	float alpha, omega, sn, cs;
-
-#ifdef FILTER_USING_FIXED_POINT
-	FTYPE fx_b0, fx_b1, fx_b2, fx_a0, fx_a1, fx_a2, fx_alpha, fx_cs;;
-#else
-	float a0, a1, a2, b0, b1, b2;
-#endif
-	
+// filter is the filter envelope of the voices in lane group g
+inline void calc_filter(grooveiator_t *ld, int g, lvb_vf filter) {
 	// These limits the cutoff frequency and resonance to
 	// reasoneable values.
 	if (ld->cutoff < 4.0f) { ld->cutoff = 4.0f; };
@@ -128,52 +106,43 @@ inline void calc_filter(grooveiator_t *ld, note_t *coef) {
 	if (ld->resonance < 1.0f) { ld->resonance = 1.0f; };
 	if (ld->resonance > 127.0f) { ld->resonance = 127.0f; };
 
-	omega = (500.0f + (FTYPEtof(coef->filter) * ld->cutoff)) / ld->freq;
+	lvb_vf cutoff =
+		(lvb_splat(500.0f) + filter * lvb_splat(ld->cutoff)) * lvb_splat(1.0f / ld->freq);
 
-//	omega = (0.5 + 0.5 * SAT_SIN_SCALAR(
-//		(coef->t % 11000) / 11000.0))  * ld->cutoff / ld->freq;
+	// alpha = sin(omega) / resonance
+	lvb_biquad_set_group(&(ld->voice->lpf), g, LVB_LOWPASS, cutoff, 1.0f - 1.0f / ld->resonance);
+}
 
-//	omega = ld->cutoff / ld->freq;
-	sn = SAT_SIN_SCALAR(omega);
-	cs = SAT_COS_SCALAR(omega);
+// the basic waveforms, t is the phase from 0 to 1 and dt, dt_i come from lvb_blep_dt()
+static inline lvb_vf wave_shape(int wave, lvb_vf t, lvb_vf dt, lvb_vf dt_i) {
+	switch(wave) {
+	case 0:
+		return lvb_blep_saw(t, dt, dt_i);
+	case 1:
+		return lvb_sin_cycles(t);
+	case 2:
+		return lvb_blep_pulse(t, dt, dt_i, lvb_splat(0.5f));
+	}
+	return lvb_splat(0.0f);
+}
 
-	alpha = sn / ld->resonance;
+// the waveforms are the fundamental minus half of the second harmonic,
+// except for wave 3 which is half a cosine period
+static inline lvb_vf wave_sample(int wave, lvb_osc_bank_t *osc, int g) {
+	if(wave == 3)
+		return lvb_osc_sawsmooth(osc, g);
 
-	if(alpha < 0.0f) {
-		alpha = 0.0; // if alpha is < 0.0 we will get bad sounds...
-	}
+	lvb_vf t = osc->t.v[g];
+	lvb_vf t2 = t + t;
+	t2 = t2 - lvb_floor(t2);
 
+	// the second harmonic advances twice as fast, so its inverse is half as large
+	lvb_vf dt_i, dt2_i;
+	lvb_vf dt = lvb_blep_dt(osc->dt.v[g], &dt_i);
+	lvb_vf dt2 = lvb_min(dt + dt, lvb_splat(0.5f));
+	dt2_i = lvb_max(lvb_splat(0.5f) * dt_i, lvb_splat(2.0f));
 
-#ifdef FILTER_USING_FIXED_POINT
-	fx_cs = ftoFTYPE(cs);
-	fx_alpha = ftoFTYPE(alpha);
-	
-	fx_b1 = ftoFTYPE(1.0f) - fx_cs;
-	fx_b0 = fx_b2 = divFTYPE(fx_b1, ftoFTYPE(2.0f));
-
-	fx_a0 = ftoFTYPE(1.0f) + fx_alpha;
-	fx_a1 = mulFTYPE(ftoFTYPE(-2.0), fx_cs);
-	fx_a2 = ftoFTYPE(1.0f) - fx_alpha;
-
-	coef->coef[0] = divFTYPE(fx_b0, fx_a0);
-	coef->coef[1] = divFTYPE(fx_b1, fx_a0);
-	coef->coef[2] = divFTYPE(fx_b2, fx_a0);
-	coef->coef[3] = divFTYPE(-fx_a1, fx_a0);
-	coef->coef[4] = divFTYPE(-fx_a2, fx_a0);
-#else
-	b1 = 1.0f - cs;
-	b0 = b2 = b1 / 2.0f;
-
-	a0 = 1.0f + alpha;
-	a1 = -2.0f * cs;
-	a2 = 1.0f - alpha;
-
-	coef->coef[0] = ftoFTYPE(b0 / a0);
-	coef->coef[1] = ftoFTYPE(b1 / a0);
-	coef->coef[2] = ftoFTYPE(b2 / a0);
-	coef->coef[3] = ftoFTYPE(-a1 / a0);
-	coef->coef[4] = ftoFTYPE(-a2 / a0);
-#endif
+	return wave_shape(wave, t, dt, dt_i) - lvb_splat(0.5f) * wave_shape(wave, t2, dt2, dt2_i);
 }
 
 void *init(MachineTable *mt, const char *name) {
@@ -184,6 +153,12 @@ void *init(MachineTable *mt, const char *name) {
 	
 	memset(grooveiator, 0, sizeof(grooveiator_t));
 
+	grooveiator->voice = (grooveiatorVoiceBank_t *)lvb_alloc(sizeof(grooveiatorVoiceBank_t));
+	if(grooveiator->voice == NULL) {
+		free(grooveiator);
+		return NULL;
+	}
+
 	grooveiator->midi_channel = GROOVEIATOR_CHANNEL;
 	grooveiator->volume = 0.35;
 
@@ -270,14 +245,15 @@ void reset(MachineTable *mt, void *void_grooveiator) {
 	grooveiator_t *grooveiator = (grooveiator_t *)void_grooveiator;
 	int n_k;
 	for(n_k = 0; n_k < POLYPHONY; n_k++) {
-		note_t *n = &(grooveiator->note[n_k]);
-		n->active = 0;
+		lvb_env_reset(&(grooveiator->voice->amp), n_k);
+		lvb_env_reset(&(grooveiator->voice->fil), n_k);
+		grooveiator->note_on[n_k] = 0;
 	}
 }
 
-#define SAMPLES_PER_FILTER_UPDATE (1024 - 1)
 void execute(MachineTable *mt, void *void_grooveiator) {
 	grooveiator_t *grooveiator = (grooveiator_t *)void_grooveiator;
+	grooveiatorVoiceBank_t *v = grooveiator->voice;
 
 	SignalPointer *outsig = NULL;
 	SignalPointer *insig = NULL;
@@ -305,8 +281,10 @@ void execute(MachineTable *mt, void *void_grooveiator) {
 	float Fs = (float)mt->get_signal_frequency(outsig);
 	grooveiator->freq = Fs;
 
-	FTYPE volume = ftoFTYPE(grooveiator->volume);
-	FTYPE wave_mix = ftoFTYPE(grooveiator->wave_mix);
+	// the voices are processed in float, also when FTYPE is fixed point
+	lvb_vf gain_A = lvb_splat(grooveiator->volume * (1.0f - grooveiator->wave_mix));
+	lvb_vf gain_B = lvb_splat(grooveiator->volume * grooveiator->wave_mix);
+	lvb_vf zero = lvb_splat(0.0f);
 
 	int t, n_k;
 
@@ -356,65 +334,47 @@ void execute(MachineTable *mt, void *void_grooveiator) {
 			int note = mev->data[1];
 			float velocity = (float)(mev->data[2]);
 			for(n_k = 0; n_k < POLYPHONY; n_k++) {
-				if(!(grooveiator->note[n_k].active)) {
-					note_t *n = &(grooveiator->note[n_k]);
+				if(!(v->amp.active & (1 << n_k))) {
+					float frequency_A = note_table[note] / Fs;
 
-					n->active = 1;
-					n->t = 0;
-					n->note = note;
-					n->note_on = 1;
-
-					n->period_A = (int)(Fs / (float)(note_table[note]));
 					int t_note = note + grooveiator->wave_transpose;
-					n->period_B = (int)(Fs / (float)(note_table[t_note] +
-									 grooveiator->wave_detune *
-									 ((note_table[t_note+1] - note_table[t_note])/100.0)
-								    ));
+					if(t_note < 0) t_note = 0;
+					if(t_note > 255) t_note = 255;
+					float frequency_B = (note_table[t_note] +
+							     grooveiator->wave_detune *
+							     ((note_table[t_note+1] - note_table[t_note])/100.0)
+						) / Fs;
 
 					// just make sure we don't hit notes we can't possibly play...
-					if(n->period_A == 0 ||
-					   n->period_B == 0) {
-						n->active = 0;
+					if(frequency_A >= 1.0f || frequency_B >= 1.0f) {
 						DYNLIB_DEBUG("note %d out of playable range!\n", note);
+						break;
 					}
-					
+
+					grooveiator->note[n_k] = note;
+					grooveiator->note_on[n_k] = 1;
+					v->velocity.f[n_k] = velocity / 127.0f;
+
+					lvb_osc_set_frequency(&(v->osc_A), n_k, frequency_A);
+					lvb_osc_set_frequency(&(v->osc_B), n_k, frequency_B);
+					lvb_osc_reset(&(v->osc_A), n_k);
+					lvb_osc_reset(&(v->osc_B), n_k);
+
 					// amplitude stuff
-					n->amp_phase = 0;
-					n->amplitude = ftoFTYPE(0.0);
-					n->amp_attack_steps = 1 +
-						(int)((float)grooveiator->amp_attack * (float)Fs);
-					n->amp_attack_step =
-						ftoFTYPE((velocity / 127.0) /
-							  n->amp_attack_steps);
-					n->amp_hold_steps = 1 +
-						(int)((float)grooveiator->amp_hold * (float)Fs);
-					n->amp_decay_steps = 1 +
-						(int)((float)grooveiator->amp_decay * (float)Fs);
-					n->amp_decay_step =
-						ftoFTYPE((1.0 - grooveiator->amp_sustain) *
-							  (velocity / 127.0) /
-							  n->amp_decay_steps);
+					lvb_env_trigger(&(v->amp), n_k, (int)Fs,
+							grooveiator->amp_attack, grooveiator->amp_hold,
+							grooveiator->amp_decay, grooveiator->amp_sustain,
+							grooveiator->amp_release);
 
 					// filter stuff
-					n->fil_phase = 0;
-					n->filter = ftoFTYPE(0.0);
-					n->fil_attack_steps = 1 +
-						(int)((float)grooveiator->fil_attack * (float)Fs);
-					n->fil_attack_step =
-						ftoFTYPE((velocity / 127.0) /
-							  n->fil_attack_steps);
-					n->fil_hold_steps = 1 +
-						(int)((float)grooveiator->fil_hold * (float)Fs);
-					n->fil_decay_steps = 1 +
-						(int)((float)grooveiator->fil_decay * (float)Fs);
-					n->fil_decay_step = 
-						ftoFTYPE((1.0 - grooveiator->fil_sustain) *
-						(velocity / 127.0) /
-						n->fil_decay_steps);
-					n->hist_x[0] = itoFTYPE(0);
-					n->hist_x[1] = itoFTYPE(0);
-					n->hist_y[0] = itoFTYPE(0);
-					n->hist_y[1] = itoFTYPE(0);
+					lvb_env_trigger(&(v->fil), n_k, (int)Fs,
+							grooveiator->fil_attack, grooveiator->fil_hold,
+							grooveiator->fil_decay, grooveiator->fil_sustain,
+							grooveiator->fil_release);
+					lvb_biquad_reset(&(v->lpf), n_k);
+
+					// don't wait for the next update to set up the filter
+					grooveiator->filter_recalc_pending |= 1 << n_k;
 
 					break;
 				}
@@ -431,217 +391,81 @@ void execute(MachineTable *mt, void *void_grooveiator) {
 			float velocity = (float)(mev->data[2]);
 			velocity = velocity / 127.0;
 			for(n_k = 0; n_k < POLYPHONY; n_k++) {
-				if((grooveiator->note[n_k].active) &&
-				   (grooveiator->note[n_k].note == note) &&
-				   (grooveiator->note[n_k].note_on)) {
-					note_t *n = &(grooveiator->note[n_k]);
-
-					n->note_on = 0;
-					n->amp_phase = 4;
-					n->amp_release_steps = 1 +
-						grooveiator->amp_release * Fs / (velocity + 1.0);
-					n->amp_release_step =
-						ftoFTYPE(FTYPEtof(n->amplitude) /
-							  (float)(n->amp_release_steps));
-
-					n->fil_phase = 4;
-					n->fil_release_steps = 1 +
-						grooveiator->fil_release * Fs / (velocity + 1.0);
-					n->fil_release_step =
-						ftoFTYPE(FTYPEtof(n->filter) /
-							  (float)(n->fil_release_steps));
+				if((v->amp.active & (1 << n_k)) &&
+				   (grooveiator->note[n_k] == note) &&
+				   (grooveiator->note_on[n_k])) {
+					grooveiator->note_on[n_k] = 0;
+
+					// harder note offs give shorter releases
+					lvb_env_set_release(&(v->amp), n_k, (int)Fs,
+							    grooveiator->amp_release / (velocity + 1.0f));
+					lvb_env_release(&(v->amp), n_k);
+
+					lvb_env_set_release(&(v->fil), n_k, (int)Fs,
+							    grooveiator->fil_release / (velocity + 1.0f));
+					lvb_env_release(&(v->fil), n_k);
 					break;
 				}
 			}
 		}
 
-		/* zero out */
-		out[t] = itoFTYPE(0);
+		float output = 0.0f;
+		int recalc = grooveiator->filter_recalc_step == 0;
 
-#ifdef __SATAN_USES_FXP
-		// << 8 is to convert fp16p16 to fp8p24
-#define SAW(r,x,f) r = (( divfp16p16( itofp16p16(((x)%(f))<<1), itofp16p16(f)) - itofp16p16(1) ) << 8)
-#else
-		int saw_tempura;
-#define SAW(r,x,f) { saw_tempura = x % f; r = (2.0f * ((float)saw_tempura / (float)f) - 1.0f); }
-#endif
+		/* process active notes, LVB_LANES at a time */
+		int g;
+		for(g = 0; g < GROOVEIATOR_NR_GROUPS; g++) {
+			unsigned int bits = LVB_GROUP_BITS(v->amp.active, g);
 
-#define SIN(x,f) ftoFTYPE(SAT_SIN_SCALAR(((x)%(f))/(float)(f)))
-#define SQR(x,f) ((((x)%(f)) > (f>>1)) ? ftoFTYPE(-1.0) : ftoFTYPE(1.0))
-#define COSHALF(x,f) ftoFTYPE(SAT_COS_SCALAR(((x)%(f))/(float)(2*f)))
-		
-		/* process active notes */
-		for(n_k = 0; n_k < POLYPHONY; n_k++) {
-			note_t *n = &(grooveiator->note[n_k]);
-			if(n->active) {
-				{ /* amplitude parameters */
-					switch(n->amp_phase) {
-					case 0: // attack phase
-						n->amplitude +=
-							n->amp_attack_step;
-						n->amp_attack_steps--;
-						if(n->amp_attack_steps < 0) {
-							n->amp_phase++;
-						}
-						break;
-					case 1: // hold phase
-						n->amp_hold_steps--;
-						if(n->amp_hold_steps < 0) {
-							n->amp_phase++;
-						}
-						break;
-					case 2: // decay phase
-						n->amplitude -=
-							n->amp_decay_step;
-						n->amp_decay_steps--;
-						if(n->amp_decay_steps < 0) {
-							n->amp_phase++;
-						}
-						break;
-					case 3: // sustain  phase
-						/* hold here until a NOTE_OFF message arrives */
-						break;
-					case 4: // release  phase
-						n->amplitude -=
-							n->amp_release_step;
-						if(n->amplitude < itoFTYPE(0)) {
-							n->amp_release_step = 0;
-							n->amp_release_steps = 0;
-						}
-						
-						n->amp_release_steps--;
-						if(n->amp_release_steps < 0) {
-							n->amplitude = itoFTYPE(0);
-							n->active = 0;
-						}
-						break;
-					}
-				}
-				
-				{ /* filter amplitude parameters */
-					switch(n->fil_phase) {
-					case 0: // attack phase
-						n->filter +=
-							n->fil_attack_step;
-						n->fil_attack_steps--;
-						if(n->fil_attack_steps < 0)
-							n->fil_phase++;
-						break;
-					case 1: // hold phase
-						n->fil_hold_steps--;
-						if(n->fil_hold_steps < 0)
-							n->fil_phase++;
-						break;
-					case 2: // decay phase
-						n->filter -=
-							n->fil_decay_step;
-						n->fil_decay_steps--;
-						if(n->fil_decay_steps < 0)
-							n->fil_phase++;
-						break;
-					case 3: // sustain  phase
-						/* hold here until a NOTE_OFF message arrives */
-						break;
-					case 4: // release  phase
-						if(n->filter > itoFTYPE(0) && n->fil_release_steps > 0) {
-							n->filter -=
-								n->fil_release_step;
-							n->fil_release_steps--;
-						}
-						if(n->filter < itoFTYPE(0))
-							n->filter = itoFTYPE(0);
-						
-						break;
-					}
-				}
+			// skip the group if all voices are idle
+			if(!bits)
+				continue;
 
-				if(((n->t & SAMPLES_PER_FILTER_UPDATE) == 0) && (grooveiator->enable_filter)) {
-					calc_filter(grooveiator, n);
-				}
+			lvb_vi mask = lvb_lane_mask(bits);
 
-				{ /* signal generation and filtration */
-					FTYPE filter_tmp;
-					float tempura2 = 0;
-					int tempura1;
-					FTYPE valX = itoFTYPE(0), valY = itoFTYPE(0), val;
+			lvb_vf amplitude = lvb_env_sample(&(v->amp), g);
+			lvb_env_step(&(v->amp), g);
+			// the filter envelope is only read at the filter updates, so it isn't smoothed
+			lvb_vf filter = v->fil.amplitude.v[g];
+			lvb_env_step(&(v->fil), g);
 
-					switch(grooveiator->wave_A) {
-					case 0:
-						tempura1 = n->t + n->t % n->period_A;
-						SAW(tempura2,tempura1, n->period_A);
-						SAW(valX,n->t,n->period_A);
-						valX = valX - mulFTYPE(ftoFTYPE(0.5), tempura2);
+			/* signal generation and filtration */
+			lvb_vf valX = wave_sample(grooveiator->wave_A, &(v->osc_A), g);
+			lvb_vf valY = wave_sample(grooveiator->wave_B, &(v->osc_B), g);
+			lvb_osc_step(&(v->osc_A), g, NULL);
+			lvb_osc_step(&(v->osc_B), g, NULL);
 
-#ifdef THIS_IS_A_MOCKERY
-						int_out_a[t] = valX;
-#endif
-						break;
-					case 1:
-						valX = SIN(n->t,n->period_A) - mulFTYPE(ftoFTYPE(0.5),
-											 SIN (n->t + n->t % n->period_A, n->period_A));
-						break;
-					case 2:
-						valX = SQR(n->t,n->period_A) - mulFTYPE(ftoFTYPE(0.5),
-											 SQR (n->t + n->t % n->period_A, n->period_A));
+			lvb_vf val = (gain_A * valX + gain_B * valY) * amplitude * v->velocity.v[g];
 
-						break;
-					case 3:
-						valX = COSHALF(n->t,n->period_A);
-						break;
-					}
-					switch(grooveiator->wave_B) {
-					case 0:
-						tempura1 = n->t + n->t % n->period_A;
-						SAW(tempura2,tempura1, n->period_A);
-						SAW(valX,n->t,n->period_B);
-						valX = valX - mulFTYPE(ftoFTYPE(0.5), tempura2);
-						break;
-					case 1:
-						valY = SIN(n->t,n->period_B) - mulFTYPE(ftoFTYPE(0.5),
-											 SIN (n->t + n->t % n->period_B, n->period_B));
-						break;
-					case 2:
-						valY = SQR(n->t,n->period_B) - mulFTYPE(ftoFTYPE(0.5),
-											 SQR (n->t + n->t % n->period_B, n->period_B));
-						break;
-					case 3:
-						valY = COSHALF(n->t,n->period_B);
-						break;
-					}
-					
-					val = mulFTYPE(itoFTYPE(1) - wave_mix, valX) +
-						mulFTYPE(wave_mix, valY);
-					val = mulFTYPE(val, n->amplitude);
 #ifdef THIS_IS_A_MOCKERY
-					int_out_b[t] = valX * n->amplitude;
+			if(g == 0 && (bits & 1)) {
+				int_out_a[t] = ftoFTYPE(lvb_lane(valX, 0));
+				int_out_b[t] = ftoFTYPE(lvb_lane(valX * amplitude * v->velocity.v[0], 0));
+			}
 #endif
 
-					if(grooveiator->enable_filter) {
-						filter_tmp =
-							mulFTYPE(n->coef[0], val) +
-							mulFTYPE(n->coef[1], n->hist_x[0]) +
-							mulFTYPE(n->coef[2], n->hist_x[1]) +
-							mulFTYPE(n->coef[3], n->hist_y[0]) +
-							mulFTYPE(n->coef[4], n->hist_y[1]);
-						
-						n->hist_y[1] = n->hist_y[0];
-						n->hist_y[0] = filter_tmp;
-						n->hist_x[1] = n->hist_x[0];
-						n->hist_x[0] = val;
-					} else {
-						filter_tmp = val;
-					}
-					
-					out[t] += mulFTYPE(filter_tmp, volume);
-					
-					n->t++;
-				}
-			}	
+			// idle voices in the group are masked out
+			val = lvb_select(mask, val, zero);
+			if(grooveiator->enable_filter) {
+				if(recalc || LVB_GROUP_BITS(grooveiator->filter_recalc_pending, g))
+					calc_filter(grooveiator, g, filter * v->velocity.v[g]);
+				val = lvb_select(mask, lvb_biquad_put(&(v->lpf), g, val), zero);
+			}
+
+			output += lvb_sum(val);
 		}
+		grooveiator->filter_recalc_pending = 0;
+		grooveiator->filter_recalc_step =
+			(grooveiator->filter_recalc_step + 1) % SAMPLES_PER_FILTER_UPDATE;
+
+		out[t] = ftoFTYPE(output);
 	}
 }
 
 void delete(void *data) {
+	grooveiator_t *grooveiator = (grooveiator_t *)data;
+
 	/* free instance data here */
-	free(data);
+	if(grooveiator->voice) lvb_free(grooveiator->voice);
+	free(grooveiator);
 }
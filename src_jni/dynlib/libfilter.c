@@ -489,3 +489,531 @@ inline FTYPE xPassFilterMonoGet(xPassFilterMono_t *xpf) {
 void xPassFilterMonoFree(xPassFilterMono_t *xpf) {
 	free(xpf);
 }
+
+/*********************************************
+ *
+ *  biquad coefficient cache
+ *
+ *  Most filters are set to the same few parameters
+ *  every buffer, so the coefficients are kept in a small
+ *  direct mapped cache instead of calling sin/cos/tan each
+ *  time. Machines may execute on different threads, an entry
+ *  is therefore protected by a sequence number that is odd
+ *  while it is being written.
+ *
+ *********************************************/
+
+#define BIQUAD_CACHE_SIZE 64
+
+typedef struct biquadCacheEntry {
+	volatile int sequence;
+	int type, Fs;
+	float frequency, Q;
+	FTYPE coef[5];
+} biquadCacheEntry_t;
+
+static biquadCacheEntry_t __libfilter_biquad_cache[BIQUAD_CACHE_SIZE];
+
+static inline biquadCacheEntry_t *biquadCacheEntry(int type, float frequency, float Q, int Fs) {
+	union { float f; uint32_t u; } f, q;
+	uint32_t h;
+
+	f.f = frequency;
+	q.f = Q;
+
+	h = f.u * 2654435761u;
+	h ^= q.u * 2246822519u;
+	h ^= (uint32_t)Fs * 3266489917u;
+	h ^= (uint32_t)type;
+	h ^= h >> 16;
+
+	return &(__libfilter_biquad_cache[h & (BIQUAD_CACHE_SIZE - 1)]);
+}
+
+static int biquadCacheLookup(int type, float frequency, float Q, int Fs, FTYPE *coef) {
+	biquadCacheEntry_t *e = biquadCacheEntry(type, frequency, Q, Fs);
+	int sequence = e->sequence;
+	int hit;
+
+	if(sequence & 1)
+		return 0; // being written
+
+	__sync_synchronize();
+	hit = e->type == type && e->Fs == Fs && e->frequency == frequency && e->Q == Q;
+	if(hit)
+		memcpy(coef, e->coef, sizeof(e->coef));
+	__sync_synchronize();
+
+	// if the entry was changed while we read it we treat it as a miss
+	return hit && e->sequence == sequence;
+}
+
+static void biquadCacheStore(int type, float frequency, float Q, int Fs, const FTYPE *coef) {
+	biquadCacheEntry_t *e = biquadCacheEntry(type, frequency, Q, Fs);
+	int sequence = e->sequence;
+
+	// if someone else is writing the entry we just skip it
+	if((sequence & 1) ||
+	   !__sync_bool_compare_and_swap(&(e->sequence), sequence, sequence + 1))
+		return;
+
+	e->type = type;
+	e->Fs = Fs;
+	e->frequency = frequency;
+	e->Q = Q;
+	memcpy(e->coef, coef, sizeof(e->coef));
+
+	__sync_synchronize();
+	e->sequence = sequence + 2;
+}
+
+/*********************************************
+ *
+ *  biquad filter class
+ *
+ *********************************************/
+
+static void biquadFilterCalc(int type, float frequency, float Q, int Fs, FTYPE *coef) {
+	float omega, alpha, cs;
+	float b0, b1, b2, a0, a1, a2;
+
+	// These limits the frequency and Q to reasonable values.
+	if(frequency < 0.0f) frequency = 0.0f;
+	if(frequency > 0.5f * Fs) frequency = 0.5f * Fs;
+	if(Q < 0.01f) Q = 0.01f;
+
+	omega = 2.0f * M_PI * frequency / (float)Fs;
+	cs = cosf(omega);
+
+	switch(type) {
+	case BIQUAD_BANDPASS:
+	{
+		// same design as bandPassFilterMonoRecalc()
+		float beta = tanf(omega / (2.0f * Q));
+		beta = 0.5f * ((1.0f - beta) / (1.0f + beta));
+
+		float ypsilon = (0.5f + beta) * cs;
+		alpha = (0.5f - beta) / 2.0f;
+
+		coef[0] = ftoFTYPE(2.0f * alpha);
+		coef[1] = ftoFTYPE(0.0f);
+		coef[2] = ftoFTYPE(-2.0f * alpha);
+		coef[3] = ftoFTYPE(2.0f * ypsilon);
+		coef[4] = ftoFTYPE(-2.0f * beta);
+	}
+		return;
+
+	case BIQUAD_HIGHPASS:
+		b1 = -(1.0f + cs);
+		b0 = b2 = -(b1 / 2.0f);
+		break;
+
+	case BIQUAD_LOWPASS:
+	default:
+		b1 = 1.0f - cs;
+		b0 = b2 = b1 / 2.0f;
+		break;
+	}
+
+	alpha = sinf(omega) / (2.0f * Q);
+	if(alpha < 0.0f)
+		alpha = 0.0f; // if alpha is < 0.0 we will get bad sounds...
+
+	a0 = 1.0f + alpha;
+	a1 = -2.0f * cs;
+	a2 = 1.0f - alpha;
+
+	coef[0] = ftoFTYPE(b0 / a0);
+	coef[1] = ftoFTYPE(b1 / a0);
+	coef[2] = ftoFTYPE(b2 / a0);
+	coef[3] = ftoFTYPE(-a1 / a0);
+	coef[4] = ftoFTYPE(-a2 / a0);
+}
+
+void biquadFilterInit(biquadFilter_t *bq, int channels) {
+	memset(bq, 0, sizeof(biquadFilter_t));
+
+	if(channels < 1) channels = 1;
+	if(channels > BIQUAD_MAX_CHANNELS) channels = BIQUAD_MAX_CHANNELS;
+	bq->channels = channels;
+}
+
+biquadFilter_t *create_biquadFilter(MachineTable *mt, int channels) {
+	biquadFilter_t *r = (biquadFilter_t *)malloc(sizeof(biquadFilter_t));
+
+	if(r != NULL) {
+		biquadFilterInit(r, channels);
+	}
+
+	return r;
+}
+
+void biquadFilterFree(biquadFilter_t *bq) {
+	free(bq);
+}
+
+void biquadFilterSetCoefficients(biquadFilter_t *bq, const FTYPE *coef, int ramp) {
+	int k;
+
+	if(ramp <= 0 || memcmp(coef, bq->coef, sizeof(bq->coef)) == 0) {
+		memcpy(bq->coef, coef, sizeof(bq->coef));
+		memcpy(bq->target, coef, sizeof(bq->target));
+		bq->ramp_left = 0;
+		return;
+	}
+
+	for(k = 0; k < 5; k++) {
+		bq->target[k] = coef[k];
+		bq->delta[k] = (coef[k] - bq->coef[k]) / ramp;
+	}
+	bq->ramp_left = ramp;
+}
+
+void biquadFilterSet(biquadFilter_t *bq, int type, float frequency, float Q, int Fs, int ramp) {
+	FTYPE coef[5];
+
+	if(!biquadCacheLookup(type, frequency, Q, Fs, coef)) {
+		biquadFilterCalc(type, frequency, Q, Fs, coef);
+		biquadCacheStore(type, frequency, Q, Fs, coef);
+	}
+
+	biquadFilterSetCoefficients(bq, coef, ramp);
+}
+
+void biquadFilterReset(biquadFilter_t *bq) {
+	memset(bq->state, 0, sizeof(bq->state));
+}
+
+#ifdef __SATAN_USES_FXP
+// The transposed form adds too much rounding noise to narrow
+// low frequency bands in fixed point, so there we use direct form I
+// and accumulate in 64 bits, rounding once per output sample.
+#define BIQUAD_KERNEL(x, y, s) {					\
+		int64_t acc =						\
+			(int64_t)b0 * x +				\
+			(int64_t)b1 * s[0] +				\
+			(int64_t)b2 * s[1] +				\
+			(int64_t)a1 * s[2] +				\
+			(int64_t)a2 * s[3];				\
+		y = (FTYPE)((acc + (1 << 23)) >> 24);			\
+		s[1] = s[0]; s[0] = x;					\
+		s[3] = s[2]; s[2] = y;					\
+	}
+
+// bandpass filters have b1 = 0 and b2 = -b0, saving two multiplications
+#define BIQUAD_BANDPASS_KERNEL(x, y, s) {				\
+		int64_t acc =						\
+			(int64_t)b0 * (x - s[1]) +			\
+			(int64_t)a1 * s[2] +				\
+			(int64_t)a2 * s[3];				\
+		y = (FTYPE)((acc + (1 << 23)) >> 24);			\
+		s[1] = s[0]; s[0] = x;					\
+		s[3] = s[2]; s[2] = y;					\
+	}
+#else
+// A state decaying in silence would otherwise end up as denormals,
+// which are very slow on most CPUs. The tiny offset keeps it away from them.
+#define BIQUAD_ANTI_DENORMAL 1e-20f
+
+#define BIQUAD_KERNEL(x, y, s) {					\
+		y = b0 * x + s[0];					\
+		s[0] = b1 * x + a1 * y + s[1];				\
+		s[1] = b2 * x + a2 * y + BIQUAD_ANTI_DENORMAL;		\
+	}
+
+// bandpass filters have b1 = 0 and b2 = -b0, saving two multiplications
+#define BIQUAD_BANDPASS_KERNEL(x, y, s) {				\
+		FTYPE bx = b0 * x;					\
+		y = bx + s[0];						\
+		s[0] = a1 * y + s[1];					\
+		s[1] = a2 * y - bx + BIQUAD_ANTI_DENORMAL;		\
+	}
+#endif
+
+inline FTYPE biquadFilterPut(biquadFilter_t *bq, FTYPE x) {
+	FTYPE b0, b1, b2, a1, a2;
+	FTYPE y;
+
+	if(bq->ramp_left > 0) {
+		int k;
+
+		if(--(bq->ramp_left) == 0) {
+			memcpy(bq->coef, bq->target, sizeof(bq->coef));
+		} else {
+			for(k = 0; k < 5; k++)
+				bq->coef[k] += bq->delta[k];
+		}
+	}
+
+	b0 = bq->coef[0]; b1 = bq->coef[1]; b2 = bq->coef[2];
+	a1 = bq->coef[3]; a2 = bq->coef[4];
+	BIQUAD_KERNEL(x, y, bq->state[0]);
+
+	return y;
+}
+
+#define BIQUAD_OUTPUT(o, y) {				\
+		if(mix) o += mulFTYPE(gain, y);		\
+		else o = y;				\
+	}
+
+#define BIQUAD_RAMP_STEP {					\
+		b0 += d_b0; b1 += d_b1; b2 += d_b2;		\
+		a1 += d_a1; a2 += d_a2;				\
+	}
+
+#define BIQUAD_NO_STEP
+
+// the channel count is checked outside the loop
+#define BIQUAD_LOOP(from, to, STEP, KERNEL) {					\
+		FTYPE x, y;						\
+		if(channels == 1) {					\
+			for(i = from; i < to; i++) {			\
+				STEP;					\
+				x = in[i];				\
+				KERNEL(x, y, s_l);			\
+				BIQUAD_OUTPUT(out[i], y);		\
+			}						\
+		} else {						\
+			for(i = from; i < to; i++) {			\
+				STEP;					\
+				x = in[2 * i];				\
+				KERNEL(x, y, s_l);			\
+				BIQUAD_OUTPUT(out[2 * i], y);		\
+				x = in[2 * i + 1];			\
+				KERNEL(x, y, s_r);			\
+				BIQUAD_OUTPUT(out[2 * i + 1], y);	\
+			}						\
+		}							\
+	}
+
+// The coefficients and state are kept in locals, which lets the
+// compiler keep them in registers over the whole block. This is a
+// macro so that mix is a constant in each of the loops.
+#define BIQUAD_RUN(bq, in, out, samples, MIX) {				\
+		const int mix = MIX;					\
+		int channels = bq->channels;				\
+		FTYPE b0 = bq->coef[0], b1 = bq->coef[1], b2 = bq->coef[2]; \
+		FTYPE a1 = bq->coef[3], a2 = bq->coef[4];		\
+		FTYPE s_l[4], s_r[4];					\
+		int ramp = bq->ramp_left < samples ? bq->ramp_left : samples; \
+		int i;							\
+									\
+		memcpy(s_l, bq->state[0], sizeof(s_l));		\
+		memcpy(s_r, bq->state[1], sizeof(s_r));		\
+									\
+		if(ramp > 0) {						\
+			FTYPE d_b0 = bq->delta[0], d_b1 = bq->delta[1], d_b2 = bq->delta[2]; \
+			FTYPE d_a1 = bq->delta[3], d_a2 = bq->delta[4]; \
+									\
+			BIQUAD_LOOP(0, ramp, BIQUAD_RAMP_STEP, BIQUAD_KERNEL); \
+									\
+			bq->ramp_left -= ramp;				\
+			if(bq->ramp_left == 0) {			\
+				b0 = bq->target[0]; b1 = bq->target[1]; b2 = bq->target[2]; \
+				a1 = bq->target[3]; a2 = bq->target[4]; \
+			}						\
+		}							\
+									\
+		if(b1 == 0 && b2 == -b0) {				\
+			BIQUAD_LOOP(ramp, samples, BIQUAD_NO_STEP, BIQUAD_BANDPASS_KERNEL); \
+		} else {						\
+			BIQUAD_LOOP(ramp, samples, BIQUAD_NO_STEP, BIQUAD_KERNEL); \
+		}							\
+									\
+		bq->coef[0] = b0; bq->coef[1] = b1; bq->coef[2] = b2;	\
+		bq->coef[3] = a1; bq->coef[4] = a2;			\
+									\
+		memcpy(bq->state[0], s_l, sizeof(s_l));			\
+		memcpy(bq->state[1], s_r, sizeof(s_r));			\
+	}
+
+void biquadFilterProcess(biquadFilter_t *bq, const FTYPE *in, FTYPE *out, int samples) {
+	FTYPE gain = itoFTYPE(1);
+	BIQUAD_RUN(bq, in, out, samples, 0);
+}
+
+void biquadFilterMix(biquadFilter_t *bq, const FTYPE *in, FTYPE *out, int samples, FTYPE gain) {
+	BIQUAD_RUN(bq, in, out, samples, 1);
+}
+
+/*********************************************
+ *
+ *  feedback delay network class
+ *
+ *********************************************/
+
+static int fdnNextPrime(int n) {
+	int k;
+
+	if(n <= 2) return 2;
+	if((n & 1) == 0) n++;
+
+	for(;; n += 2) {
+		for(k = 3; k * k <= n; k += 2)
+			if(n % k == 0) break;
+		if(k * k > n) return n;
+	}
+}
+
+fdnReverb_t *create_fdnReverb(const float *delay_ms, int Fs) {
+	fdnReverb_t *fdn;
+	int k, total = 0;
+
+	fdn = (fdnReverb_t *)malloc(sizeof(fdnReverb_t));
+	if(fdn == NULL)
+		return NULL;
+	memset(fdn, 0, sizeof(fdnReverb_t));
+
+	fdn->Fs = Fs;
+	fdn->block = FDN_BLOCK;
+
+	// mutually prime lengths keep the echoes from piling up on the same samples
+	for(k = 0; k < FDN_LINES; k++) {
+		fdn->length[k] = fdnNextPrime((int)(delay_ms[k] * (float)Fs / 1000.0f));
+		if(fdn->length[k] < fdn->block) fdn->block = fdn->length[k];
+		total += fdn->length[k];
+	}
+
+	fdn->arena = (FTYPE *)malloc(sizeof(FTYPE) * total);
+	if(fdn->arena == NULL) {
+		free(fdn);
+		return NULL;
+	}
+
+	total = 0;
+	for(k = 0; k < FDN_LINES; k++) {
+		fdn->line[k] = &(fdn->arena[total]);
+		total += fdn->length[k];
+	}
+
+	fdnReverbClear(fdn);
+	fdnReverbSetDecay(fdn, 1.0f, 0.0f);
+
+	return fdn;
+}
+
+void fdnReverbSetDecay(fdnReverb_t *fdn, float rt60, float damping_frequency) {
+	int k;
+
+	if(rt60 < 0.01f) rt60 = 0.01f;
+
+	// -60 dB after rt60 seconds, each pass through line k takes length[k] samples
+	for(k = 0; k < FDN_LINES; k++) {
+		fdn->gain[k] = ftoFTYPE(powf(10.0f, -3.0f * (float)fdn->length[k] / (rt60 * (float)fdn->Fs)));
+	}
+
+	if(damping_frequency <= 0.0f || damping_frequency >= 0.5f * (float)fdn->Fs) {
+		fdn->damp = itoFTYPE(1);
+	} else {
+		fdn->damp = ftoFTYPE(1.0f - expf(-2.0f * M_PI * damping_frequency / (float)fdn->Fs));
+	}
+}
+
+void fdnReverbClear(fdnReverb_t *fdn) {
+	int k, total = 0;
+
+	for(k = 0; k < FDN_LINES; k++) {
+		total += fdn->length[k];
+		fdn->position[k] = 0;
+		fdn->damp_state[k] = itoFTYPE(0);
+	}
+	memset(fdn->arena, 0, sizeof(FTYPE) * total);
+}
+
+#ifdef __SATAN_USES_FXP
+#define FDN_ANTI_DENORMAL 0
+#else
+// same trick as the biquads, keeps a decaying tail from ending up as denormals
+#define FDN_ANTI_DENORMAL BIQUAD_ANTI_DENORMAL
+#endif
+
+#if FDN_LINES != 8
+#error "fdnReverbProcess() has the Householder sums written out for eight lines."
+#endif
+
+// copy n samples out of/into a circular line, starting at pos
+static inline void fdnLineRead(const FTYPE *line, int length, int pos, FTYPE *dst, int n) {
+	int first = length - pos;
+
+	if(first >= n) {
+		memcpy(dst, &line[pos], sizeof(FTYPE) * n);
+	} else {
+		memcpy(dst, &line[pos], sizeof(FTYPE) * first);
+		memcpy(&dst[first], line, sizeof(FTYPE) * (n - first));
+	}
+}
+
+static inline void fdnLineWrite(FTYPE *line, int length, int pos, const FTYPE *src, int n) {
+	int first = length - pos;
+
+	if(first >= n) {
+		memcpy(&line[pos], src, sizeof(FTYPE) * n);
+	} else {
+		memcpy(&line[pos], src, sizeof(FTYPE) * first);
+		memcpy(line, &src[first], sizeof(FTYPE) * (n - first));
+	}
+}
+
+void fdnReverbProcess(fdnReverb_t *fdn, const FTYPE *in, FTYPE *out, int samples) {
+	// one chunk of every line, all of it was written at least
+	// one chunk ago since no line is shorter than fdn->block
+	FTYPE tap[FDN_LINES][FDN_BLOCK];
+	FTYPE house[FDN_BLOCK], x[FDN_BLOCK];
+	FTYPE z[FDN_LINES], g[FDN_LINES];
+	FTYPE house_scale = ftoFTYPE(2.0f / FDN_LINES);
+	FTYPE in_scale = ftoFTYPE(0.5f);
+	FTYPE out_scale = ftoFTYPE(1.0f / FDN_LINES);
+	FTYPE damp = fdn->damp;
+	int offset, n, i, k;
+
+	memcpy(z, fdn->damp_state, sizeof(z));
+	memcpy(g, fdn->gain, sizeof(g));
+
+	for(offset = 0; offset < samples; offset += n) {
+		n = samples - offset;
+		if(n > fdn->block) n = fdn->block;
+
+		for(i = 0; i < n; i++)
+			x[i] = mulFTYPE(in[offset + i], in_scale);
+
+		for(k = 0; k < FDN_LINES; k++)
+			fdnLineRead(fdn->line[k], fdn->length[k], fdn->position[k], tap[k], n);
+
+		// Householder matrix, A = I - 2/N * 1 1^T, sample by sample over
+		// the whole chunk so the compiler can vectorize the sums
+		for(i = 0; i < n; i++) {
+			FTYPE sum = tap[0][i] + tap[1][i] + tap[2][i] + tap[3][i] +
+				tap[4][i] + tap[5][i] + tap[6][i] + tap[7][i];
+			FTYPE o = tap[0][i] - tap[1][i] + tap[2][i] - tap[3][i] +
+				tap[4][i] - tap[5][i] + tap[6][i] - tap[7][i];
+			house[i] = mulFTYPE(sum, house_scale);
+			out[offset + i] = mulFTYPE(o, out_scale);
+		}
+
+		// the damping filters are recursive, running all lines side by side
+		// keeps eight independent chains in flight instead of one
+		for(i = 0; i < n; i++) {
+			for(k = 0; k < FDN_LINES; k++) {
+				z[k] += mulFTYPE(damp, tap[k][i] - house[i] - z[k]) + FDN_ANTI_DENORMAL;
+				tap[k][i] = mulFTYPE(g[k], z[k]) + ((k & 1) ? -x[i] : x[i]);
+			}
+		}
+
+		for(k = 0; k < FDN_LINES; k++) {
+			fdnLineWrite(fdn->line[k], fdn->length[k], fdn->position[k], tap[k], n);
+			fdn->position[k] += n;
+			if(fdn->position[k] >= fdn->length[k])
+				fdn->position[k] -= fdn->length[k];
+		}
+	}
+
+	memcpy(fdn->damp_state, z, sizeof(z));
+}
+
+void fdnReverbFree(fdnReverb_t *fdn) {
+	if(fdn) {
+		free(fdn->arena);
+		free(fdn);
+	}
+}
@@ -218,4 +218,93 @@ void xPassFilterMonoFree(xPassFilterMono_t *vd);
 
 #define xPassFilterMonoGet(xpf) (xpf->output)
 */
+
+/*********************************************
+ *
+ *  biquad filter class
+ *
+ *  Transposed direct form II (direct form I in fixed point),
+ *  one or two interleaved channels. New coefficients are reached
+ *  by interpolating per sample over a ramp, so modulation
+ *  does not step.
+ *
+ *********************************************/
+
+#define BIQUAD_LOWPASS 0
+#define BIQUAD_HIGHPASS 1
+#define BIQUAD_BANDPASS 2
+
+#define BIQUAD_MAX_CHANNELS 2
+
+typedef struct biquadFilter {
+	int channels;
+
+	// b0, b1, b2, -a1, -a2 - normalized with a0
+	FTYPE coef[5];
+
+	// coefficients we are ramping towards
+	FTYPE target[5];
+	FTYPE delta[5];
+	int ramp_left; // samples left until coef == target
+
+	// transposed direct form II uses the first two,
+	// direct form I (fixed point) all four
+	FTYPE state[BIQUAD_MAX_CHANNELS][4];
+} biquadFilter_t;
+
+// for filters embedded in other structures
+void biquadFilterInit(biquadFilter_t *bq, int channels);
+biquadFilter_t *create_biquadFilter(MachineTable *mt, int channels);
+void biquadFilterFree(biquadFilter_t *bq);
+
+// frequency in Hz, for the lowpass and highpass Q = 0.5 is no resonance.
+// The new coefficients are reached after ramp samples, 0 means immediately.
+void biquadFilterSet(biquadFilter_t *bq, int type, float frequency, float Q, int Fs, int ramp);
+void biquadFilterSetCoefficients(biquadFilter_t *bq, const FTYPE *coef, int ramp);
+void biquadFilterReset(biquadFilter_t *bq);
+
+// single sample, first channel only
+inline FTYPE biquadFilterPut(biquadFilter_t *bq, FTYPE x);
+// in and out are interleaved with bq->channels channels, they may be the same buffer
+void biquadFilterProcess(biquadFilter_t *bq, const FTYPE *in, FTYPE *out, int samples);
+// like biquadFilterProcess() but adds gain * output to out, for parallel filter banks
+void biquadFilterMix(biquadFilter_t *bq, const FTYPE *in, FTYPE *out, int samples, FTYPE gain);
+
+/*********************************************
+ *
+ *  feedback delay network class
+ *
+ *  FDN_LINES delay lines in one shared memory arena, mixed
+ *  through a Householder matrix and fed back through a one pole
+ *  damping lowpass per line. Delays are given in milliseconds and
+ *  converted with the real sample rate.
+ *
+ *********************************************/
+
+#define FDN_LINES 8
+#define FDN_BLOCK 64
+
+typedef struct fdnReverb {
+	int Fs;
+	int block; // chunk size, never longer than the shortest line
+
+	FTYPE *arena; // all lines, back to back
+	FTYPE *line[FDN_LINES];
+	int length[FDN_LINES];
+	int position[FDN_LINES]; // read and write position, the line is exactly length long
+
+	FTYPE gain[FDN_LINES]; // feedback gain per line giving the requested decay
+	FTYPE damp; // one pole lowpass coefficient, 1.0 is no damping
+	FTYPE damp_state[FDN_LINES];
+} fdnReverb_t;
+
+// delay_ms points to FDN_LINES delays, they are rounded up to primes
+fdnReverb_t *create_fdnReverb(const float *delay_ms, int Fs);
+// rt60 in seconds, damping frequency in Hz - 0 or less disables damping
+void fdnReverbSetDecay(fdnReverb_t *fdn, float rt60, float damping_frequency);
+void fdnReverbClear(fdnReverb_t *fdn);
+// mono, in and out may be the same buffer
+void fdnReverbProcess(fdnReverb_t *fdn, const FTYPE *in, FTYPE *out, int samples);
+void fdnReverbFree(fdnReverb_t *fdn);
+
 #endif
@@ -34,6 +34,7 @@
 #include "liboscillator.h"
 #include <math.h>
 #include <stdio.h>
+#include <pthread.h>
 
 int __LOS_Fs_integer = 1;
 float __LOS_Fs_INVERSE = 1.0f;
@@ -48,16 +49,144 @@ void los_set_Fs(MachineTable *mt, int new_Fs) {
 	}
 }
 
+/*
+ * Band limited wavetables, one table per octave. Level 0 has LOS_TABLE_MAX_HARMONICS harmonics,
+ * and every following level has half the harmonics of the previous one. The tables have a guard
+ * point at the end to simplify interpolation.
+ */
+#define LOS_TABLE_SIZE 2048
+#define LOS_TABLE_MAX_HARMONICS 512
+#define LOS_TABLE_LEVELS 10
+#define LOS_TABLE_WAVEFORMS 3
+
+static float __los_wavetable[LOS_TABLE_WAVEFORMS][LOS_TABLE_LEVELS][LOS_TABLE_SIZE + 1];
+static pthread_once_t __los_wavetable_once = PTHREAD_ONCE_INIT;
+
+static void los_build_wavetables(void) {
+	static float sine[LOS_TABLE_SIZE];
+	int w, l, h, j;
+
+	for(j = 0; j < LOS_TABLE_SIZE; j++)
+		sine[j] = sinf(2.0f * M_PI * (float)j / (float)LOS_TABLE_SIZE);
+
+	for(w = 0; w < LOS_TABLE_WAVEFORMS; w++) {
+		for(l = 0; l < LOS_TABLE_LEVELS; l++) {
+			float *table = __los_wavetable[w][l];
+			int harmonics = LOS_TABLE_MAX_HARMONICS >> l;
+
+			memset(table, 0, sizeof(__los_wavetable[w][l]));
+			for(h = 1; h <= harmonics; h++) {
+				float a = 0.0f;
+				switch(w + LOS_WAVEFORM_TABLE_SAW) {
+				case LOS_WAVEFORM_TABLE_SAW:
+					a = -2.0f / (M_PI * h);
+					break;
+				case LOS_WAVEFORM_TABLE_SQUARE:
+					if(h & 1) a = -4.0f / (M_PI * h);
+					break;
+				case LOS_WAVEFORM_TABLE_TRIANGLE:
+					if(h & 1) a = ((h & 2) ? -8.0f : 8.0f) / (M_PI * M_PI * h * h);
+					break;
+				}
+				if(a == 0.0f) continue;
+
+				// sin(2 pi h j / N) is found exactly in the sine table
+				for(j = 0; j < LOS_TABLE_SIZE; j++)
+					table[j] += a * sine[(j * h) % LOS_TABLE_SIZE];
+			}
+			table[LOS_TABLE_SIZE] = table[0];
+		}
+	}
+}
+
+static inline float los_table_lookup(int waveform, float t, float dt) {
+	// pick the level where the highest harmonic is below Fs / 2
+	float h = dt * (2.0f * LOS_TABLE_MAX_HARMONICS);
+	int level = 0;
+	while(h > 1.0f && level < LOS_TABLE_LEVELS - 1) {
+		h *= 0.5f;
+		level++;
+	}
+
+	const float *table = __los_wavetable[waveform - LOS_WAVEFORM_TABLE_SAW][level];
+	float p = t * (float)LOS_TABLE_SIZE;
+	int i = (int)p;
+	if(i >= LOS_TABLE_SIZE) i = LOS_TABLE_SIZE - 1;
+	if(i < 0) i = 0;
+	float f = p - (float)i;
+
+	return table[i] + f * (table[i + 1] - table[i]);
+}
+
+// correction for a unit step at t = 0, dt is the phase increment
+static inline float los_poly_blep(float t, float dt) {
+	if(t < dt) {
+		t /= dt;
+		return t + t - t * t - 1.0f;
+	} else if(t > 1.0f - dt) {
+		t = (t - 1.0f) / dt;
+		return t * t + t + t + 1.0f;
+	}
+	return 0.0f;
+}
+
+static inline float los_band_limited_value(int waveform, float pulse_width, float t, float dt) {
+	if(dt < 0.0f) dt = -dt;
+	if(dt > 0.5f) dt = 0.5f;
+
+	switch(waveform) {
+	case LOS_WAVEFORM_BLEP_SAW:
+		if(dt == 0.0f) return 2.0f * t - 1.0f;
+		return 2.0f * t - 1.0f - los_poly_blep(t, dt);
+
+	case LOS_WAVEFORM_BLEP_SQUARE:
+		pulse_width = 0.5f;
+		// fall through
+	case LOS_WAVEFORM_BLEP_PULSE:
+	{
+		float v = t < pulse_width ? -1.0f : 1.0f;
+		if(dt == 0.0f) return v;
+
+		float t2 = t - pulse_width;
+		if(t2 < 0.0f) t2 += 1.0f;
+		// falling edge at t = 0, rising edge at the pulse width
+		return v - los_poly_blep(t, dt) + los_poly_blep(t2, dt);
+	}
+
+	case LOS_WAVEFORM_TABLE_SAW:
+	case LOS_WAVEFORM_TABLE_SQUARE:
+	case LOS_WAVEFORM_TABLE_TRIANGLE:
+		return los_table_lookup(waveform, t, dt);
+	}
+	return 0.0f;
+}
+
 void los_init_oscillator(oscillator_t *oscillator) {
+	// the tables are built the first time, outside the audio thread
+	pthread_once(&__los_wavetable_once, los_build_wavetables);
+
 	memset(oscillator, 0, sizeof(oscillator_t));
 	oscillator->amplitude = oscillator->amplitude_base = itoFTYPE(1);
 	oscillator->voltage_glide_phase_count = itoFTYPE(1);
+	oscillator->waveform = LOS_WAVEFORM_NAIVE;
+	oscillator->pulse_width = 0.5f;
 }
 
 void los_set_oscillator_source(oscillator_t *oscillator, FTYPE (*src)(FTYPE voltage)) {
 	oscillator->oscillator_source = src;
 }
 
+void los_set_waveform(oscillator_t *oscillator, los_waveform_t waveform) {
+	oscillator->waveform = waveform;
+}
+
+void los_set_pulse_width(oscillator_t *oscillator, FTYPE pulse_width) {
+	float pw = FTYPEtof(pulse_width);
+	if(pw < 0.01f) pw = 0.01f;
+	if(pw > 0.99f) pw = 0.99f;
+	oscillator->pulse_width = pw;
+}
+
 void los_set_base_frequency(oscillator_t *oscillator, FTYPE frequency) {
 	oscillator->voltage_step_base = frequency; // these so happens to be the same since frequency is (f / Fs)!
 }
@@ -101,9 +230,14 @@ FTYPE los_get_alternate_sample(oscillator_t *oscillator,
 	return mulFTYPE(oscillator->amplitude, alternate_source(oscillator->voltage));
 }
 
-void los_step_oscillator(oscillator_t *oscillator,
-			 FTYPE frequency_modulator_voltage,
-			 FTYPE amplitude_modulator_voltage) {
+FTYPE los_get_band_limited_sample(oscillator_t *oscillator, los_waveform_t waveform) {
+	float v = los_band_limited_value(waveform, oscillator->pulse_width,
+					 FTYPEtof(oscillator->voltage),
+					 FTYPEtof(oscillator->voltage_step));
+	return mulFTYPE(oscillator->amplitude, ftoFTYPE(v));
+}
+
+static inline void los_step_glide(oscillator_t *oscillator) {
 	if(oscillator->voltage_glide_phase_count < itoFTYPE(1)) {
 		if(oscillator->glide_count == 0) {
 			oscillator->voltage_step_base += oscillator->voltage_step_glide_step;
@@ -117,6 +251,12 @@ void los_step_oscillator(oscillator_t *oscillator,
 			oscillator->voltage_step_base = oscillator->glide_target_frequency;
 		}
 	}
+}
+
+void los_step_oscillator(oscillator_t *oscillator,
+			 FTYPE frequency_modulator_voltage,
+			 FTYPE amplitude_modulator_voltage) {
+	los_step_glide(oscillator);
 
 	frequency_modulator_voltage =
 		SAT_POW_FTYPE(itoFTYPE(2),
@@ -131,12 +271,57 @@ void los_step_oscillator(oscillator_t *oscillator,
 			amplitude_modulator_voltage,
 			oscillator->amplitude_modulator_depth);
 
+	oscillator->voltage_step = voltage_step;
 	oscillator->voltage += voltage_step;
 	if(oscillator->voltage > itoFTYPE(1)) {
 		oscillator->voltage -= itoFTYPE(1);
 	}
 }
 
+void los_render_block(oscillator_t *oscillator, FTYPE *out, int n,
+		      const FTYPE *fm_buf, const FTYPE *am_buf) {
+	int k;
+
+	if(oscillator->waveform == LOS_WAVEFORM_NAIVE) {
+		for(k = 0; k < n; k++) {
+			out[k] = los_get_sample(oscillator);
+			los_step_oscillator(oscillator,
+					    fm_buf ? fm_buf[k] : itoFTYPE(0),
+					    am_buf ? am_buf[k] : itoFTYPE(0));
+		}
+		return;
+	}
+
+	// the state is kept in float during the block, for both FTYPE builds
+	int waveform = oscillator->waveform;
+	float pulse_width = oscillator->pulse_width;
+	float t = FTYPEtof(oscillator->voltage);
+	float dt = FTYPEtof(oscillator->voltage_step);
+	float amplitude = FTYPEtof(oscillator->amplitude);
+	float amplitude_base = FTYPEtof(oscillator->amplitude_base);
+	float amplitude_depth = FTYPEtof(oscillator->amplitude_modulator_depth);
+
+	for(k = 0; k < n; k++) {
+		out[k] = ftoFTYPE(amplitude * los_band_limited_value(waveform, pulse_width, t, dt));
+
+		los_step_glide(oscillator);
+		dt = FTYPEtof(oscillator->voltage_step_base);
+		if(fm_buf)
+			dt *= exp2f(FTYPEtof(fm_buf[k]) * (1.0f / 12.0f));
+
+		amplitude = amplitude_base;
+		if(am_buf)
+			amplitude += FTYPEtof(am_buf[k]) * amplitude_depth;
+
+		t += dt;
+		if(t > 1.0f) t -= 1.0f;
+	}
+
+	oscillator->voltage = ftoFTYPE(t);
+	oscillator->voltage_step = ftoFTYPE(dt);
+	oscillator->amplitude = ftoFTYPE(amplitude);
+}
+
 void los_reset_oscillator(oscillator_t *oscillator) {
 	oscillator->voltage = itoFTYPE(0);
 }
@@ -57,7 +57,28 @@ FTYPE los_src_coshalf(FTYPE voltage); // cos (half wave)
 FTYPE los_src_square(FTYPE voltage); // square wave
 FTYPE los_src_noise(FTYPE voltage); // noise ("white")
 
+/* band limited waveforms
+ *
+ * The BLEP waveforms are generated directly using PolyBLEP correction of the
+ * discontinuities, the TABLE waveforms are read from pre-computed wavetables
+ * with one table per octave. The tables are shared by all oscillators.
+ *
+ * They have the same phase and polarity as the corresponding los_src_* functions.
+ */
+typedef enum {
+	LOS_WAVEFORM_NAIVE = 0, // use the source function, see los_set_oscillator_source()
+	LOS_WAVEFORM_BLEP_SAW,
+	LOS_WAVEFORM_BLEP_SQUARE,
+	LOS_WAVEFORM_BLEP_PULSE, // see los_set_pulse_width()
+	LOS_WAVEFORM_TABLE_SAW,
+	LOS_WAVEFORM_TABLE_SQUARE,
+	LOS_WAVEFORM_TABLE_TRIANGLE
+} los_waveform_t;
+
 inline void los_set_oscillator_source(oscillator_t *oscillator, FTYPE (*)(FTYPE voltage));
+void los_set_waveform(oscillator_t *oscillator, los_waveform_t waveform);
+// pulse width is given as a fraction of the period, 0.5 gives a square wave
+void los_set_pulse_width(oscillator_t *oscillator, FTYPE pulse_width);
 inline void los_set_base_frequency(oscillator_t *oscillator, FTYPE frequency);
 inline void los_glide_frequency(oscillator_t *oscillator, FTYPE target_frequency, FTYPE time);
 inline void los_set_frequency_modulator_depth(oscillator_t *oscillator, FTYPE frequency_modulator_depth);
@@ -72,6 +93,15 @@ inline void los_step_oscillator(oscillator_t *oscillator,
 				FTYPE frequency_modulator_voltage,
 				FTYPE amplitude_modulator_voltage);
 
+// get a band limited sample from the oscillator, using the current frequency
+FTYPE los_get_band_limited_sample(oscillator_t *oscillator, los_waveform_t waveform);
+
+// render n samples and step the oscillator n times, using the waveform set with
+// los_set_waveform(). fm_buf and am_buf are the modulator voltages, like
+// for los_step_oscillator(), and may be NULL.
+void los_render_block(oscillator_t *oscillator, FTYPE *out, int n,
+		      const FTYPE *fm_buf, const FTYPE *am_buf);
+
 // reset period to zero
 inline void los_reset_oscillator(oscillator_t *oscillator);
 
@@ -49,5 +49,10 @@ struct __struct_oscillator {
 	FTYPE amplitude_modulator_depth;
 	
 	FTYPE (*oscillator_source)(FTYPE _voltage_source);
+
+	// band limited rendering, see los_set_waveform()
+	int waveform;
+	float pulse_width;
+	FTYPE voltage_step; // the last step, needed for the band limiting
 };
 
@@ -38,10 +38,21 @@
 
 #include "../kiss_fftr.h"
 
+// kiss must be built with FIXED_POINT=32 in fixed point mode, just like on the device,
+// the FFT services are not available otherwise
+#if defined(__SATAN_USES_FXP) && !defined(FIXED_POINT)
+#define __TESTBENCH_NO_FFT
+#else
+#include "../convolution.cc"
+#endif
+
 #ifndef TIMER_TESTBENCH_DECLARED
 #error "You must #include libtestbench_timer.c ahead of the file you want to bench."
 #endif
 
+// set to true to silence the trace output
+int mockery_quiet = 0;
+
 struct mockery *mockery_table[] = {
 	NULL, NULL, NULL, NULL, NULL,
 	NULL, NULL, NULL, NULL, NULL
@@ -70,6 +81,16 @@ struct mockery *register_mockery(struct mockery *m) {
 	return NULL;
 }
 
+void unregister_mockery(struct mockery *m) {
+	int k;
+
+	for(k = 0; k < 10; k++) {
+		if(mockery_table[k] == m) {
+			mockery_table[k] = NULL;
+		}
+	}
+}
+
 int fill_sink(struct _MachineTable *mt,
 	      int (*fill_sink_callback)(int status, void *cbd),
 	      void *callback_data) {
@@ -136,6 +157,54 @@ SignalPointer *get_next_signal(struct _MachineTable *mt, SignalPointer *sp) {
 	return NULL;
 }
 
+/* port handles are just indexes into this table, the
+ * signal is looked up by name each time since the bench
+ * might replace the mock signals at any time.
+ */
+#define __TESTBENCH_MAX_PORTS 32
+struct mock_port {
+	MachineTable *mt;
+	int is_input;
+	char *name;
+};
+static struct mock_port mock_ports[__TESTBENCH_MAX_PORTS];
+static int mock_port_count = 0;
+
+PortHandle resolve_mock_port(struct _MachineTable *mt, const char *name, int is_input) {
+	int k;
+
+	for(k = 0; k < mock_port_count; k++) {
+		if(mock_ports[k].mt == mt &&
+		   mock_ports[k].is_input == is_input &&
+		   strcmp(mock_ports[k].name, name) == 0)
+			return k;
+	}
+
+	if(mock_port_count >= __TESTBENCH_MAX_PORTS) return INVALID_PORT;
+
+	mock_ports[mock_port_count].mt = mt;
+	mock_ports[mock_port_count].is_input = is_input;
+	mock_ports[mock_port_count].name = strdup(name);
+
+	return mock_port_count++;
+}
+
+PortHandle get_input_port(struct _MachineTable *mt, const char *name) {
+	return resolve_mock_port(mt, name, -1);
+}
+
+PortHandle get_output_port(struct _MachineTable *mt, const char *name) {
+	return resolve_mock_port(mt, name, 0);
+}
+
+SignalPointer *get_port_signal(struct _MachineTable *mt, PortHandle p) {
+	if(p < 0 || p >= mock_port_count) return NULL;
+
+	if(mock_ports[p].is_input)
+		return get_input_signal(mt, mock_ports[p].name);
+	return get_output_signal(mt, mock_ports[p].name);
+}
+
 #define __TESTBENCH_STATIC_SIGNAL_LENGTH (44100 / 2)
 static int16_t static_signal_data[__TESTBENCH_STATIC_SIGNAL_LENGTH];
 struct signus static_signal = {
@@ -151,8 +220,14 @@ struct signus static_signal = {
 };
 
 SignalPointer *get_static_signal(int index) {
+	static int generated = 0;
 	int k;
 	float value, t;
+
+	// machines look this up on every execute(), only generate it once
+	if(generated) return &static_signal;
+	generated = -1;
+
 	for(k = 0; k < __TESTBENCH_STATIC_SIGNAL_LENGTH; k++) {
 
 		t = k;
@@ -310,7 +385,8 @@ void *get_signal_buffer(SignalPointer *sp) {
 			void **p = (void **)(s->u_data);
 			p = &(p[offset]);
 			memcpy(s->data, p, sizeof(void *) * m->test_step_length);
-			printf("midi_in at %p\n", p);
+			if(!mockery_quiet)
+				printf("midi_in at %p\n", p);
 
 		}
 			break;
@@ -320,11 +396,73 @@ void *get_signal_buffer(SignalPointer *sp) {
 	return s->data;
 }
 
+void *get_port_buffer(struct _MachineTable *mt, PortHandle p) {
+	SignalPointer *s = get_port_signal(mt, p);
+	return s == NULL ? NULL : get_signal_buffer(s);
+}
+
+int get_port_samples(struct _MachineTable *mt, PortHandle p) {
+	SignalPointer *s = get_port_signal(mt, p);
+	return s == NULL ? 0 : get_signal_samples(s);
+}
+
+int get_port_channels(struct _MachineTable *mt, PortHandle p) {
+	SignalPointer *s = get_port_signal(mt, p);
+	return s == NULL ? 0 : get_signal_channels(s);
+}
+
+// the bench does not generate any controller changes
+void enable_parameter_events(struct _MachineTable *mt) {
+}
+
+int get_parameter_index(struct _MachineTable *mt, void *controller_ptr) {
+	return -1;
+}
+
+int get_parameter_events(struct _MachineTable *mt, const ParameterEvent **events) {
+	*events = NULL;
+	return 0;
+}
+
+const float *get_parameter_ramp(struct _MachineTable *mt, int index) {
+	return NULL;
+}
+
+// the bench always feeds MIDI in the _PTR format, which the iterators handle
+void enable_midi_event_lists(struct _MachineTable *mt) {
+}
+
+// the bench static signal is always resident
+int get_static_signal_frames(SignalPointer *sp) {
+	struct signus *s = (struct signus *)sp;
+
+	return s->sam;
+}
+
+int read_static_signal(SignalPointer *sp, int frame, void **data) {
+	struct signus *s = (struct signus *)sp;
+
+	if(frame < 0 || frame >= s->sam) {
+		*data = NULL;
+		return 0;
+	}
+	*data = &(((int16_t *)s->data)[frame * s->chan]);
+	return s->sam - frame;
+}
+
 int get_recording_filename(struct _MachineTable *mt, char *dst, unsigned int len) {
 	dst[0] = '\0';
 	return 0;
 }
 
+// the test bench has no recording sink, the sink machine writes the file itself
+int open_recording_sink(struct _MachineTable *mt, const char *file_name, int rate, int channels) {
+	return -1;
+}
+
+void write_recording_sink(struct _MachineTable *mt, const int16_t *data, int frames) {}
+void close_recording_sink(struct _MachineTable *mt) {}
+
 void register_failure(void *machine_instance, const char *msg) {
 	printf("error: %s\n", msg);
 }
@@ -387,28 +525,80 @@ kiss_fftr_cfg prepare_fft(int samples, int do_inverse) {
 }
 
 void do_fft(kiss_fftr_cfg cfg, FTYPE *timedata, kiss_fft_cpx *freqdata) {
-#ifndef __SATAN_USES_FXP
+#ifndef __TESTBENCH_NO_FFT
 	kiss_fftr(cfg, timedata, freqdata);
 #else
-	printf(" Warning, do_fft not implemented in fixed point mode\n");
+	printf(" Warning, do_fft not available in fixed point mode without FIXED_POINT=32\n");
 #endif
 }
 
 void inverse_fft(kiss_fftr_cfg cfg, kiss_fft_cpx *freqdata, FTYPE *timedata) {
-#ifndef __SATAN_USES_FXP
+#ifndef __TESTBENCH_NO_FFT
 	kiss_fftri(cfg, freqdata, timedata);
 #else
-	printf(" Warning, do_fft not implemented in fixed point mode\n");
+	printf(" Warning, inverse_fft not available in fixed point mode without FIXED_POINT=32\n");
 #endif
 }
 
+// the operation runs directly, so a machine never has to wait for it in the bench
+void run_async_operation(AsyncOp *op) {
+	op->func(op);
+	op->finished = -1;
+}
+
+void run_async_operation_priority(AsyncOp *op, int priority) {
+	run_async_operation(op);
+}
+
+#ifndef __TESTBENCH_NO_FFT
+ConvolverPointer *create_convolver(int partition_size) {
+	return (ConvolverPointer *)convolver_create(partition_size);
+}
+
+int convolver_set_ir(ConvolverPointer *c, int static_signal_index, int max_frames) {
+	SignalPointer *sp = get_static_signal(static_signal_index);
+	if(sp == NULL) return -1;
+
+	int frames = get_static_signal_frames(sp);
+	if(max_frames > 0 && max_frames < frames) frames = max_frames;
+
+	return convolver_load_signal((Convolver *)c, sp,
+				     get_signal_channels(sp), get_signal_resolution(sp), frames,
+				     read_static_signal);
+}
+
+void convolver_process_mock(ConvolverPointer *c, FTYPE *in, FTYPE *out, int frames) {
+	convolver_process((Convolver *)c, in, out, frames);
+}
+
+int get_convolver_latency(ConvolverPointer *c) {
+	return ((Convolver *)c)->partition_size;
+}
+
+void delete_convolver(ConvolverPointer *c) {
+	convolver_delete((Convolver *)c);
+}
+#else
+ConvolverPointer *create_convolver(int partition_size) {
+	printf(" Warning, convolution not available in fixed point mode without FIXED_POINT=32\n");
+	return NULL;
+}
+
+int convolver_set_ir(ConvolverPointer *c, int static_signal_index, int max_frames) { return -1; }
+void convolver_process_mock(ConvolverPointer *c, FTYPE *in, FTYPE *out, int frames) {}
+int get_convolver_latency(ConvolverPointer *c) { return 0; }
+void delete_convolver(ConvolverPointer *c) {}
+#endif
+
 void init_mock_machine_table(MachineTable *mt) {
 	mt->fill_sink = fill_sink;
 
 	mt->set_signal_defaults = set_signal_defaults;
 
 	mt->get_input_signal = get_input_signal;
+#ifdef THIS_IS_A_MOCKERY
 	mt->get_mocking_signal = get_mocking_signal;
+#endif
 	mt->get_output_signal = get_output_signal;
 	mt->get_next_signal = get_next_signal;
 	mt->get_static_signal = get_static_signal;
@@ -420,6 +610,24 @@ void init_mock_machine_table(MachineTable *mt) {
 	mt->get_signal_samples = get_signal_samples;
 	mt->get_signal_buffer = get_signal_buffer;
 
+	mt->version = MACHINE_TABLE_VERSION;
+
+	mt->get_input_port = get_input_port;
+	mt->get_output_port = get_output_port;
+	mt->get_port_signal = get_port_signal;
+	mt->get_port_buffer = get_port_buffer;
+	mt->get_port_samples = get_port_samples;
+	mt->get_port_channels = get_port_channels;
+
+	mt->enable_parameter_events = enable_parameter_events;
+	mt->get_parameter_index = get_parameter_index;
+	mt->get_parameter_events = get_parameter_events;
+	mt->get_parameter_ramp = get_parameter_ramp;
+	mt->enable_midi_event_lists = enable_midi_event_lists;
+
+	mt->get_static_signal_frames = get_static_signal_frames;
+	mt->read_static_signal = read_static_signal;
+
 	mt->get_recording_filename = get_recording_filename;
 	mt->register_failure = register_failure;
 
@@ -428,14 +636,29 @@ void init_mock_machine_table(MachineTable *mt) {
 	mt->prepare_fft = prepare_fft;
 	mt->do_fft = do_fft;
 	mt->inverse_fft = inverse_fft;
-
+	mt->run_async_operation = run_async_operation;
+	mt->run_async_operation_priority = run_async_operation_priority;
+
+	mt->create_convolver = create_convolver;
+	mt->convolver_set_ir = convolver_set_ir;
+	mt->convolver_process = convolver_process_mock;
+	mt->get_convolver_latency = get_convolver_latency;
+	mt->delete_convolver = delete_convolver;
+
+	mt->open_recording_sink = open_recording_sink;
+	mt->write_recording_sink = write_recording_sink;
+	mt->close_recording_sink = close_recording_sink;
 }
 
+// the engine puts this pattern directly after each signal buffer, some machines check it
+#define __TESTBENCH_VERIFICATION_PATTERN "THIS_PATTERN_IS_RIGHT"
+
 int validate_mock_signal(struct signus *s) {
 	int k;
 
 	for(k = 0; k < 16; k++) {
-		if((s->pad_a[k] != 0) || (s->pad_b[k] != 0)) {
+		if((s->pad_a[k] != 0) ||
+		   (k == 0 && strcmp((char *)s->pad_b, __TESTBENCH_VERIFICATION_PATTERN) != 0)) {
 			printf("validation failed %p / %p.\n",
 			       &(s->pad_a[k]), &(s->pad_b[k]));
 			if(s == NULL) {
@@ -462,7 +685,7 @@ struct signus *create_mock_signal(
 	int samples,
 	void *data_pointer,
 	struct mockery *m) {
-	struct signus *s = (struct signus *)malloc(sizeof(struct signus));
+	struct signus *s = (struct signus *)calloc(1, sizeof(struct signus));
 
 	if(s == NULL) return NULL;
 
@@ -499,10 +722,11 @@ struct signus *create_mock_signal(
 			break;
 		}
 
-		s->pad_data = (uint8_t *)calloc(channels * len * (m->test_step_length) + 32, sizeof(uint8_t));
+		s->pad_data = (uint8_t *)calloc(channels * len * (m->test_step_length) + 16 + 42, sizeof(uint8_t));
 		uint8_t *t = &(s->pad_data[16]);
 		s->pad_a = s->pad_data;
 		s->pad_b = &(s->pad_data[16 + channels * len * (m->test_step_length)]);
+		strcpy((char *)s->pad_b, __TESTBENCH_VERIFICATION_PATTERN);
 		s->data = (void *)t;
 	}
 
@@ -517,7 +741,8 @@ struct signus *create_mock_signal(
  *
  *********************************************/
 
-int prepare_mockery(struct mockery *m, int test_step_length, const char *machine_name) {
+// prepare the mockery without starting the machine, so signals can be created before init()
+int create_mockery(struct mockery *m, int test_step_length) {
 	memset(m, 0, sizeof(struct mockery));
 	init_mock_machine_table(&(m->mt));
 	m->inputs = NULL;
@@ -525,18 +750,52 @@ int prepare_mockery(struct mockery *m, int test_step_length, const char *machine
 
 	if(register_mockery(m) != m) return -1;
 
+	m->current_test_step = 0;
+	m->test_step_length = test_step_length;
+
+	return 0;
+}
+
+int start_mockery(struct mockery *m, const char *machine_name) {
 	m->machine_data = init(&(m->mt), machine_name);
 	if(m->machine_data == NULL) {
 		printf("Mockery failed.\n");
 		return -1;
 	}
 
-	m->current_test_step;
-	m->test_step_length = test_step_length;
-
 	return 0;
 }
 
+int prepare_mockery(struct mockery *m, int test_step_length, const char *machine_name) {
+	if(create_mockery(m, test_step_length)) return -1;
+
+	return start_mockery(m, machine_name);
+}
+
+void free_mock_signals(struct signus *s) {
+	while(s != NULL) {
+		struct signus *next = s->next;
+		free((void *)s->name);
+		free(s->pad_data);
+		free(s);
+		s = next;
+	}
+}
+
+// delete the machine and free the mock signals, the data pointers are owned by the caller
+void destroy_mockery(struct mockery *m) {
+	if(m->machine_data != NULL)
+		delete(m->machine_data);
+	m->machine_data = NULL;
+
+	free_mock_signals(m->inputs);
+	free_mock_signals(m->intermediates);
+	free_mock_signals(m->outputs);
+	m->inputs = m->intermediates = m->outputs = NULL;
+
+	unregister_mockery(m);
+}
+
 void *get_controller(
 	struct mockery *m, const char *name, const char *group
 	) {
@@ -108,7 +108,12 @@ void RIFF_write_data(
 void interleave(int16_t *destination, int offset, const FTYPE *in, int samples);
 void write_wav(const FTYPE *left, const FTYPE *right, int samples, const char *fname);
 
+extern int mockery_quiet;
+
+int create_mockery(struct mockery *m, int test_step_length);
+int start_mockery(struct mockery *m, const char *machine_name);
 int prepare_mockery(struct mockery *m, int test_step_length, const char *machine_name);
+void destroy_mockery(struct mockery *m);
 int create_mock_input_signal(
 	struct mockery *m, const char *name,
 	int dimension,
@@ -0,0 +1,460 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#ifndef __HAVE_LIBVOICEBANK_MAIN_INCLUDED__
+#define __HAVE_LIBVOICEBANK_MAIN_INCLUDED__
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "libvoicebank.h"
+
+void *lvb_alloc(size_t size) {
+	void *r = NULL;
+
+	// malloc() only guarantees 8 byte alignment on 32 bit ARM
+	if(posix_memalign(&r, sizeof(lvb_vf), size) != 0)
+		return NULL;
+	memset(r, 0, size);
+
+	return r;
+}
+
+void lvb_free(void *bank) {
+	free(bank);
+}
+
+/*********************************************
+ *
+ *  vector helpers
+ *
+ *********************************************/
+
+static const lvb_vi __lvb_lane_masks[1 << LVB_LANES] = {
+	{ 0,  0,  0,  0}, {-1,  0,  0,  0}, { 0, -1,  0,  0}, {-1, -1,  0,  0},
+	{ 0,  0, -1,  0}, {-1,  0, -1,  0}, { 0, -1, -1,  0}, {-1, -1, -1,  0},
+	{ 0,  0,  0, -1}, {-1,  0,  0, -1}, { 0, -1,  0, -1}, {-1, -1,  0, -1},
+	{ 0,  0, -1, -1}, {-1,  0, -1, -1}, { 0, -1, -1, -1}, {-1, -1, -1, -1}
+};
+
+static inline lvb_vf lvb_splat(float x) {
+	lvb_vf r = {x, x, x, x};
+	return r;
+}
+
+static inline lvb_vf lvb_select(lvb_vi mask, lvb_vf a, lvb_vf b) {
+	return (lvb_vf)(((lvb_vi)a & mask) | ((lvb_vi)b & ~mask));
+}
+
+static inline lvb_vi lvb_lane_mask(unsigned int bits) {
+	return __lvb_lane_masks[bits & ((1 << LVB_LANES) - 1)];
+}
+
+static inline int lvb_any(lvb_vi mask) {
+#if defined(__SSE__)
+	return __builtin_ia32_movmskps((lvb_vf)mask) != 0;
+#else
+	union { lvb_vi v; int32_t i[LVB_LANES]; } u;
+	u.v = mask;
+	return (u.i[0] | u.i[1] | u.i[2] | u.i[3]) != 0;
+#endif
+}
+
+static inline float lvb_lane(lvb_vf v, int lane) {
+	union { lvb_vf v; float f[LVB_LANES]; } u;
+	u.v = v;
+	return u.f[lane];
+}
+
+static inline float lvb_sum(lvb_vf v) {
+	union { lvb_vf v; float f[LVB_LANES]; } u;
+	u.v = v;
+	return (u.f[0] + u.f[1]) + (u.f[2] + u.f[3]);
+}
+
+static inline lvb_vf lvb_abs(lvb_vf x) {
+	lvb_vi m = {0x7fffffff, 0x7fffffff, 0x7fffffff, 0x7fffffff};
+	return (lvb_vf)((lvb_vi)x & m);
+}
+
+static inline lvb_vf lvb_min(lvb_vf a, lvb_vf b) {
+	return lvb_select(a < b, a, b);
+}
+
+static inline lvb_vf lvb_max(lvb_vf a, lvb_vf b) {
+	return lvb_select(a > b, a, b);
+}
+
+// adding and subtracting 1.5 * 2^23 rounds to the nearest integer, valid for |x| < 2^22
+#define LVB_ROUND_MAGIC 12582912.0f
+
+static inline lvb_vf lvb_floor(lvb_vf x) {
+	lvb_vf magic = lvb_splat(LVB_ROUND_MAGIC);
+	lvb_vf r = (x + magic) - magic;
+	return r - lvb_select(r > x, lvb_splat(1.0f), lvb_splat(0.0f));
+}
+
+static inline lvb_vf lvb_sin_cycles(lvb_vf x) {
+	// parabolic approximation of sin(pi u) on [-1, 1], with one correction step
+	lvb_vf u = x + x - lvb_splat(1.0f);
+	lvb_vf s = lvb_splat(4.0f) * u * (lvb_splat(1.0f) - lvb_abs(u));
+	s = s * (lvb_splat(0.775f) + lvb_splat(0.225f) * lvb_abs(s));
+	return -s; // sin(2 pi x) = -sin(pi (2x - 1))
+}
+
+static inline lvb_vf lvb_exp2(lvb_vf x) {
+	x = lvb_min(lvb_max(x, lvb_splat(-126.0f)), lvb_splat(126.0f));
+
+	lvb_vf magic = lvb_splat(LVB_ROUND_MAGIC);
+	lvb_vf m = x + magic;
+	lvb_vi n = (lvb_vi)m - (lvb_vi)magic; // the rounded value as an integer
+	lvb_vf f = x - (m - magic); // in [-0.5, 0.5]
+
+	lvb_vf p = lvb_splat(0.0096181291f);
+	p = p * f + lvb_splat(0.0555041087f);
+	p = p * f + lvb_splat(0.2402264923f);
+	p = p * f + lvb_splat(0.6931471806f);
+	p = p * f + lvb_splat(1.0f);
+
+	// multiply by 2^n by adding n to the exponent
+	return (lvb_vf)((lvb_vi)p + (n << 23));
+}
+
+/*********************************************
+ *
+ *  oscillator bank
+ *
+ *********************************************/
+
+void lvb_osc_set_frequency(lvb_osc_bank_t *osc, int lane, float frequency) {
+	osc->dt_base.f[lane] = frequency;
+	osc->glide_left.f[lane] = 0.0f;
+	osc->glide_step.f[lane] = 0.0f;
+}
+
+void lvb_osc_glide_frequency(lvb_osc_bank_t *osc, int lane, float target_frequency, float time, int Fs) {
+	if(time <= 0.0f || osc->dt_base.f[lane] == 0.0f) {
+		lvb_osc_set_frequency(osc, lane, target_frequency);
+	} else {
+		float samples = time * (float)Fs;
+		if(samples < 1.0f) samples = 1.0f;
+
+		osc->glide_target.f[lane] = target_frequency;
+		osc->glide_left.f[lane] = samples;
+		osc->glide_step.f[lane] = (target_frequency - osc->dt_base.f[lane]) / samples;
+	}
+}
+
+void lvb_osc_reset(lvb_osc_bank_t *osc, int lane) {
+	osc->t.f[lane] = 0.0f;
+}
+
+static inline lvb_vf lvb_osc_sin(lvb_osc_bank_t *osc, int g) {
+	return lvb_sin_cycles(osc->t.v[g]);
+}
+
+static inline lvb_vf lvb_osc_saw(lvb_osc_bank_t *osc, int g) {
+	lvb_vf t = osc->t.v[g];
+	return t + t - lvb_splat(1.0f);
+}
+
+static inline lvb_vf lvb_osc_sawsmooth(lvb_osc_bank_t *osc, int g) {
+	// cos(pi t) = sin(2 pi (t / 2 + 1 / 4))
+	return lvb_sin_cycles(osc->t.v[g] * lvb_splat(0.5f) + lvb_splat(0.25f));
+}
+
+static inline lvb_vf lvb_osc_square(lvb_osc_bank_t *osc, int g) {
+	return lvb_select(osc->t.v[g] < lvb_splat(0.5f), lvb_splat(-1.0f), lvb_splat(1.0f));
+}
+
+// correction for a unit step at t = 0, like los_poly_blep()
+static inline lvb_vf lvb_poly_blep(lvb_vf t, lvb_vf dt, lvb_vf dt_i) {
+	lvb_vf one = lvb_splat(1.0f);
+	lvb_vf a = t * dt_i;
+	lvb_vf b = (t - one) * dt_i;
+	lvb_vi after_edge = t < dt;
+	lvb_vi before_edge = t > one - dt;
+
+	return lvb_select(after_edge, a + a - a * a - one,
+			  lvb_select(before_edge, b * b + b + b + one, lvb_splat(0.0f)));
+}
+
+static inline lvb_vf lvb_blep_dt(lvb_vf dt, lvb_vf *dt_i) {
+	dt = lvb_min(lvb_abs(dt), lvb_splat(0.5f));
+	*dt_i = lvb_splat(1.0f) / lvb_max(dt, lvb_splat(1e-12f));
+	return dt;
+}
+
+static inline lvb_vf lvb_blep_saw(lvb_vf t, lvb_vf dt, lvb_vf dt_i) {
+	return t + t - lvb_splat(1.0f) - lvb_poly_blep(t, dt, dt_i);
+}
+
+static inline lvb_vf lvb_blep_pulse(lvb_vf t, lvb_vf dt, lvb_vf dt_i, lvb_vf width) {
+	lvb_vf t2 = t - width;
+	t2 = t2 + lvb_select(t2 < lvb_splat(0.0f), lvb_splat(1.0f), lvb_splat(0.0f));
+
+	// rising edge at t = 0, falling edge at t = width
+	return lvb_select(t < width, lvb_splat(1.0f), lvb_splat(-1.0f))
+		+ lvb_poly_blep(t, dt, dt_i) - lvb_poly_blep(t2, dt, dt_i);
+}
+
+static inline lvb_vf lvb_osc_blep_saw(lvb_osc_bank_t *osc, int g) {
+	lvb_vf dt_i;
+	lvb_vf dt = lvb_blep_dt(osc->dt.v[g], &dt_i);
+	return lvb_blep_saw(osc->t.v[g], dt, dt_i);
+}
+
+static inline lvb_vf lvb_osc_blep_square(lvb_osc_bank_t *osc, int g) {
+	lvb_vf dt_i;
+	lvb_vf dt = lvb_blep_dt(osc->dt.v[g], &dt_i);
+	// falling edge at t = 0, rising edge at t = 0.5
+	return -lvb_blep_pulse(osc->t.v[g], dt, dt_i, lvb_splat(0.5f));
+}
+
+static inline lvb_vf lvb_osc_blep_pulse(lvb_osc_bank_t *osc, int g, lvb_vf width) {
+	lvb_vf dt_i;
+	lvb_vf dt = lvb_blep_dt(osc->dt.v[g], &dt_i);
+	return lvb_blep_pulse(osc->t.v[g], dt, dt_i, width);
+}
+
+static inline void lvb_osc_step(lvb_osc_bank_t *osc, int g, const lvb_vf *fm) {
+	lvb_vi gliding = osc->glide_left.v[g] > lvb_splat(0.0f);
+	if(lvb_any(gliding)) {
+		// glide_step is zero for the lanes that are not gliding
+		lvb_vf left = osc->glide_left.v[g] - lvb_select(gliding, lvb_splat(1.0f), lvb_splat(0.0f));
+		lvb_vi done = gliding & (left <= lvb_splat(0.0f));
+
+		osc->dt_base.v[g] = lvb_select(done, osc->glide_target.v[g],
+					       osc->dt_base.v[g] + osc->glide_step.v[g]);
+		osc->glide_step.v[g] = lvb_select(done, lvb_splat(0.0f), osc->glide_step.v[g]);
+		osc->glide_left.v[g] = lvb_select(done, lvb_splat(0.0f), left);
+	}
+
+	lvb_vf dt = osc->dt_base.v[g];
+	if(fm)
+		dt = dt * lvb_exp2(*fm * lvb_splat(1.0f / 12.0f));
+
+	lvb_vf t = osc->t.v[g] + dt;
+	osc->t.v[g] = t - lvb_floor(t);
+	osc->dt.v[g] = dt;
+}
+
+/*********************************************
+ *
+ *  envelope bank
+ *
+ *********************************************/
+
+static inline float lvb_env_calc_step(float Fs_i, float seconds) {
+	if(seconds == 0.0f)
+		return 1.0f; // this will indicate that we skip the phase
+	return Fs_i / seconds;
+}
+
+static inline void lvb_env_set_phase(lvb_env_bank_t *env, int lane, int phase, float amp_step, float level_step) {
+	env->phase[lane] = phase;
+	env->phase_level.f[lane] = 0.0f;
+	env->amp_step.f[lane] = amp_step;
+	env->level_step.f[lane] = level_step;
+
+	if(phase == 0)
+		env->active &= ~(1 << lane);
+	else
+		env->active |= (1 << lane);
+}
+
+void lvb_env_reset(lvb_env_bank_t *env, int lane) {
+	env->amplitude.f[lane] = 0.0f;
+	env->amplitude_mem.f[lane] = 0.0f;
+	lvb_env_set_phase(env, lane, 0, 0.0f, 0.0f);
+}
+
+void lvb_env_trigger(lvb_env_bank_t *env, int lane, int Fs,
+		     float attack, float hold, float decay, float sustain, float release) {
+	float Fs_i = 1.0f / (float)Fs;
+
+	env->attack_level_step[lane] = lvb_env_calc_step(Fs_i, attack);
+	env->hold_level_step[lane] = lvb_env_calc_step(Fs_i, hold);
+	env->decay_level_step[lane] = lvb_env_calc_step(Fs_i, decay);
+	env->release_level_step[lane] = lvb_env_calc_step(Fs_i, release);
+	env->sustain_amplitude[lane] = sustain;
+
+	env->amplitude.f[lane] = 0.0f;
+
+	if(env->attack_level_step[lane] == 1.0f &&
+	   env->hold_level_step[lane] == 1.0f &&
+	   env->decay_level_step[lane] == 1.0f) {
+		env->amplitude.f[lane] = sustain;
+		lvb_env_set_phase(env, lane, 4, 0.0f, 0.0f);
+	} else {
+		// regular mode - start with the attack phase
+		lvb_env_set_phase(env, lane, 1,
+				  env->attack_level_step[lane], env->attack_level_step[lane]);
+	}
+}
+
+void lvb_env_release(lvb_env_bank_t *env, int lane) {
+	// adapt the release amp step to the current amplitude
+	lvb_env_set_phase(env, lane, 5,
+			  -env->release_level_step[lane] * env->amplitude.f[lane],
+			  env->release_level_step[lane]);
+}
+
+void lvb_env_set_release(lvb_env_bank_t *env, int lane, int Fs, float release) {
+	env->release_level_step[lane] = lvb_env_calc_step(1.0f / (float)Fs, release);
+}
+
+// called when the phase level of a lane has reached 1
+static void lvb_env_next_phase(lvb_env_bank_t *env, int lane) {
+	switch(env->phase[lane]) {
+	case 1: // attack -> hold
+		lvb_env_set_phase(env, lane, 2, 0.0f, env->hold_level_step[lane]);
+		break;
+
+	case 2: // hold -> decay, adapt the decay amp step to the sustain amplitude setting
+		lvb_env_set_phase(env, lane, 3,
+				  -env->decay_level_step[lane] * (1.0f - env->sustain_amplitude[lane]),
+				  env->decay_level_step[lane]);
+		break;
+
+	case 3: // decay -> sustain, wait for release
+		lvb_env_set_phase(env, lane, 4, 0.0f, 0.0f);
+		break;
+
+	case 5: // release -> no action
+		// the smoothed amplitude of an idle lane would otherwise decay into denormals
+		env->amplitude.f[lane] = 0.0f;
+		env->amplitude_mem.f[lane] = 0.0f;
+		lvb_env_set_phase(env, lane, 0, 0.0f, 0.0f);
+		break;
+	}
+}
+
+static inline lvb_vf lvb_env_sample(lvb_env_bank_t *env, int g) {
+	env->amplitude_mem.v[g] =
+		lvb_splat(0.95f) * env->amplitude_mem.v[g] +
+		lvb_splat(0.05f) * env->amplitude.v[g];
+	return env->amplitude_mem.v[g];
+}
+
+static inline void lvb_env_step(lvb_env_bank_t *env, int g) {
+	env->amplitude.v[g] += env->amp_step.v[g];
+	env->phase_level.v[g] += env->level_step.v[g];
+
+	// phase changes are rare, so they are handled one lane at a time
+	lvb_vi next = env->phase_level.v[g] >= lvb_splat(1.0f);
+	if(lvb_any(next)) {
+		int l;
+		for(l = 0; l < LVB_LANES; l++) {
+			if(env->phase_level.f[g * LVB_LANES + l] >= 1.0f)
+				lvb_env_next_phase(env, g * LVB_LANES + l);
+		}
+	}
+}
+
+/*********************************************
+ *
+ *  biquad bank
+ *
+ *********************************************/
+
+static void lvb_biquad_calc(int type, float cutoff, float resonance, float *coef) {
+	// These limits the cutoff frequency and resonance to
+	// reasoneable values.
+	if(cutoff < 0.0f) cutoff = 0.0f;
+	if(cutoff > 1.0f) cutoff = 1.0f;
+	if(resonance < 0.0f) resonance = 0.0f;
+	if(resonance > 1.0f) resonance = 1.0f;
+
+	float sn = sinf(2.0f * M_PI * cutoff);
+	float cs = cosf(2.0f * M_PI * cutoff);
+	float alpha = sn * (1.0f - resonance);
+	if(alpha < 0.0f)
+		alpha = 0.0f; // if alpha is < 0.0 we will get bad sounds...
+
+	float b0, b1, b2;
+	switch(type) {
+	case LVB_LOWPASS:
+	default:
+		b1 = 1.0f - cs;
+		b0 = b2 = b1 / 2.0f;
+		break;
+	case LVB_HIGHPASS:
+		b1 = -(1.0f + cs);
+		b0 = b2 = -(b1 / 2.0f);
+		break;
+	}
+
+	float a0_i = 1.0f / (1.0f + alpha);
+	coef[0] = b0 * a0_i;
+	coef[1] = b1 * a0_i;
+	coef[2] = b2 * a0_i;
+	coef[3] = 2.0f * cs * a0_i;
+	coef[4] = -(1.0f - alpha) * a0_i;
+}
+
+static inline void lvb_biquad_set_coef(lvb_biquad_bank_t *bq, int lane, const float *coef) {
+	bq->b0.f[lane] = coef[0];
+	bq->b1.f[lane] = coef[1];
+	bq->b2.f[lane] = coef[2];
+	bq->a1.f[lane] = coef[3];
+	bq->a2.f[lane] = coef[4];
+}
+
+void lvb_biquad_set(lvb_biquad_bank_t *bq, int lane, int type, float cutoff, float resonance) {
+	float coef[5];
+	lvb_biquad_calc(type, cutoff, resonance, coef);
+	lvb_biquad_set_coef(bq, lane, coef);
+}
+
+void lvb_biquad_set_all(lvb_biquad_bank_t *bq, int type, float cutoff, float resonance) {
+	float coef[5];
+	int l;
+
+	lvb_biquad_calc(type, cutoff, resonance, coef);
+	for(l = 0; l < LVB_MAX_VOICES; l++)
+		lvb_biquad_set_coef(bq, l, coef);
+}
+
+void lvb_biquad_reset(lvb_biquad_bank_t *bq, int lane) {
+	bq->s1.f[lane] = 0.0f;
+	bq->s2.f[lane] = 0.0f;
+}
+
+static inline void lvb_biquad_set_group(lvb_biquad_bank_t *bq, int g, int type, lvb_vf cutoff, float resonance) {
+	int l;
+	for(l = 0; l < LVB_LANES; l++)
+		lvb_biquad_set(bq, g * LVB_LANES + l, type, lvb_lane(cutoff, l), resonance);
+}
+
+// idle lanes are fed zeros, the tiny offset keeps their state away from denormals
+#define LVB_ANTI_DENORMAL 1e-20f
+
+static inline lvb_vf lvb_biquad_put(lvb_biquad_bank_t *bq, int g, lvb_vf x) {
+	lvb_vf y = bq->b0.v[g] * x + bq->s1.v[g];
+
+	bq->s1.v[g] = bq->b1.v[g] * x + bq->a1.v[g] * y + bq->s2.v[g];
+	bq->s2.v[g] = bq->b2.v[g] * x + bq->a2.v[g] * y + lvb_splat(LVB_ANTI_DENORMAL);
+
+	return y;
+}
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * Voice bank - structure of arrays state for polyphonic synthesizers.
+ *
+ * Instead of keeping one struct per voice, every state variable is stored as an array
+ * with one lane per voice. The lanes are processed LVB_LANES at a time (one lane group)
+ * using the GCC vector extensions, which become NEON instructions on ARM (-mfpu=neon)
+ * and SSE instructions on x86. Groups where no voice is active are skipped completely,
+ * and inactive lanes in a group are masked out using the active mask.
+ *
+ * All voice bank state is kept in float, also when FTYPE is fp8p24, so machines convert
+ * their parameters with FTYPEtof() and the result with ftoFTYPE().
+ *
+ * Frequencies are given as f / Fs, like for liboscillator.
+ */
+
+#ifndef __HAVE_LIBVOICEBANK_INCLUDED__
+#define __HAVE_LIBVOICEBANK_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "dynlib.h"
+
+#define LVB_LANES 4
+#define LVB_MAX_VOICES 12
+#define LVB_MAX_GROUPS (LVB_MAX_VOICES / LVB_LANES)
+
+// number of lane groups needed for nr_voices voices
+#define LVB_GROUPS(nr_voices) (((nr_voices) + LVB_LANES - 1) / LVB_LANES)
+// bits of the active mask that belong to lane group g
+#define LVB_GROUP_BITS(mask, g) (((mask) >> ((g) * LVB_LANES)) & ((1 << LVB_LANES) - 1))
+
+typedef float lvb_vf __attribute__((vector_size(16)));
+typedef int32_t lvb_vi __attribute__((vector_size(16)));
+
+// one value per voice, accessible both per lane (f) and per lane group (v)
+typedef union {
+	lvb_vf v[LVB_MAX_GROUPS];
+	float f[LVB_MAX_VOICES];
+} lvb_lanes_t;
+
+/* the voice bank objects contain vector types, use lvb_alloc() to get memory that
+ * is aligned correctly. Free it using lvb_free().
+ */
+void *lvb_alloc(size_t size);
+void lvb_free(void *bank);
+
+/*********************************************
+ *
+ *  vector helpers
+ *
+ *********************************************/
+
+static inline lvb_vf lvb_splat(float x);
+// lanes where the mask is set are taken from a, the others from b
+static inline lvb_vf lvb_select(lvb_vi mask, lvb_vf a, lvb_vf b);
+// convert the active bits of a lane group to a lane mask
+static inline lvb_vi lvb_lane_mask(unsigned int bits);
+static inline int lvb_any(lvb_vi mask);
+static inline float lvb_lane(lvb_vf v, int lane);
+static inline float lvb_sum(lvb_vf v);
+
+// sin(2 pi x) and 2^x, approximations good to about -60dB and 1e-6 respectively
+static inline lvb_vf lvb_sin_cycles(lvb_vf x); // x must be in [0, 1]
+static inline lvb_vf lvb_exp2(lvb_vf x);
+
+/*********************************************
+ *
+ *  oscillator bank
+ *
+ *********************************************/
+
+typedef struct {
+	lvb_lanes_t t; // phase, 0 to 1
+	lvb_lanes_t dt; // phase increment used by the last step, needed for the band limiting
+	lvb_lanes_t dt_base; // phase increment without modulation (f / Fs)
+
+	lvb_lanes_t glide_target;
+	lvb_lanes_t glide_step;
+	lvb_lanes_t glide_left; // number of samples left of the glide
+} lvb_osc_bank_t;
+
+void lvb_osc_set_frequency(lvb_osc_bank_t *osc, int lane, float frequency);
+// same rules as los_glide_frequency(), time is given in seconds
+void lvb_osc_glide_frequency(lvb_osc_bank_t *osc, int lane, float target_frequency, float time, int Fs);
+void lvb_osc_reset(lvb_osc_bank_t *osc, int lane);
+
+// the waveforms, matching the liboscillator source functions
+static inline lvb_vf lvb_osc_sin(lvb_osc_bank_t *osc, int g);
+static inline lvb_vf lvb_osc_saw(lvb_osc_bank_t *osc, int g);
+static inline lvb_vf lvb_osc_sawsmooth(lvb_osc_bank_t *osc, int g);
+static inline lvb_vf lvb_osc_square(lvb_osc_bank_t *osc, int g);
+// band limited waveforms, matching LOS_WAVEFORM_BLEP_SAW and LOS_WAVEFORM_BLEP_SQUARE
+static inline lvb_vf lvb_osc_blep_saw(lvb_osc_bank_t *osc, int g);
+static inline lvb_vf lvb_osc_blep_square(lvb_osc_bank_t *osc, int g);
+// 1 while t < width and -1 after it, width is between 0 and 1
+static inline lvb_vf lvb_osc_blep_pulse(lvb_osc_bank_t *osc, int g, lvb_vf width);
+// the same for any phase t advancing dt per sample, like a harmonic of an oscillator,
+// dt and dt_i must come from lvb_blep_dt() which limits dt and returns its inverse in dt_i
+static inline lvb_vf lvb_blep_dt(lvb_vf dt, lvb_vf *dt_i);
+static inline lvb_vf lvb_blep_saw(lvb_vf t, lvb_vf dt, lvb_vf dt_i);
+static inline lvb_vf lvb_blep_pulse(lvb_vf t, lvb_vf dt, lvb_vf dt_i, lvb_vf width);
+
+// step a lane group one sample, fm is the frequency modulation in semitones, or NULL
+static inline void lvb_osc_step(lvb_osc_bank_t *osc, int g, const lvb_vf *fm);
+
+/*********************************************
+ *
+ *  envelope bank - same behavior as libenvelope
+ *
+ *********************************************/
+
+typedef struct {
+	lvb_lanes_t amplitude;
+	lvb_lanes_t amplitude_mem; // for smoothing
+	lvb_lanes_t phase_level;
+
+	// the steps for the current phase of each lane
+	lvb_lanes_t amp_step;
+	lvb_lanes_t level_step;
+
+	// the settings, only used when changing phase
+	float attack_level_step[LVB_MAX_VOICES];
+	float hold_level_step[LVB_MAX_VOICES];
+	float decay_level_step[LVB_MAX_VOICES];
+	float release_level_step[LVB_MAX_VOICES];
+	float sustain_amplitude[LVB_MAX_VOICES];
+	int phase[LVB_MAX_VOICES];
+
+	unsigned int active; // one bit per lane, set when phase is not zero
+} lvb_env_bank_t;
+
+void lvb_env_reset(lvb_env_bank_t *env, int lane);
+// set up the envelope of a lane and start the attack phase, times are given in seconds
+void lvb_env_trigger(lvb_env_bank_t *env, int lane, int Fs,
+		     float attack, float hold, float decay, float sustain, float release);
+void lvb_env_release(lvb_env_bank_t *env, int lane);
+// change the release time of a lane that has already been triggered, given in seconds
+void lvb_env_set_release(lvb_env_bank_t *env, int lane, int Fs, float release);
+
+// get the smoothed amplitude of a lane group
+static inline lvb_vf lvb_env_sample(lvb_env_bank_t *env, int g);
+static inline void lvb_env_step(lvb_env_bank_t *env, int g);
+
+/*********************************************
+ *
+ *  biquad bank - same filters as xPassFilterMono
+ *
+ *********************************************/
+
+#define LVB_LOWPASS 0
+#define LVB_HIGHPASS 1
+
+typedef struct {
+	lvb_lanes_t b0, b1, b2, a1, a2; // a1 and a2 are negated
+	lvb_lanes_t s1, s2; // transposed direct form II state
+} lvb_biquad_bank_t;
+
+// cutoff is given as f / Fs, resonance between 0 and 1
+void lvb_biquad_set(lvb_biquad_bank_t *bq, int lane, int type, float cutoff, float resonance);
+void lvb_biquad_set_all(lvb_biquad_bank_t *bq, int type, float cutoff, float resonance);
+void lvb_biquad_reset(lvb_biquad_bank_t *bq, int lane);
+
+static inline void lvb_biquad_set_group(lvb_biquad_bank_t *bq, int g, int type, lvb_vf cutoff, float resonance);
+static inline lvb_vf lvb_biquad_put(lvb_biquad_bank_t *bq, int g, lvb_vf x);
+
+#endif
@@ -129,7 +129,7 @@ int fillerup(jack_nframes_t len, void *mtable_ptr) {
 		mt->set_signal_defaults(mt, _0D, len, _fl32bit, instance->frequency);
 
 		/* set midi signal defaults */
-		mt->set_signal_defaults(mt, _MIDI, len, _PTR, instance->frequency);
+		mt->set_signal_defaults(mt, _MIDI, len, _MIDI_EVENTS, instance->frequency);
 	}
 
 	/* this will eventually call our execute function, otherwise fill
@@ -273,6 +273,21 @@ void execute_midi(MachineTable *mt, MachineType mtype) {
 		return;
 	}
 
+	if(mt->get_signal_resolution(s) == _MIDI_EVENTS) {
+		MidiEventList *list = (MidiEventList *)out;
+		list->count = 0;
+
+		for(i = 0; i < event_count; i++) {
+			jack_midi_event_get(&in_event, port_buf, i);
+
+			if(!midi_event_list_append(list, in_event.time, in_event.size, in_event.buffer)) {
+				DYNLIB_DEBUG("Error in LiveOut:Midi - Midi event list is full, events are missed.");
+				return;
+			}
+		}
+		return;
+	}
+
 	if(instance->first_free_slot - instance->midi_event_buffer >= MIDI_BUFFER_SIZE) {
 		DYNLIB_DEBUG("Error in LiveOut:Midi - Midi buffer was too small, events are missed.");
 		return;
@@ -678,7 +693,7 @@ int alsa_fill_sink_callback(int callback_status, void *data) {
 					strncpy(file_name, "DEFAULT.WAV", sizeof(file_name));
 				}
 
-				RIFF_create_file(&(inst->riff_file), file_name);
+				RIFF_start_recording(mt, &(inst->riff_file), file_name);
 			}
 		}
 		break;
@@ -894,7 +909,7 @@ static AlsaInstance *init_alsa(MachineTable *mt) {
 	/* set audio signal defaults */
 	mt->set_signal_defaults(mt, _0D, instance->period_size, FTYPE_RESOLUTION, instance->rate);
 	/* set midi signal defaults */
-	mt->set_signal_defaults(mt, _MIDI, instance->period_size, _PTR, instance->rate);
+	mt->set_signal_defaults(mt, _MIDI, instance->period_size, _MIDI_EVENTS, instance->rate);
 
 	/* OK, create pthread for this */
 	pthread_attr_init(&(instance->pta));
@@ -1271,7 +1286,7 @@ int fill_sink_callback(int callback_status, void *data) {
 					strncpy(file_name, "/mnt/sdcard/SATAN_OUTPUT.WAV", sizeof(file_name));
 				}
 
-				RIFF_create_file(&(inst->riff_file), file_name);
+				RIFF_start_recording(mt, &(inst->riff_file), file_name);
 			}
 		}
 		break;
@@ -1442,7 +1457,7 @@ static AndroidInstance *init_android(MachineTable *mt) {
 		/* set audio signal defaults */
  		mt->set_signal_defaults(mt, _0D, period_size, FTYPE_RESOLUTION, rate);
 		/* set midi signal defaults */
-		mt->set_signal_defaults(mt, _MIDI, period_size, _PTR, rate);
+		mt->set_signal_defaults(mt, _MIDI, period_size, _MIDI_EVENTS, rate);
 
 		inst->mt = mt;
 
@@ -1739,7 +1754,7 @@ OpenSLInstance *init_OpenSL(MachineTable *mt) {
 				/* set audio signal defaults */
 				mt->set_signal_defaults(mt, _0D, __opensl_buffer_factor * period_size, FTYPE_RESOLUTION, rate);
 				/* set midi signal defaults */
-				mt->set_signal_defaults(mt, _MIDI, __opensl_buffer_factor * period_size, _PTR, rate);
+				mt->set_signal_defaults(mt, _MIDI, __opensl_buffer_factor * period_size, _MIDI_EVENTS, rate);
 
 				RIFF_prepare(inst, __opensl_buffer_factor * period_size * 2, &(inst->riff_file), rate);
 			} else {
@@ -1844,7 +1859,7 @@ int fill_sink_callback(int callback_status, void *data) {
 					strncpy(file_name, "/mnt/sdcard/SATAN_OUTPUT.WAV", sizeof(file_name));
 				}
 
-				RIFF_create_file(&(inst->riff_file), file_name);
+				RIFF_start_recording(mt, &(inst->riff_file), file_name);
 			}
 		}
 		break;
@@ -1921,7 +1936,7 @@ void samsung_thread_callback(unsigned int framesize, unsigned int frequency,
 			/* set audio signal defaults */
 			mt->set_signal_defaults(mt, _0D, inst->period_size, FTYPE_RESOLUTION, frequency);
 			/* set midi signal defaults */
-			mt->set_signal_defaults(mt, _MIDI, inst->period_size, _PTR, frequency);
+			mt->set_signal_defaults(mt, _MIDI, inst->period_size, _MIDI_EVENTS, frequency);
 
 			DYNLIB_DEBUG("    calling enable_low_latency_mode() (%d)\n", gettid());
 			mt->enable_low_latency_mode();
@@ -0,0 +1,233 @@
+/*
+ * vu|KNOB
+ * Copyright (C) 2015 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * Micro benchmark of ObjectAllocator (common.hh), compared to the vector
+ * based allocator it replaced and plain new/delete.
+ *
+ * Build with "make object_allocator.bench".
+ *
+ * usage: object_allocator.bench [-n objects] [-r rounds] [-t threads]
+ *
+ * fill   - allocate n objects and link them, then recycle them one by one
+ * churn  - keep n objects alive, replace a pseudo random one each step
+ * chain  - allocate n linked objects and recycle them as one chain
+ * thread - the churn test in several threads at once, for the thread cached allocator
+ *
+ * Times are nanoseconds per allocate + recycle pair.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <thread>
+#include <vector>
+#include <stack>
+
+#include "common.hh"
+
+// same size as Sequence::Note
+struct BenchNote {
+	int channel, program, velocity, note;
+	int on_at, length;
+
+	BenchNote *next;
+};
+
+// The allocator ObjectAllocator replaced. Objects are copied into a
+// std::vector, so pointers handed out earlier are invalid when it grows -
+// here the capacity is reserved up front so the benchmark doesn't crash.
+template <class T>
+class VectorObjectAllocator {
+private:
+	std::vector<T> allocated_objects;
+	std::stack<T*> free_objects;
+
+public:
+	VectorObjectAllocator(int capacity) {
+		allocated_objects.reserve(capacity);
+	}
+
+	T* allocate() {
+		T* retval = NULL;
+		if(free_objects.size() > 0) {
+			retval = free_objects.top();
+			free_objects.pop();
+		} else {
+			T new_obj;
+			auto last_index = allocated_objects.size();
+			allocated_objects.push_back(new_obj);
+			retval = &(allocated_objects.data()[last_index]);
+		}
+
+		return retval;
+	}
+
+	void recycle(T* obj) {
+		free_objects.push(obj);
+	}
+};
+
+template <class T>
+class NewDeleteAllocator {
+public:
+	T* allocate() { return new T(); }
+	void recycle(T* obj) { delete obj; }
+};
+
+static double now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// linear congruential, the same sequence for all allocators
+static inline unsigned next_random(unsigned *state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+template <class AllocatorT>
+static double bench_fill(AllocatorT &allocator, int objects, int rounds) {
+	std::vector<BenchNote *> notes(objects);
+
+	double start = now_ns();
+	for(int r = 0; r < rounds; r++) {
+		BenchNote *head = NULL;
+		for(int k = 0; k < objects; k++) {
+			auto n = allocator.allocate();
+			n->on_at = k;
+			n->next = head;
+			head = n;
+			notes[k] = n;
+		}
+		for(int k = 0; k < objects; k++)
+			allocator.recycle(notes[k]);
+	}
+	return (now_ns() - start) / ((double)objects * rounds);
+}
+
+template <class AllocatorT>
+static double bench_churn(AllocatorT &allocator, int objects, int rounds) {
+	std::vector<BenchNote *> notes(objects);
+	unsigned state = 1;
+
+	for(int k = 0; k < objects; k++)
+		notes[k] = allocator.allocate();
+
+	double start = now_ns();
+	for(long step = 0; step < (long)objects * rounds; step++) {
+		int k = next_random(&state) % objects;
+		allocator.recycle(notes[k]);
+		notes[k] = allocator.allocate();
+		notes[k]->on_at = (int)step;
+	}
+	double result = (now_ns() - start) / ((double)objects * rounds);
+
+	for(int k = 0; k < objects; k++)
+		allocator.recycle(notes[k]);
+
+	return result;
+}
+
+template <class AllocatorT>
+static double bench_chain(AllocatorT &allocator, int objects, int rounds) {
+	double start = now_ns();
+	for(int r = 0; r < rounds; r++) {
+		BenchNote *head = NULL;
+		for(int k = 0; k < objects; k++) {
+			auto n = allocator.allocate();
+			n->next = head;
+			head = n;
+		}
+		allocator.recycle_chain(head);
+	}
+	return (now_ns() - start) / ((double)objects * rounds);
+}
+
+template <class AllocatorT>
+static double bench_threads(AllocatorT &allocator, int objects, int rounds, int threads) {
+	std::vector<std::thread> workers;
+
+	double start = now_ns();
+	for(int t = 0; t < threads; t++)
+		workers.push_back(std::thread([&allocator, objects, rounds] {
+					(void) bench_churn(allocator, objects, rounds);
+				}));
+	for(auto &w : workers)
+		w.join();
+	return (now_ns() - start) / ((double)objects * rounds * threads);
+}
+
+int main(int argc, char **argv) {
+	int objects = 4096, rounds = 200, threads = 4;
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:r:t:")) != -1) {
+		switch(opt) {
+		case 'n': objects = atoi(optarg); break;
+		case 'r': rounds = atoi(optarg); break;
+		case 't': threads = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-n objects] [-r rounds] [-t threads]\n", argv[0]);
+			return 1;
+		}
+	}
+	if(objects < 1 || rounds < 1 || threads < 1) {
+		fprintf(stderr, "objects, rounds and threads must be positive\n");
+		return 1;
+	}
+
+	printf("%d objects, %d rounds, ns per allocate + recycle\n", objects, rounds);
+	printf("%-24s %8s %8s %8s %8s\n", "allocator", "fill", "churn", "chain", "thread");
+
+	{
+		VectorObjectAllocator<BenchNote> a(objects);
+		double fill = bench_fill(a, objects, rounds);
+		double churn = bench_churn(a, objects, rounds);
+		printf("%-24s %8.2f %8.2f %8s %8s\n", "vector (old)", fill, churn, "-", "-");
+	}
+	{
+		NewDeleteAllocator<BenchNote> a;
+		double fill = bench_fill(a, objects, rounds);
+		double churn = bench_churn(a, objects, rounds);
+		double thread = bench_threads(a, objects, rounds, threads);
+		printf("%-24s %8.2f %8.2f %8s %8.2f\n", "new/delete", fill, churn, "-", thread);
+	}
+	{
+		ObjectAllocator<BenchNote> a;
+		double fill = bench_fill(a, objects, rounds);
+		double churn = bench_churn(a, objects, rounds);
+		double chain = bench_chain(a, objects, rounds);
+		printf("%-24s %8.2f %8.2f %8.2f %8s\n", "slab", fill, churn, chain, "-");
+	}
+	{
+		ObjectAllocator<BenchNote, true> a;
+		double fill = bench_fill(a, objects, rounds);
+		double churn = bench_churn(a, objects, rounds);
+		double chain = bench_chain(a, objects, rounds);
+		double thread = bench_threads(a, objects, rounds, threads);
+		printf("%-24s %8.2f %8.2f %8.2f %8.2f\n", "slab, thread cached", fill, churn, chain, thread);
+	}
+
+	return 0;
+}
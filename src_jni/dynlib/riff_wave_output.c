@@ -184,6 +184,8 @@ void RIFF_prepare(void *machine_instance, size_t buffer_size, RIFF_WAVE_FILE_t *
 
 	rwf->fd = -1;
 	rwf->written_to_riff = 0;
+	rwf->rate = rate;
+	rwf->streaming = 0;
 
 	rwf->riff_header.RIFF[0] = 'R';
 	rwf->riff_header.RIFF[1] = 'I';
@@ -265,7 +267,26 @@ void RIFF_create_file(RIFF_WAVE_FILE_t *rwf, char *__file_name) {
 	}
 }
 
+void RIFF_start_recording(MachineTable *mt, RIFF_WAVE_FILE_t *rwf, char *__file_name) {
+	rwf->mt = mt;
+	rwf->streaming = 0;
+
+	if(mt->version >= MACHINE_TABLE_VERSION_RECORDING_SINK &&
+	   mt->open_recording_sink(mt, __file_name, rwf->rate, 2) == 0) {
+		DYNLIB_DEBUG(" RIFF_start_recording: streaming ]%s[.\n", __file_name); fflush(0);
+		rwf->streaming = 1;
+		return;
+	}
+
+	RIFF_create_file(rwf, __file_name);
+}
+
 void RIFF_close_file(RIFF_WAVE_FILE_t *rwf) {
+	if(rwf->streaming) {
+		rwf->mt->close_recording_sink(rwf->mt);
+		rwf->streaming = 0;
+	}
+
 	wait_for_pending_async_riff_writers(&(rwf->arwc));
 
 	if(rwf->fd != -1) {
@@ -300,6 +321,12 @@ void RIFF_write_data(
 	void *data,
 	int size) {
 
+	if(rwf->streaming) {
+		// 16 bit stereo
+		mt->write_recording_sink(mt, (int16_t *)data, size / (2 * sizeof(int16_t)));
+		return;
+	}
+
 	if(rwf->fd != -1) {
 		int k;
 
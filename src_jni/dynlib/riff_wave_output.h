@@ -76,12 +76,18 @@ typedef struct RIFF_WAVE_FILE {
 	struct RIFF_WAVE_header riff_header;
 	int fd;
 	uint32_t written_to_riff;
+	uint32_t rate;
+
+	// set when the engine's recording sink writes the files instead of us
+	int streaming;
 
 	AsyncRiffWriterContainer arwc;
 } RIFF_WAVE_FILE_t;
 
 void RIFF_prepare(void *machine_instance, size_t buffer_size, RIFF_WAVE_FILE_t *rwf, uint32_t rate);
 void RIFF_create_file(RIFF_WAVE_FILE_t *rwf, char *__file_name);
+// use the engine's recording sink if available, otherwise RIFF_create_file()
+void RIFF_start_recording(MachineTable *mt, RIFF_WAVE_FILE_t *rwf, char *__file_name);
 void RIFF_close_file(RIFF_WAVE_FILE_t *rwf);
 void RIFF_write_data(MachineTable *mt, RIFF_WAVE_FILE_t *rwf, void *data, int size);
 
@@ -41,65 +41,54 @@
 #error "CAN'T FIND config.h"
 #endif
 
-// this define forces grooveiator to do additional calculations in fixed point mode that are otherwise still floating.
-#define FILTER_USING_FIXED_POINT
-
 #include <fixedpointmath.h>
 
 #define SAMPLER_CHANNEL 0
 #define POLYPHONY 12
+#define SAMPLER_NR_GROUPS LVB_GROUPS(POLYPHONY)
+
+// the play position is an ufp24p8_t, so we can't play more than 24 bits worth of frames
+#define STATIC_SIGNAL_MAX_FRAMES 0xffffff
 
 USE_SATANS_MATH
 
+#include "libvoicebank.c"
+
 typedef enum Resolution _Resolution;
 
+// the play position of a voice, the rest of the voice state is in the voice bank
 typedef struct note_struct {
-	int active; /* !0 == active, 0 == inactive */
 	int note; /* midi note */
 	int note_on; // boolean value. This is used to make sure we only care for the FIRST received note off
 
 	_Resolution resolution;
 	
 	int channels;
-	void *data;
+	StaticSignalReader reader;
 
 	int i; /* which static signal to play */
 
 	ufp24p8_t t, t_max, t_step; /* static signal time, length and time step/output sample */
+} note_t;
 
-	// Amplitude
-	int amp_phase;
-	FTYPE amplitude; /* 0<1 */
-	int amp_attack_steps;
-	FTYPE amp_attack_step;
-	int amp_hold_steps;
-	int amp_decay_steps;
-	FTYPE amp_decay_step;
-	int amp_release_steps;
-	FTYPE amp_release_step;
-	
-	// Filter
-	int fil_phase;
-	FTYPE filter;
-	int fil_attack_steps;
-	FTYPE fil_attack_step;
-	int fil_hold_steps;
-	int fil_decay_steps;
-	FTYPE fil_decay_step;
-	int fil_release_steps;
-	FTYPE fil_release_step;
-
-	FTYPE hist_x[2];
-	FTYPE hist_y[2];
-	FTYPE coef[5];
+// the state of all voices, one lane per voice
+typedef struct sampler_voice_bank {
+	lvb_env_bank_t amp;
+	lvb_env_bank_t fil;
 
-} note_t;
+	lvb_biquad_bank_t lpf;
+
+	lvb_lanes_t velocity;
+} samplerVoiceBank_t;
 
 typedef struct sampler_instance {
 	int midi_channel;
 	float volume;
 	fp16p16_t frequency[256];
 	note_t note[POLYPHONY]; // POLYPHONY concurrent samples
+	samplerVoiceBank_t *voice;
+	int filter_recalc_step;
+	unsigned int filter_recalc_pending; // voices triggered since the last sample, one bit per voice
 	int program; // current program, used as index to static signal table
 	int fil_enable; // if 1, then enable filter envelope, otherwise disable filtering
 	
@@ -110,14 +99,8 @@ typedef struct sampler_instance {
 	float freq;
 } sampler_t;
 
-inline void calc_filter(sampler_t *ld, note_t *coef) {
-	float alpha, omega, sn, cs;
-//	float a0, a1, a2, b0, b1, b2;
-
-#ifdef FILTER_USING_FIXED_POINT
-	FTYPE fx_b0, fx_b1, fx_b2, fx_a0, fx_a1, fx_a2, fx_alpha, fx_cs;;
-#endif
-
+// filter is the filter envelope of the voices in lane group g
+inline void calc_filter(sampler_t *ld, int g, lvb_vf filter) {
 	// These limits the cutoff frequency and resonance to
 	// reasoneable values.
 	if (ld->cutoff < 4.0f) { ld->cutoff = 4.0f; };
@@ -125,59 +108,26 @@ inline void calc_filter(sampler_t *ld, note_t *coef) {
 	if (ld->resonance < 1.0f) { ld->resonance = 1.0f; };
 	if (ld->resonance > 127.0f) { ld->resonance = 127.0f; };
 
-	omega = (500.0f + (FTYPEtof(coef->filter) * ld->cutoff)) / ld->freq;
-
-//	omega = (0.5 + 0.5 * SAT_SIN_SCALAR(
-//		(coef->t % 11000) / 11000.0))  * ld->cutoff / ld->freq;
-
-//	omega = ld->cutoff / ld->freq;
-	sn = SAT_SIN_SCALAR(omega);
-	cs = SAT_COS_SCALAR(omega);
-
-	alpha = sn / ld->resonance;
-
-	if(alpha < 0.0f) {
-		alpha = 0.0; // if alpha is < 0.0 we will get bad sounds...
-	}
-
-#ifdef FILTER_USING_FIXED_POINT
-	fx_cs = ftoFTYPE(cs);
-	fx_alpha = ftoFTYPE(alpha);
-	
-	fx_b1 = ftoFTYPE(1.0f) - fx_cs;
-	fx_b0 = fx_b2 = divFTYPE(fx_b1, ftoFTYPE(2.0f));
-
-	fx_a0 = ftoFTYPE(1.0f) + fx_alpha;
-	fx_a1 = mulFTYPE(ftoFTYPE(-2.0), fx_cs);
-	fx_a2 = ftoFTYPE(1.0f) - fx_alpha;
-
-	coef->coef[0] = divFTYPE(fx_b0, fx_a0);
-	coef->coef[1] = divFTYPE(fx_b1, fx_a0);
-	coef->coef[2] = divFTYPE(fx_b2, fx_a0);
-	coef->coef[3] = divFTYPE(-fx_a1, fx_a0);
-	coef->coef[4] = divFTYPE(-fx_a2, fx_a0);
-#else
-	b1 = 1.0f - cs;
-	b0 = b2 = b1 / 2.0f;
+	lvb_vf cutoff =
+		(lvb_splat(500.0f) + filter * lvb_splat(ld->cutoff)) * lvb_splat(1.0f / ld->freq);
+	cutoff = lvb_min(cutoff, lvb_splat(0.5f));
 
-	a0 = 1.0f + alpha;
-	a1 = -2.0f * cs;
-	a2 = 1.0f - alpha;
-	
-	coef->coef[0] = ftoFTYPE(b0 / a0);
-	coef->coef[1] = ftoFTYPE(b1 / a0);
-	coef->coef[2] = ftoFTYPE(b2 / a0);
-	coef->coef[3] = ftoFTYPE(-a1 / a0);
-	coef->coef[4] = ftoFTYPE(-a2 / a0);
-#endif
-	
+	// alpha = sin(omega) / resonance
+	lvb_biquad_set_group(&(ld->voice->lpf), g, LVB_LOWPASS, cutoff, 1.0f - 1.0f / ld->resonance);
 }
 
 void *init(MachineTable *mt, const char *name) {
 	/* Allocate and initiate instance data here */
 	sampler_t *sampler = (sampler_t *)malloc(sizeof(sampler_t));;
+	if(sampler == NULL) return NULL;
 	memset(sampler, 0, sizeof(sampler_t));
 
+	sampler->voice = (samplerVoiceBank_t *)lvb_alloc(sizeof(samplerVoiceBank_t));
+	if(sampler->voice == NULL) {
+		free(sampler);
+		return NULL;
+	}
+
 	sampler->midi_channel = SAMPLER_CHANNEL;
 	sampler->volume = 0.9;
 	
@@ -256,14 +206,16 @@ void reset(MachineTable *mt, void *void_sampler) {
 	sampler_t *sampler = (sampler_t *)void_sampler;
 	int n_k;
 	for(n_k = 0; n_k < POLYPHONY; n_k++) {
-		note_t *n = &(sampler->note[n_k]);
-		n->active = 0;
+		lvb_env_reset(&(sampler->voice->amp), n_k);
+		lvb_env_reset(&(sampler->voice->fil), n_k);
+		sampler->note[n_k].note_on = 0;
 	}
 }
 
-#define SAMPLES_PER_FILTER_UPDATE (1024 - 1)
+#define SAMPLES_PER_FILTER_UPDATE 64
 void execute(MachineTable *mt, void *void_sampler) {
 	sampler_t *sampler = (sampler_t *)void_sampler;
+	samplerVoiceBank_t *v = sampler->voice;
 
 	SignalPointer *outsig = NULL;
 	SignalPointer *insig = NULL;
@@ -274,11 +226,11 @@ void execute(MachineTable *mt, void *void_sampler) {
 	outsig = mt->get_output_signal(mt, "Mono");
 	if(outsig == NULL)
 		return;
-	
+
 	void **midi_in = (void **)mt->get_signal_buffer(insig);
 	int midi_l = mt->get_signal_samples(insig);
 	MidiEvent *mev = NULL;
-			
+
 	FTYPE *out =
 		(FTYPE *)mt->get_signal_buffer(outsig);
 	int out_l = mt->get_signal_samples(outsig);
@@ -289,26 +241,31 @@ void execute(MachineTable *mt, void *void_sampler) {
 	float Fs = (float)mt->get_signal_frequency(outsig);
 	sampler->freq = Fs;
 
-	FTYPE volume = ftoFTYPE(sampler->volume);
+	// the voices are processed in float, also when FTYPE is fixed point
+	lvb_vf volume = lvb_splat(sampler->volume);
+	lvb_vf zero = lvb_splat(0.0f);
 
 	int t, n_k;
 
 	for(n_k = 0; n_k < POLYPHONY; n_k++) {
-		if(sampler->note[n_k].active) {
+		if(v->amp.active & (1 << n_k)) {
 			SignalPointer *sp = mt->get_static_signal(sampler->note[n_k].i);
-			sampler->note[n_k].data = (sp == NULL) ? NULL : mt->get_signal_buffer(sp);
+
+			// stop the voice if the static signal is gone
+			if(!static_signal_reader_init(&(sampler->note[n_k].reader), mt, sp))
+				lvb_env_reset(&(v->amp), n_k);
 		}
 	}
 
 #ifdef THIS_IS_A_MOCKERY
 	int mock_max_d = 0;
-	FTYPE mock_max_val = itoFTYPE(0);
+	float mock_max_val = 0.0f;
 #endif
-					
+
 	for(t = 0; t < out_l; t++) {
 		// check for midi events
 		mev = midi_in[t];
-		
+
 		if((mev != NULL)
 		   &&
 		   ((mev->data[0] & 0xf0) == MIDI_PROGRAM_CHANGE)
@@ -329,37 +286,37 @@ void execute(MachineTable *mt, void *void_sampler) {
 			float velocity;
 			velocity = (float)mev->data[2];
 #ifdef THIS_IS_A_MOCKERY
-			printf("  velocity: %f\n", FTYPEtof(velocity));
+			printf("  velocity: %f\n", velocity);
 #endif
 
 
 			for(n_k = 0; n_k < POLYPHONY; n_k++) {
-				if(!(sampler->note[n_k].active)) {
+				if(!(v->amp.active & (1 << n_k))) {
 					SignalPointer *sample = NULL;
-					
+
 					note_t *n = &(sampler->note[n_k]);
 
-					n->active = 1;
 					n->note_on = 1;
 					n->note = note;
-					n->amplitude = mulFTYPE(velocity, volume);
 
 					n->i = sampler->program;
 					sample =
 						mt->get_static_signal(n->i);
 
-					if(sample != NULL) {
+					if(sample != NULL && static_signal_reader_init(&(n->reader), mt, sample)) {
 						float sf = (float)mt->get_signal_frequency(sample);
 
 						n->t = itoufp24p8(0);
-						
+
 						n->channels =
 							mt->get_signal_channels(sample);
 
 						n->resolution = mt->get_signal_resolution(sample);
-						n->t_max = itoufp24p8(mt->get_signal_samples(sample));
+						n->t_max = itoufp24p8(
+							n->reader.frames > STATIC_SIGNAL_MAX_FRAMES ?
+							STATIC_SIGNAL_MAX_FRAMES : n->reader.frames);
 						sf /= Fs;
-						
+
 						n->t_step =
 							mulfp16p16(
 								ftofp16p16(sf),
@@ -367,51 +324,26 @@ void execute(MachineTable *mt, void *void_sampler) {
 									   sampler->frequency[60]) /* C4 == note 60 */
 								);
 						n->t_step = n->t_step >> 8; // we calculated using fp16p16, we need to shift it to fp24p8..
-						n->data =
-							mt->get_signal_buffer(sample);
+
+						v->velocity.f[n_k] = velocity / 127.0f;
 
 						// amplitude stuff
-						n->amp_phase = 0;
-						n->amplitude = ftoFTYPE(0.0);
-						n->amp_attack_steps = 1 +
-							(int)((float)sampler->amp_attack * (float)Fs);
-						n->amp_attack_step =
-							ftoFTYPE((velocity / 127.0) /
-								  n->amp_attack_steps);
-						n->amp_hold_steps = 1 +
-							(int)((float)sampler->amp_hold * (float)Fs);
-						n->amp_decay_steps = 1 +
-							(int)((float)sampler->amp_decay * (float)Fs);
-						n->amp_decay_step =
-							ftoFTYPE((1.0 - sampler->amp_sustain) *
-								  (velocity / 127.0) /
-								  n->amp_decay_steps);
-						
+						lvb_env_trigger(&(v->amp), n_k, (int)Fs,
+								sampler->amp_attack, sampler->amp_hold,
+								sampler->amp_decay, sampler->amp_sustain,
+								sampler->amp_release);
+
 						// filter stuff
-						n->fil_phase = 0;
-						n->filter = ftoFTYPE(0.0);
-						n->fil_attack_steps = 1 +
-							(int)((float)sampler->fil_attack * (float)Fs);
-						n->fil_attack_step =
-							ftoFTYPE((velocity / 127.0) /
-								  n->fil_attack_steps);
-						n->fil_hold_steps = 1 +
-							(int)((float)sampler->fil_hold * (float)Fs);
-						n->fil_decay_steps = 1 +
-							(int)((float)sampler->fil_decay * (float)Fs);
-						n->fil_decay_step = 
-							ftoFTYPE((1.0 - sampler->fil_sustain) *
-								  (velocity / 127.0) /
-								  n->fil_decay_steps);
-						n->hist_x[0] = itoFTYPE(0);
-						n->hist_x[1] = itoFTYPE(0);
-						n->hist_y[0] = itoFTYPE(0);
-						n->hist_y[1] = itoFTYPE(0);
-
-					} else {
-						n->active = 0;
+						lvb_env_trigger(&(v->fil), n_k, (int)Fs,
+								sampler->fil_attack, sampler->fil_hold,
+								sampler->fil_decay, sampler->fil_sustain,
+								sampler->fil_release);
+						lvb_biquad_reset(&(v->lpf), n_k);
+
+						// don't wait for the next update to set up the filter
+						sampler->filter_recalc_pending |= 1 << n_k;
 					}
-					
+
 					break;
 				}
 			}
@@ -427,128 +359,53 @@ void execute(MachineTable *mt, void *void_sampler) {
 			float velocity = (float)(mev->data[2]);
 			velocity = velocity / 127.0;
 			for(n_k = 0; n_k < POLYPHONY; n_k++) {
-				if((sampler->note[n_k].active) &&
+				if((v->amp.active & (1 << n_k)) &&
 				   (sampler->note[n_k].note == note) &&
 				   (sampler->note[n_k].note_on == 1)) {
-					note_t *n = &(sampler->note[n_k]);
+					sampler->note[n_k].note_on = 0;
+
+					// harder note offs give shorter releases
+					lvb_env_set_release(&(v->amp), n_k, (int)Fs,
+							    sampler->amp_release / (velocity + 1.0f));
+					lvb_env_release(&(v->amp), n_k);
 
-					n->note_on = 0;
-
-					n->amp_phase = 4;
-					n->amp_release_steps = 1 +
-						sampler->amp_release * Fs / (velocity + 1.0);
-					n->amp_release_step =
-						ftoFTYPE(FTYPEtof(n->amplitude) /
-							  (float)(n->amp_release_steps));
-
-					n->fil_phase = 4;
-					n->fil_release_steps = 1 +
-						sampler->fil_release * Fs / (velocity + 1.0);
-					n->fil_release_step =
-						ftoFTYPE(FTYPEtof(n->filter) /
-							  (float)(n->fil_release_steps));
+					lvb_env_set_release(&(v->fil), n_k, (int)Fs,
+							    sampler->fil_release / (velocity + 1.0f));
+					lvb_env_release(&(v->fil), n_k);
 					break;
 				}
 			}
 		}
 
-		/* zero out */
-		out[t] = itoFTYPE(0);
-
-		/* process active notes */
-		for(n_k = 0; n_k < POLYPHONY; n_k++) {
-			note_t *n = &(sampler->note[n_k]);
-			int channels = n->channels;
-			if(n->active && n->data != NULL) {
-				{ /* amplitude parameters */
-					switch(n->amp_phase) {
-					case 0: // attack phase
-						n->amplitude +=
-							n->amp_attack_step;
-						n->amp_attack_steps--;
-						if(n->amp_attack_steps < 0) {
-							n->amp_phase++;
-						}
-						break;
-					case 1: // hold phase
-						n->amp_hold_steps--;
-						if(n->amp_hold_steps < 0) {
-							n->amp_phase++;
-						}
-						break;
-					case 2: // decay phase
-						n->amplitude -=
-							n->amp_decay_step;
-						n->amp_decay_steps--;
-						if(n->amp_decay_steps < 0) {
-							n->amp_phase++;
-						}
-						break;
-					case 3: // sustain  phase
-						/* hold here until a NOTE_OFF message arrives */
-						break;
-					case 4: // release  phase
-						n->amplitude -=
-							n->amp_release_step;
-						if(n->amplitude < itoFTYPE(0)) {
-							n->amp_release_step = 0;
-							n->amp_release_steps = 0;
-						}
-						
-						n->amp_release_steps--;
-						if(n->amp_release_steps < 0) {
-							n->amplitude = itoFTYPE(0);
-							n->active = 0;
-						}
-						break;
-					}
-				}
-				
-				{ /* filter amplitude parameters */
-					switch(n->fil_phase) {
-					case 0: // attack phase
-						n->filter +=
-							n->fil_attack_step;
-						n->fil_attack_steps--;
-						if(n->fil_attack_steps < 0)
-							n->fil_phase++;
-						break;
-					case 1: // hold phase
-						n->fil_hold_steps--;
-						if(n->fil_hold_steps < 0)
-							n->fil_phase++;
-						break;
-					case 2: // decay phase
-						n->filter -=
-							n->fil_decay_step;
-						n->fil_decay_steps--;
-						if(n->fil_decay_steps < 0)
-							n->fil_phase++;
-						break;
-					case 3: // sustain  phase
-						/* hold here until a NOTE_OFF message arrives */
-						break;
-					case 4: // release  phase
-						if(n->filter > itoFTYPE(0) && n->fil_release_steps > 0) {
-							n->filter -=
-								n->fil_release_step;
-							n->fil_release_steps--;
-						}
-						if(n->filter < itoFTYPE(0))
-							n->filter = itoFTYPE(0);
-						
-						break;
-					}
-				}
+		float output = 0.0f;
+		int recalc = sampler->filter_recalc_step == 0;
+
+		/* process active notes, LVB_LANES at a time */
+		int g;
+		for(g = 0; g < SAMPLER_NR_GROUPS; g++) {
+			unsigned int bits = LVB_GROUP_BITS(v->amp.active, g);
+
+			// skip the group if all voices are idle
+			if(!bits)
+				continue;
 
-				if((n->t & SAMPLES_PER_FILTER_UPDATE) == 0)
-					calc_filter(sampler, n);
+			unsigned int ended = 0;
+			lvb_vf sample = zero;
+			int l;
 
-				FTYPE filter_tmp;
-				FTYPE val = itoFTYPE(0);
-				switch(n->resolution) {
+			// reading the static signals can't be vectorized, so that is done one lane at a time
+			for(l = 0; l < LVB_LANES; l++) {
+				n_k = g * LVB_LANES + l;
+				note_t *n = &(sampler->note[n_k]);
+				float val = 0.0f;
+
+				if(!(bits & (1 << l)))
+					continue;
+
+				void *frame = static_signal_reader_at(&(n->reader), mt, ufp24p8toi(n->t));
+				if(frame != NULL) switch(n->resolution) {
 					// never care
-				case _PTR: case _MAX_R: break;
+				case _PTR: case _MIDI_EVENTS: case _MAX_R: break;
 
 					// the rest
 				case _8bit:
@@ -557,86 +414,85 @@ void execute(MachineTable *mt, void *void_sampler) {
 					break;
 				case _fl32bit:
 				{
-					float *d = (float *)(n->data);
-					val = ftoFTYPE(d[ufp24p8toi(n->t) * (int)channels]);
+					float *d = (float *)frame;
+					val = d[0];
 				}
 					break;
 				case _fx8p24bit:
 				{
-					fp8p24_t *d = (fp8p24_t *)(n->data);
-					fp8p24_t tmp = d[ufp24p8toi(n->t) * (int)channels];
-
-#ifdef __SATAN_USES_FXP
-					val = tmp;
-#else
-					val = fp8p24tof(tmp);
-#endif
+					fp8p24_t *d = (fp8p24_t *)frame;
+					val = fp8p24tof(d[0]);
 				}
 					break;
 				case _16bit:
 				{
-#ifdef __SATAN_USES_FXP
-					int16_t *d = (int16_t *)(n->data);
-					int32_t *tmp = (int32_t *)&val;
-					*tmp = (int32_t)d[ufp24p8toi(n->t) * (int)channels];
-					*tmp = *tmp << 7;
-
-#ifdef THIS_IS_A_MOCKERY
-					mock_max_d = d[ufp24p8toi(n->t) * (int)channels] > mock_max_d ?
-						d[ufp24p8toi(n->t) * (int)channels] : mock_max_d;
-					mock_max_val = val > mock_max_val ? val : mock_max_val;
-#endif
-
-#else
-					int16_t *d = (int16_t *)(n->data);
-					val = (float)d[ufp24p8toi(n->t) * (int)channels];
+					int16_t *d = (int16_t *)frame;
+					val = (float)d[0];
 
-					val = val / (4.0f * 32768.0f);  
+					val = val / (4.0f * 32768.0f);
 
 #ifdef THIS_IS_A_MOCKERY
-					mock_max_d = d[ufp24p8toi(n->t) * (int)channels] > mock_max_d ?
-						d[ufp24p8toi(n->t) * (int)channels] : mock_max_d;
+					mock_max_d = d[0] > mock_max_d ?
+						d[0] : mock_max_d;
 					mock_max_val = val > mock_max_val ? val : mock_max_val;
-#endif
 #endif
 				}
 				break;
 				}
 
-				val = mulFTYPE(val, n->amplitude);
-
-				filter_tmp =
-					mulFTYPE(n->coef[0], val) +
-					mulFTYPE(n->coef[1], n->hist_x[0]) +
-					mulFTYPE(n->coef[2], n->hist_x[1]) +
-					mulFTYPE(n->coef[3], n->hist_y[0]) +
-					mulFTYPE(n->coef[4], n->hist_y[1]);
-				
-				n->hist_y[1] = n->hist_y[0];
-				n->hist_y[0] = filter_tmp;
-				n->hist_x[1] = n->hist_x[0];
-				n->hist_x[0] = val;
-				
-				out[t] += sampler->fil_enable ? 
-					mulFTYPE(filter_tmp, volume) :
-					mulFTYPE(val, volume);
-				
+				// insert the frame in lane l without going through memory
+				sample = lvb_select(lvb_lane_mask(1 << l), lvb_splat(val), sample);
+
 				n->t += n->t_step;
 				if(n->t >= n->t_max) {
-					n->active = 0;
+					ended |= 1 << l;
 				}
 			}
+
+			lvb_vi mask = lvb_lane_mask(bits);
+
+			lvb_vf amplitude = lvb_env_sample(&(v->amp), g);
+			lvb_env_step(&(v->amp), g);
+
+			// the filter envelope is only read at the filter updates, so it isn't smoothed
+			lvb_vf filter = v->fil.amplitude.v[g];
+			lvb_env_step(&(v->fil), g);
+
+			lvb_vf val = sample * amplitude * v->velocity.v[g];
+
+			if(sampler->fil_enable) {
+				if(recalc || LVB_GROUP_BITS(sampler->filter_recalc_pending, g))
+					calc_filter(sampler, g, filter * v->velocity.v[g]);
+
+				val = lvb_biquad_put(&(v->lpf), g, val);
+			}
+
+			// idle voices in the group are masked out
+			output += lvb_sum(lvb_select(mask, val * volume, zero));
+
+			for(l = 0; l < LVB_LANES; l++) {
+				if(ended & (1 << l))
+					lvb_env_reset(&(v->amp), g * LVB_LANES + l);
+			}
 		}
+		sampler->filter_recalc_pending = 0;
+		sampler->filter_recalc_step =
+			(sampler->filter_recalc_step + 1) % SAMPLES_PER_FILTER_UPDATE;
+
+		out[t] = ftoFTYPE(output);
 	}
 
 #ifdef THIS_IS_A_MOCKERY
 	printf(" max d: %d\n", mock_max_d);
-	printf(" max val: %f\n", FTYPEtof(mock_max_val));
+	printf(" max val: %f\n", mock_max_val);
 #endif
 
 }
 
 void delete(void *data) {
+	sampler_t *sampler = (sampler_t *)data;
+
 	/* free instance data here */
-	free(data);
+	if(sampler->voice) lvb_free(sampler->voice);
+	free(sampler);
 }
@@ -41,11 +41,11 @@
 USE_SATANS_MATH
 
 #include "liboscillator.c"
-#include "libfilter.c"
-#include "libenvelope.c"
+#include "libvoicebank.c"
 
 // keys and voices must be equal size...
 #define SUBASTARD_NR_VOICES 6
+#define SUBASTARD_NR_GROUPS LVB_GROUPS(SUBASTARD_NR_VOICES)
 #define SUBASTARD_FILTER_RECALC_PERIOD 1024
 
 // +4 since we need four "spare" ones for VCO modulation
@@ -53,25 +53,25 @@ USE_SATANS_MATH
 #define NOTE_TABLE_LENGTH 256 + 4 + 24
 FTYPE note_table[NOTE_TABLE_LENGTH];
 
-typedef struct subastard_voice {
-	FTYPE velocity;
-	
-	int filter_recalc_step;
+// the state of all voices, one lane per voice
+typedef struct subastard_voice_bank {
+	lvb_osc_bank_t vco_1;
+	lvb_osc_bank_t vco_2;
 
-	oscillator_t vco_1;
-	oscillator_t vco_2;
+	lvb_biquad_bank_t lpf;
 
-	xPassFilterMono_t *lpf;
-	
-	envelope_t env1;
-	envelope_t env2;
-
-	int active_key;
-} subastardVoice_t;
+	lvb_env_bank_t env1;
+	lvb_env_bank_t env2;
 
+	lvb_lanes_t velocity;
+} subastardVoiceBank_t;
 
 typedef struct subastard_instance {
-	subastardVoice_t voice[SUBASTARD_NR_VOICES];
+	subastardVoiceBank_t *voice;
+	int active_key[SUBASTARD_NR_VOICES];
+
+	int filter_recalc_step;
+	unsigned int filter_recalc_pending; // voices triggered since the last sample, one bit per voice
 
 	FTYPE general_mix;
 	FTYPE general_volume;
@@ -105,26 +105,10 @@ typedef struct subastard_instance {
 	FTYPE vcf_env;
 } subastard_t;
 
-int init_voice(MachineTable *mt, subastardVoice_t *v) {
-	los_init_oscillator(&(v->vco_1));
-	los_init_oscillator(&(v->vco_2));
-
-	v->lpf = create_xPassFilterMono(mt, 0);
-	if(v->lpf == NULL) return -1;
-
-	return 0;
-}
-
-void free_voice(subastardVoice_t *v) {
-	if(v->lpf) xPassFilterMonoFree(v->lpf);
-}
-
 void delete(void *void_subastard) {
 	subastard_t *subastard = (subastard_t *)void_subastard;
-	int k;
-	for(k = 0; k < SUBASTARD_NR_VOICES; k++) {
-		free_voice(&(subastard->voice[k]));
-	}
+
+	if(subastard->voice) lvb_free(subastard->voice);
 
 	/* free instance data here */
 	free(subastard);
@@ -135,11 +119,9 @@ void reset(MachineTable *mt, void *void_subastard) {
 
 	int l;
 	for(l = 0; l < SUBASTARD_NR_VOICES; l++) {
-		subastardVoice_t *v = &(subastard->voice[l]);
-
-		envelope_reset(&(v->env1));
-		envelope_reset(&(v->env2));
-		v->active_key = -1;
+		lvb_env_reset(&(subastard->voice->env1), l);
+		lvb_env_reset(&(subastard->voice->env2), l);
+		subastard->active_key[l] = -1;
 	}
 
 }
@@ -151,12 +133,9 @@ void *init(MachineTable *mt, const char *name) {
 	
 	memset(subastard, 0, sizeof(subastard_t));
 
-	int k;
-	for(k = 0; k < SUBASTARD_NR_VOICES; k++) {
-		if(init_voice(mt, &(subastard->voice[k]))) {
-			goto fail;
-		}
-	}
+	subastard->voice = (subastardVoiceBank_t *)lvb_alloc(sizeof(subastardVoiceBank_t));
+	if(subastard->voice == NULL)
+		goto fail;
 	
 	/* set defaults */
 	subastard->general_mix = ftoFTYPE(0.5f);
@@ -259,47 +238,40 @@ void calc_note_freq() {
 	}
 }
 
-inline void trigger_voice_envelope(envelope_t *env, int Fs,
+inline void trigger_voice_envelope(lvb_env_bank_t *env, int voice_id, int Fs,
 				   FTYPE a, FTYPE d, FTYPE s, FTYPE r) {
-	envelope_init(env, Fs);
-	
-	envelope_set_attack(env, a);
-	envelope_set_hold(env, ftoFTYPE(0.001));
-	envelope_set_decay(env, d);
-	envelope_set_sustain(env, s);
-	envelope_set_release(env, r);
-
-	envelope_hold(env);
-
+	lvb_env_trigger(env, voice_id, Fs,
+			FTYPEtof(a), 0.001f, FTYPEtof(d), FTYPEtof(s), FTYPEtof(r));
 }
 
-inline void set_voice_to_key(subastard_t *subastard, subastardVoice_t *voice, int key) {
+inline void set_voice_to_key(subastard_t *subastard, int voice_id, int key, int Fs) {
+	subastardVoiceBank_t *voice = subastard->voice;
 	FTYPE frequency_end = note_table[key];
 	FTYPE frequency_1_begin = mulFTYPE(frequency_end, subastard->vco_1_begin_multiplier);
 	FTYPE frequency_2_begin = mulFTYPE(frequency_end, subastard->vco_2_begin_multiplier);
 
-	los_set_base_frequency(
-		&(voice->vco_1),
-		frequency_1_begin);
+	lvb_osc_set_frequency(
+		&(voice->vco_1), voice_id,
+		FTYPEtof(frequency_1_begin));
 	
-	los_set_base_frequency(
-		&(voice->vco_2),
-		frequency_2_begin);
+	lvb_osc_set_frequency(
+		&(voice->vco_2), voice_id,
+		FTYPEtof(frequency_2_begin));
 	
-	los_glide_frequency(
-		&(voice->vco_1),
-		frequency_end,
-		subastard->vco_1_freq_slide);
+	lvb_osc_glide_frequency(
+		&(voice->vco_1), voice_id,
+		FTYPEtof(frequency_end),
+		FTYPEtof(subastard->vco_1_freq_slide), Fs);
 	
-	los_glide_frequency(
-		&(voice->vco_2),
-		frequency_end,
-		subastard->vco_2_freq_slide
-		);
+	lvb_osc_glide_frequency(
+		&(voice->vco_2), voice_id,
+		FTYPEtof(frequency_end),
+		FTYPEtof(subastard->vco_2_freq_slide), Fs);
 }
 
 void execute(MachineTable *mt, void *void_subastard) {
 	subastard_t *subastard = (subastard_t *)void_subastard;
+	subastardVoiceBank_t *v = subastard->voice;
 
 	SignalPointer *outsig = NULL;
 	SignalPointer *insig = NULL;
@@ -333,7 +305,6 @@ void execute(MachineTable *mt, void *void_subastard) {
 #endif
 	
 	los_set_Fs(mt, Fs);
-	libfilter_set_Fs(Fs);
 
 	static int Fs_CURRENT = 0;
 	if(Fs_CURRENT != Fs) {
@@ -341,9 +312,9 @@ void execute(MachineTable *mt, void *void_subastard) {
 		calc_note_freq(Fs);
 	}
 	
-	FTYPE vcf_cutoff = mulFTYPE(subastard->vcf_cutoff, ftoFTYPE(0.45)); // 45% of Fs
-	FTYPE vcf_resonance = subastard->vcf_resonance;
-	FTYPE vcf_env = subastard->vcf_env;
+	float vcf_cutoff = FTYPEtof(mulFTYPE(subastard->vcf_cutoff, ftoFTYPE(0.45))); // 45% of Fs
+	float vcf_resonance = FTYPEtof(subastard->vcf_resonance);
+	float vcf_env = FTYPEtof(subastard->vcf_env);
 
 	FTYPE env1_a, env1_d, env1_s, env1_r;
 	env1_a = subastard->env1_attack;
@@ -370,6 +341,11 @@ void execute(MachineTable *mt, void *void_subastard) {
 
 	FTYPE volume = (subastard->general_volume);
 
+	// the voices are processed in float, also when FTYPE is fixed point
+	lvb_vf gain_VCO_1 = lvb_splat(FTYPEtof(mulFTYPE(volume, mix_VCO_1)));
+	lvb_vf gain_VCO_2 = lvb_splat(FTYPEtof(mulFTYPE(volume, mix_VCO_2)));
+	lvb_vf zero = lvb_splat(0.0f);
+
 	int t; 
 	for(t = 0; t < out_l; t++) {		
 		MidiEvent *mev = (MidiEvent *)midi_in[t];
@@ -390,26 +366,26 @@ void execute(MachineTable *mt, void *void_subastard) {
 
 			int voice_id;
 			for(voice_id = 0; voice_id < SUBASTARD_NR_VOICES; voice_id++) {
-				if(subastard->voice[voice_id].active_key == -1) {
+				if(subastard->active_key[voice_id] == -1) {
 					// set the active key of this voice
-					subastard->voice[voice_id].active_key = key;
+					subastard->active_key[voice_id] = key;
 
 					// set velocity
-					subastard->voice[voice_id].velocity = velocity_f;
+					v->velocity.f[voice_id] = FTYPEtof(velocity_f);
 					
 					// trigger the envelope
-					trigger_voice_envelope(&(subastard->voice[voice_id].env1),
+					trigger_voice_envelope(&(v->env1), voice_id,
 							       Fs,
 							       env1_a, env1_d, env1_s, env1_r);
-					trigger_voice_envelope(&(subastard->voice[voice_id].env2),
+					trigger_voice_envelope(&(v->env2), voice_id,
 							       Fs,
 							       env2_a, env2_d, env2_s, env2_r);
 
 					// set the frequencies for the oscillators
-					set_voice_to_key(subastard,
-							 &(subastard->voice[voice_id]),
-							 key
-						);
+					set_voice_to_key(subastard, voice_id, key, Fs);
+
+					// don't wait for the next recalc period to set up the filter
+					subastard->filter_recalc_pending |= 1 << voice_id;
 						
 					// exit for loop
 					break;
@@ -426,115 +402,97 @@ void execute(MachineTable *mt, void *void_subastard) {
 			int key = mev->data[1];
 			int voice_id;
 			for(voice_id = 0; voice_id < SUBASTARD_NR_VOICES; voice_id++) {
-				if(subastard->voice[voice_id].active_key == key) {
+				if(subastard->active_key[voice_id] == key) {
 					// mark this voice as unused
-					subastard->voice[voice_id].active_key = -1;
+					subastard->active_key[voice_id] = -1;
 
 					// release envelope
-					envelope_release(
-						&(subastard->voice[voice_id].env1));
-					envelope_release(
-						&(subastard->voice[voice_id].env2));
+					lvb_env_release(&(v->env1), voice_id);
+					lvb_env_release(&(v->env2), voice_id);
 				}
 			}						
 		}
 
-		// set the current output sample to 0
-		out[t] = itoFTYPE(0);
+		float output = 0.0f;
+		int recalc = subastard->filter_recalc_step == 0;
 
-		// process voices
+		// process voices, LVB_LANES at a time
 		{
-			int l;
-			for(l = 0; l < SUBASTARD_NR_VOICES; l++) {
-				subastardVoice_t *v = &(subastard->voice[l]);
-
-				// if both envelopes are non-active, skip processing this voice
-				if(
-					(!envelope_is_active(&(v->env1)))
-					&&
-					(!envelope_is_active(&(v->env2)))
-					) {
-					break;
-				} 
-				
+			// a voice is processed as long as one of the envelopes is active
+			unsigned int active = v->env1.active | v->env2.active;
+
+			int g;
+			for(g = 0; g < SUBASTARD_NR_GROUPS; g++) {
+				unsigned int bits = LVB_GROUP_BITS(active, g);
+
+				// skip the group if all voices are idle
+				if(!bits)
+					continue;
+
 				// otherwise, process it hereafter!
-				
-				FTYPE vco_1 = itoFTYPE(0), vco_2 = itoFTYPE(0);
-				FTYPE env1 = itoFTYPE(0);
-				FTYPE env2 = itoFTYPE(0);
+
+				lvb_vi mask = lvb_lane_mask(bits);
+				lvb_vf vco_1 = zero, vco_2 = zero;
+				lvb_vf env1, env2;
 
 				{ // process ENV1 and ENV2
-					env1 = envelope_get_sample(&(v->env1));
-					envelope_step(&(v->env1));
-					env2 = envelope_get_sample(&(v->env2));
-					envelope_step(&(v->env2));
+					env1 = lvb_env_sample(&(v->env1), g);
+					lvb_env_step(&(v->env1), g);
+					env2 = lvb_env_sample(&(v->env2), g);
+					lvb_env_step(&(v->env2), g);
 				}
 				
 				{ // process VCO-2
-					FTYPE saw = los_get_alternate_sample(&(v->vco_2), los_src_saw);
 					if(subastard->vco_2_sin)
-						vco_2 += los_get_alternate_sample(&(v->vco_2), los_src_sin);
+						vco_2 += lvb_osc_sin(&(v->vco_2), g);
 					if(subastard->vco_2_saw)
-						vco_2 += saw;
-					if(subastard->vco_2_pulse) {
-						vco_2 += los_get_alternate_sample(
-							&(v->vco_2), los_src_square);
-					}
+						vco_2 += lvb_osc_blep_saw(&(v->vco_2), g);
+					if(subastard->vco_2_pulse)
+						vco_2 += lvb_osc_blep_square(&(v->vco_2), g);
 					
-					los_step_oscillator(&(v->vco_2), itoFTYPE(0), itoFTYPE(0));
+					lvb_osc_step(&(v->vco_2), g, NULL);
 				}
 
 				{ // process VCO-1
-					FTYPE saw = los_get_alternate_sample(&(v->vco_1), los_src_saw);
 					if(subastard->vco_1_sin)
-						vco_1 += los_get_alternate_sample(&(v->vco_1), los_src_sin);
+						vco_1 += lvb_osc_sin(&(v->vco_1), g);
 					if(subastard->vco_1_saw)
-						vco_1 += saw;
-					if(subastard->vco_1_pulse) {
-						vco_1 += los_get_alternate_sample(
-							&(v->vco_1), los_src_square);
-					}
-					los_step_oscillator(&(v->vco_1), itoFTYPE(0), itoFTYPE(0));
+						vco_1 += lvb_osc_blep_saw(&(v->vco_1), g);
+					if(subastard->vco_1_pulse)
+						vco_1 += lvb_osc_blep_square(&(v->vco_1), g);
+
+					lvb_osc_step(&(v->vco_1), g, NULL);
 				}
 
 				{ // process VCF parameters
-					FTYPE cutoff;
+					if(recalc || LVB_GROUP_BITS(subastard->filter_recalc_pending, g)) {
+						lvb_vf cutoff = lvb_splat(vcf_cutoff) *
+							(lvb_splat(1.0f - vcf_env) + env1 * lvb_splat(vcf_env));
 
-					if(v->filter_recalc_step == 0) {
-						cutoff = mulFTYPE(vcf_cutoff,
-								  itoFTYPE(1) - vcf_env + mulFTYPE(env1, vcf_env));
-					       
-
-						xPassFilterMonoSetCutoff(v->lpf, cutoff);
-						xPassFilterMonoSetResonance(v->lpf, vcf_resonance);
-						xPassFilterMonoRecalc(v->lpf);
+						lvb_biquad_set_group(&(v->lpf), g, LVB_LOWPASS, cutoff, vcf_resonance);
 					}
 				}
 
 				{ // process end result
 #ifdef THIS_IS_A_MOCKERY
-					if(l == 0) {
-						int_out_a[t] = mulFTYPE(ftoFTYPE(0.9f), vco_1);
-						int_out_b[t] = mulFTYPE(ftoFTYPE(0.9f), vco_2);
+					if(g == 0 && (bits & 1)) {
+						int_out_a[t] = ftoFTYPE(0.9f * lvb_lane(vco_1, 0));
+						int_out_b[t] = ftoFTYPE(0.9f * lvb_lane(vco_2, 0));
 					}
 #endif
-					
-					vco_1 = mulFTYPE(vco_1, env1);
-					vco_2 = mulFTYPE(vco_2, env2);
-					FTYPE output_v = mulFTYPE(
-						volume,
-						mulFTYPE(mix_VCO_1, vco_1) + mulFTYPE(mix_VCO_2, vco_2)
-						);
 
-					output_v = mulFTYPE(output_v, v->velocity);
+					lvb_vf output_v =
+						(gain_VCO_1 * vco_1 * env1 + gain_VCO_2 * vco_2 * env2) * v->velocity.v[g];
 
-					xPassFilterMonoPut(v->lpf, output_v);
-					output_v = xPassFilterMonoGet(v->lpf);
-					
-					out[t] += output_v;
+					// idle voices in the group are masked out
+					output_v = lvb_biquad_put(&(v->lpf), g, lvb_select(mask, output_v, zero));
+					output += lvb_sum(lvb_select(mask, output_v, zero));
 				}
-				v->filter_recalc_step = (v->filter_recalc_step + 1) % SUBASTARD_FILTER_RECALC_PERIOD;
 			}
 		}
+		subastard->filter_recalc_pending = 0;
+		subastard->filter_recalc_step = (subastard->filter_recalc_step + 1) % SUBASTARD_FILTER_RECALC_PERIOD;
+
+		out[t] = ftoFTYPE(output);
 	}
 }
@@ -41,331 +41,365 @@
 #include "dynlib.h"
 USE_SATANS_MATH
 
-#include "libfilter.c"
+/* The vocoder is a short time Fourier transform filter bank. For each hop
+ * the modulator and the carrier are windowed and transformed once, the
+ * spectrum is divided into bands with logarithmically spaced edges and the
+ * carrier bins of each band are scaled by the modulator band level over
+ * the carrier band level. The carrier is thus flattened and the output
+ * gets the spectral envelope of the modulator. The carrier spectrum is
+ * then transformed back and overlap-added.
+ *
+ * The number of bands and the transform size, which sets both the
+ * latency and the frequency resolution, can be changed while running.
+ * The output is delayed by the transform size.
+ */
 
-// if we have a fixed point implementation
-// we use the IIR implementation
-// otherwise the default is to use the FFT implementation
-#ifdef __SATAN_USES_FXP
-#define VOCODER_IIR_IMPLEMENTATION
-#define VOCODER_CHANNELS 10
-#else
-#define FFT_OPTIMAL_LENGTH 512
-#define VOCODER_CHANNELS 16
-#endif
+#define VOCODER_MIN_BANDS 8
+#define VOCODER_MAX_BANDS 64
 
+// transform sizes selected by the latency controller, 256 to 2048
+#define VOCODER_SIZES 4
+#define VOCODER_MIN_FFT_BITS 8
+#define VOCODER_MAX_FFT (1 << (VOCODER_MIN_FFT_BITS + VOCODER_SIZES - 1))
 
-typedef struct _VocoderData {
+// hop = fft_len / VOCODER_OVERLAP, the square root Hann windows sum to 2 at 75% overlap
+#define VOCODER_OVERLAP 4
 
-#ifdef VOCODER_IIR_IMPLEMENTATION
-	bandPassFilterMono_t **bp_carrier;
-	bandPassFilterMono_t **bp_modulator;
-	xPassFilterMono_t **lp_modulator; // for envelope detector
-#else
-	FTYPE *prev_carrier, *prev_modulator;
-	FTYPE *prev_output;
-	FTYPE *next_output;
-	FTYPE *output;
-	FTYPE *hanning;
-	FTYPE *carrier, *modulator;
-	kiss_fftr_cfg fft_fwd_cfg;
-	kiss_fftr_cfg fft_rev_cfg;
-	kiss_fft_cpx *m_fft;
-	kiss_fft_cpx *c_fft;
-	int fft_len, fft_lap, channel_width;
-
-	// in case the machine input and output buffers
-	// are smaller than FFT_OPTIMAL_LENGTH we need to use
-	// these indirect buffers to save up enough data to process..
-	// this causes extra latency in the output but it shouldn't be significant to actually hear it
-	FTYPE *indirect_carrier;
-	FTYPE *indirect_modulator;
-	FTYPE *indirect_output;
-	int indirect_index, indirect_limit, indirect_size;
-#endif
+// the bands are spaced logarithmically between these, the first and last band take the rest
+#define VOCODER_LOW_FREQUENCY 100.0f
+#define VOCODER_HIGH_FREQUENCY 12000.0f
 
-	float volume;
+// the carrier band level is limited from below, relative to the average band and absolute,
+// so that we don't amplify noise in bands where the carrier is silent
+#define VOCODER_RELATIVE_FLOOR 0.001f
+#define VOCODER_ABSOLUTE_FLOOR 0.000001f
+#define VOCODER_MAX_GAIN 16.0f
 
+typedef struct _VocoderData {
+	float volume;
+	int bands; // controller
+	int latency; // controller, index of the transform size
+
+	// the active configuration
+	int Fs, active_bands, size;
+	int fft_len, fft_bits, hop;
+	float power_scale; // converts the sum of squared bins to signal power
+	int band_start[VOCODER_MAX_BANDS + 1]; // first bin of each band
+
+	kiss_fftr_cfg forward[VOCODER_SIZES], inverse[VOCODER_SIZES];
+
+	FTYPE *window; // square root of a periodic Hann window
+	FTYPE *modulator, *carrier; // the last fft_len frames of input
+	FTYPE *frame; // scratch
+	FTYPE *overlap; // overlap-add accumulator
+	FTYPE *ready; // one hop of output, delivered during the next hop
+	kiss_fft_cpx *spectrum;
+	int position; // frames collected in the current hop
+
+	float m_power[VOCODER_MAX_BANDS], c_power[VOCODER_MAX_BANDS];
+	FTYPE gain[VOCODER_MAX_BANDS];
 } VocoderData;
 
-#ifdef VOCODER_IIR_IMPLEMENTATION
+/*********************************************
+ *
+ *  modulator analysis cache
+ *
+ *  Vocoders fed by the same modulator see the same
+ *  frames - as long as they started at the same time
+ *  modulo the hop size, which is always the case when the
+ *  hop size divides the buffer size - so the first one to
+ *  analyse a frame stores the band levels here. An entry is
+ *  keyed by the complete frame, a hit is exact. Entries are
+ *  protected like the biquad coefficient cache in
+ *  libfilter.c, an entry that is busy is a miss.
+ *
+ *********************************************/
 
-void cleanup_filters(VocoderData *d) {
-	int k = 0;
+#define VOCODER_CACHE_SIZE 8
 
-	if(d->bp_carrier) {
-		for(k = 0; k < VOCODER_CHANNELS; k++) {
-			if(d->bp_carrier[k])
-				bandPassFilterMonoFree(d->bp_carrier[k]);
-		}
-		free(d->bp_carrier);
-		d->bp_carrier = NULL;
-	}
-	if(d->bp_modulator) {
-		for(k = 0; k < VOCODER_CHANNELS; k++) {
-			if(d->bp_modulator[k])
-				bandPassFilterMonoFree(d->bp_modulator[k]);
-		}
-		free(d->bp_modulator);
-		d->bp_modulator = NULL;
-	}
-	if(d->lp_modulator) {
-		for(k = 0; k < VOCODER_CHANNELS; k++) {
-			if(d->lp_modulator[k])
-				xPassFilterMonoFree(d->lp_modulator[k]);
-		}
-		free(d->lp_modulator);
-		d->lp_modulator = NULL;
-	}
+typedef struct _VocoderCacheEntry {
+	volatile int sequence;
+	uint32_t hash;
+	int Fs, fft_len, bands;
+	FTYPE frame[VOCODER_MAX_FFT];
+	float power[VOCODER_MAX_BANDS];
+} VocoderCacheEntry;
 
-}
+static VocoderCacheEntry vocoder_cache[VOCODER_CACHE_SIZE];
 
-int setup_filters(MachineTable *mt, VocoderData *d, float Fs) {
-	cleanup_filters(d);
+// the frames before the last hop are part of the key but not the hash
+static uint32_t vocoder_cache_hash(VocoderData *d) {
+	const FTYPE *x = &(d->modulator[d->fft_len - d->hop]);
+	uint32_t h = 2166136261u;
+	int k;
 
-	d->bp_carrier = (bandPassFilterMono_t **)calloc(1, sizeof(bandPassFilterMono_t *) * VOCODER_CHANNELS);
-	d->bp_modulator = (bandPassFilterMono_t **)calloc(1, sizeof(bandPassFilterMono_t *) * VOCODER_CHANNELS);
-	d->lp_modulator = (xPassFilterMono_t **)calloc(1, sizeof(xPassFilterMono_t *) * VOCODER_CHANNELS);
+	for(k = 0; k < d->hop; k++) {
+		union { FTYPE f; uint32_t u; } v;
+		v.f = x[k];
+		h = (h ^ v.u) * 16777619u;
+	}
+	return h ^ (h >> 16);
+}
 
-	if(d->bp_carrier == NULL || d->bp_modulator == NULL || d->lp_modulator == NULL) return 1;
+static int vocoder_cache_lookup(VocoderData *d, uint32_t hash) {
+	VocoderCacheEntry *e = &(vocoder_cache[hash & (VOCODER_CACHE_SIZE - 1)]);
+	int sequence = e->sequence;
+	int hit;
 
-	int k;
-	for(k = 0; k < VOCODER_CHANNELS; k++) {
-		d->bp_carrier[k] = create_bandPassFilterMono(mt);
-		d->bp_modulator[k] = create_bandPassFilterMono(mt);
-		d->lp_modulator[k] = create_xPassFilterMono(mt, 0);
+	if(sequence & 1)
+		return 0; // being written
 
-		if(d->bp_carrier[k] == NULL || d->bp_modulator[k] == NULL ||d->lp_modulator[k] == NULL)
-			return 1;
+	__sync_synchronize();
+	hit = e->hash == hash && e->Fs == d->Fs && e->fft_len == d->fft_len && e->bands == d->active_bands &&
+		memcmp(e->frame, d->modulator, sizeof(FTYPE) * d->fft_len) == 0;
+	if(hit)
+		memcpy(d->m_power, e->power, sizeof(float) * d->active_bands);
+	__sync_synchronize();
 
-		xPassFilterMonoSetResonance(d->lp_modulator[k], ftoFTYPE(0.0f));
-	}
+	// if the entry was changed while we read it we treat it as a miss
+	return hit && e->sequence == sequence;
+}
 
-	bandPassFilterMonoSetFrequencies(d->bp_carrier[0], 31.0f / Fs, 1.4);
-	bandPassFilterMonoSetFrequencies(d->bp_modulator[0], 31.0f / Fs, 1.4);
-	xPassFilterMonoSetCutoff(d->lp_modulator[0], ftoFTYPE(31.0f / (2.0f * Fs)));
+static void vocoder_cache_store(VocoderData *d, uint32_t hash) {
+	VocoderCacheEntry *e = &(vocoder_cache[hash & (VOCODER_CACHE_SIZE - 1)]);
+	int sequence = e->sequence;
 
-	bandPassFilterMonoSetFrequencies(d->bp_carrier[1], 62.0f / Fs, 1.4);
-	bandPassFilterMonoSetFrequencies(d->bp_modulator[1], 62.0f / Fs, 1.4);
-	xPassFilterMonoSetCutoff(d->lp_modulator[1], ftoFTYPE(62.0f / (2.0f * Fs)));
+	// if someone else is writing the entry we just skip it
+	if((sequence & 1) ||
+	   !__sync_bool_compare_and_swap(&(e->sequence), sequence, sequence + 1))
+		return;
 
-	bandPassFilterMonoSetFrequencies(d->bp_carrier[2], 125.0f / Fs, 1.4);
-	bandPassFilterMonoSetFrequencies(d->bp_modulator[2], 125.0f / Fs, 1.4);
-	xPassFilterMonoSetCutoff(d->lp_modulator[2], ftoFTYPE(125.0f / (2.0f * Fs)));
+	e->hash = hash;
+	e->Fs = d->Fs;
+	e->fft_len = d->fft_len;
+	e->bands = d->active_bands;
+	memcpy(e->frame, d->modulator, sizeof(FTYPE) * d->fft_len);
+	memcpy(e->power, d->m_power, sizeof(float) * d->active_bands);
 
-	bandPassFilterMonoSetFrequencies(d->bp_carrier[3], 250.0f / Fs, 1.4);
-	bandPassFilterMonoSetFrequencies(d->bp_modulator[3], 250.0f / Fs, 1.4);
-	xPassFilterMonoSetCutoff(d->lp_modulator[3], ftoFTYPE(250.0f / (4.0f * Fs)));
+	__sync_synchronize();
+	e->sequence = sequence + 2;
+}
 
-	bandPassFilterMonoSetFrequencies(d->bp_carrier[4], 500.0f / Fs, 1.4);
-	bandPassFilterMonoSetFrequencies(d->bp_modulator[4], 500.0f / Fs, 1.4);
-	xPassFilterMonoSetCutoff(d->lp_modulator[4], ftoFTYPE(500.0f / (4.0f * Fs)));
+/*********************************************
+ *
+ *  vocoder
+ *
+ *********************************************/
 
-	bandPassFilterMonoSetFrequencies(d->bp_carrier[5], 1000.0f / Fs, 1.4);
-	bandPassFilterMonoSetFrequencies(d->bp_modulator[5], 1000.0f / Fs, 1.4);
-	xPassFilterMonoSetCutoff(d->lp_modulator[5], ftoFTYPE(1000.0f / (4.0f * Fs)));
+static void vocoder_configure(VocoderData *d, int Fs) {
+	int bands = d->bands, size = d->latency;
+	int b;
 
-	bandPassFilterMonoSetFrequencies(d->bp_carrier[6], 2000.0f / Fs, 1.4);
-	bandPassFilterMonoSetFrequencies(d->bp_modulator[6], 2000.0f / Fs, 1.4);
-	xPassFilterMonoSetCutoff(d->lp_modulator[6], ftoFTYPE(2000.0f / (4.0f * Fs)));
+	if(bands < VOCODER_MIN_BANDS) bands = VOCODER_MIN_BANDS;
+	if(bands > VOCODER_MAX_BANDS) bands = VOCODER_MAX_BANDS;
+	if(size < 0) size = 0;
+	if(size >= VOCODER_SIZES) size = VOCODER_SIZES - 1;
 
-	bandPassFilterMonoSetFrequencies(d->bp_carrier[7], 4000.0f / Fs, 1.4);
-	bandPassFilterMonoSetFrequencies(d->bp_modulator[7], 4000.0f / Fs, 1.4);
-	xPassFilterMonoSetCutoff(d->lp_modulator[7], ftoFTYPE(4000.0f / (4.0f * Fs)));
+	if(Fs == d->Fs && bands == d->active_bands && size == d->size) return;
+
+	if(size != d->size) {
+		// a new transform size, start over
+		int k;
 
-	bandPassFilterMonoSetFrequencies(d->bp_carrier[8], 8000.0f / Fs, 1.4);
-	bandPassFilterMonoSetFrequencies(d->bp_modulator[8], 8000.0f / Fs, 1.4);
-	xPassFilterMonoSetCutoff(d->lp_modulator[8], ftoFTYPE(8000.0f / (4.0f * Fs)));
+		d->size = size;
+		d->fft_bits = VOCODER_MIN_FFT_BITS + size;
+		d->fft_len = 1 << d->fft_bits;
+		d->hop = d->fft_len / VOCODER_OVERLAP;
+		d->position = 0;
 
-	bandPassFilterMonoSetFrequencies(d->bp_carrier[9], 16000.0f / Fs, 1.4);
-	bandPassFilterMonoSetFrequencies(d->bp_modulator[9], 16000.0f / Fs, 1.4);
-	xPassFilterMonoSetCutoff(d->lp_modulator[9], ftoFTYPE(16000.0f / (4.0f * Fs)));
+		for(k = 0; k < d->fft_len; k++)
+			d->window[k] = ftoFTYPE(sqrtf(0.5f - 0.5f * cosf(2.0f * M_PI * (float)k / (float)d->fft_len)));
 
-	for(k = 0; k < VOCODER_CHANNELS; k++) {
-		bandPassFilterMonoRecalc(d->bp_carrier[k]);
-		bandPassFilterMonoRecalc(d->bp_modulator[k]);
-		xPassFilterMonoRecalc(d->lp_modulator[k]);
+		memset(d->modulator, 0, sizeof(FTYPE) * d->fft_len);
+		memset(d->carrier, 0, sizeof(FTYPE) * d->fft_len);
+		memset(d->overlap, 0, sizeof(FTYPE) * d->fft_len);
+		memset(d->ready, 0, sizeof(FTYPE) * d->hop);
 	}
 
-	return 0;
-}
+	d->Fs = Fs;
+	d->active_bands = bands;
 
+#ifdef __SATAN_USES_FXP
+	// the forward transform is scaled by 1 / fft_len and the bins are fp8p24
+	d->power_scale = (float)(2 * d->fft_len) / 281474976710656.0f;
 #else
+	// the sum of the squared window is fft_len / 2
+	d->power_scale = 2.0f / (float)d->fft_len;
+#endif
 
-void cleanup_filters(VocoderData *d) {
-	if(d->indirect_carrier) {
-		free(d->indirect_carrier);
-		d->indirect_carrier = NULL;
-	}
-	if(d->indirect_modulator) {
-		free(d->indirect_modulator);
-		d->indirect_modulator = NULL;
-	}
-	if(d->indirect_output) {
-		free(d->indirect_output);
-		d->indirect_output = NULL;
-	}
-	if(d->prev_carrier) {
-		free(d->prev_carrier);
-		d->prev_carrier = NULL;
-	}
-	if(d->prev_modulator) {
-		free(d->prev_modulator);
-		d->prev_modulator = NULL;
-	}
-
-	if(d->carrier) {
-		free(d->carrier);
-		d->carrier = NULL;
-	}
-	if(d->modulator) {
-		free(d->modulator);
-		d->modulator = NULL;
-	}
-	if(d->output) {
-		free(d->output);
-		d->output = NULL;
-	}
-	if(d->prev_output){
-		free(d->prev_output);
-		d->prev_output = NULL;
-	}
-	if(d->next_output) {
-		free(d->next_output);
-		d->next_output = NULL;
-	}
-
-	if(d->fft_fwd_cfg) {
-		free(d->fft_fwd_cfg);
-		d->fft_fwd_cfg = NULL;
-	}
-	if(d->fft_rev_cfg) {
-		free(d->fft_rev_cfg);
-		d->fft_rev_cfg = NULL;
-	}
+	float high = VOCODER_HIGH_FREQUENCY;
+	if(high > 0.5f * (float)Fs) high = 0.5f * (float)Fs;
 
-	if(d->c_fft) {
-		free(d->c_fft);
-		d->c_fft = NULL;
-	}
-	if(d->m_fft) {
-		free(d->m_fft);
-		d->m_fft = NULL;
-	}
+	// every band gets at least one bin
+	int last_bin = d->fft_len / 2;
+	d->band_start[0] = 0;
+	for(b = 1; b < bands; b++) {
+		float f = VOCODER_LOW_FREQUENCY * powf(high / VOCODER_LOW_FREQUENCY, (float)b / (float)bands);
+		int bin = (int)(f * (float)d->fft_len / (float)Fs + 0.5f);
 
-	if(d->hanning) {
-		free(d->hanning);
-		d->hanning = NULL;
+		if(bin <= d->band_start[b - 1]) bin = d->band_start[b - 1] + 1;
+		if(bin > last_bin + 1 - (bands - b)) bin = last_bin + 1 - (bands - b);
+		d->band_start[b] = bin;
 	}
+	d->band_start[bands] = last_bin + 1;
 }
 
-void calculate_window_size(float length_f, int *fft_len, int *fft_lap) {
-	float optimal = (float)FFT_OPTIMAL_LENGTH;
-	if(optimal > length_f) optimal = length_f;
-	int length = length_f;
-
-	*fft_len = optimal;
-	*fft_lap = optimal * 3 / 4; // 75% overlap
+// window x and transform it into d->spectrum
+static void vocoder_transform(MachineTable *mt, VocoderData *d, const FTYPE *x) {
+	int k;
 
-	// now we need to make sure we get an even number of pieces
-	int k, l;
+	for(k = 0; k < d->fft_len; k++)
+		d->frame[k] = mulFTYPE(x[k], d->window[k]);
+	mt->do_fft(d->forward[d->size], d->frame, d->spectrum);
+}
 
-	// so first we calculate how many pieces we have, this is k. k can be uneven...
-	k = (*fft_len) - (*fft_lap);
-	k = length / k;
+static void vocoder_band_power(VocoderData *d, float *power) {
+	const kiss_fft_cpx *s = d->spectrum;
+	int b, k;
 
-	// then we calculate a value for l, starting at k, such that length / l is an even integer value (no remainder)
-	for(l = k; l > 1; l--) {
-		if(length % l == 0) { // as soon as we find a l which divides length in even pieces we stop
-			break;
-		}
-	}
-	// if we cannot find an l which is larger than 1, then just let go... it will sound bad, but what can we do...
-	if(l > 1) {
-		*fft_lap = *fft_len - ((length) / l);
+	for(b = 0; b < d->active_bands; b++) {
+		int start = d->band_start[b], stop = d->band_start[b + 1];
+#ifdef __SATAN_USES_FXP
+		int64_t sum = 0;
+		for(k = start; k < stop; k++)
+			sum += (int64_t)s[k].r * s[k].r + (int64_t)s[k].i * s[k].i;
+#else
+		float sum = 0.0f;
+		for(k = start; k < stop; k++)
+			sum += s[k].r * s[k].r + s[k].i * s[k].i;
+#endif
+		power[b] = (float)sum * d->power_scale / (float)(stop - start);
 	}
-
 }
 
-void calculate_hanning(FTYPE *d, int len) {
-	int n;
-	float N = (float)len - 1;
+static void vocoder_hop(MachineTable *mt, VocoderData *d) {
+	int N = d->fft_len, H = d->hop;
+	int b, k;
 
-	for(n = 0; n < len; n ++) {
-		d[n] = 0.5 * (1.0f - cosf((2.0f * M_PI * ((float)n)) / N));
+	// modulator band levels
+	uint32_t hash = vocoder_cache_hash(d);
+	if(!vocoder_cache_lookup(d, hash)) {
+		vocoder_transform(mt, d, d->modulator);
+		vocoder_band_power(d, d->m_power);
+		vocoder_cache_store(d, hash);
 	}
-}
 
-int setup_filters(MachineTable *mt, VocoderData *d, int ol) {
-	calculate_window_size((float)ol, &(d->fft_len), &(d->fft_lap));
+	// carrier band levels
+	vocoder_transform(mt, d, d->carrier);
+	vocoder_band_power(d, d->c_power);
 
-#ifdef THIS_IS_A_MOCKERY
-	printf("fft_len: %d - fft_lap: %d\n", d->fft_len, d->fft_lap);
-#endif
+	float floor = 0.0f;
+	for(b = 0; b < d->active_bands; b++)
+		floor += d->c_power[b];
+	floor = VOCODER_RELATIVE_FLOOR * floor / (float)d->active_bands;
+	if(floor < VOCODER_ABSOLUTE_FLOOR) floor = VOCODER_ABSOLUTE_FLOOR;
 
-	d->prev_carrier = (FTYPE *)calloc(ol, sizeof(FTYPE));
-	d->prev_modulator = (FTYPE *)calloc(ol, sizeof(FTYPE));
+#ifdef __SATAN_USES_FXP
+	// the inverse transform is scaled by 1 / fft_len too, compensated below
+	float scale = d->volume;
+#else
+	// the transforms scale by fft_len, and the windows overlap-add to 2
+	float scale = d->volume / (float)(2 * N);
+#endif
 
-	d->carrier = (FTYPE *)calloc(d->fft_len, sizeof(FTYPE));
-	d->modulator = (FTYPE *)calloc(d->fft_len, sizeof(FTYPE));
+	for(b = 0; b < d->active_bands; b++) {
+		float c = d->c_power[b] > floor ? d->c_power[b] : floor;
+		float g = sqrtf(d->m_power[b] / c);
+		if(g > VOCODER_MAX_GAIN) g = VOCODER_MAX_GAIN;
+		d->gain[b] = ftoFTYPE(g * scale);
+	}
 
-	d->output = (FTYPE *)calloc(d->fft_len, sizeof(FTYPE));
-	d->prev_output = (FTYPE *)calloc(ol, sizeof(FTYPE));
-	d->next_output = (FTYPE *)calloc(ol, sizeof(FTYPE));
+	// shape the carrier
+	for(b = 0; b < d->active_bands; b++) {
+		FTYPE g = d->gain[b];
+		for(k = d->band_start[b]; k < d->band_start[b + 1]; k++) {
+			d->spectrum[k].r = mulFTYPE(d->spectrum[k].r, g);
+			d->spectrum[k].i = mulFTYPE(d->spectrum[k].i, g);
+		}
+	}
 
-	d->fft_fwd_cfg = mt->prepare_fft(d->fft_len, 0);
-	d->fft_rev_cfg = mt->prepare_fft(d->fft_len, 1);
+	mt->inverse_fft(d->inverse[d->size], d->spectrum, d->frame);
 
-	d->c_fft = (kiss_fft_cpx *)calloc(d->fft_len, sizeof(kiss_fft_cpx));
-	d->m_fft = (kiss_fft_cpx *)calloc(d->fft_len, sizeof(kiss_fft_cpx));
+#ifdef __SATAN_USES_FXP
+	int shift = d->fft_bits - 1;
+	for(k = 0; k < N; k++)
+		d->overlap[k] += mulFTYPE(d->frame[k] << shift, d->window[k]);
+#else
+	for(k = 0; k < N; k++)
+		d->overlap[k] += mulFTYPE(d->frame[k], d->window[k]);
+#endif
 
-	d->hanning = (FTYPE *)calloc(d->fft_len, sizeof(FTYPE));
+	// the first hop is complete, move everything one hop forward
+	memcpy(d->ready, d->overlap, sizeof(FTYPE) * H);
+	memmove(d->overlap, &(d->overlap[H]), sizeof(FTYPE) * (N - H));
+	memset(&(d->overlap[N - H]), 0, sizeof(FTYPE) * H);
 
-	d->channel_width = (d->fft_len) / (VOCODER_CHANNELS * 2);
+	memmove(d->modulator, &(d->modulator[H]), sizeof(FTYPE) * (N - H));
+	memmove(d->carrier, &(d->carrier[H]), sizeof(FTYPE) * (N - H));
+}
 
-	if(
-		(d->prev_carrier == NULL) ||
-		(d->prev_modulator == NULL) ||
-		(d->carrier == NULL) ||
-		(d->modulator == NULL) ||
-		(d->output == NULL) ||
-		(d->prev_output == NULL) ||
-		(d->next_output == NULL) ||
-		(d->fft_fwd_cfg == NULL) ||
-		(d->fft_rev_cfg == NULL) ||
-		(d->c_fft == NULL) ||
-		(d->m_fft == NULL) ||
-		(d->hanning == NULL)) {
-		return 1;
-	}
+static void vocoder_free(VocoderData *d) {
+	int k;
 
-	calculate_hanning(d->hanning, (d->fft_len));
-	return 0;
+	for(k = 0; k < VOCODER_SIZES; k++) {
+		free(d->forward[k]);
+		free(d->inverse[k]);
+	}
+	free(d->window);
+	free(d->modulator);
+	free(d->carrier);
+	free(d->frame);
+	free(d->overlap);
+	free(d->ready);
+	free(d->spectrum);
+	free(d);
 }
 
-#endif
-
 void *init(MachineTable *mt, const char *name) {
 	/* Allocate and initiate instance data here */
 	VocoderData *d = (VocoderData *)calloc(1, sizeof(VocoderData));
+	int k;
 
 	if(d == NULL) return NULL; // failed to allocate
 
-	memset(d, 0, sizeof(VocoderData));
-
 	SETUP_SATANS_MATH(mt);
 
 	d->volume = 1.0;
+	d->bands = 16;
+	d->latency = 1;
+	d->size = -1;
+
+	// everything is allocated for the largest transform, so that the
+	// configuration can be changed without allocating in execute()
+	d->window = (FTYPE *)calloc(VOCODER_MAX_FFT, sizeof(FTYPE));
+	d->modulator = (FTYPE *)calloc(VOCODER_MAX_FFT, sizeof(FTYPE));
+	d->carrier = (FTYPE *)calloc(VOCODER_MAX_FFT, sizeof(FTYPE));
+	d->frame = (FTYPE *)calloc(VOCODER_MAX_FFT, sizeof(FTYPE));
+	d->overlap = (FTYPE *)calloc(VOCODER_MAX_FFT, sizeof(FTYPE));
+	d->ready = (FTYPE *)calloc(VOCODER_MAX_FFT / VOCODER_OVERLAP, sizeof(FTYPE));
+	d->spectrum = (kiss_fft_cpx *)calloc(VOCODER_MAX_FFT / 2 + 1, sizeof(kiss_fft_cpx));
+
+	int failed = d->window == NULL || d->modulator == NULL || d->carrier == NULL ||
+		d->frame == NULL || d->overlap == NULL || d->ready == NULL || d->spectrum == NULL;
+
+	for(k = 0; k < VOCODER_SIZES; k++) {
+		d->forward[k] = mt->prepare_fft(1 << (VOCODER_MIN_FFT_BITS + k), 0);
+		d->inverse[k] = mt->prepare_fft(1 << (VOCODER_MIN_FFT_BITS + k), 1);
+		if(d->forward[k] == NULL || d->inverse[k] == NULL) failed = 1;
+	}
+
+	if(failed) {
+		vocoder_free(d);
+		return NULL;
+	}
 
 	/* return pointer to instance data */
 	return (void *)d;
 }
 
 void delete(void *data) {
-	VocoderData *d = (VocoderData *)data;
 	/* free instance data here */
-	cleanup_filters(d);
-	free(d);
+	vocoder_free((VocoderData *)data);
 }
 
 void *get_controller_ptr(MachineTable *mt, void *void_info,
@@ -374,6 +408,10 @@ void *get_controller_ptr(MachineTable *mt, void *void_info,
 	VocoderData *d = (VocoderData *)void_info;
 	if(strcmp("volume", name) == 0)
 		return &(d->volume);
+	if(strcmp("bands", name) == 0)
+		return &(d->bands);
+	if(strcmp("latency", name) == 0)
+		return &(d->latency);
 
 	return NULL;
 }
@@ -382,7 +420,6 @@ void reset(MachineTable *mt, void *data) {
 	return; /* nothing to do... */
 }
 
-#ifdef VOCODER_IIR_IMPLEMENTATION
 void execute(MachineTable *mt, void *data) {
 	VocoderData *d = (VocoderData *)data;
 
@@ -393,19 +430,8 @@ void execute(MachineTable *mt, void *data) {
 	if(os == NULL) return;
 
 	FTYPE *ou = mt->get_signal_buffer(os);
-	int Fs = mt->get_signal_frequency(os);
 	int ol = mt->get_signal_samples(os);
 
-	libfilter_set_Fs(Fs);
-
-	if(d->bp_carrier == NULL) {
-		if(setup_filters(mt, d, (float)Fs)) {
-			// failed - cleanup and set cs and ms to NULL (this triggers a clear of the output signal, and a return);
-			cleanup_filters(d);
-			cs = ms = NULL;
-		}
-	}
-
 	if(cs == NULL || ms == NULL) {
 		// just clear output, then return
 		int t;
@@ -415,228 +441,27 @@ void execute(MachineTable *mt, void *data) {
 		return;
 	}
 
-	FTYPE *c_in = mt->get_signal_buffer(cs);
-	FTYPE *m_in = mt->get_signal_buffer(ms);
-
-	int i, k;
-	FTYPE m_base, c_base, output;
-
-	FTYPE volume = ftoFTYPE(d->volume);
-
-	for(i = 0; i < ol; i++) {
-		m_base = m_in[i];
-		c_base = c_in[i];
-		output = itoFTYPE(0.0);
-
-		for(k = 0; k < VOCODER_CHANNELS; k++) {
-			FTYPE m, c;
-
-			// modulator
-			bandPassFilterMonoPut(d->bp_modulator[k], m_base);
-			m = bandPassFilterMonoGet(d->bp_modulator[k]);
-			m = ABS_FTYPE(m);
-			xPassFilterMonoPut(d->lp_modulator[k], m);
-			m = xPassFilterMonoGet(d->lp_modulator[k]);
-			m = ABS_FTYPE(m);
-
-			// carrier
-			bandPassFilterMonoPut(d->bp_carrier[k], c_base);
-			c = bandPassFilterMonoGet(d->bp_carrier[k]);
-
-			// combine
-			output += mulFTYPE(m, c);
-		}
-
-		ou[i] = mulFTYPE(output, volume);
-	}
-}
-
-#else
-
-inline void do_work(MachineTable *mt, VocoderData *d, int std_len, FTYPE *c, FTYPE *m, FTYPE *o) {
-	float factor =  d->volume * 1.0f / ((float)std_len * 20);
-	int u = (d->channel_width) * VOCODER_CHANNELS;
-	// hanning
-	{
-		int k;
-
-		for(k = 0; k < std_len; k++) {
-			c[k] *= d->hanning[k];
-			m[k] *= d->hanning[k];
-		}
-	}
-
-	// flip to frequency space
-	mt->do_fft(d->fft_fwd_cfg, c, d->c_fft);
-	mt->do_fft(d->fft_fwd_cfg, m, d->m_fft);
-
-	// do the work
-	{
-		int k, l;
-
-		for(k = 0; k < VOCODER_CHANNELS; k++) {
-			float avg = 0;
-			// calculate modulator channel average amplitude
-			for(l = 0; l < d->channel_width; l++) {
-				float i = d->m_fft[k * d->channel_width + l].i;
-				float r = d->m_fft[k * d->channel_width + l].r;
-				float v;
-
-				v = i * i + r * r; v = sqrtf(v);
-				avg += v;
-			}
-			// we have to divide by the channel width to get the average
-			avg /= (float)(d->channel_width);
-
-			float midval_i = d->c_fft[u].i * d->m_fft[u].i;
-			float midval_r = d->c_fft[u].r * d->m_fft[u].r;
-			// modulate the carrier
-			for(l = 0; l < d->channel_width; l++) {
-				d->c_fft[k * d->channel_width + l].i *= avg * factor;
-				d->c_fft[k * d->channel_width + l].r *= avg * factor;
-				d->c_fft[u + k * d->channel_width + l].i = -(d->c_fft[k * d->channel_width + l].i);
-				d->c_fft[u + k * d->channel_width + l].r = (d->c_fft[k * d->channel_width + l].r);;
-			}
-			d->c_fft[u].i = midval_i;
-			d->c_fft[u].r = midval_r;
-		}
-	}
-
-	// inverse into time space
-	mt->inverse_fft(d->fft_rev_cfg, d->c_fft, o);
-}
-
-inline void build_input_buffer(int source_size, int offset, int buffer_size, FTYPE *old_source, FTYPE *new_source, FTYPE *destination) {
-	if(offset < 0) {
-		offset = -offset; // absolute offset
-		int to_copy_from_old = buffer_size < (offset) ? buffer_size : offset;
-		int to_copy_from_new = buffer_size - to_copy_from_old;
-		memcpy(destination, &old_source[source_size - offset], (to_copy_from_old) * sizeof(FTYPE));
-		if(to_copy_from_new)
-			memcpy(&destination[to_copy_from_old], new_source, (to_copy_from_new) * sizeof(FTYPE));
-	} else {
-		memcpy(destination, &new_source[offset], (buffer_size) * sizeof(FTYPE));
-	}
-}
-
-inline void build_output_buffer(int output_size, int offset, int buffer_size,
-				FTYPE *buffer, FTYPE *dest, FTYPE *next_dest) {
-	int i, k;
-
-	for(i = 0, k = offset; i < buffer_size && k < output_size; i++, k++) {
-		dest[k] += buffer[i];
-	}
-	k -= output_size;
-	for(; i < buffer_size; i++, k++) {
-		next_dest[k] += buffer[i];
-	}
-}
-
-inline void execute_fft(MachineTable *mt, VocoderData *d, int ol, FTYPE *c_in, FTYPE *m_in, FTYPE *ou) {
-	int piece_len = d->fft_len - d->fft_lap;
-	int pieces = ol / piece_len;
-
-	int read_offset = piece_len - (piece_len * pieces);
-	int write_offset = 0;
-
-	int p;
-
-	// clear next output buffer and copy the old one into the current
-	memcpy(ou, d->prev_output, ol * sizeof(FTYPE));
-	memset(d->next_output, 0, ol * sizeof(FTYPE));
-
-	for(p = 0; p < pieces; p++) {
-		build_input_buffer(ol, read_offset, d->fft_len, d->prev_carrier, c_in, d->carrier);
-		build_input_buffer(ol, read_offset, d->fft_len, d->prev_modulator, m_in, d->modulator);
-
-		do_work(mt, d, d->fft_len, d->carrier, d->modulator, d->output);
-
-		build_output_buffer(ol, write_offset, d->fft_len,
-				    d->output, ou, d->next_output);
-		read_offset += piece_len;
-		write_offset += piece_len;
-	}
-
-	memcpy(d->prev_carrier, c_in, ol * sizeof(FTYPE));
-	memcpy(d->prev_modulator, m_in, ol * sizeof(FTYPE));
-
-	// swap previous and next output buffers
-	FTYPE *t = d->next_output;
-	d->next_output = d->prev_output;
-	d->prev_output = t;
-}
-
-void execute(MachineTable *mt, void *data) {
-	VocoderData *d = (VocoderData *)data;
-
-	SignalPointer *cs = mt->get_input_signal(mt, "Carrier");
-	SignalPointer *ms = mt->get_input_signal(mt, "Modulator");
-	SignalPointer *os = mt->get_output_signal(mt, "Mono");
-
-	if(os == NULL) return;
-
-	FTYPE *ou = mt->get_signal_buffer(os);
-	int ol = mt->get_signal_samples(os);
-
-	if(d->fft_len == 0) {
-		int k = 1;
-
-		// we must have at least FFT_OPTIMAL_LENGTH of data to do FFTs
-		if(ol < FFT_OPTIMAL_LENGTH) {
-			for(k = 1; k * ol < FFT_OPTIMAL_LENGTH; k++) { /* find multiple of ol that is larger than FFT_OPTIMAL_LENGTH */ }
-
-			d->indirect_carrier = (FTYPE *)calloc(k * ol, sizeof(FTYPE));
-			d->indirect_modulator = (FTYPE *)calloc(k * ol, sizeof(FTYPE));
-			d->indirect_output = (FTYPE *)calloc(k * ol, sizeof(FTYPE));
-
-			if(
-				(d->indirect_carrier == NULL) ||
-				(d->indirect_modulator == NULL) ||
-				(d->indirect_output == NULL)
-				) {
-				cs = ms = NULL;
-			}
-		}
-		if((cs == NULL) || (ms == NULL) || (setup_filters(mt, d, ol * k))) {
-			// failed - cleanup and set cs and ms to NULL (this triggers a clear of the output signal, and a return);
-			cleanup_filters(d);
-			cs = ms = NULL;
-		}
-
-		d->indirect_index = 1;
-		d->indirect_limit = k;
-		d->indirect_size = k * ol;
-
-#ifdef THIS_IS_A_MOCKERY
-		printf("indirect_limit: %d\n", d->indirect_limit);
-#endif
-	}
-
-	if(cs == NULL || ms == NULL) {
-		// just clear output, then return
-		int t;
-		for(t = 0; t < ol; t++) {
-			ou[t] = itoFTYPE(0);
-		}
-		return;
-	}
+	vocoder_configure(d, mt->get_signal_frequency(os));
 
 	FTYPE *c_in = mt->get_signal_buffer(cs);
 	FTYPE *m_in = mt->get_signal_buffer(ms);
 
-	if(d->indirect_limit > 1) {
-		if(d->indirect_index == 0)
-			execute_fft(mt, d, d->indirect_size, d->indirect_carrier, d->indirect_modulator, d->indirect_output);
+	int i = 0;
+	while(i < ol) {
+		int n = d->hop - d->position;
+		if(n > ol - i) n = ol - i;
 
-		int offset = d->indirect_index * ol;
+		int offset = d->fft_len - d->hop + d->position;
+		memcpy(&(d->modulator[offset]), &(m_in[i]), sizeof(FTYPE) * n);
+		memcpy(&(d->carrier[offset]), &(c_in[i]), sizeof(FTYPE) * n);
+		memcpy(&(ou[i]), &(d->ready[d->position]), sizeof(FTYPE) * n);
 
-		memcpy(&(d->indirect_carrier[offset]), c_in, ol * sizeof(FTYPE));
-		memcpy(&(d->indirect_modulator[offset]), m_in, ol * sizeof(FTYPE));
-		memcpy(ou, &(d->indirect_output[offset]), ol * sizeof(FTYPE));
+		d->position += n;
+		i += n;
 
-		d->indirect_index = (d->indirect_index + 1) % (d->indirect_limit);
-	} else {
-		execute_fft(mt, d, ol, c_in, m_in, ou);
+		if(d->position == d->hop) {
+			vocoder_hop(mt, d);
+			d->position = 0;
+		}
 	}
 }
-#endif
@@ -0,0 +1,189 @@
+/*
+ * vu|KNOB
+ * Copyright (C) 2015 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * Test bench for WriteQueue (write_queue.hh), the outgoing message queue
+ * of RemoteInterface::MessageHandler.
+ *
+ * Build with "make write_queue.mock", it returns non zero if a test fails.
+ *
+ * The writer loop below does what MessageHandler::do_write() and
+ * do_write_chunk() do, and the reader refuses messages for objects
+ * it has not seen yet - like the client does with NoSuchObject.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "write_queue.hh"
+
+#define CHUNK_SIZE 16384 // VUKNOB_BULK_CHUNK_SIZE in remote_interface.hh
+#define MAX_WRITE_BATCH 64 // VUKNOB_MAX_WRITE_BATCH in remote_interface.hh
+
+class TestMessage {
+public:
+	std::string id;
+	std::string supersede_key;
+	std::vector<int> objects; // object ids carried by a snapshot
+	size_t payload_length = 0;
+
+	TestMessage(const std::string &_id, size_t _payload_length = 0)
+		: id(_id), payload_length(_payload_length) {}
+
+	const std::string &get_supersede_key() const { return supersede_key; }
+	bool is_awaiting_reply() { return false; }
+	bool has_value(const std::string &key) const { return key == "id"; }
+	std::string get_value(const std::string &key) const { return id; }
+	size_t get_payload_length() const { return payload_length; }
+};
+
+typedef WriteQueue<TestMessage>::MessagePointer MessagePointer;
+
+// what the peer receives, one entry per write
+class Reader {
+public:
+	std::set<int> known_objects;
+	std::vector<std::string> received; // message ids in order
+	int chunks = 0;
+	bool failed = false;
+
+	void receive(const MessagePointer &msg) {
+		received.push_back(msg->id);
+		if(msg->id == "snapshot") {
+			known_objects.insert(msg->objects.begin(), msg->objects.end());
+		} else if(known_objects.find(std::stoi(msg->id)) == known_objects.end()) {
+			printf("    message for unknown object %s\n", msg->id.c_str());
+			failed = true;
+		}
+	}
+};
+
+// write until the queue is empty, bulk payloads one chunk at a time
+static void write_all(WriteQueue<TestMessage> &queue, Reader &reader) {
+	std::vector<MessagePointer> in_flight;
+
+	while(1) {
+		bool bulk = queue.take(in_flight, MAX_WRITE_BATCH);
+		if(in_flight.size() == 0) return;
+
+		if(bulk) {
+			size_t offset = 0;
+			while(offset < in_flight[0]->get_payload_length()) {
+				offset += CHUNK_SIZE;
+				reader.chunks++;
+			}
+		}
+		for(auto &msg : in_flight)
+			reader.receive(msg);
+		in_flight.clear();
+	}
+}
+
+static bool check(bool ok, const char *what) {
+	printf("  %s: %s\n", ok ? "PASS" : "FAIL", what);
+	return ok;
+}
+
+// the server queues a snapshot larger than one chunk and marks the client
+// as synchronized, the next live update is for an object in the snapshot
+static bool test_snapshot_then_update() {
+	WriteQueue<TestMessage> queue;
+	queue.set_bulk_threshold(CHUNK_SIZE);
+	Reader reader;
+
+	reader.known_objects.insert(1);
+	queue.push(std::make_shared<TestMessage>("1"));
+
+	auto snapshot = std::make_shared<TestMessage>("snapshot", 3 * CHUNK_SIZE + 100);
+	snapshot->objects.push_back(42);
+	queue.push(snapshot);
+	queue.push(std::make_shared<TestMessage>("42"));
+
+	write_all(queue, reader);
+
+	std::vector<std::string> expected = {"1", "snapshot", "42"};
+	return
+		check(reader.chunks == 4, "snapshot written in four chunks") &
+		check(reader.received == expected, "queue order kept across the snapshot") &
+		check(!reader.failed, "no update before the snapshot");
+}
+
+// a new update replaces the waiting one, and is queued last
+static bool test_supersede() {
+	WriteQueue<TestMessage> queue;
+	queue.set_bulk_threshold(CHUNK_SIZE);
+	Reader reader;
+
+	reader.known_objects.insert(1);
+	reader.known_objects.insert(2);
+
+	auto first = std::make_shared<TestMessage>("1");
+	first->supersede_key = "meter";
+	auto second = std::make_shared<TestMessage>("1");
+	second->supersede_key = "meter";
+
+	bool dropped_first = queue.push(first);
+	queue.push(std::make_shared<TestMessage>("2"));
+	bool dropped_second = queue.push(second);
+
+	bool size_ok = queue.size() == 2;
+	write_all(queue, reader);
+
+	std::vector<std::string> expected = {"2", "1"};
+	return
+		check(!dropped_first && dropped_second, "the waiting update was dropped") &
+		check(size_ok, "superseded updates are not counted") &
+		check(reader.received == expected, "the new update is queued last");
+}
+
+// without bulk frames large payloads are written as whole messages
+static bool test_no_bulk_frames() {
+	WriteQueue<TestMessage> queue;
+	Reader reader;
+
+	auto snapshot = std::make_shared<TestMessage>("snapshot", 3 * CHUNK_SIZE);
+	snapshot->objects.push_back(7);
+	queue.push(snapshot);
+	queue.push(std::make_shared<TestMessage>("7"));
+
+	write_all(queue, reader);
+
+	return
+		check(reader.chunks == 0, "no chunks without bulk frames") &
+		check(!reader.failed, "no update before the snapshot");
+}
+
+int main(int argc, char **argv) {
+	bool ok = true;
+
+	printf("snapshot followed by a live update\n");
+	ok &= test_snapshot_then_update();
+	printf("superseded updates\n");
+	ok &= test_supersede();
+	printf("peer without bulk frames\n");
+	ok &= test_no_bulk_frames();
+
+	printf("%s\n", ok ? "all tests passed" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -118,6 +118,23 @@ CLIENT_CODE(
 			if(protocol_version > __VUKNOB_PROTOCOL_VERSION__) {
 				failure_response_callback("Server is to new - you must upgrade before you can connect.");
 				disconnect();
+			} else if((msg.has_value("binary") && std::stol(msg.get_value("binary")) >= 1) ||
+				  msg.has_value("snapshot")) {
+				// server offers binary framing - accept the highest version we both know
+				int binary_version = msg.has_value("binary") ? std::stol(msg.get_value("binary")) : 0;
+				if(binary_version > __VUKNOB_BINARY_PROTOCOL_VERSION__)
+					binary_version = __VUKNOB_BINARY_PROTOCOL_VERSION__;
+
+				auto accept_msg = acquire_message();
+				accept_msg->set_value("id", std::to_string(__MSG_PROTOCOL_VERSION));
+				accept_msg->set_value("binary", std::to_string(binary_version));
+				if(msg.has_value("snapshot")) {
+					// tell the server what we already know
+					accept_msg->set_value("snapepoch", std::to_string(snapshot_epoch));
+					accept_msg->set_value("snaprev", std::to_string(snapshot_revision));
+				}
+				deliver_message(accept_msg);
+				use_binary_protocol(binary_version);
 			}
 		}
 		break;
@@ -137,6 +154,12 @@ CLIENT_CODE(
 		}
 		break;
 
+		case __MSG_SNAPSHOT:
+		{
+			process_snapshot(msg);
+		}
+		break;
+
 		case __MSG_FLUSH_ALL_OBJECTS:
 		{
 			flush_all_objects();
@@ -186,6 +209,48 @@ CLIENT_CODE(
 		}
 	}
 
+	void Client::process_snapshot(const Message &msg) {
+		const char *data = NULL;
+		size_t length = 0;
+
+		if(msg.get_value("full") == "true")
+			snapshot_objects.clear();
+
+		bool ok = msg.get_payload("data", data, length) &&
+			ObjectSnapshot::decode(
+				data, length, std::stoul(msg.get_value("rawsize")),
+				[this](int32_t objid, const uint8_t *fields, size_t l) {
+					if(fields)
+						snapshot_objects[objid].assign(fields, fields + l);
+					else
+						snapshot_objects.erase(objid);
+				}
+				);
+		if(!ok) {
+			// forget it, the next connection will get a full snapshot
+			snapshot_objects.clear();
+			snapshot_epoch = snapshot_revision = 0;
+			throw CorruptSnapshot();
+		}
+
+		snapshot_epoch = std::stoull(msg.get_value("snapepoch"));
+		snapshot_revision = std::stoull(msg.get_value("snaprev"));
+
+		SATAN_DEBUG("Client - creating %d objects from snapshot.\n", (int)snapshot_objects.size());
+		auto create_object_message = acquire_message();
+		for(auto &o : snapshot_objects) {
+			if(!create_object_message->decode_fields(o.second.data(), o.second.size())) {
+				snapshot_objects.clear();
+				snapshot_epoch = snapshot_revision = 0;
+				throw CorruptSnapshot();
+			}
+
+			std::shared_ptr<BaseObject> new_obj =
+				BaseObject::create_object_on_client(this, *create_object_message);
+			link_object(new_obj);
+		}
+	}
+
 	void Client::on_connection_dropped() {
 		// inform all waiting messages that their action failed
 		for(auto msg : msg_waiting_for_reply) {
@@ -24,6 +24,7 @@
 
 #include "../common.hh"
 #include "../remote_interface.hh"
+#include "../object_snapshot.hh"
 
 namespace RemoteInterface {
 	namespace __RI__CURRENT_NAMESPACE {
@@ -40,6 +41,13 @@ namespace RemoteInterface {
 
 			std::map<std::string, std::string> handle2hint;
 
+			// the last snapshot received, kept between connections so that a
+			// reconnect to the same server only has to transfer the changes
+			uint64_t snapshot_epoch = 0, snapshot_revision = 0;
+			std::map<int32_t, std::vector<uint8_t> > snapshot_objects;
+
+			void process_snapshot(const Message &msg);
+
 			asio::ip::tcp::resolver resolver;
 			asio::ip::udp::resolver udp_resolver;
 			std::function<void()> disconnect_callback;
@@ -66,6 +74,13 @@ namespace RemoteInterface {
 		protected:
 			virtual void on_remove_object(int32_t objid) override;
 
+		public:
+			class CorruptSnapshot : public std::runtime_error {
+			public:
+				CorruptSnapshot() : runtime_error("Object snapshot from server could not be decoded.") {}
+				virtual ~CorruptSnapshot() {}
+			};
+
 		public: // public singleton interface
 			static void connect_client(const std::string &server_host, int server_port,
 						   std::function<void()> disconnect_callback,
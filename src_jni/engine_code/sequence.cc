@@ -17,6 +17,8 @@
  * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  */
 
+#include <algorithm>
+
 #include "sequence.hh"
 
 #define __DO_SATAN_DEBUG
@@ -71,6 +73,7 @@ SERVER_CODE(
 			});
 
 		if(operation_successfull) {
+			rebuild_playback_index();
 			send_message(
 				cmd_del_pattern,
 				[pattern_id](std::shared_ptr<Message> &msg_to_send) {
@@ -99,6 +102,8 @@ SERVER_CODE(
 			});
 
 		if(operation_successfull) {
+			rebuild_playback_index();
+
 			// tell all clients to add it
 			send_message(
 				cmd_add_pattern_instance,
@@ -128,6 +133,8 @@ SERVER_CODE(
 			[this, &pattern_instance]() {
 				process_del_pattern_instance(pattern_instance);
 			});
+		rebuild_playback_index();
+
 		// tell all clients to delete it
 		send_message(
 			cmd_del_pattern_instance,
@@ -167,6 +174,7 @@ SERVER_CODE(
 					channel, program, velocity,
 					note, on_at, length);
 			});
+		rebuild_playback_index();
 
 		send_message(
 			cmd_add_note,
@@ -217,6 +225,7 @@ SERVER_CODE(
 			[this, pattern_id, note] {
 				process_delete_note(pattern_id, note);
 			});
+		rebuild_playback_index();
 
 		// tell all clients to delete it
 		send_message(
@@ -304,6 +313,12 @@ SERVER_CODE(
 		target->set_value("sequence_data", iser.result());
 	}
 
+	Sequence::~Sequence() {
+		free_retired_indexes();
+		delete pending_index.exchange(NULL);
+		delete current_index;
+	}
+
 	bool Sequence::detach_and_destroy() {
 		detach_all_inputs();
 		detach_all_outputs();
@@ -321,20 +336,172 @@ SERVER_CODE(
 		return "";
 	}
 
+	void Sequence::free_retired_indexes() {
+		auto retired = retired_indexes.exchange(NULL);
+		while(retired) {
+			auto next = retired->next;
+			delete retired;
+			retired = next;
+		}
+	}
+
+	void Sequence::rebuild_playback_index() {
+		auto index = new PlaybackIndex();
+		index->next = NULL;
+
+		instance_list.for_each(
+			[this, index](PatternInstance *pin) {
+				auto ptrn_itr = patterns.find(pin->pattern_id);
+				if(ptrn_itr == patterns.end()) return;
+				auto ptrn = ptrn_itr->second;
+
+				// without a loop length the pattern plays once, until stop_at
+				int repetition = pin->loop_length > 0 ? pin->loop_length : (pin->stop_at - pin->start_at);
+
+				for(int rep_start = pin->start_at; rep_start < pin->stop_at; rep_start += repetition) {
+					int rep_stop = std::min(rep_start + repetition, pin->stop_at);
+
+					ptrn->note_list.for_each(
+						[index, rep_start, rep_stop](Note *n) {
+							int on = rep_start + n->on_at;
+							if(n->on_at < 0 || on >= rep_stop) return;
+
+							int off = std::min(on + std::max(n->length, 1), rep_stop);
+							uint8_t channel = n->channel & 0x0f;
+							uint8_t note = n->note & 0x7f;
+							uint8_t velocity = n->velocity & 0x7f;
+
+							index->events.push_back({on, 1, channel, note, velocity});
+							index->events.push_back({off, 0, channel, note, 0});
+						}
+						);
+				}
+			}
+			);
+
+		std::stable_sort(index->events.begin(), index->events.end());
+
+		free_retired_indexes();
+		auto never_used = pending_index.exchange(index);
+		if(never_used) delete never_used;
+	}
+
+	void Sequence::playback_all_notes_off() {
+		if(active_note_count == 0) return;
+
+		for(int channel = 0; channel < 16; channel++) {
+			for(int note = 0; note < 128; note++) {
+				for(; active_notes[channel][note] > 0; active_notes[channel][note]--) {
+					_meb.queue_note_off(note, 0x7f, channel);
+				}
+			}
+		}
+		active_note_count = 0;
+	}
+
+	void Sequence::playback_seek(int at) {
+		playback_all_notes_off();
+
+		PlaybackEvent key = {at, 0, 0, 0, 0};
+		playback_cursor = std::lower_bound(current_index->events.begin(),
+						   current_index->events.end(),
+						   key) - current_index->events.begin();
+	}
+
 	void Sequence::fill_buffers() {
 		// get output signal buffer and clear it.
 		Signal *out_sig = output[MACHINE_SEQUENCER_MIDI_OUTPUT_NAME];
 
 		int output_limit = out_sig->get_samples();
-		void **output_buffer = (void **)out_sig->get_buffer();
 
-		memset(output_buffer,
-		       0,
-		       sizeof(void *) * output_limit
-			);
+		if(out_sig->get_resolution() == _MIDI_EVENTS) {
+			_meb.use_event_list((MidiEventList *)out_sig->get_buffer(), output_limit);
+		} else {
+			void **output_buffer = (void **)out_sig->get_buffer();
+
+			memset(output_buffer,
+			       0,
+			       sizeof(void *) * output_limit
+				);
+			_meb.use_buffer(output_buffer, output_limit);
+		}
+
+		// pick up a new index, the old one is freed on the next rebuild
+		PlaybackIndex *new_index = pending_index.exchange(NULL);
+		if(new_index) {
+			if(current_index) {
+				PlaybackIndex *head = retired_indexes.load();
+				do {
+					current_index->next = head;
+				} while(!retired_indexes.compare_exchange_weak(head, current_index));
+			}
+			current_index = new_index;
+			playback_expected_at = -1; // force a seek in the new index
+		}
+
+		if(current_index == NULL || !is_it_playing()) {
+			playback_all_notes_off();
+			playback_expected_at = -1;
+			_meb.finish_current_buffer();
+			return;
+		}
+
+		// synch to click track
+		int sequence_position = get_next_sequence_position();
+		int current_tick = get_next_tick();
+		int samples_per_tick = get_samples_per_tick(_MIDI);
+		int samples_per_tick_shuffle = get_samples_per_tick_shuffle(_MIDI);
+		int skip_length = get_next_tick_at(_MIDI);
+		bool do_loop = get_loop_state();
+		int loop_start = get_loop_start();
+		int loop_stop = get_loop_length() + loop_start;
+
+		auto &events = current_index->events;
+
+		while(_meb.skip(skip_length)) {
+			int now = PAD_TIME(sequence_position, current_tick);
+
+			// a loop wrap, a jump or a new index
+			if(now != playback_expected_at)
+				playback_seek(now);
+
+			for(; playback_cursor < events.size() && events[playback_cursor].at <= now; playback_cursor++) {
+				auto &e = events[playback_cursor];
+				if(e.is_on) {
+					_meb.queue_note_on(e.note, e.velocity, e.channel);
+					active_notes[e.channel][e.note]++;
+					active_note_count++;
+				} else if(active_notes[e.channel][e.note] > 0) {
+					_meb.queue_note_off(e.note, 0x7f, e.channel);
+					active_notes[e.channel][e.note]--;
+					active_note_count--;
+				}
+			}
+			playback_expected_at = now + 1;
+
+			current_tick = (current_tick + 1) % MACHINE_TICKS_PER_LINE;
+
+			if(current_tick == 0) {
+				sequence_position++;
+
+				if(do_loop && sequence_position >= loop_stop) {
+					sequence_position = loop_start;
+				}
+			}
+
+			if(sequence_position % 2 == 0) {
+				skip_length = samples_per_tick - samples_per_tick_shuffle;
+			} else {
+				skip_length = samples_per_tick + samples_per_tick_shuffle;
+			}
+		}
+
+		_meb.finish_current_buffer();
 	}
 
 	void Sequence::reset() {
+		playback_all_notes_off();
+		playback_expected_at = -1;
 	}
 
 	std::vector<std::string> Sequence::internal_get_controller_groups() {
@@ -597,11 +764,8 @@ SERVER_N_CLIENT_CODE(
 		auto ptrn_itr = patterns.find(pattern_id);
 
 		if(ptrn_itr != patterns.end()) {
-			ptrn_itr->second->note_list.clear(
-				[](Note* to_drop) {
-					note_allocator.recycle(to_drop);
-				}
-				);
+			note_allocator.recycle_chain(ptrn_itr->second->note_list.head);
+			ptrn_itr->second->note_list.head = NULL;
 			pattern_allocator.recycle(ptrn_itr->second);
 			patterns.erase(ptrn_itr);
 
@@ -780,6 +944,7 @@ SERVER_N_CLIENT_CODE(
 
 		Serialize::ItemDeserializer serder(serialized.get_value("sequence_data"));
 		serderize_sequence(serder);
+		ON_SERVER(rebuild_playback_index(););
 
 		SATAN_DEBUG("Sequence() created client side.\n");
 	}
@@ -21,6 +21,8 @@
 #define SEQUENCE_HH
 
 #include <list>
+#include <vector>
+#include <atomic>
 
 #include "../common.hh"
 #include "../linked_list.hh"
@@ -132,6 +134,7 @@ namespace RemoteInterface {
 
 			Sequence(const Factory *factory, const RemoteInterface::Message &serialized);
 			Sequence(int32_t new_obj_id, const Factory *factory);
+			ON_SERVER(virtual ~Sequence(););
 
 			// functions for implementing class Machine
 			ON_SERVER(
@@ -192,6 +195,52 @@ namespace RemoteInterface {
 			static ObjectAllocator<Note> note_allocator;
 
 			ON_SERVER(MachineSequencer* m_seq);
+
+			/* Realtime playback
+			 *
+			 * After each edit the server thread expands the pattern
+			 * instances into a time sorted list of note on/off events
+			 * and hands it to the audio thread through pending_index.
+			 * fill_buffers() picks it up, binary searches its position
+			 * after a seek or loop wrap and then just steps forward
+			 * - it never allocates or locks. Replaced indexes are pushed
+			 * on retired_indexes and freed by the next rebuild.
+			 *
+			 * Times are PAD_TIME() values, line << BITS_PER_LINE | tick.
+			 */
+			ON_SERVER(
+				struct PlaybackEvent {
+					int at;
+					uint8_t is_on; // note offs sort before note ons at the same tick
+					uint8_t channel, note, velocity;
+
+					inline bool operator<(const PlaybackEvent& rhs) const {
+						return at < rhs.at || (at == rhs.at && is_on < rhs.is_on);
+					}
+				};
+
+				struct PlaybackIndex {
+					std::vector<PlaybackEvent> events;
+					PlaybackIndex *next; // in the retired list
+				};
+
+				std::atomic<PlaybackIndex *> pending_index{NULL};
+				std::atomic<PlaybackIndex *> retired_indexes{NULL};
+
+				// only touched by the audio thread
+				PlaybackIndex *current_index = NULL;
+				size_t playback_cursor = 0;
+				int playback_expected_at = -1;
+				int active_note_count = 0;
+				uint8_t active_notes[16][128] = {}; // number of sounding notes per channel and key
+				MidiEventBuilder _meb;
+
+				void rebuild_playback_index(); // not realtime safe
+				void free_retired_indexes();
+				void playback_seek(int at);
+				void playback_all_notes_off();
+				);
+
 			std::map<uint32_t, Pattern*> patterns;
 			LinkedList<PatternInstance> instance_list;
 			std::string sequence_name;
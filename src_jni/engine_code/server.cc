@@ -38,12 +38,27 @@ SERVER_CODE(
 	}
 
 	Server::ClientAgent::ClientAgent(int32_t _id, asio::ip::tcp::socket _socket, Server *_server)
-	: MessageHandler(std::move(_socket)), id(_id), server(_server) {
+	: MessageHandler(std::move(_socket)), id(_id), server(_server), sync_timeout(_server->io_service) {
 	}
 
 	void Server::ClientAgent::start() {
 		send_handler_message();
 		start_receive();
+
+		// clients that do not know about the protocol offer never answer it
+		auto self = std::static_pointer_cast<ClientAgent>(shared_from_this());
+		sync_timeout.expires_from_now(std::chrono::seconds(VUKNOB_SYNC_TIMEOUT));
+		sync_timeout.async_wait(
+			[self](std::error_code ec) {
+				if(!ec && !self->synchronized)
+					self->server->synchronize_client(self, NULL);
+			}
+			);
+	}
+
+	void Server::ClientAgent::set_synchronized() {
+		synchronized = true;
+		sync_timeout.cancel();
 	}
 
 	void Server::ClientAgent::disconnect() {
@@ -88,6 +103,20 @@ SERVER_CODE(
 		return new_obj_id;
 	}
 
+	void Server::track_change(const Message &msg) {
+		// notifications do not change what a new client needs
+		if(msg.is_transient() || !msg.has_value("id")) return;
+
+		int identifier = std::stol(msg.get_value("id"));
+		if(identifier >= 0) {
+			snapshot.object_changed(identifier);
+		} else if(identifier == __MSG_CREATE_OBJECT) {
+			snapshot.object_changed(std::stol(msg.get_value("new_objid")));
+		} else if(identifier == __MSG_DELETE_OBJECT) {
+			snapshot.object_deleted(std::stol(msg.get_value("objid")));
+		}
+	}
+
 	void Server::delete_object(std::shared_ptr<BaseObject> obj2delete) {
 		for(auto obj  = all_objects.begin();
 		    obj != all_objects.end();
@@ -229,7 +258,20 @@ SERVER_CODE(
 			);
 	}
 
-	Server::Server(const asio::ip::tcp::endpoint& endpoint) : last_obj_id(-1), acceptor(io_service, endpoint),
+	Server::Server(const asio::ip::tcp::endpoint& endpoint) : last_obj_id(-1),
+	snapshot(
+		[this](int32_t objid, std::vector<uint8_t> &fields) -> bool {
+			auto obj = all_objects.find(objid);
+			if(obj == all_objects.end()) return false;
+
+			std::shared_ptr<Message> create_object_message = acquire_message();
+			add_create_object_header(create_object_message, obj->second);
+			obj->second->serialize(create_object_message);
+			create_object_message->encode_fields(fields);
+			return true;
+		}
+		),
+	acceptor(io_service, endpoint),
 	acceptor_socket(io_service)
 	{
 		acceptor.listen();
@@ -280,9 +322,9 @@ SERVER_CODE(
 
 					client_agents[new_id] = new_client_agent;
 
+					// the objects are sent when the client has answered
 					send_protocol_version_to_new_client(new_client_agent);
 					send_client_id_to_new_client(new_client_agent);
-					send_all_objects_to_new_client(new_client_agent);
 
 					new_client_agent->start();
 				}
@@ -371,6 +413,8 @@ SERVER_CODE(
 		std::shared_ptr<Message> pv_message = acquire_message();
 		pv_message->set_value("id", std::to_string(__MSG_PROTOCOL_VERSION));
 		pv_message->set_value("pversion", std::to_string(__VUKNOB_PROTOCOL_VERSION__));
+		pv_message->set_value("binary", std::to_string(__VUKNOB_BINARY_PROTOCOL_VERSION__));
+		pv_message->set_value("snapshot", "true");
 		client_agent->deliver_message(pv_message);
 	}
 
@@ -390,10 +434,53 @@ SERVER_CODE(
 		}
 	}
 
+	void Server::send_snapshot_to_new_client(std::shared_ptr<MessageHandler> client_agent,
+						 uint64_t known_epoch, uint64_t known_revision) {
+		std::vector<char> data;
+		size_t raw_size;
+		bool full;
+		snapshot.build(known_epoch, known_revision, data, raw_size, full);
+
+		SATAN_DEBUG("Server::send_snapshot_to_new_client() - %s, %d bytes\n",
+			    full ? "full" : "delta", (int)data.size());
+
+		std::shared_ptr<Message> snapshot_message = acquire_message();
+		snapshot_message->set_value("id", std::to_string(__MSG_SNAPSHOT));
+		snapshot_message->set_value("snapepoch", std::to_string(snapshot.get_epoch()));
+		snapshot_message->set_value("snaprev", std::to_string(snapshot.get_revision()));
+		snapshot_message->set_value("full", full ? "true" : "false");
+		snapshot_message->set_value("rawsize", std::to_string(raw_size));
+		snapshot_message->set_payload("data", std::move(data));
+		client_agent->deliver_message(snapshot_message);
+	}
+
+	void Server::synchronize_client(std::shared_ptr<ClientAgent> client_agent, const Message *request) {
+		if(client_agent->is_synchronized()) return;
+
+		if(request && request->has_value("snaprev")) {
+			send_snapshot_to_new_client(client_agent,
+						    std::stoull(request->get_value("snapepoch")),
+						    std::stoull(request->get_value("snaprev")));
+		} else {
+			send_all_objects_to_new_client(client_agent);
+		}
+		// updates distributed from now on are queued after the snapshot, and the
+		// write queue holds them until the last chunk of it has been written
+		client_agent->set_synchronized();
+	}
+
 	void Server::route_incomming_message(ClientAgent *src, const Message &msg) {
 		int identifier = std::stol(msg.get_value("id"));
 
-		if(identifier == __MSG_DELETE_OBJECT) {
+		if(identifier == __MSG_PROTOCOL_VERSION) {
+			// the client accepted our offer of binary framing
+			int binary_version = std::stol(msg.get_value("binary"));
+			if(binary_version < 0 || binary_version > __VUKNOB_BINARY_PROTOCOL_VERSION__)
+				binary_version = 0;
+			src->use_binary_protocol(binary_version);
+
+			synchronize_client(std::static_pointer_cast<ClientAgent>(src->shared_from_this()), &msg);
+		} else if(identifier == __MSG_DELETE_OBJECT) {
 			int identifier = std::stol(msg.get_value("objid"));
 
 			auto obj_iterator = all_objects.find(identifier);
@@ -531,7 +618,12 @@ SERVER_CODE(
 	}
 
 	void Server::distribute_message(std::shared_ptr<Message> &msg, bool via_udp) {
+		track_change(*msg);
+
 		for(auto client_agent : client_agents) {
+			// a client that is not synchronized will get this in its snapshot
+			if(!client_agent.second->is_synchronized()) continue;
+
 			SATAN_DEBUG("Server::distribute_message() - deliver_message() called.\n");
 			client_agent.second->deliver_message(msg, via_udp);
 		}
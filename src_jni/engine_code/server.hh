@@ -24,8 +24,13 @@
 
 #include "../common.hh"
 #include "../remote_interface.hh"
+#include "../object_snapshot.hh"
 #include "sequence.hh"
 
+// seconds to wait for a new client to answer the protocol offer, before
+// the objects are sent the old way
+#define VUKNOB_SYNC_TIMEOUT 2
+
 
 SERVER_CODE(
 
@@ -88,6 +93,10 @@ SERVER_CODE(
 
 		std::shared_ptr<HandleList> handle_list;
 
+		// the state of all objects, kept up to date by distribute_message()
+		ObjectSnapshot snapshot;
+		void track_change(const Message &msg);
+
 		/**** end service objects data and logic ****/
 
 		class ClientAgent : public MessageHandler {
@@ -95,6 +104,10 @@ SERVER_CODE(
 			int32_t id;
 			Server *server;
 
+			// messages are not distributed to a client until it has all objects
+			bool synchronized = false;
+			asio::steady_timer sync_timeout;
+
 			void send_handler_message();
 		public:
 			ClientAgent(int32_t id, asio::ip::tcp::socket _socket, Server *server);
@@ -103,6 +116,8 @@ SERVER_CODE(
 			void disconnect();
 
 			int32_t get_id() { return id; }
+			bool is_synchronized() { return synchronized; }
+			void set_synchronized();
 
 			virtual void on_message_received(const Message &msg) override;
 			virtual void on_connection_dropped() override;
@@ -132,6 +147,10 @@ SERVER_CODE(
 		void send_protocol_version_to_new_client(std::shared_ptr<MessageHandler> client_agent);
 		void send_client_id_to_new_client(std::shared_ptr<ClientAgent> client_agent);
 		void send_all_objects_to_new_client(std::shared_ptr<MessageHandler> client_agent);
+		void send_snapshot_to_new_client(std::shared_ptr<MessageHandler> client_agent,
+						 uint64_t known_epoch, uint64_t known_revision);
+		// request is the answer to the protocol offer, or NULL if the client never answered
+		void synchronize_client(std::shared_ptr<ClientAgent> client_agent, const Message *request);
 
 		int get_port();
 
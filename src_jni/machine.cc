@@ -30,6 +30,10 @@
  */
 
 #include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <semaphore.h>
 #include <iostream>
 #include <fstream>
 #include <sys/types.h>
@@ -39,6 +43,7 @@
 #include <jngldrum/jinformer.hh>
 
 #include "machine.hh"
+#include "premix_kernels.hh"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -90,7 +95,8 @@ Machine::Controller::Controller(
 	const std::string &step,
 	const std::map<int, std::string> _enumnames,
 	bool _float_is_FTYPE)
-	: has_midi_ctrl(false), coarse_controller(-1), fine_controller(-1) {
+	: has_midi_ctrl(false), coarse_controller(-1), fine_controller(-1)
+	, owner(NULL), parameter_index(-1) {
 
 	float_is_FTYPE = _float_is_FTYPE;
 	type = tp;
@@ -265,6 +271,7 @@ void Machine::Controller::internal_get_value(std::string &val) {
 void Machine::Controller::internal_set_value(int val) {
 	if(val >= min_i && val <= max_i)
 		*((int *)ptr) = val;
+	if(owner) owner->publish_parameter(parameter_index);
 }
 
 void Machine::Controller::internal_set_value(float val) {
@@ -274,6 +281,7 @@ void Machine::Controller::internal_set_value(float val) {
 		else
 			*((float *)ptr) = val;
 	}
+	if(owner) owner->publish_parameter(parameter_index);
 }
 
 void Machine::Controller::internal_set_value(double val) {
@@ -284,6 +292,7 @@ void Machine::Controller::internal_set_value(double val) {
 
 void Machine::Controller::internal_set_value(bool val) {
 	*((int *)ptr) = (val) ? -1 : 0;
+	if(owner) owner->publish_parameter(parameter_index);
 }
 
 void Machine::Controller::internal_set_value(const std::string &val) {
@@ -291,17 +300,50 @@ void Machine::Controller::internal_set_value(const std::string &val) {
 	strncpy(str, val.c_str(), STRING_CONTROLLER_SIZE);
 }
 
+bool Machine::Controller::enqueue_value(float val, int sample_offset, int ramp_length) {
+	if(owner == NULL || parameter_index < 0) return false;
+
+	ParameterQueue::Event e;
+	e.index = parameter_index;
+	e.offset = sample_offset;
+	e.ramp_length = (type == c_float && ramp_length > 0) ? ramp_length : 0;
+	e.value = val;
+	e.timestamp = get_parameter_clock();
+
+	ParameterSnapshot &ps = owner->parameter_snapshot[parameter_index];
+	ps.pending.fetch_add(1);
+	if(!owner->parameter_queue.push(e)) {
+		ps.pending.fetch_sub(1);
+		return false;
+	}
+	ps.value.store(val);
+	return true;
+}
+
 void Machine::Controller::get_value(int &val) {
+	float snapshot;
+	if((type == c_int || type == c_enum || type == c_sigid) &&
+	   owner && owner->read_parameter_snapshot(parameter_index, snapshot)) {
+		val = (int)snapshot;
+		return;
+	}
+
 	Machine::machine_operation_enqueue(
 		[&val, this](void *) {
+			if(owner) owner->flush_parameter_events();
 			internal_get_value(val);
 		},
 		NULL, true);
 }
 
 void Machine::Controller::get_value(float &val) {
+	if(type == c_float &&
+	   owner && owner->read_parameter_snapshot(parameter_index, val))
+		return;
+
 	Machine::machine_operation_enqueue(
 		[&val, this](void *) {
+			if(owner) owner->flush_parameter_events();
 			internal_get_value(val);
 		},
 		NULL, true);
@@ -316,8 +358,16 @@ void Machine::Controller::get_value(double &val) {
 }
 
 void Machine::Controller::get_value(bool &val) {
+	float snapshot;
+	if(type == c_bool &&
+	   owner && owner->read_parameter_snapshot(parameter_index, snapshot)) {
+		val = snapshot != 0.0f;
+		return;
+	}
+
 	Machine::machine_operation_enqueue(
 		[&val, this](void *) {
+			if(owner) owner->flush_parameter_events();
 			internal_get_value(val);
 		},
 		NULL, true);
@@ -356,6 +406,9 @@ std::string Machine::Controller::get_value_name(const int &val) {
 }
 
 void Machine::Controller::set_value(int &val) {
+	if(val >= min_i && val <= max_i && enqueue_value((float)val, -1, 0))
+		return;
+
 	Machine::machine_operation_enqueue(
 		[this, val](void *) {
 			internal_set_value(val);
@@ -364,6 +417,9 @@ void Machine::Controller::set_value(int &val) {
 }
 
 void Machine::Controller::set_value(float &val) {
+	if(val >= min_f && val <= max_f && enqueue_value(val, -1, 0))
+		return;
+
 	Machine::machine_operation_enqueue(
 		[val, this](void *) {
 			internal_set_value(val);
@@ -380,6 +436,9 @@ void Machine::Controller::set_value(double &val) {
 }
 
 void Machine::Controller::set_value(bool &val) {
+	if(enqueue_value(val ? 1.0f : 0.0f, -1, 0))
+		return;
+
 	Machine::machine_operation_enqueue(
 		[val, this](void *) {
 			internal_set_value(val);
@@ -395,6 +454,39 @@ void Machine::Controller::set_value(const std::string &val) {
 		NULL, true);
 }
 
+void Machine::Controller::schedule_value(float val, int sample_offset, int ramp_length) {
+	switch(type) {
+	case c_float:
+		if(val < min_f || val > max_f) return;
+		break;
+	case c_int:
+	case c_enum:
+	case c_sigid:
+		if(val < (float)min_i || val > (float)max_i) return;
+		break;
+	case c_bool:
+		break;
+	default:
+		throw jException("schedule_value() is not supported for this controller type.",
+				 jException::sanity_error);
+	}
+
+	if(sample_offset < 0) sample_offset = -1; // placed by arrival time, like set_value()
+	if(enqueue_value(val, sample_offset, ramp_length))
+		return;
+
+	// the queue is full - fall back to a buffer boundary change
+	int ival = (int)val;
+	bool bval = val != 0.0f;
+	Machine::machine_operation_enqueue(
+		[this, val, ival, bval](void *) {
+			if(type == c_float) internal_set_value(val);
+			else if(type == c_bool) internal_set_value(bval);
+			else internal_set_value(ival);
+		},
+		NULL, false);
+}
+
 bool Machine::Controller::has_midi_controller(int &_coarse, int &_fine) {
 	if(has_midi_ctrl) {
 		if((coarse_controller < 0 || coarse_controller > 127) &&
@@ -488,6 +580,30 @@ void Machine::internal_attach_input(Machine *m,
 		(*k).second->link(this, s);
 	s->attach(this);
 
+	// create the premix signal here, and not in execute(), since
+	// execute() might run in parallel with other machines.
+	if((*des).second.premix &&
+	   premixed_input.find(input_name) == premixed_input.end()) {
+		premixed_input[input_name] =
+			Signal::SignalFactory::create_signal(
+				(*des).second.channels,
+				this,
+				name + "_" + input_name + "_premix",
+				s->get_dimension()
+				);
+	}
+
+	// machines that have not enabled MIDI event lists read
+	// their MIDI inputs through a legacy pointer format signal
+	if(s->get_dimension() == _MIDI && !midi_event_lists_enabled &&
+	   premixed_input.find(input_name) == premixed_input.end()) {
+		premixed_input[input_name] =
+			Signal::SignalFactory::create_legacy_midi_signal(
+				this,
+				name + "_" + input_name + "_legacy"
+				);
+	}
+
 	// increase dependant count
 	std::map<Machine *, int>::iterator i;
 	i = dependant.find(m);
@@ -498,6 +614,8 @@ void Machine::internal_attach_input(Machine *m,
 	c++;
 	dependant[m] = c;
 
+	rebuild_premix();
+	inputs_changed();
 	recalculate_render_chain();
 
 	{
@@ -556,6 +674,8 @@ void Machine::internal_detach_input(Machine *m,
 	} else {
 		dependant[m] = c;
 	}
+	rebuild_premix();
+	inputs_changed();
 	recalculate_render_chain();
 	{
 		Machine *source_machine = m;
@@ -772,6 +892,18 @@ __MACHINE_OPERATION_CALLBACK Machine::CALL_internal_set_name(void *p) {
 
 void Machine::internal_set_name(const std::string &nm) {
 	name = nm;
+	publish_name();
+}
+
+void Machine::publish_name() {
+	NameSnapshot ns;
+	memset(&ns, 0, sizeof(ns));
+	ns.complete = name.size() < MACHINE_NAME_SNAPSHOT_SIZE;
+	if(ns.complete)
+		strncpy(ns.text, name.c_str(), MACHINE_NAME_SNAPSHOT_SIZE - 1);
+	name_snapshot.write(ns);
+
+	PerformanceTrace::set_source_name(trace_source, name);
 }
 
 /***************************
@@ -868,6 +1000,10 @@ int Machine::get_output_index(const std::string &out) {
 }
 
 std::string Machine::get_name() {
+	NameSnapshot ns = name_snapshot.read();
+	if(ns.complete)
+		return std::string(ns.text);
+
 	std::string result;
 	machine_operation_enqueue(
 		[&result, this](void */* ignored */) {
@@ -889,16 +1025,19 @@ void Machine::set_name(const std::string &nm) {
 }
 
 float Machine::get_x_position() {
-	return x_position;
+	return position_snapshot.read().x;
 }
 
 float Machine::get_y_position() {
-	return y_position;
+	return position_snapshot.read().y;
 }
 
 void Machine::set_position(float x, float y) {
 	x_position = x;
 	y_position = y;
+
+	PositionSnapshot ps = {x, y};
+	position_snapshot.write(ps);
 	SATAN_DEBUG("Machine::set_position(%f, %f) for %s\n", x, y, get_name().c_str());
 }
 
@@ -910,137 +1049,206 @@ void Machine::set_position(float x, float y) {
  *                         *
  ***************************/
 
-class MachineOperationSynchObject : public jThread::Event {
+class MachineOperationSynchObject {
 private:
-	jThread::EventQueue synch_queue;
+	sem_t done;
 public:
-	bool triggered = false;
 	std::string exception_message;
 	jException::Type exception_type;
 
-	MachineOperationSynchObject() : exception_type(jException::NO_ERROR) {}
-	virtual ~MachineOperationSynchObject() {}
+	MachineOperationSynchObject() : exception_type(jException::NO_ERROR) {
+		sem_init(&done, 0, 0);
+	}
+	~MachineOperationSynchObject() {
+		sem_destroy(&done);
+	}
 
 	void wait() {
-		(void) synch_queue.wait_for_event(); // ignore result since we already know it to be equal to *this
+		while(sem_wait(&done) != 0 && errno == EINTR);
 	}
 
+	// sem_post() never blocks, so this is safe to call from the audio thread
 	void trigger() {
-		triggered = true;
-		synch_queue.push_event(this);
+		sem_post(&done);
 	}
-
-	virtual void dummy_event_function() {}
 };
 
-class MachineOperation {
-public:
-	std::function<void(void *data)> callback;
-	void *callback_data;
-	MachineOperationSynchObject *synch_object;
+static MachineOperationQueue machine_operation_queue;
 
-	MachineOperation() : callback(NULL), synch_object(NULL) { memset(&callback_data, 0, sizeof(callback_data)); }
-};
+// true when the audio playback thread is executing the queue
+static std::atomic<bool> machine_operation_queue_active(false);
+// number of threads that might be pushing to the queue right now
+static std::atomic<int> machine_operation_producers(0);
+// the thread currently executing operations, so nested calls can execute directly
+static std::atomic<pid_t> machine_operation_thread(0);
 
-static moodycamel::ReaderWriterQueue<MachineOperation> machine_operation_queue(100);
+void Machine::machine_operation_execute(MachineOperation &mo) {
+	// if there is a synch object attached we need to trigger it after the callback
+	if(mo.synch_object) {
+		// we can catch jExceptions and pass on the error through the synch_object
+		SATAN_DEBUG(" Calling machine operation callback (with synch - %p)\n", mo.synch_object);
+		try {
+			mo();
+		} catch(jException e) {
+			mo.synch_object->exception_message = e.message;
+			mo.synch_object->exception_type = e.type;
+		} catch(std::exception const& e) {
+			SATAN_ERROR("Machine::machine_operation_execute() - Unexpected exception caught --> %s\n", e.what());
+			exit(0);
+		} catch(...) {
+			SATAN_ERROR("Machine::machine_operation_execute() - Unknown exception caught\n");
+			exit(0);
+		}
+		mo.synch_object->trigger();
+		SATAN_DEBUG(" Machine operation callback returned, and synched\n");
+	} else {
+		// otherwise, just call the callback
+		// if an exception is received here we will quit the application straight away, no mercy.
+		try {
+			SATAN_DEBUG(" Calling machine operation callback (NO synch)\n");
+			mo();
+			SATAN_DEBUG(" Machine operation callback returned (NO synch)\n");
+		} catch(const std::bad_function_call& e) {
+			SATAN_ERROR("bad_function_call exception caught in machine_operation_execute.\n");
+			exit(0);
+		} catch(...) {
+			SATAN_ERROR("Unknown exception caught in machine_operation_execute.\n");
+			exit(0);
+		}
+	}
+	mo.reset();
+}
 
 // operation called ONLY by NON audio playback threads
-void Machine::machine_operation_enqueue(std::function<void(void *data)> callback, void *callback_data, bool do_sync) {
-	// we rely on the machine_space lock here to synchronize the check of the sink variable
-	Machine::lock_machine_space();
-	if((!sink) || (!low_latency_mode)) {
-		// if sink is not set, or we dont have low latency suport,
-		// we have noone that executes machine_operation calls, so we execute directly
+void Machine::machine_operation_submit(MachineOperation &mo, bool do_sync) {
+	// called from inside another operation - we are already synchronized
+	if(machine_operation_thread.load() == gettid()) {
+		mo.synch_object = NULL;
+		mo();
+		return;
+	}
+
+	MachineOperationSynchObject synch_object;
+	mo.synch_object = do_sync ? (&synch_object) : NULL;
+
+	while(1) {
+		// machine_operation_update_mode() waits for machine_operation_producers
+		// to reach zero before draining the queue, so if we see the queue
+		// as active here our operation will always be executed.
+		machine_operation_producers.fetch_add(1);
+		if(machine_operation_queue_active.load()) {
+			bool pushed = machine_operation_queue.push(mo);
+			machine_operation_producers.fetch_sub(1);
+			if(pushed) break;
+
+			// queue full - don't hold machine_operation_producers while waiting,
+			// or machine_operation_update_mode() could wait for us forever. The
+			// queue might be inactive when we retry, then we execute directly.
+			SATAN_DEBUG("Machine::machine_operation_submit() - queue full, waiting.\n");
+			sched_yield();
+			continue;
+		}
+		machine_operation_producers.fetch_sub(1);
+
+		// no one executes the queue, so we execute directly with the machine space locked
+		Machine::lock_machine_space();
+		if(machine_operation_queue_active.load()) {
+			// activated while we waited for the lock - try the queue again
+			Machine::unlock_machine_space();
+			continue;
+		}
+		mo.synch_object = NULL;
 		try {
-			callback(callback_data);
+			mo();
 		} catch(...) {
 			// first unlock before rethrowing
 			Machine::unlock_machine_space();
 			throw;
 		}
 		Machine::unlock_machine_space();
-	} else {
-		// we write to the queue while we hold the machine space lock - to protect the queue from multiple writers
-		// but also to protect from the fact that the sink object might otherwise be deleted between our check for
-		// it and the actual write to the queue.
-		MachineOperation mo;
-		MachineOperationSynchObject synch_object;
-
-		mo.callback = callback;
-		mo.callback_data = callback_data;
-		mo.synch_object = do_sync ? (&synch_object) : NULL;
-
-		machine_operation_queue.enqueue(mo);
+		return;
+	}
 
-		Machine::unlock_machine_space();
+	if(do_sync) {
+		SATAN_DEBUG("do_sync -- wait for sync_object %p\n", &synch_object);
+		synch_object.wait();
+		SATAN_DEBUG("do_sync -- sync_object %p returned\n", &synch_object);
 
-		if(do_sync) {
-			SATAN_DEBUG("do_sync -- wait for sync_object %p\n", &synch_object);
-			synch_object.wait();
-			SATAN_DEBUG("do_sync -- sync_object %p returned\n", &synch_object);
-
-			// if there was a jException thrown during execution
-			// we throw it here too
-			if(synch_object.exception_type != jException::NO_ERROR) {
-				SATAN_DEBUG("   oops - synch_object.wait() returned an exception. (%s)\n", synch_object.exception_message.c_str());
-				throw jException(synch_object.exception_message,
-						 synch_object.exception_type);
-			}
+		// if there was a jException thrown during execution
+		// we throw it here too
+		if(synch_object.exception_type != jException::NO_ERROR) {
+			SATAN_DEBUG("   oops - synch_object.wait() returned an exception. (%s)\n", synch_object.exception_message.c_str());
+			throw jException(synch_object.exception_message,
+					 synch_object.exception_type);
 		}
 	}
 }
 
 // operation called ONLY by NON audio playback threads
-void Machine::machine_operation_enqueue(std::function<void()> operation, bool do_sync) {
+void Machine::machine_operation_enqueue_batch(const std::vector<std::function<void()> > &operations) {
 	machine_operation_enqueue(
-		[operation](void*) {
-			operation();
-		}, NULL, do_sync
-		);
+		[&operations]() {
+			std::string failure_message;
+			jException::Type failure_type = jException::NO_ERROR;
+
+			for(auto &operation : operations) {
+				try {
+					operation();
+				} catch(jException e) {
+					if(failure_type == jException::NO_ERROR) {
+						failure_message = e.message;
+						failure_type = e.type;
+					}
+				}
+			}
+
+			if(failure_type != jException::NO_ERROR)
+				throw jException(failure_message, failure_type);
+		},
+		true);
+}
+
+void Machine::machine_operation_update_mode() {
+	bool active = (sink != NULL) && low_latency_mode;
+
+	if(active == machine_operation_queue_active.load()) return;
+
+	machine_operation_queue_active.store(active);
+
+	if(!active) {
+		// wait for pushes that started while we were active, then
+		// execute what is left since no one else will do it.
+		while(machine_operation_producers.load() > 0)
+			sched_yield();
+
+		MachineOperation mo;
+		machine_operation_thread.store(gettid());
+		while(machine_operation_queue.pop(mo))
+			machine_operation_execute(mo);
+		machine_operation_thread.store(0);
+	}
 }
 
 // operation ONLY called by audio playback thread
 void Machine::machine_operation_dequeue() {
 	MachineOperation mo;
 
-	bool d;
-	int kount = 50; // limit the processing to 50 operations per call to this function
-	while(kount > 0 && ((d = machine_operation_queue.try_dequeue(mo)) == true)) {
+	pid_t self = gettid();
+	machine_operation_thread.store(self);
+
+	int kount = MAX_MACHINE_OPERATIONS_PER_BUFFER;
+	while(kount > 0 && machine_operation_queue.pop(mo)) {
 		kount--;
-		// if there is a synch object attached we need to trigger it after the callback
-		if(mo.synch_object) {
-			// we can catch jExceptions and pass on the error through the synch_object
-			SATAN_DEBUG(" Calling machine operation callback (with synch - %p)\n", mo.synch_object);
-			try {
-				mo.callback(mo.callback_data);
-			} catch(jException e) {
-				mo.synch_object->exception_message = e.message;
-				mo.synch_object->exception_type = e.type;
-			} catch(std::exception const& e) {
-				SATAN_ERROR("Machine::machine_operation_dequeue() - Unexpected exception caught --> %s\n", e.what());
-				exit(0);
-			} catch(...) {
-				SATAN_ERROR("Machine::machine_operation_dequeue() - Unknown exception caught\n");
-				exit(0);
-			}
-			mo.synch_object->trigger();
-			SATAN_DEBUG(" Machine operation callback returned, and synched\n");
-		} else {
-			// otherwise, just call the callback
-			// if an exception is received here we will quit the application straight away, no mercy.
-			try {
-				SATAN_DEBUG(" Calling machine operation callback (NO synch)\n");
-				mo.callback(mo.callback_data);
-				SATAN_DEBUG(" Machine operation callback returned (NO synch)\n");
-			} catch(const std::bad_function_call& e) {
-				SATAN_ERROR("bad_function_call exception caught in machine_operation_dequeue.\n");
-				exit(0);
-			} catch(...) {
-				SATAN_ERROR("Unknown exception caught in machine_operation_dequeue.\n");
-				exit(0);
-			}
-		}
+		machine_operation_execute(mo);
+
+		// the operation handed the graph over to the offline renderer,
+		// which will dequeue the rest
+		if(offline_rendering.load() && self != offline_render_thread)
+			break;
 	}
+
+	// the offline renderer might be dequeueing already
+	machine_operation_thread.compare_exchange_strong(self, 0);
 }
 
 pid_t machine_execution_thread = 0;
@@ -1051,6 +1259,7 @@ void Machine::activate_low_latency_mode() {
 
 	machine_execution_thread = gettid();
 	low_latency_mode = true;
+	machine_operation_update_mode();
 
 	Machine::unlock_machine_space();
 }
@@ -1059,7 +1268,7 @@ void Machine::deactivate_low_latency_mode() {
 	Machine::lock_machine_space();
 
 	low_latency_mode = false;
-	machine_operation_dequeue();
+	machine_operation_update_mode();
 	machine_execution_thread = 0;
 
 	Machine::unlock_machine_space();
@@ -1091,9 +1300,26 @@ void Machine::recalculate_render_chain() {
 	SATAN_DEBUG("-------- BEGIN NEW RENDER CHAIN\n");
 	if(sink) sink->push_to_render_chain();
 	SATAN_DEBUG("-------- END NEW RENDER CHAIN\n");
+
+	if(render_scheduler) render_scheduler->chain_changed(top_render_chain);
 }
 
 void Machine::render_chain() {
+	{ // used when placing parameter events inside the buffer
+		Resolution r;
+		int f;
+		Signal::get_defaults(_0D, parameter_cycle_samples, r, f);
+		parameter_cycle_previous_start = parameter_cycle_start;
+		parameter_cycle_start = get_parameter_clock();
+	}
+
+	// pages read by the previous cycle may now be evicted
+	StaticSignalStream::advance_cycle();
+
+	// the parallel graph might not be built yet for a new chain
+	if(render_scheduler && render_scheduler->render())
+		return;
+
 	Machine *m = top_render_chain;
 	while(m != NULL) {
 		m->execute();
@@ -1121,6 +1347,10 @@ int Machine::fill_this_sink(
 		return _notSink;
 	}
 
+	// the offline renderer owns the graph, just keep the output silent
+	if(offline_rendering.load() && gettid() != offline_render_thread)
+		return fill_sink_callback(_sinkPaused, callback_data);
+
 	if(low_latency_mode) {
 		/* first we fill the sink */
 		retval = internal_fill_sink(fill_sink_callback, callback_data);
@@ -1132,6 +1362,11 @@ int Machine::fill_this_sink(
 	} else {
 		// If not in low latency mode, we use the machine space lock
 		Machine::lock_machine_space();
+		if(offline_rendering.load() && gettid() != offline_render_thread) {
+			// switched to offline rendering while we waited for the lock
+			Machine::unlock_machine_space();
+			return fill_sink_callback(_sinkPaused, callback_data);
+		}
 		/* then we fill the sink */
 		try {
 			retval = internal_fill_sink(fill_sink_callback, callback_data);
@@ -1178,28 +1413,31 @@ void Machine::setup_machine() {
 		stream << "m#" << machine_set.size() << ":" << base_name;
 		name = stream.str();
 	}
+	publish_name();
 
 	Machine::internal_register_machine(this);
 	SATAN_DEBUG("  machine [%p] name set to ] %s [\n", this, name.c_str());
 
 }
 
-Machine::Machine() {
+Machine::Machine() : midi_event_lists_enabled(false), parameter_event_count(0), parameter_events_enabled(false),
+		     parameter_snapshot_count(0) {
 	// this should not be called from a child class
 }
 
 Machine::Machine(std::string name_base, bool _base_name_is_name, float _xpos, float _ypos) :
-	base_name(name_base), base_name_is_name(_base_name_is_name), x_position(_xpos), y_position(_ypos) {
-	CREATE_TIME_MEASURE_OBJECT(tmes_A, base_name.c_str(), 1000);
-	CREATE_TIME_MEASURE_OBJECT(tmes_B, base_name.c_str(), 1000);
-	CREATE_TIME_MEASURE_OBJECT(tmes_C, base_name.c_str(), 1000);
+	base_name(name_base), base_name_is_name(_base_name_is_name), x_position(_xpos), y_position(_ypos),
+	midi_event_lists_enabled(false), parameter_event_count(0), parameter_events_enabled(false),
+	parameter_snapshot_count(0) {
+	PositionSnapshot ps = {_xpos, _ypos};
+	position_snapshot.write(ps);
+
+	trace_source = PerformanceTrace::register_source(base_name);
 }
 
 Machine::~Machine() {
 	SATAN_DEBUG("Final destroyification of the MACHINE!\n");
-	DELETE_TIME_MEASURE_OBJECT(tmes_A);
-	DELETE_TIME_MEASURE_OBJECT(tmes_B);
-	DELETE_TIME_MEASURE_OBJECT(tmes_C);
+	PerformanceTrace::unregister_source(trace_source);
 }
 
 #define SET_CONTROLLER_VALUE(a,b,c,d)		\
@@ -1272,6 +1510,190 @@ void Machine::setup_using_xml(const KXMLDoc &mxml) {
 		n = n->get_next(this); \
 	}
 
+void Machine::rebuild_premix() {
+	premix_destinations.clear();
+	premix_sources.clear();
+
+	for(auto pmi : premixed_input) {
+		PremixDestination pd;
+		pd.destination = pmi.second;
+		pd.head = NULL;
+		pd.first_source = premix_sources.size();
+		pd.source_count = 0;
+		pd.midi_carry = NULL;
+
+		if(pmi.second->get_resolution() == _PTR) {
+			auto &carry = midi_carry[pmi.first];
+			if(!carry) {
+				carry.reset(new MidiCarry());
+				for(auto &l : carry->list) {
+					l.count = 0;
+					l.capacity = MIDI_EVENT_LIST_CAPACITY;
+				}
+				carry->current = 0;
+			}
+			pd.midi_carry = carry.get();
+		}
+
+		auto i = input.find(pmi.first);
+		if(i != input.end()) {
+			pd.head = (*i).second;
+			for(Signal *n = pd.head; n != NULL; n = n->get_next(this)) {
+				PremixSource ps;
+				ps.source = n;
+				ps.channels = n->get_channels();
+				ps.midi_cursor = 0;
+				premix_sources.push_back(ps);
+				pd.source_count++;
+			}
+		}
+
+		premix_destinations.push_back(pd);
+	}
+}
+
+// the first source is copied into the destination, the rest are added
+// - channels are mapped the same way as in __PREMIX_MACRO
+#define __PREMIX_FLAT(T,SUFFIX) \
+	{ \
+		T *out = (T *)s->get_buffer(); \
+		for(int k = 0; k < pd.source_count; k++) { \
+			const PremixSource &ps = premix_sources[pd.first_source + k]; \
+			T *in = (T *)ps.source->get_buffer(); \
+			int cmax_n = ps.channels; \
+			if(cmax_n == cmax_s) { \
+				if(k == 0) \
+					memcpy(out, in, sizeof(T) * frames * cmax_s); \
+				else \
+					premix_add_##SUFFIX(out, in, frames * cmax_s); \
+				continue; \
+			} \
+			if(k == 0) s->clear_buffer(); \
+			if(cmax_n == 1 && cmax_s == 2) { \
+				premix_add_mono_to_stereo_##SUFFIX(out, in, frames); \
+			} else { \
+				int cmax = cmax_n > cmax_s ? cmax_n : cmax_s; \
+				for(int c = 0; c < cmax; c++) { \
+					int c_n = c < cmax_n ? c : (cmax_n - 1); \
+					int c_s = c < cmax_s ? c : (cmax_s - 1); \
+					premix_add_strided_##SUFFIX(&out[c_s], cmax_s, &in[c_n], cmax_n, frames); \
+				} \
+			} \
+		} \
+	}
+
+void Machine::premix(const PremixDestination &pd) {
+	Signal *s = pd.destination;
+	Resolution res = s->get_resolution();
+
+	if(res == _PTR) {
+		premix_midi(pd);
+		return;
+	}
+
+	if(pd.source_count == 0 ||
+	   (res != _fl32bit && res != _fx8p24bit)) {
+		s->clear_buffer();
+		if(pd.head != NULL)
+			premix(s, pd.head);
+		return;
+	}
+
+	int frames = s->get_samples();
+	int cmax_s = s->get_channels();
+
+	if(res == _fl32bit)
+		__PREMIX_FLAT(float, fl32)
+	else
+		__PREMIX_FLAT(int32_t, fx8p24)
+}
+
+// returns the offset of the next event in a MIDI source, or -1 if there are
+// no more. The cursor is a list index or, for _PTR sources, a frame.
+int Machine::midi_source_peek(Signal *source, int &cursor, MidiEvent **mev) {
+	if(source->get_resolution() == _PTR) {
+		void **in = (void **)source->get_buffer();
+		int frames = source->get_samples();
+		while(cursor < frames && in[cursor] == NULL) cursor++;
+		if(cursor >= frames) return -1;
+		*mev = (MidiEvent *)in[cursor];
+		return cursor;
+	}
+
+	MidiEventList *list = (MidiEventList *)source->get_buffer();
+	if(cursor >= list->count) return -1;
+	*mev = (MidiEvent *)&(list->entry[cursor].event);
+	return list->entry[cursor].offset;
+}
+
+// convert the MIDI inputs into the old format - one MidiEvent pointer
+// per frame. All sources are merged on offset and events sharing a frame
+// spill over into the following free frames, just like MidiEventBuilder
+// did before. Events that don't fit are copied and delivered first in the
+// next buffer, so note offs are never lost. The pointers refer to the source
+// buffers or the carry list, which stay untouched until the next cycle.
+void Machine::premix_midi(const PremixDestination &pd) {
+	Signal *s = pd.destination;
+	void **out = (void **)s->get_buffer();
+	int frames = s->get_samples();
+
+	MidiCarry *carry = pd.midi_carry;
+	MidiEventList *carried = &(carry->list[carry->current]);
+	carry->current ^= 1;
+	MidiEventList *spill = &(carry->list[carry->current]);
+	spill->count = 0;
+
+	if(pd.source_count == 1 && carried->count == 0) {
+		Signal *source = premix_sources[pd.first_source].source;
+		if(source->get_resolution() == _PTR) {
+			memcpy(out, source->get_buffer(), sizeof(void *) * frames);
+			return;
+		}
+	}
+
+	memset(out, 0, sizeof(void *) * frames);
+
+	int slot = 0;
+	auto place = [out, frames, spill, &slot](int offset, MidiEvent *mev) {
+		if(slot < offset) slot = offset;
+		if(slot < frames) {
+			out[slot++] = mev;
+		} else {
+			// longer events than MIDI_EVENT_MAX_LENGTH can't be carried
+			if(!midi_event_list_append(spill, 0, mev->length, mev->data)) {
+				SATAN_DEBUG("Machine::premix_midi() - event dropped.\n");
+			}
+		}
+	};
+
+	for(int k = 0; k < carried->count; k++)
+		place(0, (MidiEvent *)&(carried->entry[k].event));
+
+	for(int k = 0; k < pd.source_count; k++)
+		premix_sources[pd.first_source + k].midi_cursor = 0;
+
+	while(1) {
+		PremixSource *next = NULL;
+		MidiEvent *next_mev = NULL;
+		int next_offset = -1;
+
+		for(int k = 0; k < pd.source_count; k++) {
+			PremixSource &ps = premix_sources[pd.first_source + k];
+			MidiEvent *mev;
+			int offset = midi_source_peek(ps.source, ps.midi_cursor, &mev);
+			if(offset >= 0 && (next == NULL || offset < next_offset)) {
+				next = &ps;
+				next_mev = mev;
+				next_offset = offset;
+			}
+		}
+		if(next == NULL) break;
+
+		place(next_offset, next_mev);
+		next->midi_cursor++;
+	}
+}
+
 void Machine::premix(Signal *s, Signal *n) {
 	int cmax_s, cmax_n, c_n, c_s;
 	int i, max_i;
@@ -1309,6 +1731,7 @@ void Machine::premix(Signal *s, Signal *n) {
 		__PREMIX_MACRO(out_fx,in_fx,fp8p24_t);
 		break;
 	case _PTR:
+	case _MIDI_EVENTS:
 		/* ignore */
 		break;
 	}
@@ -1341,49 +1764,19 @@ void Machine::destroy_tightly_attached_machines() {
 }
 
 void Machine::execute() {
-	// clear all midstorage pre-mix signals
-	// we do this here so that in case
-	// we do not have any attached signal to a slot that is
-	// premixed we do not keep signal data from before
-//	START_TIME_MEASURE((*tmes_A));
-	{
-		std::map<std::string, Signal *>::iterator i;
+	uint64_t trace_start = PerformanceTrace::timestamp();
 
-		for(i  = premixed_input.begin();
-		    i != premixed_input.end();
-		    i++) {
-			if((*i).second != NULL)
-				(*i).second->clear_buffer();
-		}
-	}
-//	STOP_TIME_MEASURE((*tmes_A), "buffers cleared");
-//	START_TIME_MEASURE((*tmes_B));
-	// pre-mix marked channels
-	{
-	static std::map<std::string, Signal *>::iterator i;
-	for(i = input.begin(); i != input.end(); i++) {
-		if(input_descriptor[(*i).first].premix && (*i).second != NULL) {
-			if(premixed_input.find((*i).first) ==
-			   premixed_input.end()) {
-				Signal *s = (*i).second;
-
-				premixed_input[(*i).first] =
-					Signal::SignalFactory::create_signal(
-						input_descriptor[(*i).first].channels, //s->get_channels(),
-						this,
-						name + "_" + (*i).first + "_premix",
-						s->get_dimension()
-						);
-				// clear buffer - we don't want noise
-				s->clear_buffer();
-			}
+	// pre-mix marked channels - premix() will also clear
+	// the premix signals that have nothing attached so
+	// we do not keep signal data from before
+	dispatch_parameter_events();
 
-			premix(premixed_input[(*i).first], (*i).second);
-		}
-	}
-//	STOP_TIME_MEASURE((*tmes_B), "premix done");
-	START_TIME_MEASURE((*tmes_C));
-	}
+	for(auto &pd : premix_destinations)
+		premix(pd);
+
+	// null sink - the offline renderer reads the premixed input itself
+	if(offline_rendering.load(std::memory_order_relaxed) && this == sink)
+		return;
 
 	try {
 		// OK, do da calculationz
@@ -1392,7 +1785,13 @@ void Machine::execute() {
 		jInformer::inform(std::string("Caught an exception when trying to execute dynlib machine [") + name + "]");
 		throw;
 	}
-	STOP_TIME_MEASURE((*tmes_C), "fill_buffers");
+
+	if(parameter_events_enabled)
+		apply_parameter_events();
+
+	publish_parameters();
+
+	PerformanceTrace::record(trace_source, trace_start, PerformanceTrace::timestamp());
 }
 
 Machine::Controller *Machine::create_controller(
@@ -1405,8 +1804,246 @@ Machine::Controller *Machine::create_controller(
 	std::string step,
 	std::map<int, std::string> enumnames,
 	bool float_is_FTYPE) {
-	return new Controller(
+	Controller *c = new Controller(
 		tp, name, title, ptr, min, max, step, enumnames, float_is_FTYPE);
+	c->owner = this;
+	c->parameter_index = register_parameter(ptr, tp, float_is_FTYPE);
+	return c;
+}
+
+/***************************
+ *                         *
+ *  parameter automation   *
+ *                         *
+ ***************************/
+
+int64_t Machine::parameter_cycle_start = 0;
+int64_t Machine::parameter_cycle_previous_start = 0;
+int Machine::parameter_cycle_samples = 0;
+
+int64_t Machine::get_parameter_clock() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return ((int64_t)t.tv_sec) * 1000000000LL + (int64_t)t.tv_nsec;
+}
+
+int Machine::register_parameter(void *ptr, Controller::Type tp, bool float_is_FTYPE) {
+	for(unsigned int k = 0; k < parameter_slots.size(); k++)
+		if(parameter_slots[k].ptr == ptr) return k;
+
+	// strings and doubles are not handled by the parameter queue
+	if(tp == Controller::c_string || tp == Controller::c_double)
+		return -1;
+
+	// controllers beyond the snapshot array fall back to machine operations
+	if(parameter_slots.size() >= MAX_PARAMETERS_PER_MACHINE)
+		return -1;
+
+	ParameterSlot slot;
+	slot.ptr = ptr;
+	slot.type = tp;
+	slot.float_is_FTYPE = float_is_FTYPE;
+	slot.touched = false;
+	slot.current = slot.step = slot.target = 0.0f;
+	slot.ramp_left = 0;
+	parameter_slots.push_back(slot);
+
+	int index = parameter_slots.size() - 1;
+	parameter_snapshot[index].value.store(read_parameter(slot));
+	parameter_snapshot[index].pending.store(0);
+	parameter_snapshot_count.store(index + 1, std::memory_order_release);
+
+	return index;
+}
+
+float Machine::read_parameter(const ParameterSlot &slot) {
+	switch(slot.type) {
+	case Controller::c_float:
+		if(slot.float_is_FTYPE)
+			return FTYPEtof(*((FTYPE *)slot.ptr));
+		return *((float *)slot.ptr);
+	case Controller::c_bool:
+		return *((int *)slot.ptr) ? 1.0f : 0.0f;
+	default:
+		return (float)(*((int *)slot.ptr));
+	}
+}
+
+void Machine::write_parameter(const ParameterSlot &slot, float value) {
+	switch(slot.type) {
+	case Controller::c_float:
+		if(slot.float_is_FTYPE)
+			*((FTYPE *)slot.ptr) = ftoFTYPE(value);
+		else
+			*((float *)slot.ptr) = value;
+		break;
+	case Controller::c_bool:
+		*((int *)slot.ptr) = (value != 0.0f) ? -1 : 0;
+		break;
+	default:
+		*((int *)slot.ptr) = (int)value;
+		break;
+	}
+}
+
+// run the events for one controller over the current buffer, starting from
+// the state in slot. If output is not NULL the value for each sample is written to it.
+void Machine::run_parameter(int index, ParameterSlot &slot, float *output) {
+	int n = parameter_cycle_samples;
+	int k = 0;
+
+	for(int i = 0; i < n; i++) {
+		while(k < parameter_event_count && parameter_events[k].offset <= i) {
+			const ParameterEvent &e = parameter_events[k++];
+			if(e.index != index) continue;
+
+			if(e.ramp_length > 0) {
+				slot.step = (e.value - slot.current) / (float)e.ramp_length;
+				slot.target = e.value;
+				slot.ramp_left = e.ramp_length;
+			} else {
+				slot.current = e.value;
+				slot.ramp_left = 0;
+			}
+		}
+		if(slot.ramp_left > 0) {
+			slot.current += slot.step;
+			if(--slot.ramp_left == 0)
+				slot.current = slot.target;
+		}
+		if(output) output[i] = slot.current;
+	}
+}
+
+void Machine::dispatch_parameter_events() {
+	ParameterQueue::Event e;
+
+	if(!parameter_events_enabled) {
+		// write directly, at the buffer boundary
+		while(parameter_queue.pop(e)) {
+			if(e.index >= 0 && e.index < (int)parameter_slots.size()) {
+				write_parameter(parameter_slots[e.index], e.value);
+				parameter_snapshot[e.index].pending.fetch_sub(1);
+			}
+		}
+		return;
+	}
+
+	int n = parameter_cycle_samples;
+	int64_t period = parameter_cycle_start - parameter_cycle_previous_start;
+
+	parameter_event_count = 0;
+	while(parameter_event_count < MAX_PARAMETER_EVENTS_PER_BUFFER && parameter_queue.pop(e)) {
+		if(e.index < 0 || e.index >= (int)parameter_slots.size()) continue;
+		parameter_snapshot[e.index].pending.fetch_sub(1);
+
+		int offset = e.offset;
+		if(offset < 0) {
+			// place the event in the buffer relative to when it arrived during the previous
+			// cycle, this gives a constant latency of one buffer instead of jitter
+			if(period > 0 && e.timestamp > parameter_cycle_previous_start)
+				offset = (int)(((e.timestamp - parameter_cycle_previous_start) * n) / period);
+			else
+				offset = 0;
+		}
+		if(offset >= n) offset = n > 0 ? n - 1 : 0;
+
+		// insertion sort on offset, keeps the order of events with equal offsets
+		int k = parameter_event_count++;
+		while(k > 0 && parameter_events[k - 1].offset > offset) {
+			parameter_events[k] = parameter_events[k - 1];
+			k--;
+		}
+		parameter_events[k].offset = offset;
+		parameter_events[k].index = e.index;
+		parameter_events[k].ramp_length = e.ramp_length;
+		parameter_events[k].value = e.value;
+
+		ParameterSlot &slot = parameter_slots[e.index];
+		if(!slot.touched && slot.ramp_left == 0)
+			slot.current = read_parameter(slot);
+		slot.touched = true;
+	}
+}
+
+void Machine::apply_parameter_events() {
+	for(unsigned int k = 0; k < parameter_slots.size(); k++) {
+		ParameterSlot &slot = parameter_slots[k];
+		if(slot.touched || slot.ramp_left > 0) {
+			run_parameter(k, slot, NULL);
+			write_parameter(slot, slot.current);
+			slot.touched = false;
+		}
+	}
+	parameter_event_count = 0;
+}
+
+// called from machine operations, to make sure queued values are visible
+void Machine::flush_parameter_events() {
+	ParameterQueue::Event e;
+	while(parameter_queue.pop(e)) {
+		if(e.index >= 0 && e.index < (int)parameter_slots.size()) {
+			ParameterSlot &slot = parameter_slots[e.index];
+			slot.ramp_left = 0;
+			write_parameter(slot, e.value);
+			parameter_snapshot[e.index].pending.fetch_sub(1);
+			publish_parameter(e.index);
+		}
+	}
+}
+
+void Machine::publish_parameter(int index) {
+	if(index < 0 || index >= (int)parameter_slots.size()) return;
+
+	ParameterSnapshot &ps = parameter_snapshot[index];
+	// if a change is still queued the snapshot already holds the newer value
+	if(ps.pending.load() == 0)
+		ps.value.store(read_parameter(parameter_slots[index]));
+}
+
+void Machine::publish_parameters() {
+	for(unsigned int k = 0; k < parameter_slots.size(); k++)
+		publish_parameter(k);
+}
+
+bool Machine::read_parameter_snapshot(int index, float &value) {
+	if(index < 0 || index >= parameter_snapshot_count.load(std::memory_order_acquire)) return false;
+
+	value = parameter_snapshot[index].value.load();
+	return true;
+}
+
+void Machine::enable_parameter_events() {
+	parameter_events_enabled = true;
+}
+
+void Machine::enable_midi_event_lists() {
+	midi_event_lists_enabled = true;
+}
+
+int Machine::get_parameter_index(void *ptr) {
+	for(unsigned int k = 0; k < parameter_slots.size(); k++)
+		if(parameter_slots[k].ptr == ptr) return k;
+	return -1;
+}
+
+int Machine::get_parameter_events(const ParameterEvent **events) {
+	*events = parameter_events;
+	return parameter_event_count;
+}
+
+const float *Machine::get_parameter_ramp(int index) {
+	if(index < 0 || index >= (int)parameter_slots.size()) return NULL;
+
+	ParameterSlot slot = parameter_slots[index];
+	if(!slot.touched && slot.ramp_left == 0) return NULL;
+
+	// only grows, so this will not allocate once we have reached the buffer size
+	if((int)parameter_ramp.size() < parameter_cycle_samples)
+		parameter_ramp.resize(parameter_cycle_samples);
+
+	run_parameter(index, slot, parameter_ramp.data());
+	return parameter_ramp.data();
 }
 
 void Machine::set_midi_controller(Controller *ctrl, int coarse, int fine) {
@@ -1470,6 +2107,8 @@ void Machine::detach_all_inputs(Machine *m) {
 				input[(*k).first] = head;
 		}
 	}
+	rebuild_premix();
+	inputs_changed();
 	recalculate_render_chain();
 }
 
@@ -1520,6 +2159,11 @@ int Machine::get_samples_per_tick_shuffle(Dimension d) {
 std::string Machine::get_controller_xml() {
 	std::ostringstream result;
 
+	// values still in the parameter queue must be saved too, the
+	// machine might not execute again before we read them (not playing,
+	// or not in the render chain)
+	flush_parameter_events();
+
 	for(auto k : internal_get_controller_names()) {
 		Controller *c =
 			internal_get_controller(k);
@@ -1623,7 +2267,10 @@ bool Machine::is_playing = false;
 bool Machine::is_recording = false;
 std::string Machine::record_fname = ""; // filename to record to
 Machine *Machine::sink = NULL;
+std::atomic<bool> Machine::offline_rendering(false);
+pid_t Machine::offline_render_thread = 0;
 Machine *Machine::top_render_chain = NULL;
+RenderChainScheduler *Machine::render_scheduler = NULL;
 std::map<Machine*, std::shared_ptr<Machine> > Machine::machine_set;
 std::set<std::weak_ptr<Machine::MachineSetListener>, std::owner_less<std::weak_ptr<Machine::MachineSetListener> > > Machine::machine_set_listeners;
 
@@ -1702,6 +2349,9 @@ void Machine::internal_register_sink(Machine *s) {
 		}
 
 		sink = s;
+		machine_operation_update_mode();
+		// a new driver, its cycles don't follow the ones of the previous one
+		PerformanceTrace::restart_cycle_timing();
 
 		Machine::unlock_machine_space();
 	}
@@ -1716,7 +2366,9 @@ void Machine::internal_unregister_sink(Machine *s) {
 	}
 
 	sink = NULL;
+	machine_operation_update_mode();
 	top_render_chain = NULL;
+	if(render_scheduler) render_scheduler->chain_changed(NULL);
 
 	Machine::unlock_machine_space();
 }
@@ -1822,7 +2474,8 @@ void Machine::calculate_next_tick_at_and_sequence_position() {
 			// only do this synchronization during the midi dimension
 			// it is anyway equal to all other dimensions
 			if(d == _MIDI) {
-				if(is_playing && __current_tick == 0) {
+				// the offline renderer reports its own progress
+				if(is_playing && __current_tick == 0 && !offline_rendering.load(std::memory_order_relaxed)) {
 					trigger_periodic_functions();
 
 				}
@@ -1862,7 +2515,6 @@ void Machine::trigger_periodic_functions() {
 // care of unlocking it before we return... however, we do not have to do it if we throw an exception..
 // in the case of an exception the caller (fill_this_sink()) will take care of unlocking..
 int Machine::internal_fill_sink(int (*fill_sink_callback)(int status, void *cbd), void *callback_data) {
-	DECLARE_TIME_MEASURE_OBJECT_STATIC(filler_sinker,"internal_fill_sink", 5000);
 	int retval = _sinkCallbackOK;
 
 #ifdef SIMPLE_JTHREAD_DEBUG
@@ -1877,11 +2529,13 @@ int Machine::internal_fill_sink(int (*fill_sink_callback)(int status, void *cbd)
 	if(!is_playing) {
 		if(was_playing) {
 			was_playing = false;
+			PerformanceTrace::restart_cycle_timing();
 			retval = fill_sink_callback(_sinkPaused, callback_data);
 		}
 	} else {
 		if(!was_playing) {
 			was_playing = true;
+			PerformanceTrace::restart_cycle_timing();
 			retval = fill_sink_callback(_sinkResumed, callback_data);
 		}
 	}
@@ -1890,9 +2544,19 @@ int Machine::internal_fill_sink(int (*fill_sink_callback)(int status, void *cbd)
 		try {
 			calculate_samples_per_tick();
 
-			START_TIME_MEASURE(filler_sinker);
+			uint64_t cycle_start = PerformanceTrace::timestamp();
 			render_chain();
-			STOP_TIME_MEASURE(filler_sinker, "chain rendered");
+			uint64_t cycle_stop = PerformanceTrace::timestamp();
+
+			if(offline_rendering.load(std::memory_order_relaxed)) {
+				// there is no deadline when rendering offline
+				PerformanceTrace::record(PERFORMANCE_TRACE_CYCLE_SOURCE, cycle_start, cycle_stop);
+			} else {
+				Resolution r;
+				int frames, frequency;
+				Signal::get_defaults(_0D, frames, r, frequency);
+				PerformanceTrace::cycle_completed(cycle_start, cycle_stop, frames, frequency);
+			}
 
 			calculate_next_tick_at_and_sequence_position();
 		} catch(jException e) {
@@ -1977,11 +2641,32 @@ Machine *Machine::internal_get_by_name(const std::string &name) {
  *
  ****************************************/
 
+// Render workers used by default, the audio thread works too so with
+// four cores we get three threads rendering and keep one for the UI and
+// the async operations. With less than four cores we render serially.
+#define DEFAULT_PARALLEL_RENDER_WORKERS_MAX 3
+
+static int default_parallel_render_workers() {
+	long cpus = sysconf(_SC_NPROCESSORS_CONF);
+	if(cpus < 4) return 0;
+	return cpus - 2 > DEFAULT_PARALLEL_RENDER_WORKERS_MAX ? DEFAULT_PARALLEL_RENDER_WORKERS_MAX : (int)cpus - 2;
+}
+
 void Machine::prepare_baseline() {
 	// start the async oeprations thread if it does not yet exist
 	if(async_ops == NULL) {
 		async_ops = AsyncOperations::start_async_operations_thread();
 	}
+
+	static bool parallel_render_configured = false;
+	if(!parallel_render_configured) {
+		parallel_render_configured = true;
+		try {
+			set_parallel_render_workers(default_parallel_render_workers());
+		} catch(RenderChainScheduler::WorkerCreationFailed &e) {
+			SATAN_ERROR("Machine::prepare_baseline() - %s Rendering serially.\n", e.what());
+		}
+	}
 }
 
 void Machine::register_periodic(__MACHINE_PERIODIC_CALLBACK_F callback_function) {
@@ -2211,8 +2896,6 @@ void Machine::stop() {
 
 		},
 		NULL, true);
-	TIME_MEASURE_PRINT_ALL_STATS();
-	TIME_MEASURE_CLEAR_ALL_STATS();
 }
 
 bool Machine::is_it_playing() {
@@ -2257,6 +2940,51 @@ void Machine::destroy_all_machines() {
 	}
 }
 
+void Machine::set_parallel_render_workers(int worker_count) {
+	if(worker_count < 0) throw ParameterOutOfSpec();
+
+	// spawn the new workers outside of the audio thread
+	RenderChainScheduler *new_scheduler = NULL;
+	if(worker_count > 0)
+		new_scheduler = new RenderChainScheduler(worker_count);
+
+	RenderChainScheduler *old_scheduler = NULL;
+	Machine::machine_operation_enqueue(
+		[new_scheduler, &old_scheduler] (void *d) {
+			old_scheduler = render_scheduler;
+			render_scheduler = new_scheduler;
+			if(render_scheduler) render_scheduler->chain_changed(top_render_chain);
+		},
+		NULL, true);
+
+	// joining the old worker threads is done here, not on the audio thread
+	if(old_scheduler) delete old_scheduler;
+}
+
+int Machine::get_parallel_render_workers() {
+	int retval = 0;
+	Machine::machine_operation_enqueue(
+		[&retval] (void *d) {
+			if(render_scheduler)
+				retval = render_scheduler->get_statistics().workers;
+		},
+		NULL, true);
+	return retval;
+}
+
+bool Machine::get_render_chain_statistics(RenderChainScheduler::Statistics &statistics) {
+	bool retval = false;
+	Machine::machine_operation_enqueue(
+		[&retval, &statistics] (void *d) {
+			if(render_scheduler) {
+				statistics = render_scheduler->get_statistics();
+				retval = true;
+			}
+		},
+		NULL, true);
+	return retval;
+}
+
 void Machine::exit_application() {
 	destroy_all_machines();
 	Machine::machine_operation_enqueue(
@@ -2383,6 +3111,15 @@ void Machine::run_async_operation(AsyncOp *op) {
 	async_ops->run_async_operation(op);
 }
 
+void Machine::run_async_operation_priority(AsyncOp *op, int priority) {
+	async_ops->run_async_operation(
+		op, priority == ASYNC_PRIORITY_BULK ? AsyncOperations::_bulk : AsyncOperations::_io);
+}
+
 void Machine::run_async_function(std::function<void()> f) {
 	async_ops->run_async_function(f);
 }
+
+void Machine::run_async_function(std::function<void()> f, AsyncOperations::Priority priority) {
+	async_ops->run_async_function(f, priority);
+}
@@ -34,7 +34,7 @@
 #define __MACHINE
 
 #define MACHINE_PROJECT_INTERFACE_LEVEL 8
-#define SIGNAL_PROJECT_INTERFACE_LEVEL 8
+#define SIGNAL_PROJECT_INTERFACE_LEVEL 9
 
 #include "signal.hh"
 
@@ -47,6 +47,7 @@
 #include <vector>
 #include <set>
 #include <memory>
+#include <atomic>
 #include <jngldrum/jthread.hh>
 #include <iostream>
 #include <functional>
@@ -54,7 +55,12 @@
 #include "readerwriterqueue/readerwriterqueue.h"
 #include "async_operations.hh"
 #include "satan_project_entry.hh"
-#include "time_measure.hh"
+#include "performance_trace.hh"
+#include "render_chain_scheduler.hh"
+#include "parameter_queue.hh"
+#include "machine_operation_queue.hh"
+#include "seqlock.hh"
+#include "static_signal_stream.hh"
 
 class Machine;
 
@@ -63,6 +69,10 @@ class Machine;
 #define MACHINE_LINE_BITMASK 0xffffff0
 #define MACHINE_TICK_BITMASK 0x000000f
 #define MAX_STATIC_SIGNALS 256
+#define MAX_PARAMETER_EVENTS_PER_BUFFER 64
+#define MAX_PARAMETERS_PER_MACHINE 128
+#define MAX_MACHINE_OPERATIONS_PER_BUFFER 256
+#define MACHINE_NAME_SNAPSHOT_SIZE 128
 
 int quantize_tick(int start_tick);
 
@@ -114,6 +124,7 @@ private:
 	friend class ProjectEntry;
 	friend class Controller;
 	friend class MachineSequencer;
+	friend class RenderChainScheduler;
 
 public:
 
@@ -174,6 +185,12 @@ public:
 		bool has_midi_ctrl;
 		int coarse_controller, fine_controller;
 
+		Machine *owner; // NULL if not created by Machine::create_controller()
+		int parameter_index; // index in the owner's parameter table
+
+		// push a change to the owner's parameter queue, returns false if not possible
+		bool enqueue_value(float val, int sample_offset, int ramp_length);
+
 		Controller(
 			Type tp,
 			const std::string &name, // internal name
@@ -229,6 +246,12 @@ public:
 		void set_value(bool &val);
 		void set_value(const std::string &val);
 
+		// Schedule a change at sample_offset inside the next rendered buffer,
+		// optionally as a linear ramp over ramp_length samples (float controllers only.)
+		// A negative sample_offset places the change relative to when it was
+		// scheduled, like set_value(). Does not block and does not allocate memory.
+		void schedule_value(float val, int sample_offset, int ramp_length = 0);
+
 		// return true if a controller has a MIDI equivalent, if so
 		// the coarse_controller integer is set
 		// and if a fine controller exists, the fine_controller int is set
@@ -301,12 +324,25 @@ protected:
 
 		std::string file_path;
 
+		// if set, only the resident part is in buffer - samples is the number of resident frames
+		StaticSignalStream *stream;
+
+		// if set, buffer points into a memory mapped storage file
+		void *mapping;
+		size_t mapping_size;
+
 		StaticSignal(
 			Dimension d, Resolution r,
 			int channels, int samples, int frequency,
 			std::string file_path,
 			std::string name,
 			void *data);
+		StaticSignal(
+			Dimension d,
+			int frequency,
+			std::string file_path,
+			std::string name,
+			StaticSignalStream *stream);
 
 		~StaticSignal();
 
@@ -320,6 +356,11 @@ protected:
 			int channels, int samples, int frequency,
 			std::string file_path,
 			std::string name);
+		static void load_0D_signal_file(
+			int index,
+			Dimension d,
+			std::string file_path,
+			std::string name);
 
 		/* loader friend */
 		friend class StaticSignalLoader;
@@ -332,6 +373,14 @@ protected:
 			std::string file_path,
 			std::string name,
 			void *data);
+		static void replace_signal(
+			int index,
+			Dimension d,
+			int frequency,
+			std::string file_path,
+			std::string name,
+			StaticSignalStream *stream);
+		static void install_signal(int index, StaticSignal *s);
 
 		std::string get_file_path();
 
@@ -341,6 +390,14 @@ protected:
 	public:
 		static StaticSignal *get_signal(int index);
 		static std::map<int, StaticSignal *> get_all_signals();
+
+		// length of the complete signal, for a streamed signal this is larger than get_samples()
+		int get_total_samples();
+
+		// Realtime safe. Returns the number of contiguous frames available at frame, and points
+		// *data to the first one. If a streamed part is not in RAM yet *data is set to NULL
+		// and the negated number of missing frames is returned. 0 means out of range.
+		int read_samples(int frame, void **data);
 	};
 
 	class Signal : public SignalBase {
@@ -357,6 +414,9 @@ protected:
 
 		Machine *originator;
 
+		// legacy MIDI signals always use the _PTR resolution
+		bool legacy_midi;
+
 		//bool alloc_2d_buffer(Signal *s);
 
 		// "globals"
@@ -382,7 +442,7 @@ protected:
 		static void internal_deregister_signal(Signal *s);
 
 		/// 0 dimension ("sound")
-		Signal(int c, Machine *originator, const std::string &name, Dimension d = _0D);
+		Signal(int c, Machine *originator, const std::string &name, Dimension d = _0D, bool legacy_midi = false);
 
 		/// destructor
 		~Signal();
@@ -393,6 +453,8 @@ protected:
 			friend class Machine;
 
 			static Signal *create_signal(int c, Machine *originator, const std::string &name, Dimension d = _0D);
+			// a MIDI signal in the old pointer per frame format, see Machine::premix_midi()
+			static Signal *create_legacy_midi_signal(Machine *originator, const std::string &name);
 			static void destroy_signal(Signal *signal);
 		};
 
@@ -452,6 +514,13 @@ public:
 			std::string file_path,
 			std::string name,
 			void *data);
+		void replace_signal(
+			int index,
+			Dimension d,
+			int frequency,
+			std::string file_path,
+			std::string name,
+			StaticSignalStream *stream);
 		void preview_signal(
 			Dimension d, Resolution r,
 			int channels, int samples, int frequency,
@@ -468,10 +537,6 @@ public:
 	};
 
 private:
-	DECLARE_TIME_MEASURE_OBJECT(tmes_A);
-	DECLARE_TIME_MEASURE_OBJECT(tmes_B);
-	DECLARE_TIME_MEASURE_OBJECT(tmes_C);
-
 	// just so no one uses it...
 	Machine();
 
@@ -490,9 +555,111 @@ private:
 	// if visualized - the graphical x and y position
 	float x_position, y_position;
 
+	// read-mostly state published for the UI threads, so that
+	// get_name() and get_x/y_position() never wait for the audio thread
+	class NameSnapshot {
+	public:
+		char text[MACHINE_NAME_SNAPSHOT_SIZE];
+		bool complete; // false if the name did not fit
+	};
+	class PositionSnapshot {
+	public:
+		float x, y;
+	};
+	SeqLock<NameSnapshot> name_snapshot;
+	SeqLock<PositionSnapshot> position_snapshot;
+	void publish_name();
+
+	// PerformanceTrace source for execute(), -1 if the table was full
+	int trace_source = -1;
+
+	// flattened premix data - rebuilt by rebuild_premix() when a connection
+	// changes, so execute() does not have to walk the maps and the signal lists
+	class PremixSource {
+	public:
+		Signal *source;
+		int channels;
+		int midi_cursor; // used by premix_midi() when merging the sources
+	};
+	// MIDI events that did not fit in a legacy _PTR buffer, they are
+	// delivered in the next one. Double buffered since the legacy signal
+	// points into the list carried over from the previous buffer.
+	class MidiCarry {
+	public:
+		MidiEventList list[2];
+		int current;
+	};
+	class PremixDestination {
+	public:
+		Signal *destination;
+		Signal *head; // first signal attached to the input, NULL if none
+		int first_source, source_count; // range in premix_sources
+		MidiCarry *midi_carry; // for _PTR destinations
+	};
+	std::vector<PremixDestination> premix_destinations;
+	std::vector<PremixSource> premix_sources;
+	std::map<std::string, std::unique_ptr<MidiCarry> > midi_carry; // indexed by input name
+
+	// if false the MIDI inputs are converted into the old pointer
+	// per frame format, in a legacy signal in premixed_input
+	bool midi_event_lists_enabled;
+
+	// parameter automation - controller changes are queued in parameter_queue
+	// and dispatched at the start of execute(). Machines that have called
+	// enable_parameter_events() get the changes with sample offsets, the
+	// rest gets them written directly to the controller pointer.
+	class ParameterSlot {
+	public:
+		void *ptr;
+		Controller::Type type;
+		bool float_is_FTYPE;
+
+		// ramp state
+		bool touched; // events for this slot in the current buffer
+		float current, step, target;
+		int ramp_left;
+	};
+	std::vector<ParameterSlot> parameter_slots; // indexed by controller index
+	ParameterQueue parameter_queue;
+	ParameterEvent parameter_events[MAX_PARAMETER_EVENTS_PER_BUFFER]; // sorted by offset
+	int parameter_event_count;
+	bool parameter_events_enabled;
+	std::vector<float> parameter_ramp;
+
+	// controller values published for Controller::get_value(), the audio
+	// thread only updates a value when no change for it is pending in the queue.
+	// The array never moves, so other threads can read entries below
+	// parameter_snapshot_count while new controllers are registered.
+	class ParameterSnapshot {
+	public:
+		std::atomic<float> value;
+		std::atomic<int> pending;
+	};
+	ParameterSnapshot parameter_snapshot[MAX_PARAMETERS_PER_MACHINE]; // indexed by controller index
+	std::atomic<int> parameter_snapshot_count;
+
+	// start time, in nanoseconds, of the current and the previous render cycle
+	static int64_t parameter_cycle_start, parameter_cycle_previous_start;
+	static int parameter_cycle_samples;
+
+	float read_parameter(const ParameterSlot &slot);
+	void write_parameter(const ParameterSlot &slot, float value);
+	void run_parameter(int index, ParameterSlot &slot, float *output);
+	void dispatch_parameter_events();
+	void apply_parameter_events();
+	void flush_parameter_events();
+	void publish_parameter(int index);
+	void publish_parameters();
+	bool read_parameter_snapshot(int index, float &value);
+	static int64_t get_parameter_clock();
+
 	void destroy_tightly_attached_machines();
 	void execute();
+	void rebuild_premix();
+	void premix(const PremixDestination &pd);
 	void premix(Signal *result, Signal *head);
+	void premix_midi(const PremixDestination &pd);
+	static int midi_source_peek(Signal *source, int &cursor, MidiEvent **mev);
 	bool find_machine_in_graph(Machine *machine); // this function is used to detect loops
 	Signal *get_output(const std::string &name);
 	std::string get_controller_xml(); // this function is used to export control values to xml
@@ -600,11 +767,42 @@ public:
 	 ******************************************************************/
 public:
 	// operations called ONLY by NON audio playback threads
-	static void machine_operation_enqueue(std::function<void(void *data)> operation,
-					      void *operation_data, bool do_synch);
-	static void machine_operation_enqueue(std::function<void()> operation, bool do_synch = true);
+	// (if called from inside an operation they are executed directly)
+	template <class F>
+	static void machine_operation_enqueue(F &&operation, void *operation_data, bool do_synch) {
+		MachineOperation mo;
+		mo.set_callback(std::forward<F>(operation));
+		mo.callback_data = operation_data;
+		machine_operation_submit(mo, do_synch);
+	}
+	template <class F>
+	static void machine_operation_enqueue(F &&operation, bool do_synch = true) {
+		MachineOperation mo;
+		mo.set_callback(VoidMachineOperation<typename std::decay<F>::type>(std::forward<F>(operation)));
+		machine_operation_submit(mo, do_synch);
+	}
+
+	// execute all operations during the same visit of the audio playback
+	// thread, and wait once. If an operation throws a jException the rest
+	// are still executed, then the first jException is rethrown.
+	static void machine_operation_enqueue_batch(const std::vector<std::function<void()> > &operations);
 
 private:
+	template <class F>
+	class VoidMachineOperation {
+	private:
+		F f;
+	public:
+		template <class G>
+		VoidMachineOperation(G &&g) : f(std::forward<G>(g)) {}
+		void operator()(void *) { f(); }
+	};
+
+	static void machine_operation_submit(MachineOperation &mo, bool do_synch);
+	static void machine_operation_execute(MachineOperation &mo);
+	// called with the machine space locked when sink or low_latency_mode changes
+	static void machine_operation_update_mode();
+
 	// operation ONLY called by audio playback thread
 	static void machine_operation_dequeue();
 
@@ -632,6 +830,17 @@ protected:
 	// all data in your derived class from the XML block
 	void setup_using_xml(const KXMLDoc &mxml);
 
+	// add a controller pointer to the parameter table, returns the index
+	int register_parameter(void *ptr, Controller::Type tp, bool float_is_FTYPE);
+	// sample accurate parameter events, for use in fill_buffers()
+	void enable_parameter_events();
+	int get_parameter_index(void *ptr); // returns -1 if ptr is not a controller
+	int get_parameter_events(const ParameterEvent **events);
+	// per sample values for the current buffer, NULL if the value does not change
+	const float *get_parameter_ramp(int index);
+	// read MIDI inputs in the _MIDI_EVENTS format - call before any input is attached
+	void enable_midi_event_lists();
+
 	// create a new controller handle
 	Controller *create_controller(
 		Controller::Type tp,
@@ -684,6 +893,9 @@ protected:
 	// reset a machine to a defined state
 	virtual void reset() = 0;
 
+	// called after the set of signals attached to the inputs has changed
+	virtual void inputs_changed() {}
+
 	/// Returns a set of controller groups
 	virtual std::vector<std::string> internal_get_controller_groups() = 0;
 	/// Returns the set of all controller names
@@ -718,8 +930,10 @@ protected:
 					 int frequency);
 
 	// Async Operations
-	static void run_async_operation(AsyncOp *op);
-	static void run_async_function(std::function<void()> f);
+	static void run_async_operation(AsyncOp *op); // ordered
+	static void run_async_operation_priority(AsyncOp *op, int priority); // unordered
+	static void run_async_function(std::function<void()> f); // ordered
+	static void run_async_function(std::function<void()> f, AsyncOperations::Priority priority); // unordered
 
 private:
 	static void lock_machine_space();
@@ -748,7 +962,16 @@ private:
 	static std::string record_fname; // filename to record to
 
 	static Machine *top_render_chain; // whenever a machine is connected to another the chain is recalculated
+	static RenderChainScheduler *render_scheduler; // if not NULL the render chain is executed in parallel
 	static Machine *sink; // There can only be one...
+
+	// while rendering offline the render thread owns the machine graph, fill_this_sink()
+	// only plays silence for other threads and the sink machine acts as a null sink
+	class OfflineRenderer;
+	friend class OfflineRenderer;
+	static std::atomic<bool> offline_rendering;
+	static pid_t offline_render_thread;
+	static OfflineRenderer *offline_renderer;
 	static std::map<Machine *, std::shared_ptr<Machine> >machine_set; // global array of all machines
 
 	static std::set<std::weak_ptr<MachineSetListener>, std::owner_less<std::weak_ptr<MachineSetListener> > > machine_set_listeners;
@@ -889,6 +1112,47 @@ public:
 
 	/// This will end up as a call to exit()
 	static void exit_application();
+
+	/// Use worker_count additional threads to render the machine graph, 0 means render serially
+	static void set_parallel_render_workers(int worker_count);
+	static int get_parallel_render_workers();
+	/// Get timing for the last rendered buffer, returns false if not rendering in parallel
+	static bool get_render_chain_statistics(RenderChainScheduler::Statistics &statistics);
+
+	/// Offline rendering - renders the song to file as fast as possible, on a separate thread.
+	/// The audio output is silent while rendering.
+	class OfflineRenderSettings {
+	public:
+		std::string file_name; // base name, the extensions are added
+		std::string title, artist, genre; // Vorbis comments
+		int formats; // RecordingSink::Format flags
+		int buffer_size; // frames per render cycle
+		int start_line; // ignored if looping is on
+		int loops; // if looping is on the loop is rendered this many times
+		float tail_seconds; // rendered after the last line, for releases and reverb tails
+		int render_workers; // parallel render workers while rendering, -1 keeps the current setting
+
+		OfflineRenderSettings();
+	};
+	class OfflineRenderProgress {
+	public:
+		int lines_rendered, lines_total;
+		int64_t frames_rendered;
+		double seconds_rendered, seconds_elapsed;
+		bool finished; // set in the last callback
+		bool cancelled;
+		std::string error; // not empty if the render failed
+
+		OfflineRenderProgress();
+	};
+	// called from the render thread after each buffer, and once when finished - return false to cancel
+	typedef std::function<bool(const OfflineRenderProgress &progress)> OfflineRenderCallback;
+
+	/// Throws jException if there is no sink, if playing, or if already rendering.
+	static void start_offline_render(const OfflineRenderSettings &settings, OfflineRenderCallback callback);
+	/// Blocks until the offline render is done, returns the final progress.
+	static OfflineRenderProgress wait_for_offline_render();
+	static bool is_rendering_offline();
 };
 
 #endif
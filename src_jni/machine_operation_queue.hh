@@ -0,0 +1,205 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#ifndef __MACHINE_OPERATION_QUEUE
+#define __MACHINE_OPERATION_QUEUE
+
+#include <atomic>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+// must be a power of two
+#define MACHINE_OPERATION_QUEUE_SIZE 1024
+
+// callbacks with captures up to this size are stored inside the operation
+#define MACHINE_OPERATION_INLINE_SIZE 48
+
+class MachineOperationSynchObject;
+
+/*
+ * A callback to run on the audio playback thread. Small callables are
+ * stored inside the object, so enqueueing a typical lambda does not
+ * allocate any memory. Larger ones fall back to the heap.
+ */
+class MachineOperation {
+public:
+	void *callback_data;
+	MachineOperationSynchObject *synch_object;
+
+	MachineOperation() : callback_data(NULL), synch_object(NULL), invoke(NULL), manage(NULL) {}
+	~MachineOperation() { reset(); }
+
+	MachineOperation(const MachineOperation &) = delete;
+	MachineOperation &operator=(const MachineOperation &) = delete;
+
+	// F must be callable as f(void *callback_data)
+	template <class F>
+	void set_callback(F &&f) {
+		typedef typename std::decay<F>::type Fn;
+
+		reset();
+		if(sizeof(Fn) <= sizeof(storage) &&
+		   std::alignment_of<Fn>::value <= std::alignment_of<Storage>::value) {
+			new (&storage) Fn(std::forward<F>(f));
+			invoke = &invoke_inline<Fn>;
+			manage = &manage_inline<Fn>;
+		} else {
+			*((Fn **)&storage) = new Fn(std::forward<F>(f));
+			invoke = &invoke_heap<Fn>;
+			manage = &manage_heap<Fn>;
+		}
+	}
+
+	void operator()() {
+		invoke(&storage, callback_data);
+	}
+
+	// move the content of other into this, other is left empty
+	void take(MachineOperation &other) {
+		reset();
+		if(other.manage) other.manage(_relocate, &storage, &other.storage);
+		invoke = other.invoke;
+		manage = other.manage;
+		callback_data = other.callback_data;
+		synch_object = other.synch_object;
+
+		other.invoke = NULL;
+		other.manage = NULL;
+		other.callback_data = NULL;
+		other.synch_object = NULL;
+	}
+
+	void reset() {
+		if(manage) manage(_destroy, &storage, NULL);
+		invoke = NULL;
+		manage = NULL;
+	}
+
+private:
+	enum ManageOperation {
+		_relocate, _destroy
+	};
+
+	typedef typename std::aligned_storage<MACHINE_OPERATION_INLINE_SIZE>::type Storage;
+	Storage storage;
+
+	void (*invoke)(void *storage, void *data);
+	void (*manage)(ManageOperation op, void *storage, void *source);
+
+	template <class Fn>
+	static void invoke_inline(void *s, void *data) {
+		(*((Fn *)s))(data);
+	}
+
+	template <class Fn>
+	static void manage_inline(ManageOperation op, void *s, void *source) {
+		if(op == _relocate) {
+			new (s) Fn(std::move(*((Fn *)source)));
+			((Fn *)source)->~Fn();
+		} else {
+			((Fn *)s)->~Fn();
+		}
+	}
+
+	template <class Fn>
+	static void invoke_heap(void *s, void *data) {
+		(**((Fn **)s))(data);
+	}
+
+	template <class Fn>
+	static void manage_heap(ManageOperation op, void *s, void *source) {
+		if(op == _relocate)
+			*((Fn **)s) = *((Fn **)source);
+		else
+			delete *((Fn **)s);
+	}
+};
+
+/*
+ * Fixed capacity, lock-free, multi producer multi consumer queue
+ * of machine operations. No memory is allocated after construction.
+ *
+ * (bounded queue with per cell sequence numbers, as described by D. Vyukov)
+ */
+class MachineOperationQueue {
+public:
+	MachineOperationQueue() : enqueue_position(0), dequeue_position(0) {
+		for(unsigned int k = 0; k < MACHINE_OPERATION_QUEUE_SIZE; k++)
+			cells[k].sequence.store(k, std::memory_order_relaxed);
+	}
+
+	// returns false if the queue is full, otherwise mo is left empty
+	bool push(MachineOperation &mo) {
+		Cell *cell;
+		unsigned int pos = enqueue_position.load(std::memory_order_relaxed);
+		while(1) {
+			cell = &cells[pos & (MACHINE_OPERATION_QUEUE_SIZE - 1)];
+			unsigned int seq = cell->sequence.load(std::memory_order_acquire);
+			int diff = (int)seq - (int)pos;
+			if(diff == 0) {
+				if(enqueue_position.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if(diff < 0) {
+				return false;
+			} else {
+				pos = enqueue_position.load(std::memory_order_relaxed);
+			}
+		}
+		cell->operation.take(mo);
+		cell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// returns false if the queue is empty
+	bool pop(MachineOperation &mo) {
+		Cell *cell;
+		unsigned int pos = dequeue_position.load(std::memory_order_relaxed);
+		while(1) {
+			cell = &cells[pos & (MACHINE_OPERATION_QUEUE_SIZE - 1)];
+			unsigned int seq = cell->sequence.load(std::memory_order_acquire);
+			int diff = (int)seq - (int)(pos + 1);
+			if(diff == 0) {
+				if(dequeue_position.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if(diff < 0) {
+				return false;
+			} else {
+				pos = dequeue_position.load(std::memory_order_relaxed);
+			}
+		}
+		mo.take(cell->operation);
+		cell->sequence.store(pos + MACHINE_OPERATION_QUEUE_SIZE, std::memory_order_release);
+		return true;
+	}
+
+private:
+	class Cell {
+	public:
+		std::atomic<unsigned int> sequence;
+		MachineOperation operation;
+	};
+
+	Cell cells[MACHINE_OPERATION_QUEUE_SIZE];
+	std::atomic<unsigned int> enqueue_position;
+	std::atomic<unsigned int> dequeue_position;
+};
+
+#endif
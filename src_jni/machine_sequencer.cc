@@ -533,6 +533,23 @@ int MachineSequencer::internal_get_loop_id_at(int position) {
 	return loop_sequence[position];
 }
 
+// the last loop placed in the sequence decides where it ends,
+// it replaces the loop playing before it
+int MachineSequencer::internal_get_sequence_end() {
+	for(int s_p = loop_sequence_length - 1; s_p >= 0; s_p--) {
+		if(loop_sequence[s_p] == NOTE_NOT_SET) continue;
+
+		int last_off = 0; // in ticks
+		const NoteEntry *n = loop_store[loop_sequence[s_p]]->notes_get();
+		for(; n != NULL; n = n->next) {
+			if(n->on_at + n->length + 1 > last_off)
+				last_off = n->on_at + n->length + 1;
+		}
+		return s_p + (last_off + MACHINE_TICKS_PER_LINE - 1) / MACHINE_TICKS_PER_LINE;
+	}
+	return 0;
+}
+
 void MachineSequencer::internal_get_loop_ids_at(int *position_vector, int length) {
 	int k;
 	for(k = 0; k < length; k++) {
@@ -710,12 +727,18 @@ void MachineSequencer::fill_buffers() {
 	Signal *out_sig = output[MACHINE_SEQUENCER_MIDI_OUTPUT_NAME];
 
 	int output_limit = out_sig->get_samples();
-	void **output_buffer = (void **)out_sig->get_buffer();
 
-	memset(output_buffer,
-	       0,
-	       sizeof(void *) * output_limit
-		);
+	if(out_sig->get_resolution() == _MIDI_EVENTS) {
+		_meb.use_event_list((MidiEventList *)out_sig->get_buffer(), output_limit);
+	} else {
+		void **output_buffer = (void **)out_sig->get_buffer();
+
+		memset(output_buffer,
+		       0,
+		       sizeof(void *) * output_limit
+			);
+		_meb.use_buffer(output_buffer, output_limit);
+	}
 
 	// synch to click track
 	int sequence_position = get_next_sequence_position();
@@ -727,8 +750,6 @@ void MachineSequencer::fill_buffers() {
 	int samples_per_tick_shuffle = get_samples_per_tick_shuffle(_MIDI);
 	int skip_length = get_next_tick_at(_MIDI);
 
-	_meb.use_buffer(output_buffer, output_limit);
-
 	bool no_sound = is_playing ? mute : true;
 
 	while(_meb.skip(skip_length)) {
@@ -1655,6 +1676,15 @@ void MachineSequencer::set_sequence_length(int newv) {
  *
  *************************************/
 
+int MachineSequencer::internal_get_song_end() {
+	int song_end = 0;
+	for(auto k : machine2sequencer) {
+		int e = k.second->internal_get_sequence_end();
+		if(e > song_end) song_end = e;
+	}
+	return song_end;
+}
+
 void MachineSequencer::presetup_from_xml(int project_interface_level, const KXMLDoc &machine_xml) {
 	typedef struct {
 		const KXMLDoc &mxml;
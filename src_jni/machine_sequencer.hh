@@ -283,6 +283,7 @@ private:
 	void internal_get_loop_ids_at(int *position_vector, int length);
 	void internal_set_loop_id_at(int position, int loop_id);
 	int internal_add_new_loop();
+	int internal_get_sequence_end();
 	void get_loops_xml(std::ostringstream &stream);
 	void get_loop_sequence_xml(std::ostringstream &stream);
 
@@ -371,6 +372,10 @@ public:
 	/// This will export the entire sequence to a MIDI, type 2, file
 	static void export2MIDI(bool just_loops, const std::string &output_path);
 
+	/// The line after the last note off in the whole song.
+	/// Must be called from the audio thread, or with the machine space locked.
+	static int internal_get_song_end();
+
 };
 
 #endif
@@ -26,18 +26,24 @@
 
 /*************************************
  *
- * Global free chain of midi events
+ * Free chain of midi events
  *
  *************************************/
 
 #define DEFAULT_MAX_FREE_CHAIN 256
-MidiEventChain* MidiEventBuilder::MidiEventChainControler::next_free_midi_event = NULL;
-MidiEventChain* MidiEventBuilder::MidiEventChainControler::separation_zone = NULL;
 
 #define container_of(ptr, type, member) ({				\
 			const typeof( ((type *)0)->member ) *__mptr = (ptr); \
 			(type *)( (char *)__mptr - offsetof(type,member) );})
 
+MidiEventBuilder::MidiEventChainControler::MidiEventChainControler()
+	: separation_zone(NULL), next_free_midi_event(NULL) {}
+
+MidiEventBuilder::MidiEventChainControler::~MidiEventChainControler() {
+	for(auto data : allocated_blocks)
+		free(data);
+}
+
 void MidiEventBuilder::MidiEventChainControler::init_free_midi_event_chain() {
 	MidiEventChain *data, *next = NULL;
 
@@ -46,6 +52,7 @@ void MidiEventBuilder::MidiEventChainControler::init_free_midi_event_chain() {
 	if(data == NULL) {
 		throw std::bad_alloc();
 	}
+	allocated_blocks.push_back(data);
 
 	memset(data, 0, sizeof(MidiEventChain) * DEFAULT_MAX_FREE_CHAIN);
 	separation_zone = &data[DEFAULT_MAX_FREE_CHAIN];
@@ -153,11 +160,26 @@ void MidiEventBuilder::MidiEventChainControler::join_chains(MidiEventChain **des
  *
  *************************************/
 
-MidiEventBuilder::MidiEventBuilder() : remaining_midi_chain(NULL), freeable_midi_chain(NULL) {}
+MidiEventBuilder::MidiEventBuilder()
+	: buffer(NULL), event_list(NULL), buffer_size(0), buffer_position(0), buffer_p_last_skip(0)
+	, remaining_midi_chain(NULL), freeable_midi_chain(NULL) {}
+
+// the list gets a copy, so the event goes straight back to the free chain
+bool MidiEventBuilder::append_to_list(MidiEvent *mev) {
+	if(!midi_event_list_append(event_list, buffer_position, mev->length, mev->data))
+		return false;
+
+	free_chain.push_next_free_midi(mev);
+	return true;
+}
 
 void MidiEventBuilder::chain_event(MidiEvent *mev) {
 	if(buffer_position >= buffer_size) {
 		MidiEventChainControler::chain_to_tail(&(remaining_midi_chain), mev);
+	} else if(event_list) {
+		// events in the list share the offset, no need to step buffer_position
+		if(!append_to_list(mev))
+			MidiEventChainControler::chain_to_tail(&(remaining_midi_chain), mev);
 	} else {
 		buffer[buffer_position++] = mev;
 		MidiEventChainControler::chain_to_tail(&(freeable_midi_chain), mev);
@@ -167,11 +189,20 @@ void MidiEventBuilder::chain_event(MidiEvent *mev) {
 void MidiEventBuilder::process_freeable_chain() {
 	while(freeable_midi_chain != NULL) {
 		MidiEvent *mev = MidiEventChainControler::get_chain_head(&freeable_midi_chain);
-		MidiEventChainControler::push_next_free_midi(mev);
+		free_chain.push_next_free_midi(mev);
 	}
 }
 
 void MidiEventBuilder::process_remaining_chain() {
+	if(event_list) {
+		while(remaining_midi_chain != NULL &&
+		      event_list->count < event_list->capacity) {
+			MidiEvent *mev = MidiEventChainControler::get_chain_head(&remaining_midi_chain);
+			(void) append_to_list(mev);
+		}
+		return;
+	}
+
 	while(buffer_position < buffer_size && remaining_midi_chain != NULL) {
 		MidiEvent *mev = MidiEventChainControler::get_chain_head(&remaining_midi_chain);
 
@@ -182,6 +213,18 @@ void MidiEventBuilder::process_remaining_chain() {
 
 void MidiEventBuilder::use_buffer(void **_buffer, int _buffer_size) {
 	buffer = _buffer;
+	event_list = NULL;
+	buffer_size = _buffer_size;
+	buffer_position = 0;
+	buffer_p_last_skip = 0;
+
+	process_remaining_chain();
+}
+
+void MidiEventBuilder::use_event_list(MidiEventList *_list, int _buffer_size) {
+	buffer = NULL;
+	event_list = _list;
+	event_list->count = 0;
 	buffer_size = _buffer_size;
 	buffer_position = 0;
 	buffer_p_last_skip = 0;
@@ -193,6 +236,7 @@ void MidiEventBuilder::finish_current_buffer() {
 	buffer_size = 0;
 	buffer_position = 1;
 	buffer = 0;
+	event_list = NULL;
 	process_freeable_chain();
 }
 
@@ -231,7 +275,7 @@ void MidiEventBuilder::queue_midi_data(size_t len, const char *data) {
 }
 
 void MidiEventBuilder::queue_note_on(int note, int velocity, int channel) {
-	MidiEvent *mev = MidiEventChainControler::pop_next_free_midi(3);
+	MidiEvent *mev = free_chain.pop_next_free_midi(3);
 
 	SET_MIDI_DATA_3(
 		mev,
@@ -243,7 +287,7 @@ void MidiEventBuilder::queue_note_on(int note, int velocity, int channel) {
 }
 
 void MidiEventBuilder::queue_note_off(int note, int velocity, int channel) {
-	MidiEvent *mev = MidiEventChainControler::pop_next_free_midi(3);
+	MidiEvent *mev = free_chain.pop_next_free_midi(3);
 
 	SET_MIDI_DATA_3(
 		mev,
@@ -255,7 +299,7 @@ void MidiEventBuilder::queue_note_off(int note, int velocity, int channel) {
 }
 
 void MidiEventBuilder::queue_controller(int controller, int value, int channel) {
-	MidiEvent *mev = MidiEventChainControler::pop_next_free_midi(3);
+	MidiEvent *mev = free_chain.pop_next_free_midi(3);
 
 	SATAN_DEBUG("queue_controller(%d, %d, %d)\n", controller, value, channel);
 
@@ -269,7 +313,7 @@ void MidiEventBuilder::queue_controller(int controller, int value, int channel)
 }
 
 void MidiEventBuilder::queue_pitch_bend(int value_lsb, int value_msb, int channel) {
-	MidiEvent *mev = MidiEventChainControler::pop_next_free_midi(3);
+	MidiEvent *mev = free_chain.pop_next_free_midi(3);
 
 	SET_MIDI_DATA_3(
 		mev,
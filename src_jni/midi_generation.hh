@@ -21,6 +21,7 @@
 #define MIDI_EVENT_BUILDER_HH
 
 #include <map>
+#include <vector>
 #include <functional>
 
 #include "dynlib/dynlib.h"
@@ -40,22 +41,30 @@ typedef struct _MidiEventChain {
 
 class MidiEventBuilder {
 private:
+	/// each builder has its own free chain, since machines
+	/// may be executed in parallel by the RenderChainScheduler
 	class MidiEventChainControler {
 	private:
-		static MidiEventChain *separation_zone;
-		static MidiEventChain *next_free_midi_event;
+		MidiEventChain *separation_zone;
+		MidiEventChain *next_free_midi_event;
+		std::vector<MidiEventChain *> allocated_blocks;
 
-		static void init_free_midi_event_chain();
+		void init_free_midi_event_chain();
 	public:
-		static void check_separation_zone();
+		MidiEventChainControler();
+		~MidiEventChainControler();
+		MidiEventChainControler(const MidiEventChainControler &) = delete;
+		MidiEventChainControler &operator=(const MidiEventChainControler &) = delete;
+
+		void check_separation_zone();
 
 		/// please note - the MidiEvent pointers here are really a hack
 		/// and really point to MidiEventChain objects.
 		///
 		/// Do not atempt to push a MidiEvent that was NOT retrieved using pop
 		/// in this class. It will epicly FAIL.
-		static MidiEvent *pop_next_free_midi(size_t size);
-		static void push_next_free_midi(MidiEvent *_element);
+		MidiEvent *pop_next_free_midi(size_t size);
+		void push_next_free_midi(MidiEvent *_element);
 
 		/// external stacks of events allocated from the main stack
 		/// same warning here - do not play around with MidiEvent pointers
@@ -65,7 +74,11 @@ private:
 		static void join_chains(MidiEventChain **destination, MidiEventChain **source);
 	};
 
+	MidiEventChainControler free_chain;
+
+	// either buffer (one pointer per frame) or event_list is used
 	void **buffer;
+	MidiEventList *event_list;
 	int buffer_size;
 	int buffer_position, buffer_p_last_skip;
 
@@ -78,6 +91,7 @@ private:
 	MidiEventChain *freeable_midi_chain;
 
 	void chain_event(MidiEvent *mev);
+	bool append_to_list(MidiEvent *mev);
 	void process_freeable_chain();
 	void process_remaining_chain();
 
@@ -86,6 +100,8 @@ public:
 	MidiEventBuilder();
 
 	void use_buffer(void **buffer, int buffer_size);
+	// fill a _MIDI_EVENTS signal instead, the events are copied into the list
+	void use_event_list(MidiEventList *list, int buffer_size);
 	void finish_current_buffer();
 	bool skip(int skip_length); // return true as long as buffer is not full.
 
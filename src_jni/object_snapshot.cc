@@ -0,0 +1,165 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#include <zlib.h>
+#include <chrono>
+#include <random>
+
+#include <jngldrum/jexception.hh>
+
+#include "object_snapshot.hh"
+#include "satan_error.hh"
+
+//#define __DO_SATAN_DEBUG
+#include "satan_debug.hh"
+
+// deleted objects remembered for deltas
+#define OBJECT_SNAPSHOT_MAX_DELETED 1024
+
+// refuse to decompress anything larger than this
+#define OBJECT_SNAPSHOT_MAX_RAW_SIZE (64 * 1024 * 1024)
+
+static inline void put_varint(std::vector<uint8_t> &out, uint64_t v) {
+	while(v >= 0x80) {
+		out.push_back((uint8_t)(v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	out.push_back((uint8_t)v);
+}
+
+static inline bool get_varint(const uint8_t *&p, const uint8_t *end, uint64_t &v) {
+	v = 0;
+	for(int shift = 0; shift < 64; shift += 7) {
+		if(p >= end) return false;
+		uint8_t b = *p++;
+		v |= ((uint64_t)(b & 0x7f)) << shift;
+		if(!(b & 0x80)) return true;
+	}
+	return false;
+}
+
+ObjectSnapshot::ObjectSnapshot(Serializer _serializer) : serializer(_serializer) {
+	std::random_device rd;
+	epoch = ((uint64_t)rd() << 32) ^ (uint64_t)rd() ^
+		(uint64_t)std::chrono::system_clock::now().time_since_epoch().count();
+	if(epoch == 0) epoch = 1; // zero means "no snapshot" to the clients
+}
+
+void ObjectSnapshot::object_changed(int32_t objid) {
+	auto &state = objects[objid];
+	state.revision = ++revision;
+	state.serialized = false;
+}
+
+void ObjectSnapshot::object_deleted(int32_t objid) {
+	objects.erase(objid);
+	deleted[objid] = ++revision;
+
+	if(deleted.size() > OBJECT_SNAPSHOT_MAX_DELETED) {
+		auto oldest = deleted.begin();
+		for(auto d = deleted.begin(); d != deleted.end(); d++)
+			if(d->second < oldest->second) oldest = d;
+
+		if(oldest->second > delta_horizon)
+			delta_horizon = oldest->second;
+		deleted.erase(oldest);
+	}
+}
+
+void ObjectSnapshot::add_entry(std::vector<uint8_t> &target, int32_t objid, ObjectState &state) {
+	if(!state.serialized) {
+		state.fields.clear();
+		if(!serializer(objid, state.fields)) return;
+		state.serialized = true;
+	}
+	put_varint(target, (uint64_t)objid);
+	put_varint(target, state.fields.size());
+	target.insert(target.end(), state.fields.begin(), state.fields.end());
+}
+
+void ObjectSnapshot::compress(const std::vector<uint8_t> &raw, std::vector<char> &result) {
+	uLongf length = compressBound(raw.size());
+	result.resize(length);
+	if(compress2((Bytef *)result.data(), &length,
+		     (const Bytef *)raw.data(), raw.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+		throw jException("ObjectSnapshot - failed to compress snapshot.", jException::sanity_error);
+	result.resize(length);
+}
+
+void ObjectSnapshot::build(uint64_t since_epoch, uint64_t since_revision,
+			   std::vector<char> &result, size_t &raw_size, bool &full) {
+	full = since_epoch != epoch || since_revision < delta_horizon || since_revision > revision;
+
+	if(full) {
+		if(!full_snapshot_valid || full_snapshot_revision != revision) {
+			std::vector<uint8_t> raw;
+			for(auto &o : objects)
+				add_entry(raw, o.first, o.second);
+			compress(raw, full_snapshot);
+			full_snapshot_raw_size = raw.size();
+			full_snapshot_revision = revision;
+			full_snapshot_valid = true;
+
+			SATAN_DEBUG("ObjectSnapshot::build() - %d objects, %d bytes, %d compressed.\n",
+				    (int)objects.size(), (int)raw.size(), (int)full_snapshot.size());
+		}
+		result = full_snapshot;
+		raw_size = full_snapshot_raw_size;
+		return;
+	}
+
+	std::vector<uint8_t> raw;
+	for(auto &o : objects)
+		if(o.second.revision > since_revision)
+			add_entry(raw, o.first, o.second);
+	for(auto &d : deleted) {
+		if(d.second > since_revision) {
+			put_varint(raw, (uint64_t)d.first);
+			put_varint(raw, 0);
+		}
+	}
+	compress(raw, result);
+	raw_size = raw.size();
+}
+
+bool ObjectSnapshot::decode(const char *data, size_t length, size_t raw_size, EntryCallback callback) {
+	if(raw_size > OBJECT_SNAPSHOT_MAX_RAW_SIZE) return false;
+
+	std::vector<uint8_t> raw(raw_size);
+	uLongf raw_length = raw_size;
+	if(raw_size > 0 &&
+	   (uncompress((Bytef *)raw.data(), &raw_length, (const Bytef *)data, length) != Z_OK ||
+	    raw_length != raw_size)) {
+		SATAN_ERROR("ObjectSnapshot::decode() - failed to decompress snapshot.\n");
+		return false;
+	}
+
+	const uint8_t *p = raw.data(), *end = raw.data() + raw.size();
+	while(p < end) {
+		uint64_t objid, l;
+		if(!get_varint(p, end, objid) || !get_varint(p, end, l) ||
+		   objid > INT32_MAX || l > (uint64_t)(end - p))
+			return false;
+
+		callback((int32_t)objid, l ? p : NULL, (size_t)l);
+		p += l;
+	}
+	return true;
+}
@@ -0,0 +1,105 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#ifndef OBJECT_SNAPSHOT_HH
+#define OBJECT_SNAPSHOT_HH
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <vector>
+#include <functional>
+
+/*
+ * The state of all remote interface objects on the server, as the
+ * create object messages a new client needs.
+ *
+ * Every change that is distributed to the clients bumps the revision and
+ * marks the object as changed, transient notifications are not tracked.
+ * The create message of an object is only serialized again when a
+ * snapshot is requested after it has changed, and the complete compressed
+ * snapshot is kept until the next change - so a new client costs close
+ * to nothing unless the project was edited.
+ *
+ * A client that has received a snapshot before remembers its epoch and
+ * revision, and when it reconnects it only gets the objects changed or
+ * deleted since then. The epoch identifies the server session, revisions
+ * from another session are never compared.
+ *
+ * Snapshot format, before compression - a list of entries:
+ *
+ *   varint object id
+ *   varint length - zero for a deleted object
+ *   length bytes of binary message fields (Message::encode_fields())
+ */
+class ObjectSnapshot {
+public:
+	// serialize the create message of objid into fields, returns false if it does not exist
+	typedef std::function<bool(int32_t objid, std::vector<uint8_t> &fields)> Serializer;
+
+	// called for each entry in a decoded snapshot, fields is NULL for a deleted object
+	typedef std::function<void(int32_t objid, const uint8_t *fields, size_t length)> EntryCallback;
+
+	ObjectSnapshot(Serializer serializer);
+
+	uint64_t get_epoch() const { return epoch; }
+	uint64_t get_revision() const { return revision; }
+
+	void object_changed(int32_t objid);
+	void object_deleted(int32_t objid);
+
+	// Build the compressed snapshot for a client that knows the state at
+	// since_epoch/since_revision. Pass zero to get everything. full is set
+	// to true if the result is a complete snapshot instead of a delta.
+	void build(uint64_t since_epoch, uint64_t since_revision,
+		   std::vector<char> &result, size_t &raw_size, bool &full);
+
+	// returns false if the data is corrupt
+	static bool decode(const char *data, size_t length, size_t raw_size, EntryCallback callback);
+
+private:
+	class ObjectState {
+	public:
+		uint64_t revision; // of the latest change
+		bool serialized = false;
+		std::vector<uint8_t> fields;
+	};
+
+	Serializer serializer;
+	uint64_t epoch;
+	uint64_t revision = 0;
+
+	std::map<int32_t, ObjectState> objects;
+
+	// deleted objects, pruned when there are too many - deltas can
+	// not be created from a revision older than the oldest dropped one
+	std::map<int32_t, uint64_t> deleted;
+	uint64_t delta_horizon = 0;
+
+	std::vector<char> full_snapshot;
+	size_t full_snapshot_raw_size = 0;
+	uint64_t full_snapshot_revision = 0;
+	bool full_snapshot_valid = false;
+
+	void add_entry(std::vector<uint8_t> &target, int32_t objid, ObjectState &state);
+	static void compress(const std::vector<uint8_t> &raw, std::vector<char> &result);
+};
+
+#endif
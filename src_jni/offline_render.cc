@@ -0,0 +1,515 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+/*
+ * Offline rendering - a normal thread drives internal_fill_sink() through
+ * fill_this_sink(), as fast as the CPU allows and with large buffers,
+ * while the audio device gets silence. The sink machine acts as a null
+ * sink, we read its premixed input and write the files ourselves.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include <jngldrum/jexception.hh>
+
+#include "machine.hh"
+#include "machine_sequencer.hh"
+#include "recording_sink.hh"
+#include "vorbis_encoder.hh"
+#include "static_signal_stream.hh"
+
+//#define __DO_SATAN_DEBUG
+#include "satan_debug.hh"
+
+#define OFFLINE_RENDER_DEFAULT_BUFFER_SIZE 4096
+#define OFFLINE_RENDER_MIN_BUFFER_SIZE 64
+#define OFFLINE_RENDER_MAX_BUFFER_SIZE 16384
+
+Machine::OfflineRenderSettings::OfflineRenderSettings()
+	: formats(RecordingSink::get_formats())
+	, buffer_size(OFFLINE_RENDER_DEFAULT_BUFFER_SIZE)
+	, start_line(0), loops(1), tail_seconds(2.0f), render_workers(-1)
+{}
+
+Machine::OfflineRenderProgress::OfflineRenderProgress()
+	: lines_rendered(0), lines_total(0), frames_rendered(0)
+	, seconds_rendered(0.0), seconds_elapsed(0.0)
+	, finished(false), cancelled(false)
+{}
+
+class Machine::OfflineRenderer {
+public:
+	OfflineRenderer(const OfflineRenderSettings &settings, OfflineRenderCallback callback);
+	~OfflineRenderer();
+
+	// returns when the machine graph has been handed over to the render thread,
+	// throws jException if that was not possible
+	void start();
+
+	OfflineRenderProgress wait();
+	bool is_done();
+
+private:
+	OfflineRenderSettings settings;
+	OfflineRenderCallback callback;
+	OfflineRenderProgress progress;
+
+	pthread_t thread;
+	pid_t tid;
+	sem_t started;
+	std::string start_error;
+	bool joined;
+	std::atomic<bool> done;
+
+	FILE *wave_file, *vorbis_file;
+	uint32_t wave_bytes;
+	VorbisEncoder vorbis;
+	std::vector<int16_t> pcm;
+
+	// the rest is only used while we own the machine graph
+	Machine *target; // the sink
+	int saved_samples[_MAX_D], saved_frequency[_MAX_D];
+	Resolution saved_resolution[_MAX_D];
+	int saved_resume_position;
+	int saved_workers;
+	int rate;
+	float volume;
+	int position; // sequence position after the previous buffer
+	bool in_tail, stop_requested;
+	int64_t tail_frames;
+
+	void enter();
+	void leave();
+
+	void open_files();
+	void write_files(int frames);
+	void close_files();
+
+	Signal *find_sink_signal();
+	void render_buffer();
+	static int fill_sink_callback(int status, void *cbd);
+
+	static void *thread_entry(void *r);
+	void thread_body();
+};
+
+Machine::OfflineRenderer *Machine::offline_renderer = NULL;
+static std::mutex offline_renderer_lock;
+
+Machine::OfflineRenderer::OfflineRenderer(const OfflineRenderSettings &_settings,
+					  OfflineRenderCallback _callback)
+	: settings(_settings), callback(_callback), tid(0), joined(true), done(false)
+	, wave_file(NULL), vorbis_file(NULL), wave_bytes(0)
+	, target(NULL), saved_resume_position(0), saved_workers(-1), rate(0), volume(1.0f)
+	, position(0), in_tail(false), stop_requested(false), tail_frames(0)
+{
+	sem_init(&started, 0, 0);
+}
+
+Machine::OfflineRenderer::~OfflineRenderer() {
+	(void)wait();
+	sem_destroy(&started);
+}
+
+void Machine::OfflineRenderer::start() {
+	if(settings.buffer_size < OFFLINE_RENDER_MIN_BUFFER_SIZE ||
+	   settings.buffer_size > OFFLINE_RENDER_MAX_BUFFER_SIZE ||
+	   settings.loops < 1 || settings.tail_seconds < 0.0f)
+		throw jException("Offline render - bad settings.", jException::sanity_error);
+	if((settings.formats & (RecordingSink::_wave | RecordingSink::_vorbis)) == 0)
+		throw jException("Offline render - no output format selected.", jException::sanity_error);
+
+	if(pthread_create(&thread, NULL, thread_entry, this) != 0)
+		throw jException("Failed to create offline render thread.", jException::syscall_error);
+	joined = false;
+
+	while(sem_wait(&started) != 0 && errno == EINTR);
+
+	if(start_error != "") {
+		(void)wait();
+		throw jException(start_error, jException::sanity_error);
+	}
+}
+
+Machine::OfflineRenderProgress Machine::OfflineRenderer::wait() {
+	if(!joined) {
+		pthread_join(thread, NULL);
+		joined = true;
+	}
+	return progress;
+}
+
+bool Machine::OfflineRenderer::is_done() {
+	return done.load();
+}
+
+/*****************************
+ *
+ * Taking over the machine graph
+ *
+ *****************************/
+
+// executed as a machine operation, so the audio thread is not rendering
+void Machine::OfflineRenderer::enter() {
+	if(sink == NULL)
+		throw jException("Offline render - there is no sink.", jException::sanity_error);
+	if(is_playing)
+		throw jException("Offline render - stop playback first.", jException::sanity_error);
+
+	target = sink;
+
+	Dimension dims[] = {_0D, _MIDI};
+	for(auto d : dims)
+		Signal::get_defaults(d, saved_samples[d], saved_resolution[d], saved_frequency[d]);
+	rate = saved_frequency[_0D];
+	if(rate <= 0 || saved_samples[_0D] <= 0)
+		throw jException("Offline render - the sink is not configured.", jException::sanity_error);
+
+	for(auto d : dims) {
+		if(saved_samples[d] > 0)
+			Signal::set_defaults(d, settings.buffer_size, saved_resolution[d], saved_frequency[d]);
+	}
+
+	// match the level of a realtime recording
+	volume = 1.0f;
+	try {
+		Controller *c = target->internal_get_controller("volume");
+		if(c->get_type() == Controller::c_float)
+			c->internal_get_value(volume);
+		delete c;
+	} catch(...) {
+		// no volume control, use unity gain
+	}
+
+	int start_line;
+	if(__do_loop) {
+		start_line = __loop_start;
+		progress.lines_total = settings.loops * (__loop_stop - __loop_start);
+	} else {
+		start_line = settings.start_line;
+		progress.lines_total = MachineSequencer::internal_get_song_end() - start_line;
+		if(progress.lines_total < 0) progress.lines_total = 0;
+	}
+
+	saved_resume_position = __resume_sequence_position;
+	reset_all_machines();
+	reset_global_playback_parameters(start_line);
+	position = start_line;
+	is_playing = true;
+
+	StaticSignalStream::set_blocking_reads(true);
+
+	offline_render_thread = tid;
+	offline_rendering.store(true);
+}
+
+// called by the render thread between two buffers
+void Machine::OfflineRenderer::leave() {
+	Machine::lock_machine_space();
+
+	is_playing = false;
+	reset_all_machines();
+
+	Dimension dims[] = {_0D, _MIDI};
+	for(auto d : dims) {
+		if(saved_samples[d] > 0)
+			Signal::set_defaults(d, saved_samples[d], saved_resolution[d], saved_frequency[d]);
+	}
+
+	__resume_sequence_position = saved_resume_position;
+	reset_global_playback_parameters(saved_resume_position);
+
+	StaticSignalStream::set_blocking_reads(false);
+
+	offline_rendering.store(false);
+	offline_render_thread = 0;
+	// the audio thread only got silence while we rendered, that gap was no xrun
+	PerformanceTrace::restart_cycle_timing();
+
+	Machine::unlock_machine_space();
+}
+
+/*****************************
+ *
+ * Output files
+ *
+ *****************************/
+
+void Machine::OfflineRenderer::open_files() {
+	if(settings.formats & RecordingSink::_wave) {
+		std::string path = settings.file_name + ".wav";
+		wave_file = fopen(path.c_str(), "wb");
+		if(wave_file == NULL || !RecordingSink::write_wave_header(wave_file, 2, rate, 0))
+			throw jException("Offline render - could not create " + path, jException::syscall_error);
+	}
+
+	if(settings.formats & RecordingSink::_vorbis) {
+		std::string path = settings.file_name + ".ogg";
+		vorbis_file = fopen(path.c_str(), "wb");
+		if(vorbis_file == NULL ||
+		   vorbis.open(vorbis_file, 2, rate, settings.title, settings.artist, settings.genre) != 0)
+			throw jException("Offline render - could not create " + path, jException::syscall_error);
+	}
+}
+
+void Machine::OfflineRenderer::write_files(int frames) {
+	if(wave_file) {
+		size_t samples = (size_t)frames * 2;
+		bool ok = true;
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+		ok = fwrite(pcm.data(), sizeof(int16_t), samples, wave_file) == samples;
+#else
+		for(size_t k = 0; ok && k < samples; k++) {
+			uint8_t le[2] = {(uint8_t)(pcm[k] & 0xff), (uint8_t)((pcm[k] >> 8) & 0xff)};
+			ok = fwrite(le, 1, 2, wave_file) == 2;
+		}
+#endif
+		wave_bytes += samples * sizeof(int16_t);
+		if(!ok) progress.error = "Offline render - failed to write the WAV file.";
+	}
+
+	if(vorbis_file && vorbis.write(pcm.data(), frames) != 0)
+		progress.error = "Offline render - failed to write the OGG file.";
+}
+
+void Machine::OfflineRenderer::close_files() {
+	if(wave_file) {
+		if(!RecordingSink::write_wave_header(wave_file, 2, rate, wave_bytes) && progress.error == "")
+			progress.error = "Offline render - failed to write the WAV file.";
+		fclose(wave_file);
+		wave_file = NULL;
+	}
+
+	if(vorbis_file) {
+		if(vorbis.finish() != 0 && progress.error == "")
+			progress.error = "Offline render - failed to write the OGG file.";
+		fclose(vorbis_file);
+		vorbis_file = NULL;
+	}
+}
+
+/*****************************
+ *
+ * Rendering
+ *
+ *****************************/
+
+Machine::Signal *Machine::OfflineRenderer::find_sink_signal() {
+	for(auto &k : target->premixed_input) {
+		if(k.second->get_dimension() == _0D)
+			return k.second;
+	}
+	return NULL;
+}
+
+// called from internal_fill_sink() after the chain was rendered
+void Machine::OfflineRenderer::render_buffer() {
+	Signal *s = find_sink_signal();
+	int frames = settings.buffer_size;
+
+	pcm.resize(frames * 2);
+	if(s == NULL) {
+		std::fill(pcm.begin(), pcm.end(), 0);
+	} else {
+		int channels = s->get_channels();
+		bool is_float = s->get_resolution() == _fl32bit;
+		void *buffer = s->get_buffer();
+		if(s->get_samples() < frames) frames = s->get_samples();
+
+		for(int k = 0; k < frames; k++) {
+			for(int c = 0; c < 2; c++) {
+				int i = k * channels + (c < channels ? c : channels - 1);
+				float x = is_float ?
+					((float *)buffer)[i] :
+					((int32_t *)buffer)[i] / 16777216.0f;
+				x *= volume;
+				if(x > 1.0f) x = 1.0f;
+				if(x < -1.0f) x = -1.0f;
+				pcm[k * 2 + c] = (int16_t)(x * 32767.0f);
+			}
+		}
+	}
+
+	write_files(frames);
+	if(progress.error != "") stop_requested = true;
+
+	progress.frames_rendered += frames;
+	progress.seconds_rendered = (double)progress.frames_rendered / rate;
+
+	if(in_tail) {
+		tail_frames -= frames;
+		if(tail_frames <= 0) stop_requested = true;
+		return;
+	}
+
+	int delta = __next_sequence_position - position;
+	if(delta < 0) delta += __loop_stop - __loop_start; // wrapped around the loop
+	position = __next_sequence_position;
+	progress.lines_rendered += delta;
+
+	if(progress.lines_rendered >= progress.lines_total) {
+		progress.lines_rendered = progress.lines_total;
+		// no new notes, but let the playing ones ring out
+		is_playing = false;
+		in_tail = true;
+		tail_frames = (int64_t)(settings.tail_seconds * rate);
+		if(tail_frames <= 0) stop_requested = true;
+	}
+}
+
+int Machine::OfflineRenderer::fill_sink_callback(int status, void *cbd) {
+	OfflineRenderer *r = (OfflineRenderer *)cbd;
+
+	// _sinkPaused and _sinkResumed are just notifications
+	if(status == _sinkJustPlay || status == _sinkRecord)
+		r->render_buffer();
+
+	return _sinkCallbackOK;
+}
+
+void *Machine::OfflineRenderer::thread_entry(void *r) {
+	((OfflineRenderer *)r)->thread_body();
+	return NULL;
+}
+
+void Machine::OfflineRenderer::thread_body() {
+	tid = gettid();
+
+	if(settings.render_workers >= 0) {
+		saved_workers = get_parallel_render_workers();
+		if(saved_workers != settings.render_workers)
+			set_parallel_render_workers(settings.render_workers);
+	}
+
+	try {
+		machine_operation_enqueue(
+			[this] (void *d) {
+				enter();
+			},
+			NULL, true);
+	} catch(jException e) {
+		start_error = e.message;
+	}
+
+	if(start_error == "") {
+		try {
+			open_files();
+		} catch(jException e) {
+			start_error = e.message;
+			leave();
+			close_files();
+		}
+	}
+
+	if(start_error != "") {
+		if(saved_workers >= 0 && saved_workers != settings.render_workers)
+			set_parallel_render_workers(saved_workers);
+		done = true;
+		sem_post(&started);
+		return;
+	}
+	sem_post(&started);
+
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	while(!stop_requested) {
+		try {
+			if(fill_this_sink(target, fill_sink_callback, this) == _notSink) {
+				progress.error = "Offline render - the sink was removed.";
+				break;
+			}
+		} catch(jException e) {
+			progress.error = e.message;
+			break;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		progress.seconds_elapsed =
+			(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1000000000.0;
+
+		if(callback && !stop_requested && !callback(progress)) {
+			progress.cancelled = true;
+			break;
+		}
+	}
+
+	leave();
+	close_files();
+
+	if(saved_workers >= 0 && saved_workers != settings.render_workers)
+		set_parallel_render_workers(saved_workers);
+
+	SATAN_DEBUG("Offline render - %f seconds rendered in %f seconds.\n",
+		    progress.seconds_rendered, progress.seconds_elapsed);
+
+	progress.finished = true;
+	if(callback) (void)callback(progress);
+	done = true;
+}
+
+/*****************************
+ *
+ * Machine interface
+ *
+ *****************************/
+
+void Machine::start_offline_render(const OfflineRenderSettings &settings, OfflineRenderCallback callback) {
+	std::lock_guard<std::mutex> lock(offline_renderer_lock);
+
+	if(offline_renderer != NULL) {
+		if(!offline_renderer->is_done())
+			throw jException("Offline render - already rendering.", jException::sanity_error);
+		delete offline_renderer;
+		offline_renderer = NULL;
+	}
+
+	OfflineRenderer *r = new OfflineRenderer(settings, callback);
+	try {
+		r->start();
+	} catch(...) {
+		delete r;
+		throw;
+	}
+	offline_renderer = r;
+}
+
+Machine::OfflineRenderProgress Machine::wait_for_offline_render() {
+	std::lock_guard<std::mutex> lock(offline_renderer_lock);
+
+	OfflineRenderProgress retval;
+	if(offline_renderer != NULL) {
+		retval = offline_renderer->wait();
+		delete offline_renderer;
+		offline_renderer = NULL;
+	}
+	return retval;
+}
+
+bool Machine::is_rendering_offline() {
+	return offline_rendering.load();
+}
@@ -0,0 +1,100 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __PARAMETER_QUEUE
+#define __PARAMETER_QUEUE
+
+#include <atomic>
+#include <stdint.h>
+
+// must be a power of two
+#define PARAMETER_QUEUE_SIZE 128
+
+/*
+ * Fixed capacity, lock-free, multi producer queue of controller changes.
+ *
+ * Any thread may push(), only the thread executing the machine
+ * may pop(). No memory is allocated after construction.
+ *
+ * (bounded queue with per cell sequence numbers, as described by D. Vyukov)
+ */
+class ParameterQueue {
+public:
+	class Event {
+	public:
+		int index; // controller index in the owning machine
+		int offset; // sample offset in the next buffer, or < 0 to use timestamp
+		int ramp_length; // number of samples to ramp over, 0 for a direct change
+		float value;
+		int64_t timestamp; // monotonic time, in nanoseconds, of the change
+	};
+
+	ParameterQueue() : enqueue_position(0), dequeue_position(0) {
+		for(unsigned int k = 0; k < PARAMETER_QUEUE_SIZE; k++)
+			cells[k].sequence.store(k, std::memory_order_relaxed);
+	}
+
+	// returns false if the queue is full
+	bool push(const Event &e) {
+		Cell *cell;
+		unsigned int pos = enqueue_position.load(std::memory_order_relaxed);
+		while(1) {
+			cell = &cells[pos & (PARAMETER_QUEUE_SIZE - 1)];
+			unsigned int seq = cell->sequence.load(std::memory_order_acquire);
+			int diff = (int)seq - (int)pos;
+			if(diff == 0) {
+				if(enqueue_position.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if(diff < 0) {
+				return false;
+			} else {
+				pos = enqueue_position.load(std::memory_order_relaxed);
+			}
+		}
+		cell->event = e;
+		cell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// returns false if the queue is empty
+	bool pop(Event &e) {
+		unsigned int pos = dequeue_position.load(std::memory_order_relaxed);
+		Cell *cell = &cells[pos & (PARAMETER_QUEUE_SIZE - 1)];
+		unsigned int seq = cell->sequence.load(std::memory_order_acquire);
+		if((int)seq - (int)(pos + 1) < 0)
+			return false;
+		e = cell->event;
+		cell->sequence.store(pos + PARAMETER_QUEUE_SIZE, std::memory_order_release);
+		dequeue_position.store(pos + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+private:
+	class Cell {
+	public:
+		std::atomic<unsigned int> sequence;
+		Event event;
+	};
+
+	Cell cells[PARAMETER_QUEUE_SIZE];
+	std::atomic<unsigned int> enqueue_position;
+	std::atomic<unsigned int> dequeue_position;
+};
+
+#endif
@@ -0,0 +1,286 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#include "performance_monitor.hh"
+
+//#define __DO_SATAN_DEBUG
+#include "satan_debug.hh"
+
+PerformanceMonitor::PerformanceMonitor(const Factory *factory, const RemoteInterface::Message &serialized)
+	: SimpleBaseObject(factory, serialized) {
+	register_handlers();
+}
+
+PerformanceMonitor::PerformanceMonitor(int32_t new_obj_id, const Factory *factory)
+	: SimpleBaseObject(new_obj_id, factory) {
+	register_handlers();
+}
+
+std::string PerformanceMonitor::serialize_statistics(const PerformanceTrace::Statistics &statistics) {
+	Serialize::ItemSerializer iser;
+
+	iser.process(statistics.sources);
+	iser.process(statistics.cycle.average);
+	iser.process(statistics.cycle.peak);
+	iser.process(statistics.cycle.load);
+	iser.process(statistics.buffer_duration);
+	iser.process(statistics.cycles);
+	iser.process(statistics.deadline_misses);
+	iser.process(statistics.xruns);
+	iser.process(statistics.dropped_events);
+
+	return iser.result();
+}
+
+PerformanceTrace::Statistics PerformanceMonitor::deserialize_statistics(const std::string &serialized) {
+	PerformanceTrace::Statistics statistics;
+	Serialize::ItemDeserializer ideser(serialized);
+
+	ideser.process(statistics.sources);
+	ideser.process(statistics.cycle.average);
+	ideser.process(statistics.cycle.peak);
+	ideser.process(statistics.cycle.load);
+	ideser.process(statistics.buffer_duration);
+	ideser.process(statistics.cycles);
+	ideser.process(statistics.deadline_misses);
+	ideser.process(statistics.xruns);
+	ideser.process(statistics.dropped_events);
+
+	statistics.cycle.name = "render cycle";
+	return statistics;
+}
+
+void PerformanceMonitor::handle_start_meter(
+	RemoteInterface::Context *context, RemoteInterface::MessageHandler *src, const RemoteInterface::Message& msg)
+{
+	if(is_server_side()) {
+		meter_users[src->shared_from_this()]++;
+		if(trace_listener != -1) return;
+
+		trace_listener = PerformanceTrace::add_listener(
+			[this](const PerformanceTrace::Statistics &statistics) {
+				std::string serialized = serialize_statistics(statistics);
+				this->context->post_action(
+					[this, serialized]() {
+						release_meter_users();
+						if(meter_users.empty()) return;
+
+						send_message(
+							CMD_METER_UPDATE,
+							[serialized](std::shared_ptr<RemoteInterface::Message> &msg2send) {
+								msg2send->set_value("stats", serialized);
+								msg2send->set_transient();
+							}
+							);
+					},
+					true
+					);
+			}
+			);
+	}
+}
+
+void PerformanceMonitor::handle_stop_meter(
+	RemoteInterface::Context *context, RemoteInterface::MessageHandler *src, const RemoteInterface::Message& msg)
+{
+	if(is_server_side()) {
+		auto user = meter_users.find(src->shared_from_this());
+		if(user != meter_users.end() && --(user->second) == 0)
+			meter_users.erase(user);
+		release_meter_users();
+	}
+}
+
+void PerformanceMonitor::release_meter_users() {
+	auto user = meter_users.begin();
+	while(user != meter_users.end()) {
+		if(user->first.expired())
+			user = meter_users.erase(user);
+		else
+			user++;
+	}
+
+	if(meter_users.empty() && trace_listener != -1) {
+		PerformanceTrace::remove_listener(trace_listener);
+		trace_listener = -1;
+	}
+}
+
+void PerformanceMonitor::handle_meter_update(
+	RemoteInterface::Context *context, RemoteInterface::MessageHandler *src, const RemoteInterface::Message& msg)
+{
+	if(!is_server_side()) {
+		MeterListener listener;
+		{
+			std::lock_guard<std::mutex> lck(listener_mtx);
+			listener = meter_listener;
+		}
+		if(listener)
+			listener(deserialize_statistics(msg.get_value("stats")));
+	}
+}
+
+void PerformanceMonitor::handle_get_counters(
+	RemoteInterface::Context *context, RemoteInterface::MessageHandler *src, const RemoteInterface::Message& msg)
+{
+	if(is_server_side()) {
+		std::shared_ptr<RemoteInterface::Message> reply = context->acquire_reply(msg);
+		reply->set_value("misses", std::to_string(PerformanceTrace::get_deadline_misses()));
+		reply->set_value("xruns", std::to_string(PerformanceTrace::get_xruns()));
+
+		// the server side of the link to this client
+		auto link = src->get_outgoing_counters();
+		reply->set_value("qdepth", std::to_string(link.queue_depth));
+		reply->set_value("msgs", std::to_string(link.messages));
+		reply->set_value("writes", std::to_string(link.writes));
+		reply->set_value("bytes", std::to_string(link.bytes));
+		reply->set_value("superseded", std::to_string(link.superseded));
+		reply->set_value("bps", std::to_string(link.bytes_per_second));
+		src->deliver_message(reply);
+	}
+}
+
+void PerformanceMonitor::handle_start_capture(
+	RemoteInterface::Context *context, RemoteInterface::MessageHandler *src, const RemoteInterface::Message& msg)
+{
+	if(is_server_side()) {
+		bool started = true;
+		try {
+			PerformanceTrace::start_capture(msg.get_value("file"));
+		} catch(jException e) {
+			SATAN_ERROR("PerformanceMonitor - failed to start capture: %s\n", e.message.c_str());
+			started = false;
+		}
+
+		std::shared_ptr<RemoteInterface::Message> reply = context->acquire_reply(msg);
+		reply->set_value("started", started ? "true" : "false");
+		src->deliver_message(reply);
+	}
+}
+
+void PerformanceMonitor::handle_stop_capture(
+	RemoteInterface::Context *context, RemoteInterface::MessageHandler *src, const RemoteInterface::Message& msg)
+{
+	if(is_server_side()) {
+		PerformanceTrace::stop_capture();
+	}
+}
+
+void PerformanceMonitor::set_meter_listener(MeterListener listener) {
+	std::lock_guard<std::mutex> lck(listener_mtx);
+	meter_listener = listener;
+}
+
+void PerformanceMonitor::start_meter() {
+	send_message_to_server(
+		CMD_START_METER,
+		[](std::shared_ptr<RemoteInterface::Message> &msg2send) {}
+		);
+}
+
+void PerformanceMonitor::stop_meter() {
+	send_message_to_server(
+		CMD_STOP_METER,
+		[](std::shared_ptr<RemoteInterface::Message> &msg2send) {}
+		);
+}
+
+void PerformanceMonitor::get_counters(int &deadline_misses, int &xruns) {
+	deadline_misses = xruns = 0;
+
+	send_message_to_server(
+		CMD_GET_COUNTERS,
+
+		[](std::shared_ptr<RemoteInterface::Message> &msg2send) {},
+
+		[&deadline_misses, &xruns](const RemoteInterface::Message *reply_message) {
+			if(reply_message) {
+				deadline_misses = std::stoi(reply_message->get_value("misses"));
+				xruns = std::stoi(reply_message->get_value("xruns"));
+			}
+		}
+		);
+}
+
+void PerformanceMonitor::get_link_counters(RemoteInterface::MessageHandler::OutgoingCounters &counters) {
+	counters = RemoteInterface::MessageHandler::OutgoingCounters();
+
+	send_message_to_server(
+		CMD_GET_COUNTERS,
+
+		[](std::shared_ptr<RemoteInterface::Message> &msg2send) {},
+
+		[&counters](const RemoteInterface::Message *reply_message) {
+			if(reply_message && reply_message->has_value("qdepth")) {
+				counters.queue_depth = std::stoul(reply_message->get_value("qdepth"));
+				counters.messages = std::stoull(reply_message->get_value("msgs"));
+				counters.writes = std::stoull(reply_message->get_value("writes"));
+				counters.bytes = std::stoull(reply_message->get_value("bytes"));
+				counters.superseded = std::stoull(reply_message->get_value("superseded"));
+				counters.bytes_per_second = std::stod(reply_message->get_value("bps"));
+			}
+		}
+		);
+}
+
+bool PerformanceMonitor::start_capture(const std::string &file_name) {
+	bool retval = false;
+
+	send_message_to_server(
+		CMD_START_CAPTURE,
+
+		[file_name](std::shared_ptr<RemoteInterface::Message> &msg2send) {
+			msg2send->set_value("file", file_name);
+		},
+
+		[&retval](const RemoteInterface::Message *reply_message) {
+			if(reply_message) {
+				retval = reply_message->get_value("started") == "true";
+			}
+		}
+		);
+
+	return retval;
+}
+
+void PerformanceMonitor::stop_capture() {
+	send_message_to_server(
+		CMD_STOP_CAPTURE,
+		[](std::shared_ptr<RemoteInterface::Message> &msg2send) {}
+		);
+}
+
+void PerformanceMonitor::on_delete(RemoteInterface::Context* context) {
+	if(is_server_side() && trace_listener != -1) {
+		PerformanceTrace::remove_listener(trace_listener);
+		trace_listener = -1;
+	}
+	meter_users.clear();
+	context->unregister_this_object(this);
+}
+
+static PerformanceMonitor::PerformanceMonitorFactory this_will_register_us_as_a_factory;
+
+std::shared_ptr<PerformanceMonitor>	PerformanceMonitor::PerformanceMonitorFactory::clientside_monitor_object;
+std::mutex				PerformanceMonitor::PerformanceMonitorFactory::clientside_mtx;
+volatile bool				PerformanceMonitor::PerformanceMonitorFactory::clientside_obj_created = false;
+std::shared_ptr<PerformanceMonitor>	PerformanceMonitor::PerformanceMonitorFactory::serverside_monitor_object;
+std::mutex				PerformanceMonitor::PerformanceMonitorFactory::serverside_mtx;
+volatile bool				PerformanceMonitor::PerformanceMonitorFactory::serverside_obj_created = false;
@@ -0,0 +1,169 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#ifndef PERFORMANCE_MONITOR_HH
+#define PERFORMANCE_MONITOR_HH
+
+#include "remote_interface.hh"
+#include "serialize.hh"
+#include "performance_trace.hh"
+
+#include "satan_error.hh"
+
+/*
+ * Remote access to PerformanceTrace - a live per machine CPU meter,
+ * the deadline miss and xrun counters, and Chrome trace capture on
+ * the server side. Also reports the outgoing queue of the server
+ * for the requesting client.
+ *
+ * The meter is shared by all clients, the server streams updates to
+ * everyone while at least one connected client has it started.
+ */
+class PerformanceMonitor : public RemoteInterface::SimpleBaseObject {
+public:
+	static constexpr const char* FACTORY_NAME		= "PerfMon";
+
+	typedef std::function<void(const PerformanceTrace::Statistics &statistics)> MeterListener;
+
+	class PerformanceMonitorFactory : public FactoryTemplate<PerformanceMonitor> {
+	private:
+		static std::shared_ptr<PerformanceMonitor> clientside_monitor_object;
+		static std::mutex clientside_mtx;
+		volatile static bool clientside_obj_created;
+
+		static std::shared_ptr<PerformanceMonitor> serverside_monitor_object;
+		static std::mutex serverside_mtx;
+		volatile static bool serverside_obj_created;
+
+	public:
+
+		PerformanceMonitorFactory() : FactoryTemplate<PerformanceMonitor>(FACTORY_NAME, true) {}
+
+		virtual std::shared_ptr<BaseObject> create(const RemoteInterface::Message &serialized) override {
+			std::lock_guard<std::mutex> lck(clientside_mtx);
+			if(clientside_obj_created) throw StaticSingleObjectAlreadyCreated();
+			clientside_obj_created = true;
+			clientside_monitor_object = std::make_shared<PerformanceMonitor>(this, serialized);
+			return clientside_monitor_object;
+		}
+
+		virtual std::shared_ptr<BaseObject> create(int32_t new_obj_id) override {
+			std::lock_guard<std::mutex> lck(serverside_mtx);
+			if(serverside_obj_created) throw StaticSingleObjectAlreadyCreated();
+			serverside_obj_created = true;
+			serverside_monitor_object = std::make_shared<PerformanceMonitor>(new_obj_id, this);
+			return serverside_monitor_object;
+		}
+
+		static std::shared_ptr<PerformanceMonitor> get_clientside_monitor_object() {
+			if(clientside_obj_created)
+				return clientside_monitor_object;
+
+			std::shared_ptr<PerformanceMonitor> empty;
+			return empty;
+		}
+	};
+
+private:
+
+	static constexpr const char* CMD_START_METER		= "startm";
+	static constexpr const char* CMD_STOP_METER		= "stopm";
+	static constexpr const char* CMD_METER_UPDATE		= "meter";
+	static constexpr const char* CMD_GET_COUNTERS		= "getcnt";
+	static constexpr const char* CMD_START_CAPTURE		= "startcap";
+	static constexpr const char* CMD_STOP_CAPTURE		= "stopcap";
+
+	void handle_start_meter(RemoteInterface::Context *context, RemoteInterface::MessageHandler *src,
+				const RemoteInterface::Message& msg);
+	void handle_stop_meter(RemoteInterface::Context *context, RemoteInterface::MessageHandler *src,
+			       const RemoteInterface::Message& msg);
+	void handle_meter_update(RemoteInterface::Context *context, RemoteInterface::MessageHandler *src,
+				 const RemoteInterface::Message& msg);
+	void handle_get_counters(RemoteInterface::Context *context, RemoteInterface::MessageHandler *src,
+				 const RemoteInterface::Message& msg);
+	void handle_start_capture(RemoteInterface::Context *context, RemoteInterface::MessageHandler *src,
+				  const RemoteInterface::Message& msg);
+	void handle_stop_capture(RemoteInterface::Context *context, RemoteInterface::MessageHandler *src,
+				 const RemoteInterface::Message& msg);
+
+	void register_handlers() {
+		register_handler(CMD_START_METER,
+				 std::bind(&PerformanceMonitor::handle_start_meter, this,
+					   std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+		register_handler(CMD_STOP_METER,
+				 std::bind(&PerformanceMonitor::handle_stop_meter, this,
+					   std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+		register_handler(CMD_METER_UPDATE,
+				 std::bind(&PerformanceMonitor::handle_meter_update, this,
+					   std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+		register_handler(CMD_GET_COUNTERS,
+				 std::bind(&PerformanceMonitor::handle_get_counters, this,
+					   std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+		register_handler(CMD_START_CAPTURE,
+				 std::bind(&PerformanceMonitor::handle_start_capture, this,
+					   std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+		register_handler(CMD_STOP_CAPTURE,
+				 std::bind(&PerformanceMonitor::handle_stop_capture, this,
+					   std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+	}
+
+	/* serverside data */
+	// number of start_meter() calls not yet stopped, per client
+	std::map<std::weak_ptr<RemoteInterface::MessageHandler>, int,
+		 std::owner_less<std::weak_ptr<RemoteInterface::MessageHandler> > > meter_users;
+	int trace_listener = -1;
+
+	// forget clients that disconnected without stopping the meter, and
+	// stop listening to PerformanceTrace when no one is left
+	void release_meter_users();
+
+	/* clientside data */
+	std::mutex listener_mtx;
+	MeterListener meter_listener;
+
+	static std::string serialize_statistics(const PerformanceTrace::Statistics &statistics);
+	static PerformanceTrace::Statistics deserialize_statistics(const std::string &serialized);
+
+public:
+
+	PerformanceMonitor(const Factory *factory, const RemoteInterface::Message &serialized);
+	PerformanceMonitor(int32_t new_obj_id, const Factory *factory);
+
+	/// The listener is called on the client context thread. Pass an empty function to clear it.
+	void set_meter_listener(MeterListener listener);
+	void start_meter();
+	void stop_meter();
+
+	void get_counters(int &deadline_misses, int &xruns);
+	/// Outgoing traffic from the server to this client.
+	void get_link_counters(RemoteInterface::MessageHandler::OutgoingCounters &counters);
+
+	/// The path is on the server side, returns false if the capture could not be started.
+	bool start_capture(const std::string &file_name);
+	void stop_capture();
+
+	virtual void on_delete(RemoteInterface::Context* context) override;
+
+	static std::shared_ptr<PerformanceMonitor> get_monitor_object() {
+		return PerformanceMonitorFactory::get_clientside_monitor_object();
+	}
+};
+
+#endif
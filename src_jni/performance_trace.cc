@@ -0,0 +1,592 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <map>
+#include <mutex>
+
+#include <jngldrum/jexception.hh>
+
+#include "performance_trace.hh"
+#include "seqlock.hh"
+
+//#define __DO_SATAN_DEBUG
+#include "satan_debug.hh"
+
+// how often the collector drains the rings, and how often listeners are updated
+#define PERFORMANCE_TRACE_DRAIN_INTERVAL_MS 50
+#define PERFORMANCE_TRACE_PUBLISH_INTERVAL_MS 250
+
+/*****************************
+ *
+ * Trace sources
+ *
+ *****************************/
+
+namespace {
+	class SourceName {
+	public:
+		char text[PERFORMANCE_TRACE_SOURCE_NAME_SIZE];
+	};
+
+	class Source {
+	public:
+		std::atomic<bool> used;
+		SeqLock<SourceName> name;
+
+		Source() : used(false) {}
+	};
+
+	class Event {
+	public:
+		uint64_t start;
+		uint32_t duration; // in ticks
+		int32_t source;
+	};
+
+	Source sources[PERFORMANCE_TRACE_MAX_SOURCES];
+
+	double calibrate_ticks_per_microsecond() {
+#if defined(__aarch64__)
+		uint64_t frequency;
+		asm volatile("mrs %0, cntfrq_el0" : "=r" (frequency));
+		return frequency / 1000000.0;
+#elif defined(__i386__) || defined(__x86_64__)
+		struct timespec t0, t1, wait = {0, 5000000};
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		uint64_t c0 = PerformanceTrace::timestamp();
+		nanosleep(&wait, NULL);
+		uint64_t c1 = PerformanceTrace::timestamp();
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		double us = (t1.tv_sec - t0.tv_sec) * 1000000.0 + (t1.tv_nsec - t0.tv_nsec) / 1000.0;
+		return us > 0.0 ? (c1 - c0) / us : 1000.0;
+#else
+		return 1000.0; // nanoseconds
+#endif
+	}
+
+	const double tpus = calibrate_ticks_per_microsecond();
+
+	// zero when there is no previous cycle to compare with
+	std::atomic<uint64_t> previous_cycle_start(0);
+
+	std::atomic<uint64_t> deadline_ticks(0);
+	std::atomic<int> deadline_misses(0);
+	std::atomic<int> xruns(0);
+};
+
+static void write_source_name(int source, const std::string &name) {
+	SourceName sn;
+	memset(&sn, 0, sizeof(sn));
+	strncpy(sn.text, name.c_str(), PERFORMANCE_TRACE_SOURCE_NAME_SIZE - 1);
+	sources[source].name.write(sn);
+}
+
+int PerformanceTrace::register_source(const std::string &name) {
+	for(int k = PERFORMANCE_TRACE_CYCLE_SOURCE + 1; k < PERFORMANCE_TRACE_MAX_SOURCES; k++) {
+		bool expected = false;
+		if(sources[k].used.compare_exchange_strong(expected, true)) {
+			write_source_name(k, name);
+			return k;
+		}
+	}
+	return -1;
+}
+
+void PerformanceTrace::set_source_name(int source, const std::string &name) {
+	if(source > PERFORMANCE_TRACE_CYCLE_SOURCE && source < PERFORMANCE_TRACE_MAX_SOURCES)
+		write_source_name(source, name);
+}
+
+void PerformanceTrace::unregister_source(int source) {
+	if(source > PERFORMANCE_TRACE_CYCLE_SOURCE && source < PERFORMANCE_TRACE_MAX_SOURCES)
+		sources[source].used.store(false);
+}
+
+double PerformanceTrace::ticks_per_microsecond() {
+	return tpus;
+}
+
+/*****************************
+ *
+ * Per thread rings
+ *
+ *****************************/
+
+// single producer (the owning thread), single consumer (whoever holds the collector lock)
+class PerformanceTrace::Ring {
+public:
+	enum State {
+		_free,
+		_owned,
+		_abandoned // the owning thread has exited, free it when drained
+	};
+
+	std::atomic<int> state;
+	pid_t tid;
+	bool named; // thread name written to the current capture
+	std::atomic<uint32_t> head, tail;
+	std::atomic<int> dropped;
+	Event events[PERFORMANCE_TRACE_RING_SIZE];
+
+	Ring() : state(_free), tid(0), named(false), head(0), tail(0), dropped(0) {}
+
+	static Ring *claim();
+};
+
+// gives the ring back when the owning thread exits
+class PerformanceTrace::RingOwnership {
+public:
+	Ring *ring;
+	bool tried;
+
+	RingOwnership() : ring(NULL), tried(false) {}
+	~RingOwnership() {
+		if(ring) ring->state.store(Ring::_abandoned, std::memory_order_release);
+	}
+};
+
+std::atomic<bool> PerformanceTrace::collecting(false);
+std::atomic<PerformanceTrace::Ring *> PerformanceTrace::rings(NULL);
+
+PerformanceTrace::Ring *PerformanceTrace::Ring::claim() {
+	Ring *all = rings.load(std::memory_order_acquire);
+	for(int k = 0; all && k < PERFORMANCE_TRACE_MAX_THREADS; k++) {
+		int expected = _free;
+		if(all[k].state.compare_exchange_strong(expected, _owned)) {
+			all[k].tid = gettid();
+			all[k].named = false;
+			return &all[k];
+		}
+	}
+	return NULL;
+}
+
+void PerformanceTrace::record_event(int source, uint64_t start, uint64_t stop) {
+	static thread_local RingOwnership ownership;
+
+	if(ownership.ring == NULL) {
+		// if all rings were taken we do not try again
+		if(ownership.tried) return;
+		ownership.tried = true;
+		if((ownership.ring = Ring::claim()) == NULL) return;
+	}
+
+	Ring *r = ownership.ring;
+	uint32_t h = r->head.load(std::memory_order_relaxed);
+	if(h - r->tail.load(std::memory_order_acquire) >= PERFORMANCE_TRACE_RING_SIZE) {
+		r->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	Event *e = &r->events[h & (PERFORMANCE_TRACE_RING_SIZE - 1)];
+	e->start = start;
+	e->duration = stop > start ? (uint32_t)(stop - start) : 0;
+	e->source = source;
+	r->head.store(h + 1, std::memory_order_release);
+}
+
+/*****************************
+ *
+ * Deadlines and xruns
+ *
+ *****************************/
+
+void PerformanceTrace::cycle_completed(uint64_t start, uint64_t stop, int frames, int sample_rate) {
+	if(frames <= 0 || sample_rate <= 0) return;
+
+	uint64_t deadline = (uint64_t)(frames * tpus * 1000000.0 / sample_rate);
+	deadline_ticks.store(deadline, std::memory_order_relaxed);
+
+	if(stop - start > deadline)
+		deadline_misses.fetch_add(1, std::memory_order_relaxed);
+	uint64_t previous = previous_cycle_start.exchange(start, std::memory_order_relaxed);
+	if(previous != 0 && start - previous > 2 * deadline)
+		xruns.fetch_add(1, std::memory_order_relaxed);
+
+	record(PERFORMANCE_TRACE_CYCLE_SOURCE, start, stop);
+}
+
+void PerformanceTrace::restart_cycle_timing() {
+	previous_cycle_start.store(0, std::memory_order_relaxed);
+}
+
+void PerformanceTrace::report_xrun() {
+	xruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+int PerformanceTrace::get_deadline_misses() {
+	return deadline_misses.load();
+}
+
+int PerformanceTrace::get_xruns() {
+	return xruns.load();
+}
+
+PerformanceTrace::Statistics::Statistics()
+	: buffer_duration(0.0), cycles(0), deadline_misses(0), xruns(0), dropped_events(0)
+{}
+
+/*****************************
+ *
+ * Collector
+ *
+ *****************************/
+
+class PerformanceTrace::Collector {
+public:
+	static Collector *get();
+
+	int add_listener(Listener listener);
+	void remove_listener(int id);
+
+	void start_capture(const std::string &file_name);
+	void stop_capture();
+	bool is_capturing();
+
+private:
+	class Accumulator {
+	public:
+		uint64_t sum, peak;
+		int count;
+	};
+
+	static Collector *instance;
+
+	pthread_t thread;
+	sem_t wake_up;
+
+	// lock order - only one lock is ever held
+	std::mutex lock;
+	std::map<int, Listener> listeners;
+	int next_listener_id;
+
+	Accumulator accumulators[PERFORMANCE_TRACE_MAX_SOURCES];
+	struct timespec last_publish;
+
+	FILE *capture_file;
+	uint64_t capture_start;
+
+	Collector();
+
+	void activate(); // lock must be held
+	void drain(bool keep); // lock must be held
+	void write_capture_event(Ring *r, const Event &e, const char *name);
+	void publish(Statistics &statistics); // lock must be held
+	void close_capture(); // lock must be held
+
+	static void *thread_entry(void *c);
+	void thread_body();
+};
+
+PerformanceTrace::Collector *PerformanceTrace::Collector::instance = NULL;
+
+PerformanceTrace::Collector *PerformanceTrace::Collector::get() {
+	static std::mutex creation_lock;
+	std::lock_guard<std::mutex> lock(creation_lock);
+
+	if(instance == NULL)
+		instance = new Collector();
+	return instance;
+}
+
+PerformanceTrace::Collector::Collector()
+	: next_listener_id(0), capture_file(NULL), capture_start(0)
+{
+	memset(accumulators, 0, sizeof(accumulators));
+	clock_gettime(CLOCK_MONOTONIC, &last_publish);
+
+	write_source_name(PERFORMANCE_TRACE_CYCLE_SOURCE, "render cycle");
+	sources[PERFORMANCE_TRACE_CYCLE_SOURCE].used.store(true);
+
+	sem_init(&wake_up, 0, 0);
+
+	if(pthread_create(&thread, NULL, thread_entry, this) != 0) {
+		sem_destroy(&wake_up);
+		throw jException("Failed to create performance trace collector thread.",
+				 jException::syscall_error);
+	}
+}
+
+void PerformanceTrace::Collector::activate() {
+	if(rings.load() == NULL)
+		rings.store(new Ring[PERFORMANCE_TRACE_MAX_THREADS]);
+
+	if(!collecting.load()) {
+		drain(false); // left overs from the previous time
+		memset(accumulators, 0, sizeof(accumulators));
+		clock_gettime(CLOCK_MONOTONIC, &last_publish);
+		collecting.store(true);
+	}
+
+	sem_post(&wake_up);
+}
+
+int PerformanceTrace::Collector::add_listener(Listener listener) {
+	std::lock_guard<std::mutex> lck(lock);
+	int id = next_listener_id++;
+	listeners[id] = listener;
+	activate();
+	return id;
+}
+
+void PerformanceTrace::Collector::remove_listener(int id) {
+	std::lock_guard<std::mutex> lck(lock);
+	listeners.erase(id);
+}
+
+void PerformanceTrace::Collector::start_capture(const std::string &file_name) {
+	std::lock_guard<std::mutex> lck(lock);
+
+	if(capture_file != NULL)
+		throw jException("Performance trace - already capturing.", jException::sanity_error);
+
+	capture_file = fopen(file_name.c_str(), "w");
+	if(capture_file == NULL)
+		throw jException("Performance trace - could not create " + file_name, jException::syscall_error);
+
+	fprintf(capture_file,
+		"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+		"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"VuKNOB\"}}");
+
+	Ring *all = rings.load();
+	if(all)
+		for(int k = 0; k < PERFORMANCE_TRACE_MAX_THREADS; k++) all[k].named = false;
+
+	activate();
+	capture_start = timestamp();
+}
+
+void PerformanceTrace::Collector::close_capture() {
+	fprintf(capture_file, "\n]}\n");
+	fclose(capture_file);
+	capture_file = NULL;
+}
+
+void PerformanceTrace::Collector::stop_capture() {
+	std::lock_guard<std::mutex> lck(lock);
+	if(capture_file == NULL) return;
+
+	drain(true);
+	close_capture();
+}
+
+bool PerformanceTrace::Collector::is_capturing() {
+	std::lock_guard<std::mutex> lck(lock);
+	return capture_file != NULL;
+}
+
+static void write_json_string(FILE *f, const char *s) {
+	fputc('"', f);
+	for(; *s; s++) {
+		if(*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else if((unsigned char)*s < 0x20)
+			fprintf(f, "\\u%04x", *s);
+		else
+			fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+void PerformanceTrace::Collector::write_capture_event(Ring *r, const Event &e, const char *name) {
+	if(e.start < capture_start) return;
+
+	if(!r->named) {
+		r->named = true;
+		fprintf(capture_file,
+			",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+			"\"args\":{\"name\":\"render thread %d\"}}", (int)r->tid, (int)r->tid);
+	}
+
+	bool is_cycle = e.source == PERFORMANCE_TRACE_CYCLE_SOURCE;
+	double ts = (e.start - capture_start) / tpus;
+	double dur = e.duration / tpus;
+
+	fprintf(capture_file, ",\n{\"name\":");
+	write_json_string(capture_file, name);
+	fprintf(capture_file, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+		is_cycle ? "cycle" : "machine", (int)r->tid, ts, dur);
+
+	if(is_cycle && e.duration > deadline_ticks.load(std::memory_order_relaxed))
+		fprintf(capture_file,
+			",\n{\"name\":\"deadline miss\",\"cat\":\"cycle\",\"ph\":\"i\",\"s\":\"g\","
+			"\"pid\":1,\"tid\":%d,\"ts\":%.3f}", (int)r->tid, ts + dur);
+}
+
+void PerformanceTrace::Collector::drain(bool keep) {
+	Ring *all = rings.load(std::memory_order_acquire);
+	if(all == NULL) return;
+
+	for(int k = 0; k < PERFORMANCE_TRACE_MAX_THREADS; k++) {
+		Ring *r = &all[k];
+		int state = r->state.load(std::memory_order_acquire);
+		if(state == Ring::_free) continue;
+
+		uint32_t t = r->tail.load(std::memory_order_relaxed);
+		uint32_t h = r->head.load(std::memory_order_acquire);
+
+		for(; keep && t != h; t++) {
+			const Event &e = r->events[t & (PERFORMANCE_TRACE_RING_SIZE - 1)];
+			if(e.source < 0 || e.source >= PERFORMANCE_TRACE_MAX_SOURCES) continue;
+
+			Accumulator *a = &accumulators[e.source];
+			a->sum += e.duration;
+			if(e.duration > a->peak) a->peak = e.duration;
+			a->count++;
+
+			if(capture_file)
+				write_capture_event(r, e, sources[e.source].name.read().text);
+		}
+
+		r->tail.store(h, std::memory_order_release);
+
+		if(state == Ring::_abandoned) {
+			r->head.store(0, std::memory_order_relaxed);
+			r->tail.store(0, std::memory_order_relaxed);
+			r->state.store(Ring::_free, std::memory_order_release);
+		}
+	}
+}
+
+void PerformanceTrace::Collector::publish(Statistics &statistics) {
+	int cycles = accumulators[PERFORMANCE_TRACE_CYCLE_SOURCE].count;
+	if(cycles < 1) cycles = 1;
+
+	double deadline = deadline_ticks.load() / tpus;
+	statistics.buffer_duration = deadline;
+	statistics.cycles = accumulators[PERFORMANCE_TRACE_CYCLE_SOURCE].count;
+	statistics.deadline_misses = deadline_misses.load();
+	statistics.xruns = xruns.load();
+
+	Ring *all = rings.load();
+	for(int k = 0; all && k < PERFORMANCE_TRACE_MAX_THREADS; k++)
+		statistics.dropped_events += all[k].dropped.load(std::memory_order_relaxed);
+
+	for(int k = 0; k < PERFORMANCE_TRACE_MAX_SOURCES; k++) {
+		Accumulator *a = &accumulators[k];
+		if(a->count == 0 || !sources[k].used.load()) continue;
+
+		auto load = std::make_shared<SourceLoad>();
+		load->name = sources[k].name.read().text;
+		load->average = a->sum / tpus / cycles;
+		load->peak = a->peak / tpus;
+		load->load = deadline > 0.0 ? load->average / deadline : 0.0;
+
+		if(k == PERFORMANCE_TRACE_CYCLE_SOURCE)
+			statistics.cycle = *load;
+		else
+			statistics.sources.push_back(load);
+	}
+
+	memset(accumulators, 0, sizeof(accumulators));
+}
+
+void *PerformanceTrace::Collector::thread_entry(void *c) {
+	((Collector *)c)->thread_body();
+	return NULL;
+}
+
+void PerformanceTrace::Collector::thread_body() {
+	while(1) {
+		bool active;
+		{
+			std::lock_guard<std::mutex> lck(lock);
+			active = !listeners.empty() || capture_file != NULL;
+			if(!active && collecting.load()) {
+				collecting.store(false);
+				drain(false);
+			}
+		}
+
+		if(!active) {
+			// sleep until someone wants data
+			while(sem_wait(&wake_up) != 0 && errno == EINTR);
+			continue;
+		}
+
+		struct timespec t;
+		clock_gettime(CLOCK_REALTIME, &t);
+		t.tv_nsec += PERFORMANCE_TRACE_DRAIN_INTERVAL_MS * 1000000;
+		if(t.tv_nsec >= 1000000000) {
+			t.tv_sec++;
+			t.tv_nsec -= 1000000000;
+		}
+		(void)sem_timedwait(&wake_up, &t);
+
+		Statistics statistics;
+		std::vector<Listener> to_call;
+		{
+			std::lock_guard<std::mutex> lck(lock);
+			drain(true);
+
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			int64_t elapsed_ms =
+				(now.tv_sec - last_publish.tv_sec) * 1000 +
+				(now.tv_nsec - last_publish.tv_nsec) / 1000000;
+			if(elapsed_ms >= PERFORMANCE_TRACE_PUBLISH_INTERVAL_MS) {
+				last_publish = now;
+				publish(statistics);
+				for(auto &l : listeners) to_call.push_back(l.second);
+			}
+		}
+
+		for(auto &l : to_call) {
+			try {
+				l(statistics);
+			} catch(std::exception &e) {
+				SATAN_ERROR("PerformanceTrace listener threw an exception: %s\n", e.what());
+			} catch(...) {
+				SATAN_ERROR("PerformanceTrace listener threw an unknown exception.\n");
+			}
+		}
+	}
+}
+
+/*****************************
+ *
+ * Public interface
+ *
+ *****************************/
+
+int PerformanceTrace::add_listener(Listener listener) {
+	return Collector::get()->add_listener(listener);
+}
+
+void PerformanceTrace::remove_listener(int id) {
+	Collector::get()->remove_listener(id);
+}
+
+void PerformanceTrace::start_capture(const std::string &file_name) {
+	Collector::get()->start_capture(file_name);
+}
+
+void PerformanceTrace::stop_capture() {
+	Collector::get()->stop_capture();
+}
+
+bool PerformanceTrace::is_capturing() {
+	return Collector::get()->is_capturing();
+}
@@ -0,0 +1,168 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#ifndef __PERFORMANCE_TRACE
+#define __PERFORMANCE_TRACE
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// maximum number of trace sources (machines) alive at the same time
+#define PERFORMANCE_TRACE_MAX_SOURCES 256
+
+// maximum number of threads that can record events
+#define PERFORMANCE_TRACE_MAX_THREADS 16
+
+// events per thread ring, must be a power of two
+#define PERFORMANCE_TRACE_RING_SIZE 4096
+
+#define PERFORMANCE_TRACE_SOURCE_NAME_SIZE 64
+
+/*
+ * Low overhead instrumentation of the render cycle.
+ *
+ * Each machine is a trace source. Machine::execute() takes a timestamp
+ * from the cycle counter before and after rendering and records an event
+ * in a lock-free ring owned by the calling thread (the audio thread or a
+ * render chain worker). The full render cycle is recorded the same way
+ * under the source PERFORMANCE_TRACE_CYCLE_SOURCE. Recording never blocks,
+ * allocates or takes a lock - if a ring is full the event is dropped.
+ *
+ * Events are only recorded while someone is collecting them. A collector
+ * thread drains the rings, sums up the execution time per source for the
+ * listeners (the CPU meter) and optionally writes every event to a
+ * Chrome trace file - open it in chrome://tracing or ui.perfetto.dev.
+ *
+ * The deadline miss and xrun counters are always updated. A deadline
+ * miss is a render cycle that took longer than the duration of the
+ * buffer it produced. An xrun is estimated from the time between two
+ * cycles - if it is more than twice the buffer duration the output
+ * most probably ran dry. Audio drivers that know better can call
+ * report_xrun() themselves.
+ */
+#define PERFORMANCE_TRACE_CYCLE_SOURCE 0
+
+class PerformanceTrace {
+public:
+	class SourceLoad {
+	public:
+		static constexpr const char* serialize_identifier = "PerformanceTrace::SourceLoad";
+
+		std::string name;
+		double average; // microseconds per cycle
+		double peak; // microseconds, worst single cycle
+		double load; // average part of the buffer duration, 1.0 means the full deadline
+
+		SourceLoad() : average(0.0), peak(0.0), load(0.0) {}
+
+		template <class SerderClassT>
+		void serderize(SerderClassT& iserder) {
+			iserder.process(name);
+			iserder.process(average);
+			iserder.process(peak);
+			iserder.process(load);
+		}
+	};
+
+	class Statistics {
+	public:
+		std::vector<std::shared_ptr<SourceLoad> > sources; // the render cycle itself is not included
+		SourceLoad cycle; // the complete render cycle
+		double buffer_duration; // microseconds
+		int cycles; // render cycles since the previous update
+		int deadline_misses, xruns; // totals
+		int dropped_events; // total, events lost because a ring was full
+
+		Statistics();
+	};
+
+	// called from the collector thread
+	typedef std::function<void(const Statistics &statistics)> Listener;
+
+	/// Returns the source id, or -1 if the source table is full. Lock-free.
+	static int register_source(const std::string &name);
+	/// Lock-free, may be called from the audio thread.
+	static void set_source_name(int source, const std::string &name);
+	static void unregister_source(int source);
+
+	/// Read the cycle counter.
+	static inline uint64_t timestamp() {
+#if defined(__aarch64__)
+		uint64_t v;
+		asm volatile("mrs %0, cntvct_el0" : "=r" (v));
+		return v;
+#elif defined(__i386__) || defined(__x86_64__)
+		return __rdtsc();
+#else
+		struct timespec t;
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+#endif
+	}
+	static double ticks_per_microsecond();
+
+	/// Realtime safe - record that source executed from start to stop.
+	static inline void record(int source, uint64_t start, uint64_t stop) {
+		if(source >= 0 && collecting.load(std::memory_order_relaxed))
+			record_event(source, start, stop);
+	}
+
+	/// Realtime safe - called by the sink after each render cycle.
+	static void cycle_completed(uint64_t start, uint64_t stop, int frames, int sample_rate);
+	/// Realtime safe - the output buffer ran dry.
+	static void report_xrun();
+	/// Realtime safe - cycles stopped for a while on purpose, the gap before the next one is not an xrun.
+	static void restart_cycle_timing();
+
+	static int get_deadline_misses();
+	static int get_xruns();
+
+	/// Listeners are called about four times per second while at least one is registered.
+	/// Returns an id to use with remove_listener().
+	static int add_listener(Listener listener);
+	static void remove_listener(int id);
+
+	/// Write all events to file_name in the Chrome trace event format until stop_capture().
+	/// Throws jException if the file could not be created.
+	static void start_capture(const std::string &file_name);
+	static void stop_capture();
+	static bool is_capturing();
+
+private:
+	class Ring;
+	class RingOwnership;
+	class Collector;
+
+	static std::atomic<bool> collecting;
+	static std::atomic<Ring *> rings;
+
+	static void record_event(int source, uint64_t start, uint64_t stop);
+};
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "premix_kernels.hh"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define __PREMIX_USE_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define __PREMIX_USE_SSE2
+#endif
+
+void premix_add_fl32(float *dst, const float *src, int count) {
+	int i = 0;
+#if defined(__PREMIX_USE_NEON)
+	for(; i + 8 <= count; i += 8) {
+		float32x4_t a0 = vld1q_f32(&dst[i]);
+		float32x4_t a1 = vld1q_f32(&dst[i + 4]);
+		float32x4_t b0 = vld1q_f32(&src[i]);
+		float32x4_t b1 = vld1q_f32(&src[i + 4]);
+		vst1q_f32(&dst[i], vaddq_f32(a0, b0));
+		vst1q_f32(&dst[i + 4], vaddq_f32(a1, b1));
+	}
+#elif defined(__PREMIX_USE_SSE2)
+	for(; i + 8 <= count; i += 8) {
+		__m128 a0 = _mm_loadu_ps(&dst[i]);
+		__m128 a1 = _mm_loadu_ps(&dst[i + 4]);
+		__m128 b0 = _mm_loadu_ps(&src[i]);
+		__m128 b1 = _mm_loadu_ps(&src[i + 4]);
+		_mm_storeu_ps(&dst[i], _mm_add_ps(a0, b0));
+		_mm_storeu_ps(&dst[i + 4], _mm_add_ps(a1, b1));
+	}
+#endif
+	for(; i < count; i++)
+		dst[i] += src[i];
+}
+
+void premix_add_fx8p24(int32_t *dst, const int32_t *src, int count) {
+	int i = 0;
+#if defined(__PREMIX_USE_NEON)
+	for(; i + 8 <= count; i += 8) {
+		int32x4_t a0 = vld1q_s32(&dst[i]);
+		int32x4_t a1 = vld1q_s32(&dst[i + 4]);
+		int32x4_t b0 = vld1q_s32(&src[i]);
+		int32x4_t b1 = vld1q_s32(&src[i + 4]);
+		vst1q_s32(&dst[i], vaddq_s32(a0, b0));
+		vst1q_s32(&dst[i + 4], vaddq_s32(a1, b1));
+	}
+#elif defined(__PREMIX_USE_SSE2)
+	for(; i + 8 <= count; i += 8) {
+		__m128i a0 = _mm_loadu_si128((const __m128i *)&dst[i]);
+		__m128i a1 = _mm_loadu_si128((const __m128i *)&dst[i + 4]);
+		__m128i b0 = _mm_loadu_si128((const __m128i *)&src[i]);
+		__m128i b1 = _mm_loadu_si128((const __m128i *)&src[i + 4]);
+		_mm_storeu_si128((__m128i *)&dst[i], _mm_add_epi32(a0, b0));
+		_mm_storeu_si128((__m128i *)&dst[i + 4], _mm_add_epi32(a1, b1));
+	}
+#endif
+	for(; i < count; i++)
+		dst[i] += src[i];
+}
+
+void premix_add_mono_to_stereo_fl32(float *dst, const float *src, int frames) {
+	int i = 0;
+#if defined(__PREMIX_USE_NEON)
+	for(; i + 4 <= frames; i += 4) {
+		float32x4_t m = vld1q_f32(&src[i]);
+		float32x4x2_t d = vld2q_f32(&dst[i * 2]);
+		d.val[0] = vaddq_f32(d.val[0], m);
+		d.val[1] = vaddq_f32(d.val[1], m);
+		vst2q_f32(&dst[i * 2], d);
+	}
+#elif defined(__PREMIX_USE_SSE2)
+	for(; i + 4 <= frames; i += 4) {
+		__m128 m = _mm_loadu_ps(&src[i]);
+		__m128 d0 = _mm_loadu_ps(&dst[i * 2]);
+		__m128 d1 = _mm_loadu_ps(&dst[i * 2 + 4]);
+		_mm_storeu_ps(&dst[i * 2], _mm_add_ps(d0, _mm_unpacklo_ps(m, m)));
+		_mm_storeu_ps(&dst[i * 2 + 4], _mm_add_ps(d1, _mm_unpackhi_ps(m, m)));
+	}
+#endif
+	for(; i < frames; i++) {
+		dst[i * 2] += src[i];
+		dst[i * 2 + 1] += src[i];
+	}
+}
+
+void premix_add_mono_to_stereo_fx8p24(int32_t *dst, const int32_t *src, int frames) {
+	int i = 0;
+#if defined(__PREMIX_USE_NEON)
+	for(; i + 4 <= frames; i += 4) {
+		int32x4_t m = vld1q_s32(&src[i]);
+		int32x4x2_t d = vld2q_s32(&dst[i * 2]);
+		d.val[0] = vaddq_s32(d.val[0], m);
+		d.val[1] = vaddq_s32(d.val[1], m);
+		vst2q_s32(&dst[i * 2], d);
+	}
+#elif defined(__PREMIX_USE_SSE2)
+	for(; i + 4 <= frames; i += 4) {
+		__m128i m = _mm_loadu_si128((const __m128i *)&src[i]);
+		__m128i d0 = _mm_loadu_si128((const __m128i *)&dst[i * 2]);
+		__m128i d1 = _mm_loadu_si128((const __m128i *)&dst[i * 2 + 4]);
+		_mm_storeu_si128((__m128i *)&dst[i * 2], _mm_add_epi32(d0, _mm_unpacklo_epi32(m, m)));
+		_mm_storeu_si128((__m128i *)&dst[i * 2 + 4], _mm_add_epi32(d1, _mm_unpackhi_epi32(m, m)));
+	}
+#endif
+	for(; i < frames; i++) {
+		dst[i * 2] += src[i];
+		dst[i * 2 + 1] += src[i];
+	}
+}
+
+void premix_add_strided_fl32(float *dst, int dst_stride, const float *src, int src_stride, int frames) {
+	for(int i = 0; i < frames; i++)
+		dst[i * dst_stride] += src[i * src_stride];
+}
+
+void premix_add_strided_fx8p24(int32_t *dst, int dst_stride, const int32_t *src, int src_stride, int frames) {
+	for(int i = 0; i < frames; i++)
+		dst[i * dst_stride] += src[i * src_stride];
+}
@@ -0,0 +1,47 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __PREMIX_KERNELS
+#define __PREMIX_KERNELS
+
+#include <stdint.h>
+
+/*
+ * Summing kernels used by Machine::execute() when premixing inputs.
+ *
+ * On armeabi-v7a (-mfpu=neon) the NEON versions are used, on x86 the SSE2
+ * versions - otherwise a plain C fallback. _fx8p24bit samples are added
+ * as 32 bit integers, just like the old generic premix did.
+ *
+ * "frames" is the number of samples per channel.
+ */
+
+// dst[i] += src[i], for i < count
+void premix_add_fl32(float *dst, const float *src, int count);
+void premix_add_fx8p24(int32_t *dst, const int32_t *src, int count);
+
+// dst is stereo, src is mono - src is added to both channels
+void premix_add_mono_to_stereo_fl32(float *dst, const float *src, int frames);
+void premix_add_mono_to_stereo_fx8p24(int32_t *dst, const int32_t *src, int frames);
+
+// generic channel mapping, dst[i * dst_stride] += src[i * src_stride]
+void premix_add_strided_fl32(float *dst, int dst_stride, const float *src, int src_stride, int frames);
+void premix_add_strided_fx8p24(int32_t *dst, int dst_stride, const int32_t *src, int src_stride, int frames);
+
+#endif
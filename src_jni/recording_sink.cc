@@ -0,0 +1,537 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <mutex>
+
+#include <jngldrum/jexception.hh>
+
+#include "recording_sink.hh"
+#include "vorbis_encoder.hh"
+
+//#define __DO_SATAN_DEBUG
+#include "satan_debug.hh"
+
+// must be a power of two
+#define RECORDING_SINK_COMMAND_QUEUE_SIZE 16
+
+#define RECORDING_SINK_NAME_LENGTH 1024
+
+// how often the encoder thread wakes up by itself, in milliseconds
+#define RECORDING_SINK_IDLE_TIMEOUT 100
+
+// the audio thread wakes the encoder when this many frames are waiting
+#define RECORDING_SINK_WAKE_UP_FRAMES 4096
+
+#define RECORDING_SINK_RING_SAMPLES (RECORDING_SINK_RING_FRAMES * RECORDING_SINK_MAX_CHANNELS)
+
+#ifdef __SATAN_USES_FLOATS
+static std::atomic<int> formats(RecordingSink::_wave | RecordingSink::_vorbis);
+#else
+// Vorbis encoding is too heavy to keep up on fixed point devices
+static std::atomic<int> formats(RecordingSink::_wave);
+#endif
+
+static std::atomic<int64_t> stat_written(0), stat_dropped(0), stat_encoded(0);
+static std::atomic<int64_t> stat_recordings(0), stat_failures(0);
+static std::atomic<int> stat_max_fill(0);
+
+/*****************************
+ *
+ * The encoder thread
+ *
+ *****************************/
+
+class RecordingSink::EncoderThread {
+public:
+	static EncoderThread *get();
+	static std::atomic<EncoderThread *> instance;
+
+	// the following are only called from the audio thread
+	bool open(const char *base_name, int rate, int channels);
+	void write(const int16_t *data, int frames);
+	void close();
+
+	void set_tags(const std::string &title, const std::string &artist, const std::string &genre);
+	void wait_until_idle();
+	int get_fill();
+
+private:
+	class Command {
+	public:
+		enum Type {
+			_open, _close
+		};
+
+		Type type;
+		uint64_t position; // ring position, in samples, where the command takes effect
+		int rate, channels, formats;
+		char base_name[RECORDING_SINK_NAME_LENGTH];
+	};
+
+	// single producer (the audio thread), single consumer (the encoder thread)
+	Command commands[RECORDING_SINK_COMMAND_QUEUE_SIZE];
+	std::atomic<unsigned int> command_head, command_tail;
+
+	int16_t *ring;
+	std::atomic<uint64_t> write_position, read_position; // in samples
+
+	// number of close commands pushed and executed, for wait_until_idle()
+	std::atomic<unsigned int> closes_pushed, closes_done;
+
+	sem_t wake_up;
+	pthread_t thread;
+
+	// only used by the audio thread
+	bool recording;
+	std::atomic<int> recording_channels; // read by get_fill()
+
+	std::mutex tags_lock;
+	std::string title, artist, genre;
+
+	// only used by the encoder thread
+	bool session_open, session_failed;
+	int session_channels, session_rate;
+	FILE *wave_file, *vorbis_file;
+	uint32_t wave_bytes;
+	VorbisEncoder vorbis;
+
+	EncoderThread();
+
+	bool push(Command::Type type, const char *base_name, int rate, int channels);
+
+	void encode(uint64_t limit);
+	void encode_frames(const int16_t *data, int frames);
+	void start_session(const Command *c);
+	void finish_session();
+
+	static void *thread_entry(void *et);
+	void thread_body();
+};
+
+std::atomic<RecordingSink::EncoderThread *> RecordingSink::EncoderThread::instance(NULL);
+
+RecordingSink::EncoderThread *RecordingSink::EncoderThread::get() {
+	static std::mutex creation_lock;
+	std::lock_guard<std::mutex> lock(creation_lock);
+
+	if(instance.load() == NULL)
+		instance.store(new EncoderThread());
+	return instance.load();
+}
+
+RecordingSink::EncoderThread::EncoderThread()
+	: command_head(0), command_tail(0), ring(NULL)
+	, write_position(0), read_position(0), closes_pushed(0), closes_done(0)
+	, recording(false), recording_channels(0)
+	, session_open(false), session_failed(false), session_channels(0), session_rate(0)
+	, wave_file(NULL), vorbis_file(NULL), wave_bytes(0)
+{
+	ring = (int16_t *)calloc(RECORDING_SINK_RING_SAMPLES, sizeof(int16_t));
+	if(ring == NULL)
+		throw jException("Failed to allocate recording sink ring.", jException::syscall_error);
+
+	sem_init(&wake_up, 0, 0);
+
+	if(pthread_create(&thread, NULL, thread_entry, this) != 0) {
+		sem_destroy(&wake_up);
+		free(ring);
+		throw jException("Failed to create recording sink encoder thread.",
+				 jException::syscall_error);
+	}
+}
+
+bool RecordingSink::EncoderThread::push(Command::Type type, const char *base_name, int rate, int channels) {
+	unsigned int head = command_head.load(std::memory_order_relaxed);
+	if(head - command_tail.load(std::memory_order_acquire) >= RECORDING_SINK_COMMAND_QUEUE_SIZE)
+		return false;
+
+	Command *c = &commands[head & (RECORDING_SINK_COMMAND_QUEUE_SIZE - 1)];
+	c->type = type;
+	c->position = write_position.load(std::memory_order_relaxed);
+	c->rate = rate;
+	c->channels = channels;
+	c->formats = formats.load();
+	c->base_name[0] = '\0';
+	if(base_name != NULL) {
+		strncpy(c->base_name, base_name, RECORDING_SINK_NAME_LENGTH - 1);
+		c->base_name[RECORDING_SINK_NAME_LENGTH - 1] = '\0';
+	}
+
+	command_head.store(head + 1, std::memory_order_release);
+	sem_post(&wake_up);
+	return true;
+}
+
+bool RecordingSink::EncoderThread::open(const char *base_name, int rate, int channels) {
+	if(channels < 1 || channels > RECORDING_SINK_MAX_CHANNELS || rate <= 0)
+		return false;
+	if(strlen(base_name) >= RECORDING_SINK_NAME_LENGTH)
+		return false;
+	if(formats.load() == 0)
+		return false;
+
+	if(recording) close();
+
+	// the matching close must always fit in the queue
+	unsigned int used = command_head.load(std::memory_order_relaxed) -
+		command_tail.load(std::memory_order_acquire);
+	if(used + 2 > RECORDING_SINK_COMMAND_QUEUE_SIZE)
+		return false;
+
+	// start on a frame boundary, a mono recording can leave the write position
+	// on an odd sample - the samples skipped are not part of any recording
+	uint64_t w = write_position.load(std::memory_order_relaxed);
+	uint64_t aligned = ((w + channels - 1) / channels) * channels;
+	if(aligned - read_position.load(std::memory_order_acquire) > RECORDING_SINK_RING_SAMPLES)
+		return false;
+	write_position.store(aligned, std::memory_order_release);
+
+	if(!push(Command::_open, base_name, rate, channels))
+		return false;
+
+	recording = true;
+	recording_channels = channels;
+	return true;
+}
+
+void RecordingSink::EncoderThread::write(const int16_t *data, int frames) {
+	if(!recording || frames <= 0) return;
+
+	uint64_t samples = (uint64_t)frames * recording_channels;
+	uint64_t w = write_position.load(std::memory_order_relaxed);
+	uint64_t r = read_position.load(std::memory_order_acquire);
+
+	if(w - r + samples > RECORDING_SINK_RING_SAMPLES) {
+		stat_dropped.fetch_add(frames, std::memory_order_relaxed);
+		sem_post(&wake_up);
+		return;
+	}
+
+	// open() aligns the write position to the channel count, and the ring size
+	// is a multiple of every channel count, so a frame never wraps
+	unsigned int offset = (unsigned int)(w % RECORDING_SINK_RING_SAMPLES);
+	uint64_t first = RECORDING_SINK_RING_SAMPLES - offset;
+	if(first > samples) first = samples;
+	memcpy(&ring[offset], data, first * sizeof(int16_t));
+	if(first < samples)
+		memcpy(ring, &data[first], (samples - first) * sizeof(int16_t));
+
+	write_position.store(w + samples, std::memory_order_release);
+	stat_written.fetch_add(frames, std::memory_order_relaxed);
+
+	int fill = (int)((w + samples - r) / recording_channels);
+	if(fill > stat_max_fill.load(std::memory_order_relaxed))
+		stat_max_fill.store(fill, std::memory_order_relaxed);
+
+	// don't wake the encoder for every buffer
+	int before = (int)((w - r) / recording_channels);
+	if(before / RECORDING_SINK_WAKE_UP_FRAMES != fill / RECORDING_SINK_WAKE_UP_FRAMES)
+		sem_post(&wake_up);
+}
+
+void RecordingSink::EncoderThread::close() {
+	if(!recording) return;
+	recording = false;
+
+	closes_pushed++;
+	// open() made sure there is room
+	(void)push(Command::_close, NULL, 0, 0);
+}
+
+void RecordingSink::EncoderThread::set_tags(const std::string &_title,
+					    const std::string &_artist,
+					    const std::string &_genre) {
+	std::lock_guard<std::mutex> lock(tags_lock);
+	title = _title;
+	artist = _artist;
+	genre = _genre;
+}
+
+void RecordingSink::EncoderThread::wait_until_idle() {
+	while(closes_done.load() != closes_pushed.load()) {
+		sem_post(&wake_up);
+		usleep(10000);
+	}
+}
+
+int RecordingSink::EncoderThread::get_fill() {
+	uint64_t w = write_position.load(), r = read_position.load();
+	int ch = recording_channels.load();
+	return ch > 0 ? (int)((w - r) / ch) : 0;
+}
+
+void RecordingSink::EncoderThread::start_session(const Command *c) {
+	std::string base = c->base_name;
+
+	session_open = true;
+	session_failed = false;
+	session_channels = c->channels;
+	session_rate = c->rate;
+	wave_bytes = 0;
+
+	if(c->formats & _wave) {
+		std::string path = base + ".wav";
+		wave_file = fopen(path.c_str(), "wb");
+		if(wave_file == NULL || !write_wave_header(wave_file, session_channels, session_rate, 0)) {
+			SATAN_ERROR("RecordingSink - failed to create %s\n", path.c_str());
+			if(wave_file) fclose(wave_file);
+			wave_file = NULL;
+			session_failed = true;
+		}
+	}
+
+	if(c->formats & _vorbis) {
+		std::string path = base + ".ogg";
+		std::string t, a, g;
+		{
+			std::lock_guard<std::mutex> lock(tags_lock);
+			t = title; a = artist; g = genre;
+		}
+		vorbis_file = fopen(path.c_str(), "wb");
+		if(vorbis_file == NULL ||
+		   vorbis.open(vorbis_file, session_channels, session_rate, t, a, g) != 0) {
+			SATAN_ERROR("RecordingSink - failed to create %s\n", path.c_str());
+			if(vorbis_file) fclose(vorbis_file);
+			vorbis_file = NULL;
+			session_failed = true;
+		}
+	}
+}
+
+void RecordingSink::EncoderThread::encode_frames(const int16_t *data, int frames) {
+	if(wave_file) {
+		size_t samples = (size_t)frames * session_channels;
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+		bool ok = fwrite(data, sizeof(int16_t), samples, wave_file) == samples;
+#else
+		bool ok = true;
+		for(size_t k = 0; ok && k < samples; k++) {
+			uint8_t le[2] = {(uint8_t)(data[k] & 0xff), (uint8_t)((data[k] >> 8) & 0xff)};
+			ok = fwrite(le, 1, 2, wave_file) == 2;
+		}
+#endif
+		if(ok) {
+			wave_bytes += samples * sizeof(int16_t);
+		} else {
+			SATAN_ERROR("RecordingSink - failed to write wave data.\n");
+			fclose(wave_file);
+			wave_file = NULL;
+			session_failed = true;
+		}
+	}
+
+	if(vorbis_file) {
+		if(vorbis.write(data, frames) != 0) {
+			SATAN_ERROR("RecordingSink - failed to write vorbis data.\n");
+			vorbis.finish();
+			fclose(vorbis_file);
+			vorbis_file = NULL;
+			session_failed = true;
+		}
+	}
+
+	stat_encoded.fetch_add(frames, std::memory_order_relaxed);
+}
+
+void RecordingSink::EncoderThread::finish_session() {
+	if(wave_file) {
+		if(!write_wave_header(wave_file, session_channels, session_rate, wave_bytes))
+			session_failed = true;
+		if(fclose(wave_file) != 0)
+			session_failed = true;
+		wave_file = NULL;
+	}
+
+	if(vorbis_file) {
+		if(vorbis.finish() != 0)
+			session_failed = true;
+		if(fclose(vorbis_file) != 0)
+			session_failed = true;
+		vorbis_file = NULL;
+	}
+
+	if(session_failed)
+		stat_failures++;
+	else
+		stat_recordings++;
+
+	session_open = false;
+}
+
+// encode everything in the ring up to limit
+void RecordingSink::EncoderThread::encode(uint64_t limit) {
+	uint64_t r = read_position.load(std::memory_order_relaxed);
+
+	while(r < limit) {
+		unsigned int offset = (unsigned int)(r % RECORDING_SINK_RING_SAMPLES);
+		uint64_t samples = limit - r;
+		if(samples > RECORDING_SINK_RING_SAMPLES - offset)
+			samples = RECORDING_SINK_RING_SAMPLES - offset;
+
+		// samples written outside a session are skipped
+		if(session_open)
+			encode_frames(&ring[offset], (int)(samples / session_channels));
+
+		r += samples;
+		read_position.store(r, std::memory_order_release);
+	}
+}
+
+void *RecordingSink::EncoderThread::thread_entry(void *et) {
+	((EncoderThread *)et)->thread_body();
+	return NULL;
+}
+
+void RecordingSink::EncoderThread::thread_body() {
+	while(1) {
+		struct timespec timeout;
+		clock_gettime(CLOCK_REALTIME, &timeout);
+		timeout.tv_nsec += RECORDING_SINK_IDLE_TIMEOUT * 1000000;
+		if(timeout.tv_nsec >= 1000000000) {
+			timeout.tv_sec++;
+			timeout.tv_nsec -= 1000000000;
+		}
+		while(sem_timedwait(&wake_up, &timeout) != 0 && errno == EINTR);
+
+		// commands take effect at the ring position they were pushed at
+		while(1) {
+			unsigned int tail = command_tail.load(std::memory_order_relaxed);
+			if(tail == command_head.load(std::memory_order_acquire)) {
+				encode(write_position.load(std::memory_order_acquire));
+				break;
+			}
+
+			Command *c = &commands[tail & (RECORDING_SINK_COMMAND_QUEUE_SIZE - 1)];
+			encode(c->position);
+
+			if(c->type == Command::_open) {
+				if(session_open) finish_session();
+				start_session(c);
+			} else {
+				if(session_open) finish_session();
+				closes_done++;
+			}
+
+			command_tail.store(tail + 1, std::memory_order_release);
+		}
+	}
+}
+
+/*****************************
+ *
+ * Public interface
+ *
+ *****************************/
+
+void RecordingSink::set_formats(int _formats) {
+	(void)EncoderThread::get();
+	formats = _formats & (_wave | _vorbis);
+}
+
+int RecordingSink::get_formats() {
+	return formats;
+}
+
+void RecordingSink::set_tags(const std::string &title,
+			     const std::string &artist,
+			     const std::string &genre) {
+	EncoderThread::get()->set_tags(title, artist, genre);
+}
+
+bool RecordingSink::open(const char *base_name, int rate, int channels) {
+	// the audio thread may not create the encoder thread, if nobody
+	// else has done it the sink machine falls back to its own writer
+	EncoderThread *et = EncoderThread::instance.load();
+	return et != NULL && et->open(base_name, rate, channels);
+}
+
+void RecordingSink::write(const int16_t *data, int frames) {
+	EncoderThread *et = EncoderThread::instance.load();
+	if(et) et->write(data, frames);
+}
+
+void RecordingSink::close() {
+	EncoderThread *et = EncoderThread::instance.load();
+	if(et) et->close();
+}
+
+void RecordingSink::wait_until_idle() {
+	EncoderThread *et = EncoderThread::instance.load();
+	if(et) et->wait_until_idle();
+}
+
+bool RecordingSink::write_wave_header(FILE *f, int channels, int rate, uint32_t data_bytes) {
+	uint8_t h[44];
+	uint32_t byte_rate = rate * channels * 2;
+
+	auto put32 = [&h](int k, uint32_t v) {
+		h[k + 0] = v & 0xff; h[k + 1] = (v >> 8) & 0xff;
+		h[k + 2] = (v >> 16) & 0xff; h[k + 3] = (v >> 24) & 0xff;
+	};
+	auto put16 = [&h](int k, uint32_t v) {
+		h[k + 0] = v & 0xff; h[k + 1] = (v >> 8) & 0xff;
+	};
+
+	memcpy(&h[0], "RIFF", 4); put32(4, 36 + data_bytes);
+	memcpy(&h[8], "WAVE", 4);
+	memcpy(&h[12], "fmt ", 4); put32(16, 16);
+	put16(20, 1); // PCM
+	put16(22, channels);
+	put32(24, rate);
+	put32(28, byte_rate);
+	put16(32, channels * 2);
+	put16(34, 16);
+	memcpy(&h[36], "data", 4); put32(40, data_bytes);
+
+	return fseek(f, 0, SEEK_SET) == 0 && fwrite(h, 1, 44, f) == 44;
+}
+
+RecordingSink::Statistics RecordingSink::get_statistics() {
+	Statistics s;
+	EncoderThread *et = EncoderThread::instance.load();
+
+	s.frames_written = stat_written;
+	s.frames_dropped = stat_dropped;
+	s.frames_encoded = stat_encoded;
+	s.recordings = stat_recordings;
+	s.failures = stat_failures;
+	s.ring_frames = RECORDING_SINK_RING_FRAMES;
+	s.ring_fill = et ? et->get_fill() : 0;
+	s.ring_max_fill = stat_max_fill;
+
+	return s;
+}
+
+void RecordingSink::clear_statistics() {
+	stat_written = 0;
+	stat_dropped = 0;
+	stat_encoded = 0;
+	stat_recordings = 0;
+	stat_failures = 0;
+	stat_max_fill = 0;
+}
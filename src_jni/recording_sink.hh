@@ -0,0 +1,98 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#ifndef __RECORDING_SINK
+#define __RECORDING_SINK
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+#include <stdio.h>
+
+// capacity of the ring between the audio thread and the encoder, in frames
+// (about three seconds of audio at 44100 samples / second)
+#define RECORDING_SINK_RING_FRAMES (1 << 17)
+#define RECORDING_SINK_MAX_CHANNELS 2
+
+/*
+ * The RecordingSink takes the final output from the sink machine while
+ * recording and writes it to disk on a background encoder thread - as
+ * Ogg/Vorbis, RIFF/WAVE or both - while playback continues. There is no
+ * need to transcode a recorded WAV file afterwards.
+ *
+ * open(), write() and close() are called from the audio thread, they are
+ * lock-free and never block or allocate memory. The frames are passed
+ * through a single producer, single consumer ring. If the encoder falls
+ * behind and the ring is full, write() drops the frames and counts them in
+ * the statistics rather than blocking the audio thread.
+ */
+class RecordingSink {
+public:
+	enum Format {
+		_wave = 1,
+		_vorbis = 2
+	};
+
+	class Statistics {
+	public:
+		int64_t frames_written; // frames accepted by write()
+		int64_t frames_dropped; // frames lost because the ring was full
+		int64_t frames_encoded; // frames written to file by the encoder thread
+		int64_t recordings; // completed recordings
+		int64_t failures; // recordings where a file could not be written
+		int ring_frames; // capacity of the ring
+		int ring_fill; // frames waiting in the ring right now
+		int ring_max_fill; // the highest ring fill level seen
+	};
+
+	// The formats used by the next recording. 0 disables the sink, then the sink
+	// machine writes a WAV file by itself. Not realtime safe.
+	static void set_formats(int formats);
+	static int get_formats();
+
+	// Comments for the next Vorbis stream. Not realtime safe.
+	static void set_tags(const std::string &title,
+			     const std::string &artist,
+			     const std::string &genre);
+
+	// Realtime safe. Starts a recording, the file extensions are added to base_name.
+	// Returns false if the sink is disabled, or the command could not be queued.
+	static bool open(const char *base_name, int rate, int channels);
+
+	// Realtime safe. data is interleaved, with the channels given to open().
+	static void write(const int16_t *data, int frames);
+
+	// Realtime safe. Ends the recording, the encoder finishes the files in the background.
+	static void close();
+
+	// Not realtime safe. Blocks until all recordings that are closed are written to disk.
+	static void wait_until_idle();
+
+	static Statistics get_statistics();
+	static void clear_statistics();
+
+	// Writes a 16 bit PCM RIFF/WAVE header at the start of f, returns false on failure.
+	static bool write_wave_header(FILE *f, int channels, int rate, uint32_t data_bytes);
+
+private:
+	class EncoderThread;
+};
+
+#endif
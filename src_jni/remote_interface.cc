@@ -33,6 +33,9 @@
 #include <string>
 #include <mutex>
 #include <condition_variable>
+#include <array>
+#include <string.h>
+#include <stdlib.h>
 
 #include "remote_interface.hh"
 #include "dynamic_machine.hh"
@@ -50,9 +53,123 @@
  *
  ***************************/
 
-RemoteInterface::Message::Message() : context(), ostrm(&sbuf), data2send(0) {}
+/*
+ * Binary framing
+ *
+ * header: magic byte, format version, two reserved bytes and the
+ *         body length as a little endian 32 bit integer. A text header
+ *         is always eight hex digits, so the first byte tells them apart.
+ *
+ * body:   a sequence of fields, each field starts with a varint tag
+ *         where the two lowest bits give the value type and the rest
+ *         the interned key id. Key id zero means the key follows as a
+ *         length prefixed string.
+ *
+ * bulk:   same header but with its own magic byte. The body starts with
+ *         the varints total payload length, chunk offset and chunk length.
+ *         The first chunk continues with the payload key and the fields.
+ *         The raw chunk data follows the body, and is not included in
+ *         the body length of the header.
+ *
+ * Values are sent as zigzag varints if they are integers as produced by
+ * std::to_string(int), as 32 bit floats if they are exactly what
+ * std::to_string(float) produces and as length prefixed blobs otherwise,
+ * so the receiver always gets back the exact same string.
+ */
+
+#define BINARY_VALUE_BLOB 0
+#define BINARY_VALUE_INTEGER 1
+#define BINARY_VALUE_FLOAT 2
+#define BINARY_VALUE_EMPTY 3
+
+// NEVER reorder or remove entries, only append - the index
+// is part of the binary protocol (key id = index + 1)
+static const char *binary_key_table[] = {
+	"id", "command", "ignored", "name", "pattern_id", "value", "xpos", "ypos",
+	"commandid", "start_at", "stop_at", "loop_length", "velocity", "source",
+	"s_objid", "program", "on_at", "note", "lpb", "length", "index", "destination",
+	"ctrl_id", "channel", "bpm", "repid", "offset", "objid", "loopid", "keys", "key",
+	"response", "mctrls", "ctrgroups", "connections", "zp", "yp", "xp", "type",
+	"state", "sibling", "sequence_data", "scales", "scale", "recording", "record",
+	"pversion", "position", "playing", "path", "outputs", "octave", "nrscl",
+	"nrow", "nrloops", "new_objid", "midictrl", "lpbsync", "is_sink",
+	"is_recording", "is_playing", "inputs", "handles", "handle", "grname",
+	"fname", "fgr", "factory", "evt", "doquantize", "direction", "data",
+	"ctrlnames", "ctrlname", "ctrl", "content", "clid", "chordmode", "bpmsync",
+	"axis", "arppattern", "arp_patterns", "binary"
+};
+#define BINARY_KEY_TABLE_SIZE ((int)(sizeof(binary_key_table) / sizeof(binary_key_table[0])))
+
+static int binary_key_id(const std::string &key) {
+	static const std::unordered_map<std::string, int> key2id = [] {
+		std::unordered_map<std::string, int> k2i;
+		for(int k = 0; k < BINARY_KEY_TABLE_SIZE; k++)
+			k2i[binary_key_table[k]] = k + 1;
+		return k2i;
+	}();
+
+	auto i = key2id.find(key);
+	return i == key2id.end() ? 0 : i->second;
+}
+
+static inline void put_varint(std::vector<uint8_t> &out, uint64_t v) {
+	while(v >= 0x80) {
+		out.push_back((uint8_t)(v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	out.push_back((uint8_t)v);
+}
+
+static inline bool get_varint(const uint8_t *&p, const uint8_t *end, uint64_t &v) {
+	v = 0;
+	for(int shift = 0; shift < 64; shift += 7) {
+		if(p >= end) return false;
+		uint8_t b = *p++;
+		v |= ((uint64_t)(b & 0x7f)) << shift;
+		if(!(b & 0x80)) return true;
+	}
+	return false;
+}
+
+static inline void put_blob(std::vector<uint8_t> &out, const std::string &s) {
+	put_varint(out, s.size());
+	out.insert(out.end(), s.begin(), s.end());
+}
+
+static inline bool get_blob(const uint8_t *&p, const uint8_t *end, std::string &s) {
+	uint64_t l;
+	if(!get_varint(p, end, l) || l > (uint64_t)(end - p)) return false;
+	s.assign((const char *)p, (size_t)l);
+	p += l;
+	return true;
+}
+
+// true if s is exactly what std::to_string() would produce for v
+static bool is_canonical_integer(const std::string &s, int64_t &v) {
+	size_t k = 0, l = s.size();
+	if(l > 0 && s[0] == '-') k = 1;
+	if(l == k || l - k > 18) return false;
+	if(s[k] == '0' && (l - k > 1 || k == 1)) return false;
+	for(size_t i = k; i < l; i++)
+		if(s[i] < '0' || s[i] > '9') return false;
+	v = strtoll(s.c_str(), NULL, 10);
+	return true;
+}
+
+// true if s is exactly what std::to_string() would produce for f
+static bool is_canonical_float(const std::string &s, float &f) {
+	if(s.size() > 24 || s.find('.') == std::string::npos) return false;
+	char *e;
+	f = strtof(s.c_str(), &e);
+	if(*e != '\0') return false;
+	char b[64];
+	int n = snprintf(b, sizeof(b), "%f", f);
+	return n == (int)s.size() && memcmp(b, s.data(), n) == 0;
+}
+
+RemoteInterface::Message::Message() : context(), ostrm(&sbuf) {}
 
-RemoteInterface::Message::Message(RemoteInterface::Context *_context) : context(_context), ostrm(&sbuf), data2send(0) {}
+RemoteInterface::Message::Message(RemoteInterface::Context *_context) : context(_context), ostrm(&sbuf) {}
 
 void RemoteInterface::Message::set_reply_handler(std::function<void(const Message *reply_msg)> __reply_received_callback) {
 	reply_received_callback = __reply_received_callback;
@@ -67,31 +184,85 @@ bool RemoteInterface::Message::is_awaiting_reply() {
 	return awaiting_reply;
 }
 
+int RemoteInterface::Message::find_entry(const std::string &key) const {
+	for(size_t k = 0; k < key2val_count; k++)
+		if(key2val[k].key == key) return (int)k;
+	return -1;
+}
+
+RemoteInterface::Message::KeyValue &RemoteInterface::Message::append_entry() {
+	if(key2val_count == key2val.size())
+		key2val.emplace_back();
+	return key2val[key2val_count++];
+}
+
 void RemoteInterface::Message::set_value(const std::string &key, const std::string &value) {
 	if(key.find(';') != std::string::npos) throw IllegalChar();
 	if(key.find('=') != std::string::npos) throw IllegalChar();
 	if(value.find(';') != std::string::npos) throw IllegalChar();
 	if(value.find('=') != std::string::npos) throw IllegalChar();
 
-	auto enc_key = Serialize::encode_string(key);
-	auto enc_val = Serialize::encode_string(value);
-
-	key2val[enc_key] = enc_val;
-
-	data2send += enc_key.size() + enc_val.size() + 2; // +2 for the '=' and ';' that encode will add later
+	int k = find_entry(key);
+	if(k >= 0) {
+		key2val[k].value = value;
+	} else {
+		KeyValue &kv = append_entry();
+		kv.key = key;
+		kv.value = value;
+	}
 
 	encoded = false;
+	binary_encoded = false;
 }
 
 std::string RemoteInterface::Message::get_value(const std::string &key) const {
-	auto result = key2val.find(key);
-	if(result == key2val.end()) {
-		for(auto k2v : key2val) {
-			SATAN_DEBUG("[%s] does not match [%s] -> %s.\n", key.c_str(), k2v.first.c_str(), k2v.second.c_str());
+	int k = find_entry(key);
+	if(k < 0) {
+		for(size_t i = 0; i < key2val_count; i++) {
+			SATAN_DEBUG("[%s] does not match [%s] -> %s.\n", key.c_str(),
+				    key2val[i].key.c_str(), key2val[i].value.c_str());
 		}
 		throw NoSuchKey(key.c_str());
 	}
-	return result->second;
+	return key2val[k].value;
+}
+
+bool RemoteInterface::Message::has_value(const std::string &key) const {
+	return find_entry(key) >= 0;
+}
+
+void RemoteInterface::Message::set_payload(const std::string &key, std::vector<char> &&data) {
+	// the receiver would refuse it
+	if(data.size() > VUKNOB_BULK_MAX_PAYLOAD) throw MessageTooLarge();
+
+	payload_key = key;
+	payload = std::move(data);
+
+	encoded = false;
+	binary_encoded = false;
+}
+
+bool RemoteInterface::Message::get_payload(const std::string &key, const char *&data, size_t &length) const {
+	if(payload_key != key) {
+		// sent by a peer without bulk frame support, decode the value
+		int k = find_entry(key);
+		if(k < 0) return false;
+
+		const std::string &encoded_value = key2val[k].value;
+		size_t l = encoded_value == "<empty>" ? 0 : (encoded_value.size() >> 1);
+		payload.resize(l);
+		for(size_t i = 0; i < l; i++) {
+			payload[i] =
+				((encoded_value[(i << 1) + 0] - 'a') << 4)
+				|
+				((encoded_value[(i << 1) + 1] - 'a') << 0);
+		}
+		payload_key = key;
+	}
+
+	data = payload.data();
+	length = payload.size();
+	return true;
 }
 
 asio::streambuf::mutable_buffers_type RemoteInterface::Message::prepare_buffer(std::size_t length) {
@@ -104,35 +275,73 @@ void RemoteInterface::Message::commit_data(std::size_t length) {
 }
 
 asio::streambuf::const_buffers_type RemoteInterface::Message::get_data() {
+	encode();
 	return sbuf.data();
 }
 
+asio::const_buffers_1 RemoteInterface::Message::get_binary_data() {
+	encode_binary();
+	return asio::const_buffers_1((const void *)binary_data.data(), binary_data.size());
+}
+
+asio::const_buffers_1 RemoteInterface::Message::get_payload_data(size_t offset, size_t length) const {
+	return asio::const_buffers_1((const void *)(payload.data() + offset), length);
+}
+
 void RemoteInterface::Message::recycle() {
-	sbuf.consume(data2send);
+	sbuf.consume(sbuf.size());
+	binary_data.clear();
 	clear_msg_content();
 }
 
 bool RemoteInterface::Message::decode_client_id() {
-	std::istream is(&sbuf);
-	std::string header;
-	is >> header;
-	sscanf(header.c_str(), "%08x", &client_id);
+	if(sbuf.size() < header_length) return false;
 
-	return true;
+	char header[header_length + 1];
+	memcpy(header, asio::buffer_cast<const char *>(sbuf.data()), header_length);
+	header[header_length] = '\0';
+	sbuf.consume(header_length);
+
+	return sscanf(header, "%08x", &client_id) == 1;
 }
 
 bool RemoteInterface::Message::decode_header() {
-	std::istream is(&sbuf);
-	std::string header;
-	is >> header;
-	sscanf(header.c_str(), "%08x", &body_length);
+	if(sbuf.size() < header_length) return false;
 
-	SATAN_DEBUG("decode_header()-> [%s]\n", header.c_str());
+	const uint8_t *h = asio::buffer_cast<const uint8_t *>(sbuf.data());
 
-	return true;
+	if(h[0] == VUKNOB_BINARY_FRAME_MAGIC || h[0] == VUKNOB_BULK_FRAME_MAGIC) {
+		if(h[1] > VUKNOB_FRAME_VERSION) return false;
+
+		binary_body = true;
+		bulk_frame = h[0] == VUKNOB_BULK_FRAME_MAGIC;
+		body_length =
+			((uint32_t)h[4]) |
+			((uint32_t)h[5] << 8) |
+			((uint32_t)h[6] << 16) |
+			((uint32_t)h[7] << 24);
+		sbuf.consume(header_length);
+
+		return true;
+	}
+
+	char header[header_length + 1];
+	memcpy(header, h, header_length);
+	header[header_length] = '\0';
+	sbuf.consume(header_length);
+
+	SATAN_DEBUG("decode_header()-> [%s]\n", header);
+
+	binary_body = false;
+	bulk_frame = false;
+	return sscanf(header, "%08x", &body_length) == 1;
 }
 
 bool RemoteInterface::Message::decode_body() {
+	return binary_body ? decode_binary_body() : decode_text_body();
+}
+
+bool RemoteInterface::Message::decode_text_body() {
 	std::istream is(&sbuf);
 
 	std::string key, val;
@@ -144,7 +353,9 @@ bool RemoteInterface::Message::decode_body() {
 		std::getline(is, val, ';');
 		SATAN_DEBUG("     -> val: %s\n", val.c_str());
 		if(key != "") {
-			key2val[Serialize::decode_string(key)] = Serialize::decode_string(val);
+			KeyValue &kv = append_entry();
+			kv.key = Serialize::decode_string(key);
+			kv.value = Serialize::decode_string(val);
 		}
 		std::getline(is, key, '=');
 	}
@@ -152,37 +363,257 @@ bool RemoteInterface::Message::decode_body() {
 	return true;
 }
 
+bool RemoteInterface::Message::decode_binary_body() {
+	if(sbuf.size() < body_length) return false;
+
+	// decode straight from the receive buffer
+	const uint8_t *p = asio::buffer_cast<const uint8_t *>(sbuf.data());
+	bool ok = decode_binary_fields(p, p + body_length);
+
+	sbuf.consume(body_length);
+
+	return ok;
+}
+
+bool RemoteInterface::Message::decode_bulk_body(Message &chunked_msg, Message *&target,
+						asio::mutable_buffers_1 &chunk_buffer, bool &complete) {
+	if(sbuf.size() < body_length) return false;
+
+	const uint8_t *p = asio::buffer_cast<const uint8_t *>(sbuf.data());
+	const uint8_t *end = p + body_length;
+	uint64_t total, offset, length;
+	bool ok =
+		get_varint(p, end, total) &&
+		get_varint(p, end, offset) &&
+		get_varint(p, end, length) &&
+		offset <= total && length <= total - offset;
+
+	if(ok && total > VUKNOB_BULK_MAX_PAYLOAD) {
+		SATAN_ERROR("Message::decode_bulk_body() - payload of %llu bytes refused.\n",
+			    (unsigned long long)total);
+		ok = false;
+	}
+
+	if(ok) {
+		target = (offset == 0 && length == total) ? this : &chunked_msg;
+
+		if(offset == 0) {
+			target->clear_msg_content();
+			ok = get_blob(p, end, target->payload_key) &&
+				target->decode_binary_fields(p, end);
+			target->payload.resize(total);
+			target->payload_received = 0;
+		} else if(target->payload_received != offset ||
+			  target->payload.size() != total) {
+			SATAN_ERROR("Message::decode_bulk_body() - chunk out of sequence.\n");
+			ok = false;
+		}
+	}
+
+	if(ok) {
+		// the chunk data is read straight into the payload
+		chunk_buffer = asio::mutable_buffers_1(target->payload.data() + offset, length);
+		target->payload_received = offset + length;
+		complete = target->payload_received == total;
+	}
+
+	sbuf.consume(body_length);
+
+	return ok;
+}
+
+bool RemoteInterface::Message::decode_binary_fields(const uint8_t *p, const uint8_t *end) {
+	bool ok = true;
+
+	while(ok && p < end) {
+		uint64_t tag;
+		if(!get_varint(p, end, tag)) {
+			ok = false;
+			break;
+		}
+
+		uint64_t key_id = tag >> 2;
+		KeyValue &kv = append_entry();
+
+		if(key_id == 0) {
+			ok = get_blob(p, end, kv.key);
+		} else if(key_id <= (uint64_t)BINARY_KEY_TABLE_SIZE) {
+			kv.key.assign(binary_key_table[key_id - 1]);
+		} else {
+			ok = false;
+		}
+		if(!ok) break;
+
+		char b[64];
+		switch(tag & 0x3) {
+		case BINARY_VALUE_BLOB:
+			ok = get_blob(p, end, kv.value);
+			break;
+		case BINARY_VALUE_INTEGER:
+		{
+			uint64_t zz;
+			ok = get_varint(p, end, zz);
+			int64_t v = (int64_t)(zz >> 1) ^ -((int64_t)(zz & 1));
+			kv.value.assign(b, snprintf(b, sizeof(b), "%lld", (long long)v));
+		}
+		break;
+		case BINARY_VALUE_FLOAT:
+		{
+			if(end - p < 4) {
+				ok = false;
+				break;
+			}
+			uint32_t bits =
+				((uint32_t)p[0]) |
+				((uint32_t)p[1] << 8) |
+				((uint32_t)p[2] << 16) |
+				((uint32_t)p[3] << 24);
+			p += 4;
+			float f;
+			memcpy(&f, &bits, sizeof(f));
+			kv.value.assign(b, snprintf(b, sizeof(b), "%f", f));
+		}
+		break;
+		case BINARY_VALUE_EMPTY:
+			// same as what the text format delivers for an empty value
+			kv.value.assign("<empty>");
+			break;
+		}
+	}
+
+	return ok;
+}
+
 void RemoteInterface::Message::encode() const {
 	if(encoded) return;
 	encoded = true;
 
-	// add header
-	char header[9];
-	snprintf(header, 9, "%08x", data2send);
-	ostrm << header;
+	sbuf.consume(sbuf.size());
 
-	int checksum = 0;
-	SATAN_DEBUG("encode() header -> [%s]\n", header);
-	// add body
-	for(auto k2v : key2val) {
-		auto enc_key = k2v.first;
-		auto enc_val = k2v.second;
+	std::string body;
+	for(size_t k = 0; k < key2val_count; k++) {
+		auto enc_key = Serialize::encode_string(key2val[k].key);
+		auto enc_val = Serialize::encode_string(key2val[k].value);
 
-		ostrm << enc_key << "=" << enc_val << ";";
+		body += enc_key + "=" + enc_val + ";";
 
 		SATAN_DEBUG("   encode: [%s] -> [%s]\n", enc_key.c_str(), enc_val.c_str());
-		checksum += 2 + enc_key.size() + enc_val.size();
 	}
-	SATAN_DEBUG("data2send[%d] =? checksum[%d] ?\n", data2send, checksum);
+	encode_payload_as_value(body);
+
+	// add header
+	char header[9];
+	snprintf(header, 9, "%08x", (unsigned int)body.size());
+	SATAN_DEBUG("encode() header -> [%s]\n", header);
+
+	ostrm << header << body;
+}
+
+void RemoteInterface::Message::encode_binary() const {
+	if(binary_encoded) return;
+	binary_encoded = true;
+
+	binary_data.clear();
+	binary_data.push_back(VUKNOB_BINARY_FRAME_MAGIC);
+	binary_data.push_back(VUKNOB_FRAME_VERSION);
+	binary_data.push_back(0);
+	binary_data.push_back(0);
+	binary_data.insert(binary_data.end(), 4, 0); // body length, filled in below
+
+	encode_binary_fields(binary_data);
+	if(has_payload()) {
+		// the peer does not support bulk frames, use the legacy encoding
+		uint64_t key_id = binary_key_id(payload_key);
+		put_varint(binary_data, (key_id << 2) | BINARY_VALUE_BLOB);
+		if(key_id == 0) put_blob(binary_data, payload_key);
+		put_blob(binary_data, encode_byte_array(payload.size(), payload.data()));
+	}
+
+	size_t length = binary_data.size() - header_length;
+	if(length > 0xffffffff) throw MessageTooLarge();
+	for(int b = 0; b < 4; b++)
+		binary_data[4 + b] = (uint8_t)(length >> (8 * b));
+}
+
+void RemoteInterface::Message::encode_bulk_frame(std::vector<uint8_t> &frame, size_t offset, size_t length) const {
+	frame.clear();
+	frame.push_back(VUKNOB_BULK_FRAME_MAGIC);
+	frame.push_back(VUKNOB_FRAME_VERSION);
+	frame.push_back(0);
+	frame.push_back(0);
+	frame.insert(frame.end(), 4, 0); // body length, filled in below
+
+	put_varint(frame, payload.size());
+	put_varint(frame, offset);
+	put_varint(frame, length);
+	if(offset == 0) {
+		put_blob(frame, payload_key);
+		encode_binary_fields(frame);
+	}
+
+	size_t body = frame.size() - header_length;
+	if(body > 0xffffffff) throw MessageTooLarge();
+	for(int b = 0; b < 4; b++)
+		frame[4 + b] = (uint8_t)(body >> (8 * b));
+}
+
+void RemoteInterface::Message::encode_payload_as_value(std::string &body) const {
+	if(!has_payload()) return;
+
+	// legacy encoding, as a normal key/value pair
+	body += Serialize::encode_string(payload_key) + "=" +
+		Serialize::encode_string(encode_byte_array(payload.size(), payload.data())) + ";";
+}
+
+void RemoteInterface::Message::encode_binary_fields(std::vector<uint8_t> &target) const {
+	for(size_t k = 0; k < key2val_count; k++) {
+		const KeyValue &kv = key2val[k];
+		uint64_t key_id = binary_key_id(kv.key);
+		int64_t i;
+		float f;
+
+		if(kv.value.size() == 0) {
+			put_varint(target, (key_id << 2) | BINARY_VALUE_EMPTY);
+			if(key_id == 0) put_blob(target, kv.key);
+		} else if(is_canonical_integer(kv.value, i)) {
+			put_varint(target, (key_id << 2) | BINARY_VALUE_INTEGER);
+			if(key_id == 0) put_blob(target, kv.key);
+			put_varint(target, (((uint64_t)i) << 1) ^ (uint64_t)(i >> 63));
+		} else if(is_canonical_float(kv.value, f)) {
+			put_varint(target, (key_id << 2) | BINARY_VALUE_FLOAT);
+			if(key_id == 0) put_blob(target, kv.key);
+			uint32_t bits;
+			memcpy(&bits, &f, sizeof(bits));
+			for(int b = 0; b < 4; b++)
+				target.push_back((uint8_t)(bits >> (8 * b)));
+		} else {
+			put_varint(target, (key_id << 2) | BINARY_VALUE_BLOB);
+			if(key_id == 0) put_blob(target, kv.key);
+			put_blob(target, kv.value);
+		}
+	}
+}
+
+void RemoteInterface::Message::encode_fields(std::vector<uint8_t> &target) const {
+	encode_binary_fields(target);
+}
 
-	data2send += header_length; // add header length to the total data size
+bool RemoteInterface::Message::decode_fields(const uint8_t *data, size_t length) {
+	clear_msg_content();
+	return decode_binary_fields(data, data + length);
 }
 
 void RemoteInterface::Message::clear_msg_content() {
-	data2send = 0;
+	encoded = false;
+	binary_encoded = false;
 	awaiting_reply = false;
 	reply_received_callback = [](const Message *reply_msg){};
-	key2val.clear();
+	key2val_count = 0;
+	payload_key.clear();
+	payload.clear();
+	payload_received = 0;
+	supersede_key.clear();
+	transient = false;
 }
 
 /***************************
@@ -294,20 +725,34 @@ void RemoteInterface::MessageHandler::do_read_body() {
 		[this, self](std::error_code ec, std::size_t length) {
 			if(!ec) read_msg.commit_data(length);
 
-			if(!ec && read_msg.decode_body()) {
+			if(!ec && read_msg.is_bulk_frame()) {
+				Message *target = NULL;
+				asio::mutable_buffers_1 chunk_buffer(NULL, 0);
+				bool complete = false;
 
-				try {
-					SATAN_DEBUG("MessageHandler::do_read_body() - message received..\n");
-					on_message_received(read_msg);
-				} catch (Message::NoSuchKey& e) {
-					SATAN_ERROR("do_read_body() caught an NoSuchKey exception: %s\n",
-						    e.keyname);
+				if(read_msg.decode_bulk_body(chunked_read_msg, target, chunk_buffer, complete))
+					do_read_chunk(target, chunk_buffer, complete);
+				else
 					on_connection_dropped();
-				} catch (std::exception& e) {
-					SATAN_ERROR("do_read_body() caught an exception: %s\n", e.what());
-					on_connection_dropped();
-				}
+			} else if(!ec && read_msg.decode_body()) {
+				process_received_message(read_msg);
+				do_read_header();
+			} else {
+				on_connection_dropped();
+			}
+		}
+		);
+}
 
+void RemoteInterface::MessageHandler::do_read_chunk(Message *target, asio::mutable_buffers_1 chunk_buffer, bool complete) {
+	auto self(shared_from_this());
+	asio::async_read(
+		my_socket,
+		chunk_buffer,
+		[this, self, target, complete](std::error_code ec, std::size_t length) {
+			if(!ec) {
+				if(complete)
+					process_received_message(*target);
 				do_read_header();
 			} else {
 				on_connection_dropped();
@@ -316,19 +761,82 @@ void RemoteInterface::MessageHandler::do_read_body() {
 		);
 }
 
+void RemoteInterface::MessageHandler::process_received_message(const Message &msg) {
+	try {
+		SATAN_DEBUG("MessageHandler::process_received_message() - message received..\n");
+		on_message_received(msg);
+	} catch (Message::NoSuchKey& e) {
+		SATAN_ERROR("process_received_message() caught an NoSuchKey exception: %s\n",
+			    e.keyname);
+		on_connection_dropped();
+	} catch (std::exception& e) {
+		SATAN_ERROR("process_received_message() caught an exception: %s\n", e.what());
+		on_connection_dropped();
+	}
+}
+
+void RemoteInterface::MessageHandler::gather_message(std::shared_ptr<Message> &msg) {
+	// the format is selected at write time, the same message might
+	// be distributed to both binary and text clients.
+	if(binary_protocol >= 2 && msg->has_payload()) {
+		// header and payload are written straight from their own buffers
+		if(frames_used == write_frames.size())
+			write_frames.emplace_back();
+		auto &frame = write_frames[frames_used++];
+		msg->encode_bulk_frame(frame, 0, msg->get_payload_length());
+		write_buffers.push_back(asio::buffer(frame));
+		write_buffers.push_back(msg->get_payload_data(0, msg->get_payload_length()));
+	} else if(binary_protocol) {
+		write_buffers.push_back(msg->get_binary_data());
+	} else {
+		write_buffers.push_back(msg->get_data());
+	}
+}
+
+void RemoteInterface::MessageHandler::account_write(std::size_t length) {
+	counters.writes++;
+	counters.bytes += length;
+	rate_window_bytes += length;
+	update_rate(std::chrono::steady_clock::now());
+}
+
+void RemoteInterface::MessageHandler::update_rate(std::chrono::steady_clock::time_point now) {
+	double elapsed = std::chrono::duration<double>(now - rate_window_start).count();
+	if(elapsed >= 1.0) {
+		counters.bytes_per_second = (double)rate_window_bytes / elapsed;
+		rate_window_bytes = 0;
+		rate_window_start = now;
+	}
+}
+
 void RemoteInterface::MessageHandler::do_write() {
-	SATAN_DEBUG("MessageHandler::do_write()... queing async write..\n");
+	write_buffers.clear();
+	frames_used = 0;
+	bool bulk = write_msgs.take(in_flight, VUKNOB_MAX_WRITE_BATCH);
+
+	write_in_progress = in_flight.size() > 0;
+	if(!write_in_progress) return;
+
+	if(bulk) {
+		bulk_write_offset = 0;
+		do_write_chunk();
+		return;
+	}
+
+	for(auto &msg : in_flight)
+		gather_message(msg);
+
+	SATAN_DEBUG("MessageHandler::do_write()... queing async write of %d messages..\n", (int)in_flight.size());
 	auto self(shared_from_this());
 	asio::async_write(
-		my_socket,
-		write_msgs.front()->get_data(),
+		my_socket, write_buffers,
 		[this, self](std::error_code ec, std::size_t length) {
 			SATAN_DEBUG("MessageHandler::do_write()... async write completed!\n");
 			if (!ec) {
-				write_msgs.pop_front();
-				if (!write_msgs.empty()) {
-					do_write();
-				}
+				counters.messages += in_flight.size();
+				in_flight.clear();
+				account_write(length);
+				do_write();
 			} else {
 				on_connection_dropped();
 			}
@@ -337,6 +845,43 @@ void RemoteInterface::MessageHandler::do_write() {
 	SATAN_DEBUG("MessageHandler::do_write()... async write queued..\n");
 }
 
+void RemoteInterface::MessageHandler::do_write_chunk() {
+	auto self(shared_from_this());
+	auto msg = in_flight.front();
+
+	size_t total = msg->get_payload_length();
+	size_t length = total - bulk_write_offset;
+	if(length > VUKNOB_BULK_CHUNK_SIZE) length = VUKNOB_BULK_CHUNK_SIZE;
+
+	SATAN_DEBUG("MessageHandler::do_write_chunk() - %d bytes at %d of %d\n",
+		    (int)length, (int)bulk_write_offset, (int)total);
+
+	msg->encode_bulk_frame(bulk_frame, bulk_write_offset, length);
+	std::array<asio::const_buffer, 2> buffers = {{
+			asio::buffer(bulk_frame),
+			msg->get_payload_data(bulk_write_offset, length)
+		}};
+	asio::async_write(
+		my_socket, buffers,
+		[this, self, total, length](std::error_code ec, std::size_t written) {
+			if (!ec) {
+				account_write(written);
+				bulk_write_offset += length;
+				if(bulk_write_offset < total) {
+					do_write_chunk();
+					return;
+				}
+				in_flight.clear();
+				bulk_write_offset = 0;
+				counters.messages++;
+				do_write();
+			} else {
+				on_connection_dropped();
+			}
+		}
+		);
+}
+
 void RemoteInterface::MessageHandler::do_write_udp(std::shared_ptr<Message> &msg) {
 	try {
 		my_udp_socket->send_to(msg->get_data(), udp_target_endpoint);
@@ -355,26 +900,43 @@ RemoteInterface::MessageHandler::MessageHandler(asio::ip::tcp::socket _socket) :
 }
 
 void RemoteInterface::MessageHandler::start_receive() {
+	// a new connection always starts out in text mode
+	binary_protocol = 0;
+	bulk_write_offset = 0;
 	do_read_header();
 }
 
-void RemoteInterface::MessageHandler::deliver_message(std::shared_ptr<Message> &msg, bool via_udp) {
-	msg->encode();
+void RemoteInterface::MessageHandler::use_binary_protocol(int version) {
+	SATAN_DEBUG("MessageHandler::use_binary_protocol(%d)\n", version);
+	binary_protocol = version;
+	// payloads that don't fit in one chunk are sent as bulk transfers
+	write_msgs.set_bulk_threshold(version >= 2 ? VUKNOB_BULK_CHUNK_SIZE : SIZE_MAX);
+}
 
-	SATAN_DEBUG("MessageHandler::deliver_message() - msg encoded..\n");
+void RemoteInterface::MessageHandler::deliver_message(std::shared_ptr<Message> &msg, bool via_udp) {
+	if(via_udp && my_udp_socket) {
+		msg->encode();
+		SATAN_DEBUG("MessageHandler::deliver_message() - msg encoded..\n");
+	}
 
 	if(via_udp && my_udp_socket &&
 	   (msg->get_body_length() <= VUKNOB_MAX_UDP_SIZE)) {
 		do_write_udp(msg);
 	} else {
-		bool write_in_progress = !write_msgs.empty();
-		write_msgs.push_back(msg);
+		if(write_msgs.push(msg))
+			counters.superseded++;
 		if (!write_in_progress){
 			do_write();
 		}
 	}
 }
 
+auto RemoteInterface::MessageHandler::get_outgoing_counters() -> OutgoingCounters {
+	update_rate(std::chrono::steady_clock::now());
+	counters.queue_depth = write_msgs.size();
+	return counters;
+}
+
 /***************************
  *
  *  Class RemoteInterface::BaseObject::Factory
@@ -943,6 +1505,7 @@ RemoteInterface::GlobalControlObject::GlobalControlObject(int32_t new_obj_id, co
 			send_object_message(
 				[this, row](std::shared_ptr<Message> &msg2send) {
 					msg2send->set_value("command", "nrplaying");
+					msg2send->set_transient();
 					msg2send->set_value("nrow", std::to_string(row));
 				}
 				);
@@ -1726,6 +2289,7 @@ void RemoteInterface::RIMachine::RIController::set_value(int val) {
 		[crid, val](std::shared_ptr<Message> &msg_to_send) {
 			msg_to_send->set_value("command", "setctrval");
 			msg_to_send->set_value("ctrl_id", std::to_string(crid));
+			msg_to_send->set_supersede_key("ctrl" + std::to_string(crid));
 			msg_to_send->set_value("value", std::to_string(val));
 		}
 		);
@@ -1738,6 +2302,7 @@ void RemoteInterface::RIMachine::RIController::set_value(float val) {
 		[crid, val](std::shared_ptr<Message> &msg_to_send) {
 			msg_to_send->set_value("command", "setctrval");
 			msg_to_send->set_value("ctrl_id", std::to_string(crid));
+			msg_to_send->set_supersede_key("ctrl" + std::to_string(crid));
 			msg_to_send->set_value("value", std::to_string(val));
 		}
 		);
@@ -1750,6 +2315,7 @@ void RemoteInterface::RIMachine::RIController::set_value(double val) {
 		[crid, val](std::shared_ptr<Message> &msg_to_send) {
 			msg_to_send->set_value("command", "setctrval");
 			msg_to_send->set_value("ctrl_id", std::to_string(crid));
+			msg_to_send->set_supersede_key("ctrl" + std::to_string(crid));
 			msg_to_send->set_value("value", std::to_string(val));
 		}
 		);
@@ -1762,6 +2328,7 @@ void RemoteInterface::RIMachine::RIController::set_value(bool val) {
 		[crid, val](std::shared_ptr<Message> &msg_to_send) {
 			msg_to_send->set_value("command", "setctrval");
 			msg_to_send->set_value("ctrl_id", std::to_string(crid));
+			msg_to_send->set_supersede_key("ctrl" + std::to_string(crid));
 			msg_to_send->set_value("value", val ? "true" : "false");
 		}
 		);
@@ -1774,6 +2341,7 @@ void RemoteInterface::RIMachine::RIController::set_value(const std::string &val)
 		[crid, val](std::shared_ptr<Message> &msg_to_send) {
 			msg_to_send->set_value("command", "setctrval");
 			msg_to_send->set_value("ctrl_id", std::to_string(crid));
+			msg_to_send->set_supersede_key("ctrl" + std::to_string(crid));
 			msg_to_send->set_value("value", val);
 		}
 		);
@@ -1939,17 +2507,12 @@ void RemoteInterface::RIMachine::serverside_init_from_machine_ptr(std::shared_pt
 	xpos = m_ptr->get_x_position();
 	ypos = m_ptr->get_y_position();
 
-	try {
-		inputs = m_ptr->get_input_names();
-	} catch(...) {
-		throw;
-	}
-	try {
-		outputs = m_ptr->get_output_names();
-	} catch(...) {
-		throw;
-	}
-
+	// fetch both name lists during the same visit of the playback thread
+	Machine::machine_operation_enqueue_batch(
+		{
+			[this, m_ptr] () { inputs = m_ptr->get_input_names(); },
+			[this, m_ptr] () { outputs = m_ptr->get_output_names(); }
+		});
 }
 
 void RemoteInterface::RIMachine::attach_input(std::shared_ptr<RIMachine> source_machine,
@@ -2136,6 +2699,7 @@ void RemoteInterface::RIMachine::set_position(double xp, double yp) {
 		send_object_message(
 			[this, thiz, xp, yp](std::shared_ptr<Message> &msg2send) {
 				msg2send->set_value("command", "setpos");
+				msg2send->set_supersede_key("setpos");
 				msg2send->set_value("ignored", thiz->name); // make sure thiz is not optimized away
 				msg2send->set_value("xpos", std::to_string(xp));
 				msg2send->set_value("ypos", std::to_string(yp));
@@ -2148,6 +2712,7 @@ void RemoteInterface::RIMachine::set_position(double xp, double yp) {
 				std::lock_guard<std::mutex> lock_guard(base_object_mutex);
 
 				msg2send->set_value("command", "setpos");
+				msg2send->set_supersede_key("setpos");
 				msg2send->set_value("ignored", thiz->name); // make sure thiz is not optimized away
 				msg2send->set_value("xpos", std::to_string(xp));
 				msg2send->set_value("ypos", std::to_string(yp));
@@ -2325,6 +2890,7 @@ void RemoteInterface::RIMachine::pad_clear() {
 			msg2send->set_value("ignored", thiz->name); // make sure thiz is not optimized away
 
 			msg2send->set_value("command", "padclear");
+			msg2send->set_transient();
 		}
 		);
 }
@@ -2341,6 +2907,7 @@ void RemoteInterface::RIMachine::pad_enqueue_event(int finger, PadEvent_t event_
 	send_object_message(
 		[this, xp, yp, zp, finger, event_type, thiz](std::shared_ptr<Message> &msg2send) {
 			msg2send->set_value("command", "padevt");
+			msg2send->set_transient();
 			msg2send->set_value("ignored", thiz->name); // make sure thiz is not optimized away
 
 			msg2send->set_value("evt", std::to_string(((int)event_type)));
@@ -2348,6 +2915,10 @@ void RemoteInterface::RIMachine::pad_enqueue_event(int finger, PadEvent_t event_
 			msg2send->set_value("xp", std::to_string(xp));
 			msg2send->set_value("yp", std::to_string(yp));
 			msg2send->set_value("zp", std::to_string(zp));
+
+			// only the latest position of a sliding finger matters
+			if(event_type == ms_pad_slide)
+				msg2send->set_supersede_key("slide" + std::to_string(finger));
 		},
 
 #if defined(VUKNOB_UDP_SUPPORT) && defined(VUKNOB_UDP_USE)
@@ -2359,16 +2930,17 @@ void RemoteInterface::RIMachine::pad_enqueue_event(int finger, PadEvent_t event_
 }
 
 void RemoteInterface::RIMachine::enqueue_midi_data(size_t len, const char* data) {
-	std::string encoded = encode_byte_array(len, data);
+	auto payload = std::make_shared<std::vector<char> >(data, data + len);
 	auto thiz = std::dynamic_pointer_cast<RIMachine>(shared_from_this());
 	send_object_message(
-		[encoded, thiz](std::shared_ptr<Message> &msg2send) {
+		[payload, thiz](std::shared_ptr<Message> &msg2send) {
 			msg2send->set_value("command", "midi");
+			msg2send->set_transient();
 			msg2send->set_value("ignored", thiz->name); // make sure thiz is not optimized away
 
-			msg2send->set_value("data", encoded);
+			SATAN_DEBUG("RIMachine::enqueue_midi_data() - %d bytes\n", (int)payload->size());
 
-			SATAN_DEBUG("RIMachine::enqueue_midi_data() - data: %s\n", encoded.c_str());
+			msg2send->set_payload("data", std::move(*payload));
 		}
 		);
 }
@@ -2451,20 +3023,13 @@ void RemoteInterface::RIMachine::process_message_server(Context* context,
 		}
 	} else if(command == "midi") {
 		size_t len = 0;
-		char *data = NULL;
-		decode_byte_array(msg.get_value("data"), len, &data);
-		SATAN_DEBUG("RIMachine::process_message() - midi data received. (%d -> %p)\n",
-			    len, data);
-		if(data) {
-			try {
-				auto mseq = std::dynamic_pointer_cast<MachineSequencer>(real_machine_ptr);
-				if(mseq) {
-					mseq->enqueue_midi_data(len, data);
-				}
-				free(data);
-			} catch(...) {
-				free(data);
-				throw;
+		const char *data = NULL;
+		if(msg.get_payload("data", data, len)) {
+			SATAN_DEBUG("RIMachine::process_message() - midi data received. (%d -> %p)\n",
+				    len, data);
+			auto mseq = std::dynamic_pointer_cast<MachineSequencer>(real_machine_ptr);
+			if(mseq) {
+				mseq->enqueue_midi_data(len, data);
 			}
 		}
 	} else if(command == "setctrval") {
@@ -2482,6 +3047,7 @@ void RemoteInterface::RIMachine::process_message_server(Context* context,
 		send_object_message(
 			[this, thiz](std::shared_ptr<Message> &msg2send) {
 				msg2send->set_value("command", "setpos");
+				msg2send->set_supersede_key("setpos");
 				msg2send->set_value("ignored", thiz->name); // make sure thiz is not optimized away
 				msg2send->set_value("xpos", std::to_string(xpos));
 				msg2send->set_value("ypos", std::to_string(ypos));
@@ -2727,6 +3293,10 @@ std::string RemoteInterface::RIMachine::process_get_ctrl_message(const std::stri
 	return retval;
 }
 
+// float controllers changed by a client glide to the new value over this many
+// samples, so dragging a knob doesn't cause zipper noise
+#define RIMACHINE_CONTROLLER_RAMP_LENGTH 256
+
 void RemoteInterface::RIMachine::process_setctrl_val_message(MessageHandler *src, const Message &msg) {
 	auto c2cc = client2ctrl_container.find(src->shared_from_this());
 	if(c2cc != client2ctrl_container.end()) {
@@ -2741,7 +3311,7 @@ void RemoteInterface::RIMachine::process_setctrl_val_message(MessageHandler *src
 			case Machine::Controller::c_float:
 			{
 				float val = std::stof(msg.get_value("value"));
-				ctrl->set_value(val);
+				ctrl->schedule_value(val, -1, RIMACHINE_CONTROLLER_RAMP_LENGTH);
 			}
 				break;
 			case Machine::Controller::c_double:
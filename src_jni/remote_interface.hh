@@ -42,11 +42,13 @@
 #include <utility>
 #include <atomic>
 #include <unordered_map>
+#include <chrono>
 #include <typeinfo>
 #include <typeindex>
 #include <cxxabi.h>
 
 #include "common.hh"
+#include "write_queue.hh"
 
 #define RI_LOOP_NOT_SET -1
 
@@ -138,6 +140,7 @@
 #define __MSG_PROTOCOL_VERSION -5
 #define __MSG_REPLY -6
 #define __MSG_CLIENT_ID -7
+#define __MSG_SNAPSHOT -8
 
 // Factory names
 #define __FCT_HANDLELIST		"HandleList"
@@ -147,6 +150,34 @@
 
 #define __VUKNOB_PROTOCOL_VERSION__ 9
 
+// The binary framing is negotiated separately from the protocol
+// version, the server offers it in the __MSG_PROTOCOL_VERSION message
+// and a client that understands it answers with its own version.
+// Clients that never answer keep receiving the text format.
+//
+// The object snapshot is offered the same way. A client that wants it
+// answers with the epoch and revision of the last snapshot it got, zero
+// if none, and receives one compressed __MSG_SNAPSHOT with all objects
+// (or only the changes) instead of one create message per object.
+//
+// version 1 - binary framing
+// version 2 - bulk frames, raw binary payloads sent in chunks
+#define __VUKNOB_BINARY_PROTOCOL_VERSION__ 2
+#define VUKNOB_BINARY_FRAME_MAGIC 0xb1
+#define VUKNOB_BULK_FRAME_MAGIC 0xb2
+#define VUKNOB_FRAME_VERSION 1
+
+// payloads larger than this are split, and other messages
+// may be sent in between the chunks
+#define VUKNOB_BULK_CHUNK_SIZE 16384
+
+// a peer announcing a larger payload than this is refused,
+// the size is read from the network before anything is received
+#define VUKNOB_BULK_MAX_PAYLOAD (64 * 1024 * 1024)
+
+// maximum number of messages gathered into one write
+#define VUKNOB_MAX_WRITE_BATCH 64
+
 //#define VUKNOB_UDP_SUPPORT
 //#define VUKNOB_UDP_USE
 
@@ -163,18 +194,10 @@ namespace RemoteInterface {
 	};
 
 	static inline std::string encode_byte_array(size_t len, const char *data) {
-		std::string result;
-		size_t offset = 0;
-		while(len - offset > 0) {
-			char frb[3];
-
-			frb[0] = ((data[offset] & 0xf0) >> 4) + 'a';
-			frb[1] = ((data[offset] & 0x0f) >> 0) + 'a';
-			frb[2] = '\0';
-
-			offset++;
-
-			result +=  frb;
+		std::string result(len << 1, 'a');
+		for(size_t offset = 0; offset < len; offset++) {
+			result[(offset << 1) + 0] = ((data[offset] & 0xf0) >> 4) + 'a';
+			result[(offset << 1) + 1] = ((data[offset] & 0x0f) >> 0) + 'a';
 		}
 		return result;
 	}
@@ -235,28 +258,84 @@ namespace RemoteInterface {
 
 		void set_value(const std::string &key, const std::string &value);
 		std::string get_value(const std::string &key) const;
+		bool has_value(const std::string &key) const;
 
 		asio::streambuf::mutable_buffers_type prepare_buffer(std::size_t length);
 		void commit_data(std::size_t length);
-		asio::streambuf::const_buffers_type get_data();
+		asio::streambuf::const_buffers_type get_data(); // text format
+		asio::const_buffers_1 get_binary_data(); // binary format
+
+		// Attach raw binary data, the vector is handed over without copying.
+		// With a peer that supports bulk frames the data is sent as is,
+		// otherwise it is sent hex encoded as the value of key.
+		// Throws MessageTooLarge above VUKNOB_BULK_MAX_PAYLOAD bytes.
+		void set_payload(const std::string &key, std::vector<char> &&data);
+		// works for both raw and hex encoded payloads, the data pointer
+		// is valid until the message is recycled
+		bool get_payload(const std::string &key, const char *&data, size_t &length) const;
+		inline bool has_payload() const { return payload_key.size() > 0; }
+		inline size_t get_payload_length() const { return payload.size(); }
+
+		// Mark the message as a state update that only matters until a
+		// newer one arrives, like a controller value. If a message with the
+		// same object id and key is still waiting to be written when a new
+		// one is delivered, the old one is dropped. The key is not sent.
+		inline void set_supersede_key(const std::string &key) { supersede_key = key; }
+		inline const std::string &get_supersede_key() const { return supersede_key; }
+
+		// Mark the message as a notification that does not change the state
+		// of the object, like a meter reading or a pad event. Transient
+		// messages are not tracked by the server snapshot. Not sent.
+		inline void set_transient() { transient = true; }
+		inline bool is_transient() const { return transient; }
+
+		// the key/value pairs in binary form, without any framing - used to store messages
+		void encode_fields(std::vector<uint8_t> &target) const;
+		bool decode_fields(const uint8_t *data, size_t length);
 
 	private:
+		class KeyValue {
+		public:
+			std::string key, value;
+		};
+
 		Context* context;
 
-		mutable bool encoded;
+		mutable bool encoded = false;
+		mutable bool binary_encoded = false;
+		mutable bool binary_body = false; // set by decode_header()
 		mutable uint32_t body_length;
 		mutable int32_t client_id;
 		mutable asio::streambuf sbuf;
 		mutable std::ostream ostrm;
-		mutable int data2send;
+		mutable std::vector<uint8_t> binary_data;
+
+		mutable bool bulk_frame = false; // set by decode_header()
+		mutable std::string payload_key;
+		mutable std::vector<char> payload; // capacity is kept when recycled
+		size_t payload_received = 0;
 
 		std::function<void(const Message *reply_msg)> reply_received_callback;
 		bool awaiting_reply = false;
 
-		std::map<std::string, std::string> key2val;
+		std::string supersede_key;
+		bool transient = false;
+
+		// flat storage, reused between messages so a recycled message
+		// does not allocate for short keys and values
+		std::vector<KeyValue> key2val;
+		size_t key2val_count = 0;
 
+		int find_entry(const std::string &key) const; // -1 if not found
+		KeyValue &append_entry();
 		void clear_msg_content();
 
+		bool decode_text_body();
+		bool decode_binary_body();
+		bool decode_binary_fields(const uint8_t *p, const uint8_t *end);
+		void encode_binary_fields(std::vector<uint8_t> &target) const;
+		void encode_payload_as_value(std::string &body) const;
+
 	public:
 		void recycle();
 
@@ -264,10 +343,21 @@ namespace RemoteInterface {
 		inline int32_t get_client_id() { return client_id; }
 
 		bool decode_client_id(); // only for messages arriving via UDP
-		bool decode_header();
+		bool decode_header(); // detects text, binary or bulk framing
 		bool decode_body();
 
+		inline bool is_bulk_frame() { return bulk_frame; }
+		// Decode the body of a bulk frame. A payload that fits in one frame is
+		// received into this message, otherwise into chunked_msg. The chunk data
+		// should then be read into chunk_buffer, directly from the socket.
+		bool decode_bulk_body(Message &chunked_msg, Message *&target,
+				      asio::mutable_buffers_1 &chunk_buffer, bool &complete);
+
 		void encode() const;
+		void encode_binary() const;
+		// create the frame header for one chunk of the payload
+		void encode_bulk_frame(std::vector<uint8_t> &frame, size_t offset, size_t length) const;
+		asio::const_buffers_1 get_payload_data(size_t offset, size_t length) const;
 
 	};
 
@@ -420,11 +510,33 @@ namespace RemoteInterface {
 	class MessageHandler : public std::enable_shared_from_this<MessageHandler> {
 	private:
 		Message read_msg;
-		std::deque<std::shared_ptr<Message> > write_msgs;
+		Message chunked_read_msg; // receives payloads larger than one chunk
+
+		// Messages delivered while a write is in progress are queued, and
+		// all of them go out in one gathered write when it completes. A
+		// payload larger than one chunk is written alone, one chunk at a
+		// time, and the messages queued after it wait for the last chunk.
+		WriteQueue<Message> write_msgs;
+		bool write_in_progress = false;
+
+		// the write in progress
+		std::vector<std::shared_ptr<Message> > in_flight;
+		std::vector<asio::const_buffer> write_buffers;
+		std::deque<std::vector<uint8_t> > write_frames; // deque - must not move when growing
+		size_t frames_used = 0;
+
+		// the bulk transfer in progress, in_flight holds the message
+		size_t bulk_write_offset = 0;
+		std::vector<uint8_t> bulk_frame;
 
 		void do_read_header();
 		void do_read_body();
+		void do_read_chunk(Message *target, asio::mutable_buffers_1 chunk_buffer, bool complete);
+		void process_received_message(const Message &msg);
+		void gather_message(std::shared_ptr<Message> &msg);
+		void account_write(std::size_t length);
 		void do_write();
+		void do_write_chunk();
 		void do_write_udp(std::shared_ptr<Message> &msg);
 
 	protected:
@@ -433,6 +545,10 @@ namespace RemoteInterface {
 		std::shared_ptr<asio::ip::udp::socket> my_udp_socket;
 		asio::ip::udp::endpoint udp_target_endpoint;
 
+		// binary protocol version the remote side has agreed to receive, zero
+		// for text framing - incoming messages are always accepted in all formats
+		int binary_protocol = 0;
+
 	public:
 		class OnlyForDelivery : public std::runtime_error {
 		public:
@@ -440,15 +556,37 @@ namespace RemoteInterface {
 			virtual ~OnlyForDelivery() {}
 		};
 
+		// outgoing traffic, only valid on the context thread
+		class OutgoingCounters {
+		public:
+			size_t queue_depth = 0; // messages waiting for the write in progress
+			uint64_t messages = 0; // written, total
+			uint64_t writes = 0; // number of socket writes, total
+			uint64_t bytes = 0; // total
+			uint64_t superseded = 0; // updates dropped because a newer one was queued
+			double bytes_per_second = 0.0; // over the last second or so
+		};
+
 		MessageHandler(asio::io_service &io_service);
 		MessageHandler(asio::ip::tcp::socket _socket);
 
 		void start_receive();
 
+		void use_binary_protocol(int version);
+
 		virtual void deliver_message(std::shared_ptr<Message> &msg, bool via_udp = false);
 
+		OutgoingCounters get_outgoing_counters();
+
 		virtual void on_message_received(const Message &msg) = 0;
 		virtual void on_connection_dropped() = 0;
+
+	private:
+		OutgoingCounters counters;
+		std::chrono::steady_clock::time_point rate_window_start;
+		uint64_t rate_window_bytes = 0;
+
+		void update_rate(std::chrono::steady_clock::time_point now);
 	};
 
 	class BaseObject : public std::enable_shared_from_this<BaseObject> {
@@ -0,0 +1,577 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+
+#include <jngldrum/jexception.hh>
+
+#include "render_chain_scheduler.hh"
+#include "machine.hh"
+
+//#define __DO_SATAN_DEBUG
+#include "satan_debug.hh"
+
+// priority of the worker threads, if we are allowed to use SCHED_FIFO
+#define RENDER_WORKER_PRIORITY 2
+
+static inline void relax_cpu() {
+#if defined(__arm__) && defined(__ARM_ARCH_7A__)
+	asm volatile("yield" ::: "memory");
+#else
+	sched_yield();
+#endif
+}
+
+/*****************************
+ *
+ * Creation and destruction
+ *
+ *****************************/
+
+// initial size of the topology arrays, they grow when needed
+#define TOPOLOGY_INITIAL_MACHINES 64
+#define TOPOLOGY_INITIAL_EDGES 256
+
+RenderChainScheduler::RenderChainScheduler(int worker_count)
+	: topology_state(topology_idle), topology_missed(false), generation(0)
+	, current(NULL), pending(NULL), retired(NULL), rendering(NULL)
+	, ready_head(0), ready_tail(0), completed(0)
+	, failed(false), failed_node(-1), running(false), active_workers(0), terminate(false)
+	, last_machines(0), last_levels(0)
+	, last_wall_time(0), last_work_time(0), last_critical_path(0), worst_critical_path(0)
+{
+	sem_init(&wake_up, 0, 0);
+	sem_init(&build_wanted, 0, 0);
+
+	topology.allocate(TOPOLOGY_INITIAL_MACHINES, TOPOLOGY_INITIAL_EDGES);
+
+	// the builder is not time critical, it runs with the default priority
+	if(pthread_create(&builder, NULL, builder_entry, this) != 0) {
+		sem_destroy(&build_wanted);
+		sem_destroy(&wake_up);
+		throw WorkerCreationFailed();
+	}
+
+	for(int k = 0; k < worker_count; k++) {
+		pthread_t thread;
+		pthread_attr_t pta;
+		struct sched_param sp;
+
+		pthread_attr_init(&pta);
+		pthread_attr_setschedpolicy(&pta, SCHED_FIFO);
+		sp.sched_priority = RENDER_WORKER_PRIORITY;
+		pthread_attr_setschedparam(&pta, &sp);
+
+		if(pthread_create(&thread, &pta, worker_entry, this) != 0) {
+			// not allowed to use realtime scheduling - try again with the defaults
+			SATAN_DEBUG("RenderChainScheduler - failed to create realtime worker, fallback to default.\n");
+			if(pthread_create(&thread, NULL, worker_entry, this) != 0) {
+				pthread_attr_destroy(&pta);
+				stop_threads();
+				throw WorkerCreationFailed();
+			}
+		}
+		pthread_attr_destroy(&pta);
+
+		workers.push_back(thread);
+	}
+}
+
+RenderChainScheduler::~RenderChainScheduler() {
+	stop_threads();
+
+	free_retired();
+	delete pending.exchange(NULL);
+	delete current;
+}
+
+void RenderChainScheduler::stop_threads() {
+	terminate = true;
+	for(unsigned int k = 0; k < workers.size(); k++)
+		sem_post(&wake_up);
+	for(auto thread : workers)
+		pthread_join(thread, NULL);
+	sem_post(&build_wanted);
+	pthread_join(builder, NULL);
+	sem_destroy(&wake_up);
+	sem_destroy(&build_wanted);
+}
+
+void RenderChainScheduler::Topology::allocate(int machines, int edges) {
+	release();
+
+	machine_capacity = machines;
+	edge_capacity = edges;
+	chain = new Machine*[machines];
+	edge_from = new int[edges];
+	edge_to = new int[edges];
+	tight_a = new int[edges];
+	tight_b = new int[edges];
+}
+
+void RenderChainScheduler::Topology::release() {
+	if(chain) delete[] chain;
+	if(edge_from) delete[] edge_from;
+	if(edge_to) delete[] edge_to;
+	if(tight_a) delete[] tight_a;
+	if(tight_b) delete[] tight_b;
+	chain = NULL;
+	edge_from = edge_to = tight_a = tight_b = NULL;
+	machine_capacity = edge_capacity = 0;
+}
+
+/*****************************
+ *
+ * Topology copy, on the audio thread
+ *
+ *****************************/
+
+static inline int chain_index_of(Machine **chain, int machine_count, Machine *m) {
+	for(int k = 0; k < machine_count; k++)
+		if(chain[k] == m) return k;
+	return -1;
+}
+
+void RenderChainScheduler::chain_changed(Machine *top) {
+	generation.fetch_add(1);
+	copy_topology(top);
+}
+
+void RenderChainScheduler::copy_topology(Machine *top) {
+	int expected = topology_idle;
+	if(!topology_state.compare_exchange_strong(expected, topology_writing)) {
+		expected = topology_ready;
+		if(!topology_state.compare_exchange_strong(expected, topology_writing)) {
+			// the builder is reading - it will ask for a new copy when it's done
+			topology_missed = true;
+			return;
+		}
+	}
+
+	Topology &t = topology;
+	t.generation = generation.load();
+	t.overflow = false;
+	t.machine_count = t.edge_count = t.tight_count = 0;
+
+	for(Machine *m = top; m != NULL; m = m->next_render_chain) {
+		if(t.machine_count == t.machine_capacity) {
+			t.overflow = true;
+			break;
+		}
+		t.chain[t.machine_count++] = m;
+	}
+
+	for(int k = 0; k < t.machine_count && !t.overflow; k++) {
+		for(auto dep : t.chain[k]->dependant) {
+			int i = chain_index_of(t.chain, t.machine_count, dep.first);
+			if(i < 0) continue;
+			if(t.edge_count == t.edge_capacity) {
+				t.overflow = true;
+				break;
+			}
+			t.edge_from[t.edge_count] = i;
+			t.edge_to[t.edge_count++] = k;
+		}
+		for(auto tight : t.chain[k]->tightly_connected) {
+			int i = chain_index_of(t.chain, t.machine_count, tight);
+			if(i <= k) continue;
+			if(t.tight_count == t.edge_capacity) {
+				t.overflow = true;
+				break;
+			}
+			t.tight_a[t.tight_count] = k;
+			t.tight_b[t.tight_count++] = i;
+		}
+	}
+
+	topology_state = topology_ready;
+	sem_post(&build_wanted);
+}
+
+// called by the builder thread, copies the topology on the audio thread without
+// invalidating the current graph
+void RenderChainScheduler::request_topology() {
+	Machine::machine_operation_enqueue(
+		[] (void *d) {
+			if(Machine::render_scheduler)
+				Machine::render_scheduler->copy_topology(Machine::top_render_chain);
+		},
+		NULL, false);
+}
+
+/*****************************
+ *
+ * Graph construction, on the builder thread
+ *
+ *****************************/
+
+RenderChainScheduler::Schedule *RenderChainScheduler::build(const Topology &t) {
+	int N = t.machine_count;
+	Schedule *s = new Schedule();
+	s->generation = t.generation;
+
+	// collect edges, dependency -> dependant
+	std::vector<std::vector<int> > edges_out(N);
+	std::vector<int> in_degree(N, 0);
+	for(int e = 0; e < t.edge_count; e++) {
+		edges_out[t.edge_from[e]].push_back(t.edge_to[e]);
+		in_degree[t.edge_to[e]]++;
+	}
+
+	// tightly connected machines might share data inside a dynamic module
+	// so we must never run them in parallel - if they are not ordered
+	// by a dependency we force them into render chain order
+	if(t.tight_count > 0) {
+		// reachable[a][b] - b feeds a, directly or indirectly. The chain is
+		// ordered so that dependencies come first.
+		std::vector<std::vector<bool> > reachable(N, std::vector<bool>(N, false));
+		for(int k = 0; k < N; k++) {
+			for(int e = 0; e < t.edge_count; e++) {
+				if(t.edge_to[e] != k) continue;
+				int d = t.edge_from[e];
+				reachable[k][d] = true;
+				for(int x = 0; x < N; x++)
+					if(reachable[d][x]) reachable[k][x] = true;
+			}
+		}
+
+		for(int p = 0; p < t.tight_count; p++) {
+			int k = t.tight_a[p], i = t.tight_b[p];
+			if(reachable[k][i] || reachable[i][k]) continue;
+
+			edges_out[k].push_back(i);
+			in_degree[i]++;
+		}
+	}
+
+	// level ordering (Kahn's algorithm, one level at a time)
+	std::vector<int> level(N, 0);
+	std::vector<int> order;
+	{
+		std::vector<int> remaining = in_degree;
+		std::vector<int> current_level;
+		for(int k = 0; k < N; k++)
+			if(remaining[k] == 0) current_level.push_back(k);
+
+		int l = 0;
+		while(current_level.size() > 0) {
+			std::vector<int> next;
+			for(auto k : current_level) {
+				level[k] = l;
+				order.push_back(k);
+				for(auto x : edges_out[k]) {
+					if(--remaining[x] == 0)
+						next.push_back(x);
+				}
+			}
+			current_level = next;
+			l++;
+		}
+		s->level_count = l;
+	}
+
+	if((int)order.size() != N) {
+		// this should never happen since connections that would create
+		// a loop are refused - but forced tight ordering might conflict.
+		SATAN_ERROR("RenderChainScheduler::build() - graph is not acyclic, falling back to serial order.\n");
+		order.clear();
+		edges_out.assign(N, std::vector<int>());
+		in_degree.assign(N, 0);
+		for(int k = 0; k < N; k++) {
+			order.push_back(k);
+			level[k] = k;
+			if(k + 1 < N) {
+				edges_out[k].push_back(k + 1);
+				in_degree[k + 1] = 1;
+			}
+		}
+		s->level_count = N;
+	}
+
+	// remap from chain index to level order index
+	std::vector<int> remap(N);
+	for(int k = 0; k < N; k++)
+		remap[order[k]] = k;
+
+	s->nodes.resize(N);
+	s->predecessor_start.assign(N + 1, 0);
+
+	std::vector<std::vector<int> > edges_in(N);
+	for(int k = 0; k < N; k++) {
+		int c = order[k];
+		Node &n = s->nodes[k];
+		n.machine = t.chain[c];
+		n.level = level[c];
+		n.dependency_count = in_degree[c];
+		n.first_successor = s->successors.size();
+		n.successor_count = edges_out[c].size();
+		for(auto x : edges_out[c]) {
+			s->successors.push_back(remap[x]);
+			edges_in[remap[x]].push_back(k);
+		}
+	}
+	for(int k = 0; k < N; k++) {
+		s->predecessor_start[k] = s->predecessors.size();
+		for(auto p : edges_in[k])
+			s->predecessors.push_back(p);
+	}
+	s->predecessor_start[N] = s->predecessors.size();
+
+	s->path_length.assign(N, 0);
+
+	s->ready = N > 0 ? new std::atomic<int>[N] : NULL;
+	s->ready_size = N;
+
+	SATAN_DEBUG("RenderChainScheduler::build() - %d machines in %d levels.\n", N, s->level_count);
+
+	return s;
+}
+
+void RenderChainScheduler::free_retired() {
+	Schedule *s = retired.exchange(NULL);
+	while(s) {
+		Schedule *next = s->next;
+		delete s;
+		s = next;
+	}
+}
+
+void *RenderChainScheduler::builder_entry(void *scheduler) {
+	((RenderChainScheduler *)scheduler)->builder_body();
+	return NULL;
+}
+
+void RenderChainScheduler::builder_body() {
+	while(1) {
+		while(sem_wait(&build_wanted) != 0 && errno == EINTR);
+
+		if(terminate) return;
+
+		int expected = topology_ready;
+		if(!topology_state.compare_exchange_strong(expected, topology_building))
+			continue; // already built, or being overwritten and posted again
+
+		if(topology.overflow) {
+			topology.allocate(topology.machine_capacity * 2, topology.edge_capacity * 2);
+			topology_state = topology_idle;
+			request_topology();
+			continue;
+		}
+
+		Schedule *s = build(topology);
+		topology_state = topology_idle;
+
+		free_retired();
+		delete pending.exchange(s); // never picked up by render()
+
+		if(topology_missed.exchange(false))
+			request_topology();
+	}
+}
+
+/*****************************
+ *
+ * Rendering
+ *
+ *****************************/
+
+void RenderChainScheduler::push_ready(int node_index) {
+	int slot = ready_tail.fetch_add(1);
+	rendering->ready[slot].store(node_index, std::memory_order_release);
+}
+
+void RenderChainScheduler::execute_node(int node_index) {
+	Schedule *s = rendering;
+	Node &n = s->nodes[node_index];
+
+	n.start_time = now();
+	try {
+		n.machine->execute();
+	} catch(...) {
+		failed_node = node_index;
+		failed = true;
+		return;
+	}
+	n.finish_time = now();
+
+	for(int k = 0; k < n.successor_count; k++) {
+		int x = s->successors[n.first_successor + k];
+		if(s->nodes[x].pending.fetch_sub(1) == 1)
+			push_ready(x);
+	}
+
+	completed.fetch_add(1, std::memory_order_release);
+}
+
+void RenderChainScheduler::participate() {
+	Schedule *s = rendering;
+
+	while(!failed) {
+		int pos = ready_head.fetch_add(1);
+		if(pos >= s->ready_size) return;
+
+		int node_index;
+		while((node_index = s->ready[pos].load(std::memory_order_acquire)) < 0) {
+			if(failed) return;
+			relax_cpu();
+		}
+		execute_node(node_index);
+	}
+}
+
+bool RenderChainScheduler::render() {
+	Schedule *fresh = pending.exchange(NULL);
+	if(fresh) {
+		if(current) {
+			Schedule *head = retired.load();
+			do {
+				current->next = head;
+			} while(!retired.compare_exchange_weak(head, current));
+		}
+		current = fresh;
+	}
+
+	// not built yet for the current chain
+	if(current == NULL || current->generation != generation.load())
+		return false;
+
+	Schedule *s = current;
+	if(s->ready_size == 0) return true;
+
+	int64_t start = now();
+
+	// prepare for a new buffer
+	for(int k = 0; k < s->ready_size; k++) {
+		s->ready[k].store(-1, std::memory_order_relaxed);
+		s->nodes[k].pending.store(s->nodes[k].dependency_count, std::memory_order_relaxed);
+	}
+	rendering = s;
+	ready_head = 0;
+	ready_tail = 0;
+	completed = 0;
+	failed = false;
+	failed_node = -1;
+
+	// nodes are sorted in level order, so the roots come first
+	for(int k = 0; k < s->ready_size && s->nodes[k].dependency_count == 0; k++)
+		push_ready(k);
+
+	running = true;
+	for(unsigned int k = 0; k < workers.size(); k++)
+		sem_post(&wake_up);
+
+	participate();
+
+	while(completed.load(std::memory_order_acquire) < s->ready_size && !failed)
+		relax_cpu();
+
+	// make sure all workers have left this buffer before we return
+	running = false;
+	while(active_workers > 0)
+		relax_cpu();
+
+	if(failed) {
+		int f = failed_node;
+		std::string name = f >= 0 ? s->nodes[f].machine->name : "unknown";
+		throw jException(std::string("Machine [") + name + "] failed in render chain.",
+				 jException::sanity_error);
+	}
+
+	calculate_statistics(start, now());
+
+	return true;
+}
+
+void RenderChainScheduler::calculate_statistics(int64_t start, int64_t stop) {
+	Schedule *s = rendering;
+	int64_t work = 0, critical = 0;
+
+	// nodes are in level order, so all predecessors are already calculated
+	for(int k = 0; k < s->ready_size; k++) {
+		int64_t longest = 0;
+		for(int p = s->predecessor_start[k]; p < s->predecessor_start[k + 1]; p++) {
+			int64_t l = s->path_length[s->predecessors[p]];
+			if(l > longest) longest = l;
+		}
+		int64_t t = s->nodes[k].finish_time - s->nodes[k].start_time;
+		work += t;
+		s->path_length[k] = longest + t;
+		if(s->path_length[k] > critical) critical = s->path_length[k];
+	}
+
+	last_machines = s->ready_size;
+	last_levels = s->level_count;
+	last_wall_time = stop - start;
+	last_work_time = work;
+	last_critical_path = critical;
+	if(critical > worst_critical_path)
+		worst_critical_path = critical;
+}
+
+RenderChainScheduler::Statistics RenderChainScheduler::get_statistics() {
+	Statistics s;
+	s.machines = last_machines;
+	s.levels = last_levels;
+	s.workers = workers.size();
+	s.wall_time = last_wall_time;
+	s.work_time = last_work_time;
+	s.critical_path = last_critical_path;
+	s.worst_critical_path = worst_critical_path;
+	return s;
+}
+
+void RenderChainScheduler::clear_statistics() {
+	worst_critical_path = 0;
+}
+
+/*****************************
+ *
+ * Worker threads
+ *
+ *****************************/
+
+void *RenderChainScheduler::worker_entry(void *scheduler) {
+	((RenderChainScheduler *)scheduler)->worker_body();
+	return NULL;
+}
+
+void RenderChainScheduler::worker_body() {
+	while(1) {
+		while(sem_wait(&wake_up) != 0 && errno == EINTR);
+
+		if(terminate) return;
+
+		// the audio thread will not return from render() until
+		// active_workers is back at zero - and if running
+		// is false we were woken up too late for this buffer.
+		active_workers.fetch_add(1);
+		if(running) {
+			participate();
+		}
+		active_workers.fetch_sub(1);
+	}
+}
+
+int64_t RenderChainScheduler::now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return ((int64_t)t.tv_sec) * 1000000000LL + (int64_t)t.tv_nsec;
+}
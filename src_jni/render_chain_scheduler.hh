@@ -0,0 +1,206 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __RENDER_CHAIN_SCHEDULER
+#define __RENDER_CHAIN_SCHEDULER
+
+#include <atomic>
+#include <vector>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdexcept>
+
+class Machine;
+
+/*
+ * The RenderChainScheduler executes the render chain as a dependency DAG
+ * instead of as a flat list. Machines that do not depend on each other are
+ * executed in parallel by a fixed pool of pre-spawned worker threads, the audio
+ * thread itself is also acting as a worker while rendering.
+ *
+ * When the render chain is recalculated, on the audio thread or with the
+ * machine space locked, chain_changed() copies the topology into preallocated
+ * arrays and wakes the builder thread. The builder constructs the graph and
+ * hands it over to render() through an atomic pointer. Until the graph for the
+ * current chain has arrived render() returns false and the caller renders the
+ * chain serially, so the audio thread never allocates or frees here. Replaced
+ * graphs are freed by the builder.
+ */
+class RenderChainScheduler {
+public:
+	/// Statistics for the last rendered buffer, all times are in nanoseconds
+	class Statistics {
+	public:
+		int machines; // number of machines in the graph
+		int levels; // depth of the graph
+		int workers; // number of worker threads (not counting the audio thread)
+		int64_t wall_time; // time from start to end of render()
+		int64_t work_time; // sum of the execution time of all machines
+		int64_t critical_path; // longest dependency chain, in execution time
+		int64_t worst_critical_path; // worst critical path since last clear_statistics()
+	};
+
+	class WorkerCreationFailed : public std::runtime_error {
+	public:
+		WorkerCreationFailed() : runtime_error("Failed to create render chain worker thread.") {}
+		virtual ~WorkerCreationFailed() {}
+	};
+
+	// worker_count is the number of threads to spawn, the audio thread is not included
+	RenderChainScheduler(int worker_count);
+	~RenderChainScheduler();
+
+	// the render chain changed, top points to the top of the serial render chain
+	// - call ONLY from the audio thread, or with the machine space locked
+	void chain_changed(Machine *top);
+
+	// render all machines in the graph - call ONLY from the audio thread
+	// returns false if the graph of the current chain is not built yet,
+	// then the caller must render the chain serially.
+	bool render();
+
+	Statistics get_statistics();
+	void clear_statistics();
+
+private:
+	class Node {
+	public:
+		Machine *machine;
+		int level;
+		int dependency_count; // number of nodes that must finish before this one
+		int first_successor, successor_count; // range in the successors vector
+
+		std::atomic<int> pending;
+
+		// written by the executing thread, read by the audio thread after completion
+		int64_t start_time, finish_time;
+
+		Node() : machine(NULL), level(0), dependency_count(0),
+			 first_successor(0), successor_count(0),
+			 pending(0), start_time(0), finish_time(0) {}
+		Node(const Node &other) : machine(other.machine), level(other.level),
+					  dependency_count(other.dependency_count),
+					  first_successor(other.first_successor),
+					  successor_count(other.successor_count),
+					  pending(0), start_time(0), finish_time(0) {}
+	};
+
+	// the graph of one render chain, immutable once built except for
+	// the per buffer state in the nodes and the ready queue
+	class Schedule {
+	public:
+		unsigned generation; // the chain_changed() call it was built for
+
+		std::vector<Node> nodes; // sorted in level order
+		std::vector<int> successors;
+		std::vector<int> predecessors; // used only for the critical path calculation
+		std::vector<int> predecessor_start;
+		std::vector<int64_t> path_length;
+		int level_count;
+
+		// the ready "queue" - each slot is written exactly once per buffer
+		std::atomic<int> *ready;
+		int ready_size;
+
+		Schedule *next; // in the retired list
+
+		Schedule() : generation(0), level_count(0), ready(NULL), ready_size(0), next(NULL) {}
+		~Schedule() { if(ready) delete[] ready; }
+	};
+
+	// The render chain as copied by chain_changed(), edges are chain indexes.
+	// If the arrays are too small overflow is set and the builder grows them.
+	class Topology {
+	public:
+		unsigned generation;
+		bool overflow;
+		int machine_capacity, edge_capacity;
+		int machine_count, edge_count, tight_count;
+		Machine **chain;
+		int *edge_from, *edge_to; // dependency -> dependant
+		int *tight_a, *tight_b; // tightly connected, tight_a < tight_b
+
+		Topology() : generation(0), overflow(false),
+			     machine_capacity(0), edge_capacity(0),
+			     machine_count(0), edge_count(0), tight_count(0),
+			     chain(NULL), edge_from(NULL), edge_to(NULL), tight_a(NULL), tight_b(NULL) {}
+		~Topology() { release(); }
+
+		void allocate(int machines, int edges);
+		void release();
+	};
+
+	enum TopologyState {
+		topology_idle, // chain_changed() may write
+		topology_writing, // chain_changed() is writing
+		topology_ready, // waiting for the builder, chain_changed() may overwrite
+		topology_building // the builder is reading
+	};
+
+	Topology topology;
+	std::atomic<int> topology_state;
+	std::atomic<bool> topology_missed; // chain_changed() was called while building
+	std::atomic<unsigned> generation; // incremented by chain_changed()
+
+	Schedule *current; // only used by the audio thread
+	std::atomic<Schedule *> pending; // built, not yet picked up by render()
+	std::atomic<Schedule *> retired; // replaced, freed by the builder
+	Schedule *rendering; // the one render() is executing right now
+
+	std::atomic<int> ready_head, ready_tail;
+	std::atomic<int> completed;
+	std::atomic<bool> failed;
+	std::atomic<int> failed_node;
+	std::atomic<bool> running;
+	std::atomic<int> active_workers;
+	std::atomic<bool> terminate;
+
+	std::vector<pthread_t> workers;
+	sem_t wake_up;
+
+	pthread_t builder;
+	sem_t build_wanted;
+
+	// statistics, written by audio thread, read by anyone
+	std::atomic<int> last_machines, last_levels;
+	std::atomic<int64_t> last_wall_time, last_work_time, last_critical_path, worst_critical_path;
+
+	void copy_topology(Machine *top);
+	void request_topology();
+	Schedule *build(const Topology &t);
+	void free_retired();
+
+	void stop_threads(); // joins the workers and the builder
+
+	static void *builder_entry(void *scheduler);
+	void builder_body();
+
+	void push_ready(int node_index);
+	void execute_node(int node_index);
+	void participate();
+	void calculate_statistics(int64_t start, int64_t stop);
+
+	static void *worker_entry(void *scheduler);
+	void worker_body();
+
+	static int64_t now();
+};
+
+#endif
@@ -33,7 +33,7 @@
 #include "satan_debug.hh"
 
 // we need to set this number to the value 2 at least. The value was not defined before interface level 2 (it was then implicit..)
-int SatanProjectEntry::project_interface_level = 8;
+int SatanProjectEntry::project_interface_level = 9;
 std::map<std::string, SatanProjectEntry *> *SatanProjectEntry::entries = NULL;
 std::map<int, std::vector<std::string> > *SatanProjectEntry::load_order = NULL;
 
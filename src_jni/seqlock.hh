@@ -0,0 +1,74 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#ifndef __SEQLOCK
+#define __SEQLOCK
+
+#include <atomic>
+#include <string.h>
+#include <sched.h>
+
+/*
+ * A sequence lock around a small, trivially copyable, value.
+ *
+ * Readers never block a writer - they just retry if the value was
+ * changed while they copied it. Writers are serialized with a
+ * compare and swap on the sequence, so any thread may write, but
+ * it is meant for values that are read much more often than written.
+ */
+template <class T>
+class SeqLock {
+public:
+	SeqLock() : sequence(0) {
+		memset(&value, 0, sizeof(T));
+	}
+
+	void write(const T &v) {
+		unsigned int s = sequence.load(std::memory_order_relaxed);
+		while((s & 1) ||
+		      !sequence.compare_exchange_weak(s, s + 1, std::memory_order_acquire)) {
+			if(s & 1) {
+				sched_yield();
+				s = sequence.load(std::memory_order_relaxed);
+			}
+		}
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(&value, &v, sizeof(T));
+		sequence.store(s + 2, std::memory_order_release);
+	}
+
+	T read() const {
+		T v;
+		unsigned int s0, s1;
+		do {
+			s0 = sequence.load(std::memory_order_acquire);
+			memcpy(&v, &value, sizeof(T));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			s1 = sequence.load(std::memory_order_relaxed);
+		} while((s0 & 1) || s0 != s1);
+		return v;
+	}
+
+private:
+	std::atomic<unsigned int> sequence;
+	T value;
+};
+
+#endif
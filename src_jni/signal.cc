@@ -34,7 +34,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <arpa/inet.h>
+#include <unistd.h>
 
 #include <jngldrum/jinformer.hh>
 
@@ -50,6 +52,7 @@
 #include <fixedpointmath.h>
 
 #include "static_signal_preview.hh"
+#include "static_signal_file.hh"
 
 /*******************************
  *                             *
@@ -114,6 +117,13 @@ void Machine::SignalBase::internal_clear_buffer() {
 		memset(buffer, 0,
 		       samples * channels * sizeof(void *));
 		break;
+	case _MIDI_EVENTS:
+	{
+		MidiEventList *list = (MidiEventList *)buffer;
+		list->count = 0;
+		list->capacity = MIDI_EVENT_LIST_CAPACITY;
+	}
+		break;
 
 	case _MAX_R:
 	default:
@@ -215,6 +225,20 @@ void Machine::StaticSignalLoader::replace_signal(
 		file_path, name, data);
 }
 
+void Machine::StaticSignalLoader::replace_signal(
+	int index,
+	Dimension d,
+	int frequency,
+	std::string file_path,
+	std::string name,
+	StaticSignalStream *stream) {
+
+	Machine::StaticSignal::replace_signal(
+		index,
+		d, frequency,
+		file_path, name, stream);
+}
+
 void Machine::StaticSignalLoader::preview_signal(
 	Dimension d, Resolution r,
 	int channels, int samples, int frequency,
@@ -330,7 +354,7 @@ Machine::StaticSignal::StaticSignal(
 		int c, int s, int f,
 		std::string fp,
 		std::string n,
-		void *b) : SignalBase(n), file_path(fp) {
+		void *b) : SignalBase(n), file_path(fp), stream(NULL), mapping(NULL), mapping_size(0) {
 	dimension = d;
 	resolution = r;
 	channels = c;
@@ -339,8 +363,26 @@ Machine::StaticSignal::StaticSignal(
 	buffer = b;
 }
 
+Machine::StaticSignal::StaticSignal(
+		Dimension d,
+		int f,
+		std::string fp,
+		std::string n,
+		StaticSignalStream *strm) : SignalBase(n), file_path(fp), stream(strm), mapping(NULL), mapping_size(0) {
+	dimension = d;
+	resolution = _fx8p24bit;
+	channels = stream->get_channels();
+	samples = stream->get_resident_frames();
+	frequency = f;
+	buffer = stream->get_resident();
+}
+
 Machine::StaticSignal::~StaticSignal() {
-	if(buffer != NULL)
+	if(stream != NULL)
+		stream->release(); // the resident buffer belongs to the stream
+	else if(mapping != NULL)
+		munmap(mapping, mapping_size);
+	else if(buffer != NULL)
 		free(buffer);
 }
 
@@ -348,136 +390,71 @@ std::string Machine::StaticSignal::get_file_path() {
 	return file_path;
 }
 
-void Machine::StaticSignal::clear_signal(int index) {
-	if(signals.find(index) != signals.end()) {
-		delete signals.find(index)->second;
-		signals.erase(signals.find(index));
-	}
+int Machine::StaticSignal::get_total_samples() {
+	return stream ? stream->get_frames() : samples;
 }
 
-void Machine::StaticSignal::save_0D_signal_xml(int index) {
-	std::ostringstream fname_s;
-	fname_s << "static_sig_nr_" << index << ".dat";
-
-	int f_out = open(
-		fname_s.str().c_str(),
-		O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
-	SATAN_DEBUG(" OPEN: %d\n", f_out);
-	if(f_out == -1) {
-		std::ostringstream emsg;
-		emsg << "[name] : " 
-		     << "Failed to open storage file "
-		     << fname_s.str()
-		     << " , aborting save.";
-		SATAN_DEBUG("  EXCEPTION MESSAGE: %s\n", emsg.str().c_str());
-		throw jException(
-			emsg.str(),
-			jException::sanity_error);
+int Machine::StaticSignal::read_samples(int frame, void **data) {
+	if(stream) {
+		fp8p24_t *d;
+		int retval = stream->read(frame, &d);
+		*data = d;
+		return retval;
 	}
 
-	int k, k_max;
-
-	k_max = channels * samples;
-	
-	std::ostringstream result;
-#define _0D_SAVE_BUFFER_SIZE 1024 * 8
-	uint8_t output_buffer[_0D_SAVE_BUFFER_SIZE];
-	int output_buffer_index = 0;
-	SATAN_DEBUG("WRITING %d SAMPLES....", k_max);
-	for(k = 0; k < k_max; k++) {
-		uint8_t output[] = {0, 0, 0, 0, 0, 0, 0, 0};
-		ssize_t output_size = 0;
-		
-		switch(resolution) {
-		case _8bit:
-		{
-			int8_t *d = (int8_t *)buffer;
-			int8_t *t = (int8_t *)output;
-			*t = d[k];
-			output_size = sizeof(int8_t);
-		}
-			break;
-		case _16bit:
-		{
-			int16_t *d = (int16_t *)buffer;
-			uint16_t *bin_native;
-			uint16_t *bin_be = (uint16_t *)output;
-			bin_native = (uint16_t *)&d[k];
-			*bin_be = htons(*bin_native);
-			output_size = sizeof(int16_t);
-		}
-			break;
-		case _32bit:
-		{
-			int32_t *d = (int32_t *)buffer;
-			uint32_t *bin_native;
-			uint32_t *bin_be = (uint32_t *)output;
-			bin_native = (uint32_t *)&d[k];
-			*bin_be = htonl(*bin_native);
-			output_size = sizeof(int32_t);
-		}
-			break;
-		case _fl32bit:
-		{
-			float *d = (float *)buffer;
-			uint32_t *bin_native;
-			uint32_t *bin_be = (uint32_t *)output;
-			bin_native = (uint32_t *)&d[k];
-			*bin_be = htonl(*bin_native);
-			output_size = sizeof(float);
-		}
-			break;
-		case _fx8p24bit:
-		{
-			fp8p24_t *d = (fp8p24_t *)buffer;
-			uint32_t *bin_native;
-			uint32_t *bin_be = (uint32_t *)output;
-			bin_native = (uint32_t *)&d[k];
-			*bin_be = htonl(*bin_native);
-			output_size = sizeof(fp8p24_t);
-		}
+	int frame_size = 0;
+	switch(resolution) {
+	case _8bit:
+		frame_size = channels * sizeof(int8_t);
 		break;
-		case _PTR:
-		case _MAX_R:
-			break;
-		}
+	case _16bit:
+		frame_size = channels * sizeof(int16_t);
+		break;
+	case _32bit:
+		frame_size = channels * sizeof(int32_t);
+		break;
+	case _fl32bit:
+		frame_size = channels * sizeof(float);
+		break;
+	case _fx8p24bit:
+		frame_size = channels * sizeof(fp8p24_t);
+		break;
+	case _PTR:
+	case _MIDI_EVENTS:
+	case _MAX_R:
+		break;
+	}
 
-		if(output_buffer_index + output_size >= _0D_SAVE_BUFFER_SIZE) {
-//			if(write(f_out, output, output_size) != output_size) {
-			if(write(f_out, output_buffer, output_buffer_index) != output_buffer_index) {
-				close(f_out);
-				std::ostringstream emsg;
-				emsg << "[name] : " 
-				     << "Failed to write data to "
-				     << fname_s.str()
-				     << " , aborting save.";
-				SATAN_DEBUG("   EXCEPTION MESSAGE: %s\n", emsg.str().c_str());
-				throw jException(
-					emsg.str(),
-					jException::sanity_error);
-			}
-			output_buffer_index = 0;
-		}
-		memcpy(&output_buffer[output_buffer_index], output, output_size);
-		output_buffer_index += output_size;
+	if(frame < 0 || frame >= samples || frame_size == 0 || buffer == NULL) {
+		*data = NULL;
+		return 0;
 	}
-	if(output_buffer_index != 0) {
-		if(write(f_out, output_buffer, output_buffer_index) != output_buffer_index) {
-			close(f_out);
-			std::ostringstream emsg;
-			emsg << "[name] : " 
-			     << "Failed to write data to "
-			     << fname_s.str()
-			     << " , aborting save.";
-			SATAN_DEBUG("   EXCEPTION MESSAGE: %s\n", emsg.str().c_str());
-			throw jException(
-				emsg.str(),
-				jException::sanity_error);
-		}
+	*data = &(((uint8_t *)buffer)[frame * frame_size]);
+	return samples - frame;
+}
+
+void Machine::StaticSignal::clear_signal(int index) {
+	if(signals.find(index) != signals.end()) {
+		delete signals.find(index)->second;
+		signals.erase(signals.find(index));
 	}
+}
 
-	SATAN_DEBUG_("WROTE SAMPLES\n");
-	close(f_out);
+void Machine::StaticSignal::save_0D_signal_xml(int index) {
+	std::ostringstream fname_s;
+	fname_s << "static_sig_nr_" << index << ".vss";
+
+	// the file is written to a temporary file which is then renamed, a streamed
+	// signal might be reading from the file we are replacing.
+	if(stream)
+		StaticSignalFile::save(fname_s.str(), frequency, stream);
+	else
+		StaticSignalFile::save(fname_s.str(), resolution, channels, samples, frequency, buffer);
+
+	// remove the storage file used before PROJECT_INTERFACE_LEVEL 9, if any
+	std::ostringstream legacy_s;
+	legacy_s << "static_sig_nr_" << index << ".dat";
+	unlink(legacy_s.str().c_str());
 }
 
 std::string Machine::StaticSignal::save_signal_xml(int index) {
@@ -499,8 +476,9 @@ std::string Machine::StaticSignal::save_signal_xml(int index) {
 	       << "dimension=\"" << s->get_dimension() << "\" "
 	       << "resolution=\"" << s->get_resolution() << "\" "
 	       << "channels=\"" << s->get_channels() << "\" "
-	       << "samples=\"" << s->get_samples() << "\" "
+	       << "samples=\"" << s->get_total_samples() << "\" "
 	       << "frequency=\"" << s->get_frequency() << "\" "
+	       << "storage=\"1\" "
 	       << "name=\"" << KXMLDoc::escaped_string(s->get_name()) << "\" >\n";
 	SATAN_DEBUG_("Step 3\n");
 
@@ -547,6 +525,14 @@ void Machine::StaticSignal::load_0D_signal_xml(
 	std::string file_path,
 	std::string name) {
 
+	// from PROJECT_INTERFACE_LEVEL == 9 the data is stored in a StaticSignalFile
+	int storage;
+	KXML_GET_NUMBER(sigxml, "storage", storage, 0);
+	if(storage == 1) {
+		load_0D_signal_file(index, d, file_path, name);
+		return;
+	}
+
 	Resolution t_r = _8bit; // target resolution
 	ssize_t sr_size = 0; // source size
 	ssize_t tg_size = 0; // target size
@@ -578,10 +564,25 @@ void Machine::StaticSignal::load_0D_signal_xml(
 		t_r = _fx8p24bit;
 		break;
 	case _PTR:
+	case _MIDI_EVENTS:
 	case _MAX_R:
 		return;
 		break;
 	}
+
+	std::ostringstream fname_s;
+	fname_s << "static_sig_nr_" << index << ".dat";
+
+	// large signals are streamed from the storage file instead
+	if(s_r == _fx8p24bit &&
+	   (size_t)samples * channels * sizeof(fp8p24_t) > STATIC_SIGNAL_STREAM_THRESHOLD) {
+		StaticSignalStream *stream =
+			new StaticSignalStream(fname_s.str(), 0,
+					       StaticSignalStream::_fp8p24_be, 32,
+					       channels, samples);
+		replace_signal(index, d, frequency, file_path, name, stream);
+		return;
+	}
 	
 	// Allocate memory and clear it
 	void *data = (void *)malloc(samples * channels * tg_size);
@@ -592,12 +593,9 @@ void Machine::StaticSignal::load_0D_signal_xml(
 	
 	memset(data, 0, samples * channels * tg_size);
 	
-	std::ostringstream fname_s;
 	int v, v_max = 0;
 	int f_in = -1;
 
-	fname_s << "static_sig_nr_" << index << ".dat";
-	
 	v_max = samples * channels;
 	f_in = open(
 		fname_s.str().c_str(),
@@ -678,6 +676,7 @@ void Machine::StaticSignal::load_0D_signal_xml(
 		}
 			break;
 		case _PTR:
+		case _MIDI_EVENTS:
 		case _MAX_R:
 			break;
 		}
@@ -687,6 +686,69 @@ void Machine::StaticSignal::load_0D_signal_xml(
 		       file_path, name, data);
 }
 
+void Machine::StaticSignal::load_0D_signal_file(
+	int index,
+	Dimension d,
+	std::string file_path,
+	std::string name) {
+
+	std::ostringstream fname_s;
+	fname_s << "static_sig_nr_" << index << ".vss";
+
+	StaticSignalFile::Content c = StaticSignalFile::probe(fname_s.str());
+
+	// large signals are streamed from the storage file
+	if(c.resolution == _fx8p24bit && c.encoding == StaticSignalFile::_raw &&
+	   (size_t)c.frames * c.channels * sizeof(fp8p24_t) > STATIC_SIGNAL_STREAM_THRESHOLD) {
+		StaticSignalStream *stream =
+			new StaticSignalStream(fname_s.str(), c.data_offset,
+					       StaticSignalStream::_fp8p24_le, 32,
+					       c.channels, c.frames);
+		replace_signal(index, d, c.frequency, file_path, name, stream);
+		return;
+	}
+
+	c = StaticSignalFile::load(fname_s.str());
+
+	StaticSignal *s = NULL;
+	if(c.resolution == _fx8p24bit || c.resolution == _fl32bit) {
+		// use the loaded data directly
+		s = new StaticSignal(d, c.resolution, c.channels, c.frames, c.frequency,
+				     file_path, name, c.data);
+		s->mapping = c.mapping;
+		s->mapping_size = c.mapping_size;
+	} else {
+		// integer data is converted into f8p24_t format, like it was when first loaded
+		size_t v_max = (size_t)c.frames * c.channels;
+		fp8p24_t *data = (fp8p24_t *)malloc(v_max > 0 ? v_max * sizeof(fp8p24_t) : 1);
+		if(data == NULL) {
+			StaticSignalFile::release(c);
+			throw jException("Could not allocate enough memory for "
+					 "static signal", jException::sanity_error);
+		}
+
+		for(size_t v = 0; v < v_max; v++) {
+			switch(c.resolution) {
+			case _8bit:
+				data[v] = ((int8_t *)c.data)[v] << 16;
+				break;
+			case _16bit:
+				data[v] = ((int16_t *)c.data)[v] << 7;
+				break;
+			default:
+				data[v] = ((int32_t *)c.data)[v] >> 8;
+				break;
+			}
+		}
+		StaticSignalFile::release(c);
+
+		s = new StaticSignal(d, _fx8p24bit, c.channels, c.frames, c.frequency,
+				     file_path, name, data);
+	}
+
+	install_signal(index, s);
+}
+
 void Machine::StaticSignal::load_signal_xml(const KXMLDoc &sigxml) {
 	std::string name, fpath;
 	int i, _d, _r, c, s, f;
@@ -759,6 +821,28 @@ void Machine::StaticSignal::replace_signal(
 		file_path,
 		name, data);
 
+	install_signal(index, s);
+}
+
+void Machine::StaticSignal::replace_signal(
+	int index,
+	Dimension d,
+	int frequency,
+	std::string file_path,
+	std::string name,
+	StaticSignalStream *stream) {
+
+	StaticSignal *s = NULL;
+
+	s = new StaticSignal(
+		d, frequency,
+		file_path,
+		name, stream);
+
+	install_signal(index, s);
+}
+
+void Machine::StaticSignal::install_signal(int index, StaticSignal *s) {
 	typedef struct {
 		std::map<int, StaticSignal *> &sigs;
 		int idx;
@@ -822,9 +906,10 @@ bool Machine::Signal::initiated = false;
 std::map<Dimension, std::set<Machine::Signal *> > Machine::Signal::signal_map;
 
 // allocate a signal
-Machine::Signal::Signal(int c, Machine *orig, const std::string &nm, Dimension d) :
+Machine::Signal::Signal(int c, Machine *orig, const std::string &nm, Dimension d, bool legacy) :
 	SignalBase(nm), 
-	originator(orig)
+	originator(orig),
+	legacy_midi(legacy)
 
 	{
 	if(!(initiated && (def_samples[d] > 0))) {
@@ -836,7 +921,7 @@ Machine::Signal::Signal(int c, Machine *orig, const std::string &nm, Dimension d
 			internal_set_defaults(d, 12, _fl32bit, 24);
 			break;
 		case _MIDI:
-			internal_set_defaults(d, 1024, _PTR, 44100);
+			internal_set_defaults(d, 1024, _MIDI_EVENTS, 44100);
 			break;
 		default:
 		case _1D:
@@ -1029,15 +1114,20 @@ void Machine::Signal::internal_alloc_0d_buffer(Signal *s) {
 // allocate a buffer for MIDI signals
 void Machine::Signal::internal_alloc_MIDI_buffer(Signal *s) {
 	s->frequency = def_frequency[s->dimension];
-	s->resolution = def_resolution[s->dimension];
+	s->resolution = s->legacy_midi ? _PTR : def_resolution[s->dimension];
 	s->samples = def_samples[s->dimension];
 	
 	// Calculate memory size
-	int bsiz = 0;
+	int len = 0;
 
 	switch(s->resolution) {
 	case _PTR:
-		bsiz = sizeof(void *);
+		// XXX len may overflow!
+		len = sizeof(void *) * s->channels * s->samples;
+		break;
+	case _MIDI_EVENTS:
+		// one list for the whole signal, independent of samples
+		len = sizeof(MidiEventList);
 		break;
 	default: /* error */
 	case _8bit:
@@ -1048,9 +1138,6 @@ void Machine::Signal::internal_alloc_MIDI_buffer(Signal *s) {
 	case _MAX_R:
 		throw jException("Unsupported resolution for MIDI signal.", jException::sanity_error);
 	}
-	
-	// XXX len may overflow!
-	int len = bsiz * s->channels * s->samples;
 
 	// Allocate memory
 	void *old_buffer = s->buffer;
@@ -1063,6 +1150,8 @@ void Machine::Signal::internal_alloc_MIDI_buffer(Signal *s) {
 	s->buffer = new_buffer;
 
 	if(s->buffer == NULL) throw jException("Failed to allocate buffer.", jException::sanity_error);
+
+	s->internal_clear_buffer();
 }
 
 void Machine::Signal::internal_register_signal(Signal *s) {
@@ -1150,6 +1239,11 @@ Machine::Signal *Machine::Signal::SignalFactory::create_signal(int c, Machine *o
 	return new Signal(c, originator, name, d);
 }
 
+Machine::Signal *Machine::Signal::SignalFactory::create_legacy_midi_signal(Machine *originator,
+									   const std::string &name) {
+	return new Signal(1, originator, name, _MIDI, true);
+}
+
 void Machine::Signal::SignalFactory::destroy_signal(Signal *signal) {
 	delete signal;
 }
@@ -0,0 +1,645 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+
+#include <jngldrum/jexception.hh>
+
+#include "static_signal_file.hh"
+
+//#define __DO_SATAN_DEBUG
+#include "satan_debug.hh"
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define STATIC_SIGNAL_FILE_BIG_ENDIAN_HOST
+#endif
+
+// unary codes longer than this are escaped, and the value is stored as is
+#define RICE_ESCAPE 32
+#define RICE_ESCAPE_BITS 40
+
+bool StaticSignalFile::compression_enabled = true;
+
+/*****************************
+ *
+ * Helpers
+ *
+ *****************************/
+
+static void put_le(uint8_t *p, uint64_t value, int bytes) {
+	for(int k = 0; k < bytes; k++)
+		p[k] = (uint8_t)(value >> (8 * k));
+}
+
+static uint64_t get_le(const uint8_t *p, int bytes) {
+	uint64_t value = 0;
+	for(int k = 0; k < bytes; k++)
+		value |= ((uint64_t)p[k]) << (8 * k);
+	return value;
+}
+
+static uint32_t crc32(const uint8_t *data, size_t length) {
+	static uint32_t table[256];
+	static bool table_ready = [] {
+		for(uint32_t k = 0; k < 256; k++) {
+			uint32_t c = k;
+			for(int b = 0; b < 8; b++)
+				c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+			table[k] = c;
+		}
+		return true;
+	}();
+	(void)table_ready;
+
+	uint32_t crc = 0xffffffff;
+	for(size_t k = 0; k < length; k++)
+		crc = table[(crc ^ data[k]) & 0xff] ^ (crc >> 8);
+	return crc ^ 0xffffffff;
+}
+
+static int get_sample_size(Resolution r) {
+	switch(r) {
+	case _8bit: return sizeof(int8_t);
+	case _16bit: return sizeof(int16_t);
+	case _32bit: return sizeof(int32_t);
+	case _fl32bit: return sizeof(float);
+	case _fx8p24bit: return sizeof(fp8p24_t);
+	case _PTR:
+	case _MIDI_EVENTS:
+	case _MAX_R:
+		break;
+	}
+	return 0;
+}
+
+// convert the byte order of a complete buffer between little endian and host order
+static inline void convert_byte_order(void *data, size_t count, int sample_size) {
+#ifdef STATIC_SIGNAL_FILE_BIG_ENDIAN_HOST
+	if(sample_size == 2) {
+		uint16_t *d = (uint16_t *)data;
+		for(size_t k = 0; k < count; k++)
+			d[k] = __builtin_bswap16(d[k]);
+	} else if(sample_size == 4) {
+		uint32_t *d = (uint32_t *)data;
+		for(size_t k = 0; k < count; k++)
+			d[k] = __builtin_bswap32(d[k]);
+	}
+#endif
+}
+
+static bool write_all(int fd, const void *data, size_t length) {
+	const uint8_t *p = (const uint8_t *)data;
+	while(length > 0) {
+		ssize_t w = write(fd, p, length);
+		if(w < 0 && errno == EINTR) continue;
+		if(w <= 0) return false;
+		p += w;
+		length -= w;
+	}
+	return true;
+}
+
+static bool read_all(int fd, void *data, size_t length, off_t offset) {
+	uint8_t *p = (uint8_t *)data;
+	while(length > 0) {
+		ssize_t r = pread(fd, p, length, offset);
+		if(r < 0 && errno == EINTR) continue;
+		if(r <= 0) return false;
+		p += r;
+		length -= r;
+		offset += r;
+	}
+	return true;
+}
+
+static void fill_header(uint8_t *header, StaticSignalFile::Encoding encoding,
+			Resolution resolution, int channels, int frames, int frequency,
+			uint64_t data_size, int block_frames) {
+	memset(header, 0, STATIC_SIGNAL_FILE_HEADER_SIZE);
+	memcpy(header, "VKSS", 4);
+	put_le(&header[4], STATIC_SIGNAL_FILE_VERSION, 2);
+	put_le(&header[6], encoding, 2);
+	put_le(&header[8], resolution, 2);
+	put_le(&header[10], get_sample_size(resolution), 2);
+	put_le(&header[12], channels, 4);
+	put_le(&header[16], frames, 4);
+	put_le(&header[20], frequency, 4);
+	put_le(&header[24], STATIC_SIGNAL_FILE_HEADER_SIZE, 8);
+	put_le(&header[32], data_size, 8);
+	put_le(&header[40], block_frames, 4);
+	put_le(&header[60], crc32(header, 60), 4);
+}
+
+// writes to a temporary file, and renames it when everything is written
+class TemporaryFile {
+public:
+	int fd;
+	std::string path, temp_path;
+
+	TemporaryFile(const std::string &_path) : path(_path), temp_path(_path + ".tmp") {
+		fd = open(temp_path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+		if(fd == -1)
+			throw jException(std::string("Failed to open storage file ") + path + ", aborting save.",
+					 jException::syscall_error);
+	}
+
+	~TemporaryFile() {
+		if(fd != -1) {
+			close(fd);
+			unlink(temp_path.c_str());
+		}
+	}
+
+	void write(const void *data, size_t length) {
+		if(!write_all(fd, data, length))
+			throw jException(std::string("Failed to write data to ") + path + ", aborting save.",
+					 jException::syscall_error);
+	}
+
+	void commit() {
+		int f = fd;
+		fd = -1;
+		if(close(f) != 0 || rename(temp_path.c_str(), path.c_str()) != 0) {
+			unlink(temp_path.c_str());
+			throw jException(std::string("Failed to replace ") + path + ", aborting save.",
+					 jException::syscall_error);
+		}
+	}
+};
+
+/*****************************
+ *
+ * Rice coding
+ *
+ *****************************/
+
+class BitWriter {
+public:
+	std::vector<uint8_t> &output;
+	uint64_t accumulator;
+	int bits;
+
+	BitWriter(std::vector<uint8_t> &_output) : output(_output), accumulator(0), bits(0) {}
+
+	// n must be 32 or less
+	inline void put(uint32_t value, int n) {
+		if(n == 0) return;
+		accumulator = (accumulator << n) | (value & (0xffffffff >> (32 - n)));
+		bits += n;
+		while(bits >= 8) {
+			bits -= 8;
+			output.push_back((uint8_t)(accumulator >> bits));
+		}
+	}
+
+	inline void put_rice(uint64_t u, int k) {
+		uint64_t q = u >> k;
+		if(q < RICE_ESCAPE) {
+			put(0xfffffffe, q + 1); // q ones and a terminating zero
+			put((uint32_t)u, k);
+		} else {
+			put(0xffffffff, RICE_ESCAPE);
+			put((uint32_t)(u >> 32), RICE_ESCAPE_BITS - 32);
+			put((uint32_t)u, 32);
+		}
+	}
+
+	// pad to the next byte boundary
+	void flush() {
+		if(bits > 0) put(0, 8 - bits);
+	}
+};
+
+class BitReader {
+public:
+	const uint8_t *p, *end;
+	uint64_t accumulator; // valid bits are MSB aligned
+	int bits;
+	uint64_t consumed, available;
+
+	BitReader(const uint8_t *start, const uint8_t *_end)
+		: p(start), end(_end), accumulator(0), bits(0), consumed(0), available((_end - start) * 8) {}
+
+	inline void refill() {
+		while(bits <= 56) {
+			uint64_t b = p < end ? *p++ : 0;
+			accumulator |= b << (56 - bits);
+			bits += 8;
+		}
+	}
+
+	// n must be 32 or less
+	inline uint32_t get(int n) {
+		if(n == 0) return 0;
+		refill();
+		uint32_t v = (uint32_t)(accumulator >> (64 - n));
+		accumulator <<= n;
+		bits -= n;
+		consumed += n;
+		return v;
+	}
+
+	inline uint64_t get_rice(int k) {
+		refill();
+		uint32_t top = ~(uint32_t)(accumulator >> 32);
+		int q = top == 0 ? RICE_ESCAPE : __builtin_clz(top);
+		if(q < RICE_ESCAPE) {
+			accumulator <<= q + 1;
+			bits -= q + 1;
+			consumed += q + 1;
+			return (((uint64_t)q) << k) | get(k);
+		}
+		get(RICE_ESCAPE);
+		uint64_t u = ((uint64_t)get(RICE_ESCAPE_BITS - 32)) << 32;
+		return u | get(32);
+	}
+
+	bool overrun() {
+		return consumed > available;
+	}
+};
+
+static inline int32_t read_sample(const void *data, Resolution r, size_t k) {
+	switch(r) {
+	case _8bit: return ((const int8_t *)data)[k];
+	case _16bit: return ((const int16_t *)data)[k];
+	default: return ((const int32_t *)data)[k];
+	}
+}
+
+static inline void write_sample(void *data, Resolution r, size_t k, int32_t value) {
+	switch(r) {
+	case _8bit: ((int8_t *)data)[k] = value; break;
+	case _16bit: ((int16_t *)data)[k] = value; break;
+	default: ((int32_t *)data)[k] = value; break;
+	}
+}
+
+static inline uint64_t zigzag(int64_t v) {
+	return (((uint64_t)v) << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t u) {
+	return (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+}
+
+static inline int64_t predict(const int32_t *y, int i, int order) {
+	switch(order) {
+	case 1: return y[i - 1];
+	case 2: return 2 * (int64_t)y[i - 1] - y[i - 2];
+	case 3: return 3 * ((int64_t)y[i - 1] - y[i - 2]) + y[i - 3];
+	}
+	return 0;
+}
+
+static void encode_block(BitWriter &out, const void *data, Resolution r,
+			 int channels, int first_frame, int frames, std::vector<int32_t> &y) {
+	y.resize(frames);
+	for(int c = 0; c < channels; c++) {
+		// remove trailing zero bits common to all samples
+		uint32_t all = 0;
+		for(int i = 0; i < frames; i++) {
+			y[i] = read_sample(data, r, (size_t)(first_frame + i) * channels + c);
+			all |= (uint32_t)y[i];
+		}
+		int wasted = all == 0 ? 0 : __builtin_ctz(all);
+		if(wasted > 0)
+			for(int i = 0; i < frames; i++) y[i] >>= wasted;
+
+		// pick the predictor with the smallest residual
+		uint64_t sum[4] = {0, 0, 0, 0};
+		for(int i = 0; i < frames; i++)
+			for(int o = 0; o < 4 && o <= i; o++)
+				sum[o] += zigzag(y[i] - predict(y.data(), i, o));
+		int order = 0;
+		for(int o = 1; o < 4 && o < frames; o++)
+			if(sum[o] < sum[order]) order = o;
+
+		uint64_t mean = sum[order] / (frames - order > 0 ? frames - order : 1);
+		int k = 0;
+		while(k < 31 && (((uint64_t)2) << k) <= mean) k++;
+
+		out.put(order, 2);
+		out.put(wasted, 5);
+		out.put(k, 5);
+		for(int i = 0; i < order; i++)
+			out.put((uint32_t)y[i], 32);
+		for(int i = order; i < frames; i++)
+			out.put_rice(zigzag(y[i] - predict(y.data(), i, order)), k);
+	}
+	out.flush();
+}
+
+static bool decode_block(BitReader &in, void *data, Resolution r,
+			 int channels, int first_frame, int frames, std::vector<int32_t> &y) {
+	y.resize(frames);
+	for(int c = 0; c < channels; c++) {
+		int order = in.get(2);
+		int wasted = in.get(5);
+		int k = in.get(5);
+		if(order > frames) return false;
+
+		for(int i = 0; i < order; i++)
+			y[i] = (int32_t)in.get(32);
+		for(int i = order; i < frames; i++)
+			y[i] = (int32_t)(predict(y.data(), i, order) + unzigzag(in.get_rice(k)));
+
+		if(in.overrun()) return false;
+
+		for(int i = 0; i < frames; i++)
+			write_sample(data, r, (size_t)(first_frame + i) * channels + c,
+				     (int32_t)((uint32_t)y[i] << wasted));
+	}
+	return true;
+}
+
+/*****************************
+ *
+ * Saving
+ *
+ *****************************/
+
+void StaticSignalFile::save(const std::string &path,
+			    Resolution resolution, int channels, int frames, int frequency,
+			    const void *data) {
+	int sample_size = get_sample_size(resolution);
+	if(sample_size == 0 || channels <= 0 || frames < 0)
+		throw jException("Can not store static signal in this format.", jException::sanity_error);
+
+	uint64_t raw_size = (uint64_t)frames * channels * sample_size;
+	uint8_t header[STATIC_SIGNAL_FILE_HEADER_SIZE];
+
+	// signals that are large enough to be streamed are kept raw so they can be streamed again
+	if(compression_enabled && resolution != _fl32bit && frames > 0 &&
+	   (uint64_t)frames * channels * sizeof(fp8p24_t) <= STATIC_SIGNAL_STREAM_THRESHOLD) {
+		int block_count = (frames + STATIC_SIGNAL_FILE_BLOCK_FRAMES - 1) / STATIC_SIGNAL_FILE_BLOCK_FRAMES;
+		std::vector<uint8_t> compressed(block_count * sizeof(uint32_t));
+		compressed.reserve(raw_size / 2);
+		std::vector<int32_t> y;
+		BitWriter out(compressed);
+
+		for(int b = 0; b < block_count; b++) {
+			put_le(&compressed[b * sizeof(uint32_t)], compressed.size(), 4);
+			int first = b * STATIC_SIGNAL_FILE_BLOCK_FRAMES;
+			int n = frames - first;
+			if(n > STATIC_SIGNAL_FILE_BLOCK_FRAMES) n = STATIC_SIGNAL_FILE_BLOCK_FRAMES;
+			encode_block(out, data, resolution, channels, first, n, y);
+
+			if(compressed.size() >= raw_size) break; // not worth it
+		}
+
+		if(compressed.size() < raw_size) {
+			fill_header(header, _lpc_rice, resolution, channels, frames, frequency,
+				    compressed.size(), STATIC_SIGNAL_FILE_BLOCK_FRAMES);
+			TemporaryFile f(path);
+			f.write(header, sizeof(header));
+			f.write(compressed.data(), compressed.size());
+			f.commit();
+			return;
+		}
+	}
+
+	fill_header(header, _raw, resolution, channels, frames, frequency, raw_size, 0);
+	TemporaryFile f(path);
+	f.write(header, sizeof(header));
+#ifdef STATIC_SIGNAL_FILE_BIG_ENDIAN_HOST
+	std::vector<uint8_t> le(raw_size);
+	memcpy(le.data(), data, raw_size);
+	convert_byte_order(le.data(), (size_t)frames * channels, sample_size);
+	f.write(le.data(), raw_size);
+#else
+	f.write(data, raw_size);
+#endif
+	f.commit();
+}
+
+void StaticSignalFile::save(const std::string &path, int frequency, StaticSignalStream *stream) {
+	int channels = stream->get_channels();
+	int frames = stream->get_frames();
+	uint8_t header[STATIC_SIGNAL_FILE_HEADER_SIZE];
+
+	fill_header(header, _raw, _fx8p24bit, channels, frames, frequency,
+		    (uint64_t)frames * channels * sizeof(fp8p24_t), 0);
+
+	TemporaryFile f(path);
+	f.write(header, sizeof(header));
+
+	std::vector<fp8p24_t> chunk(STATIC_SIGNAL_STREAM_PAGE_FRAMES * channels);
+	for(int frame = 0; frame < frames; frame += STATIC_SIGNAL_STREAM_PAGE_FRAMES) {
+		int n = frames - frame;
+		if(n > STATIC_SIGNAL_STREAM_PAGE_FRAMES) n = STATIC_SIGNAL_STREAM_PAGE_FRAMES;
+		stream->read_frames(frame, n, chunk.data());
+		convert_byte_order(chunk.data(), n * channels, sizeof(fp8p24_t));
+		f.write(chunk.data(), n * channels * sizeof(fp8p24_t));
+	}
+	f.commit();
+}
+
+void StaticSignalFile::set_compression(bool enabled) {
+	compression_enabled = enabled;
+}
+
+/*****************************
+ *
+ * Loading
+ *
+ *****************************/
+
+static StaticSignalFile::Content parse_header(int fd, const std::string &path) {
+	struct stat st;
+	uint8_t header[STATIC_SIGNAL_FILE_HEADER_SIZE];
+
+	if(fstat(fd, &st) != 0 || !read_all(fd, header, sizeof(header), 0))
+		throw jException(std::string("Failed to read ") + path + ".", jException::syscall_error);
+
+	if(memcmp(header, "VKSS", 4) != 0)
+		throw jException(std::string(path) + " is not a static signal file.", jException::sanity_error);
+	if(get_le(&header[60], 4) != crc32(header, 60))
+		throw jException(std::string(path) + " has a corrupt header.", jException::sanity_error);
+	if(get_le(&header[4], 2) > STATIC_SIGNAL_FILE_VERSION)
+		throw jException(std::string("You need a newer version of this application to load ") + path + ".",
+				 jException::sanity_error);
+
+	StaticSignalFile::Content c;
+	c.encoding = (StaticSignalFile::Encoding)get_le(&header[6], 2);
+	c.resolution = (Resolution)get_le(&header[8], 2);
+	int sample_size = get_le(&header[10], 2);
+	uint64_t channels = get_le(&header[12], 4);
+	uint64_t frames = get_le(&header[16], 4);
+	c.frequency = get_le(&header[20], 4);
+	uint64_t data_offset = get_le(&header[24], 8);
+	c.data_size = get_le(&header[32], 8);
+	c.block_frames = get_le(&header[40], 4);
+	c.data = NULL;
+	c.mapping = NULL;
+	c.mapping_size = 0;
+
+	bool valid =
+		sample_size != 0 && sample_size == get_sample_size(c.resolution) &&
+		channels > 0 && channels < 0x10000 && frames < 0x80000000 &&
+		data_offset >= STATIC_SIGNAL_FILE_HEADER_SIZE && data_offset % sizeof(int32_t) == 0 &&
+		data_offset + c.data_size <= (uint64_t)st.st_size;
+	if(c.encoding == StaticSignalFile::_raw)
+		valid = valid && c.data_size == frames * channels * sample_size;
+	else if(c.encoding == StaticSignalFile::_lpc_rice)
+		valid = valid && c.block_frames > 0 && c.resolution != _fl32bit;
+	else
+		valid = false;
+
+	if(!valid)
+		throw jException(std::string(path) + " has an invalid header.", jException::sanity_error);
+
+	c.channels = channels;
+	c.frames = frames;
+	c.data_offset = data_offset;
+	return c;
+}
+
+StaticSignalFile::Content StaticSignalFile::probe(const std::string &path) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd == -1)
+		throw jException(std::string("Failed to open ") + path + ".", jException::syscall_error);
+	try {
+		Content c = parse_header(fd, path);
+		close(fd);
+		return c;
+	} catch(...) {
+		close(fd);
+		throw;
+	}
+}
+
+static void *map_file(int fd, size_t size) {
+	int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+	flags |= MAP_POPULATE;
+#endif
+	// private and writable, a machine that writes to a static signal only changes its own copy
+	void *m = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+	return m == MAP_FAILED ? NULL : m;
+}
+
+StaticSignalFile::Content StaticSignalFile::load(const std::string &path) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd == -1)
+		throw jException(std::string("Failed to open ") + path + ".", jException::syscall_error);
+
+	Content c;
+	try {
+		c = parse_header(fd, path);
+	} catch(...) {
+		close(fd);
+		throw;
+	}
+
+	int sample_size = get_sample_size(c.resolution);
+	size_t samples = (size_t)c.frames * c.channels;
+	size_t file_size = c.data_offset + c.data_size;
+
+	if(c.encoding == _raw) {
+#ifndef STATIC_SIGNAL_FILE_BIG_ENDIAN_HOST
+		// use the file directly
+		c.mapping = map_file(fd, file_size);
+		if(c.mapping != NULL) {
+			// we are going to read this from the audio thread, so try to keep it in RAM
+			(void)mlock(c.mapping, file_size);
+			c.mapping_size = file_size;
+			c.data = ((uint8_t *)c.mapping) + c.data_offset;
+			close(fd);
+			return c;
+		}
+#endif
+		c.data = malloc(c.data_size > 0 ? c.data_size : 1);
+		if(c.data == NULL || !read_all(fd, c.data, c.data_size, c.data_offset)) {
+			if(c.data) free(c.data);
+			close(fd);
+			throw jException(std::string("Failed to read ") + path + ".", jException::syscall_error);
+		}
+		close(fd);
+		convert_byte_order(c.data, samples, sample_size);
+		return c;
+	}
+
+	uint8_t *m = (uint8_t *)map_file(fd, file_size);
+	close(fd);
+	if(m == NULL)
+		throw jException(std::string("Failed to read ") + path + ".", jException::syscall_error);
+
+	c.data = malloc(samples > 0 ? samples * sample_size : 1);
+	if(c.data == NULL) {
+		munmap(m, file_size);
+		throw jException("Could not allocate enough memory for static signal.", jException::sanity_error);
+	}
+
+	const uint8_t *blocks = m + c.data_offset;
+	int block_count = (c.frames + c.block_frames - 1) / c.block_frames;
+	bool valid = (uint64_t)block_count * sizeof(uint32_t) <= c.data_size;
+	std::vector<int32_t> y;
+
+	for(int b = 0; valid && b < block_count; b++) {
+		uint64_t start = get_le(&blocks[b * sizeof(uint32_t)], 4);
+		uint64_t stop = b + 1 < block_count ? get_le(&blocks[(b + 1) * sizeof(uint32_t)], 4) : c.data_size;
+		if(start < (uint64_t)block_count * sizeof(uint32_t) || start > stop || stop > c.data_size) {
+			valid = false;
+			break;
+		}
+
+		int first = b * c.block_frames;
+		int n = c.frames - first;
+		if(n > c.block_frames) n = c.block_frames;
+
+		BitReader in(&blocks[start], &blocks[stop]);
+		valid = decode_block(in, c.data, c.resolution, c.channels, first, n, y);
+	}
+	munmap(m, file_size);
+
+	if(!valid) {
+		free(c.data);
+		throw jException(std::string(path) + " is corrupt.", jException::sanity_error);
+	}
+	return c;
+}
+
+void StaticSignalFile::release(Content &c) {
+	if(c.mapping)
+		munmap(c.mapping, c.mapping_size);
+	else if(c.data)
+		free(c.data);
+	c.data = NULL;
+	c.mapping = NULL;
+	c.mapping_size = 0;
+}
+
+bool StaticSignalFile::is_static_signal_file(const std::string &path) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd == -1) return false;
+
+	uint8_t magic[4];
+	bool retval = read_all(fd, magic, sizeof(magic), 0) && memcmp(magic, "VKSS", 4) == 0;
+	close(fd);
+	return retval;
+}
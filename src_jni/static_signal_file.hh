@@ -0,0 +1,115 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#ifndef __STATIC_SIGNAL_FILE
+#define __STATIC_SIGNAL_FILE
+
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "dynlib/dynlib.h"
+#include "static_signal_stream.hh"
+
+#define STATIC_SIGNAL_FILE_VERSION 1
+
+// size of the header, the data (or the block table) starts directly after it
+#define STATIC_SIGNAL_FILE_HEADER_SIZE 64
+
+// frames per independently compressed block
+#define STATIC_SIGNAL_FILE_BLOCK_FRAMES 4096
+
+/*
+ * Storage format for static signals in a project directory.
+ *
+ * All fields and samples are little endian. The header is followed either by
+ * the raw samples, which means the file can be memory mapped and used directly
+ * on little endian hosts, or by a table of block offsets and the compressed blocks.
+ *
+ * Compression is lossless. Each block and channel is coded separately, the
+ * trailing zero bits common to all samples are removed, the best fixed
+ * polynomial predictor (order 0 to 3) is chosen and the residual is Rice coded.
+ * Floating point data is always stored raw.
+ *
+ *   offset  size
+ *        0     4  magic "VKSS"
+ *        4     2  version
+ *        6     2  encoding, see Encoding
+ *        8     2  resolution (enum Resolution)
+ *       10     2  bytes per sample value
+ *       12     4  channels
+ *       16     4  frames
+ *       20     4  frequency
+ *       24     8  data offset
+ *       32     8  data size, in bytes
+ *       40     4  frames per compressed block
+ *       44    16  reserved, zero
+ *       60     4  CRC-32 of the bytes 0 to 59
+ */
+class StaticSignalFile {
+public:
+	enum Encoding {
+		_raw = 0,
+		_lpc_rice = 1
+	};
+
+	class Content {
+	public:
+		Resolution resolution;
+		Encoding encoding;
+		int channels, frames, frequency;
+		off_t data_offset;
+		uint64_t data_size;
+		int block_frames;
+
+		// set by load() - data is either malloc:ed, or points into a memory mapping
+		void *data;
+		void *mapping;
+		size_t mapping_size;
+	};
+
+	// Save a signal, the file is written to a temporary file which is then renamed.
+	// Throws jException on failure.
+	static void save(const std::string &path,
+			 Resolution resolution, int channels, int frames, int frequency,
+			 const void *data);
+
+	// Save a streamed signal, it's always stored raw so it can be streamed again.
+	static void save(const std::string &path, int frequency, StaticSignalStream *stream);
+
+	// Read and verify the header. Throws jException if the file is not valid.
+	static Content probe(const std::string &path);
+
+	// Load the complete signal. Throws jException if the file is not valid.
+	static Content load(const std::string &path);
+
+	// free or unmap the data returned from load()
+	static void release(Content &content);
+
+	static bool is_static_signal_file(const std::string &path);
+
+	// enable or disable compression when saving, enabled by default
+	static void set_compression(bool enabled);
+
+private:
+	static bool compression_enabled;
+};
+
+#endif
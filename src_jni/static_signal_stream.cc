@@ -0,0 +1,644 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <mutex>
+#include <vector>
+
+#include <jngldrum/jexception.hh>
+
+#include "static_signal_stream.hh"
+
+//#define __DO_SATAN_DEBUG
+#include "satan_debug.hh"
+
+// must be a power of two
+#define STATIC_SIGNAL_STREAM_REQUEST_QUEUE_SIZE 256
+
+// how often the prefetch thread wakes up to free retired pages, in milliseconds
+#define STATIC_SIGNAL_STREAM_IDLE_TIMEOUT 100
+
+// a pointer returned from read() stays valid for this many calls to advance_cycle()
+#define STATIC_SIGNAL_STREAM_GRACE_CYCLES 2
+
+// how long a blocking read() waits for a page before it gives up, in milliseconds
+#define STATIC_SIGNAL_STREAM_BLOCKING_TIMEOUT 2000
+
+std::atomic<unsigned int> StaticSignalStream::cycle(0);
+
+static std::atomic<int64_t> stat_hits(0), stat_misses(0), stat_prefetched(0), stat_evicted(0);
+static std::atomic<int64_t> cache_bytes(0), cache_limit(STATIC_SIGNAL_STREAM_DEFAULT_CACHE_SIZE);
+static std::atomic<int> open_streams(0);
+static std::atomic<bool> blocking_reads(false);
+
+/*****************************
+ *
+ * The prefetch thread
+ *
+ *****************************/
+
+class StaticSignalStream::PrefetchThread {
+public:
+	static PrefetchThread *get();
+	static PrefetchThread *instance;
+
+	// lock-free - returns false if the request queue is full
+	bool push(StaticSignalStream *stream, int page);
+
+	// lock-free
+	void push_released(StaticSignalStream *stream);
+
+private:
+	// bounded multi producer queue with per cell sequence numbers, as in MachineOperationQueue
+	class Request {
+	public:
+		std::atomic<unsigned int> sequence;
+		StaticSignalStream *stream;
+		int page;
+	};
+
+	Request requests[STATIC_SIGNAL_STREAM_REQUEST_QUEUE_SIZE];
+	std::atomic<unsigned int> enqueue_position, dequeue_position;
+
+	std::atomic<StaticSignalStream *> released_head;
+
+	sem_t wake_up;
+	pthread_t thread;
+
+	// only used by the prefetch thread
+	std::vector<Page *> cached;
+	std::vector<Page *> retired;
+	std::vector<StaticSignalStream *> releasing;
+
+	PrefetchThread();
+
+	bool pop(StaticSignalStream **stream, int *page);
+
+	void load_page(StaticSignalStream *stream, int page);
+	bool make_room(int64_t bytes);
+	void evict(unsigned int k);
+	void collect_garbage(unsigned int now);
+
+	static void *thread_entry(void *pt);
+	void thread_body();
+};
+
+StaticSignalStream::PrefetchThread *StaticSignalStream::PrefetchThread::instance = NULL;
+
+StaticSignalStream::PrefetchThread *StaticSignalStream::PrefetchThread::get() {
+	static std::mutex creation_lock;
+	std::lock_guard<std::mutex> lock(creation_lock);
+
+	if(instance == NULL)
+		instance = new PrefetchThread();
+	return instance;
+}
+
+StaticSignalStream::PrefetchThread::PrefetchThread()
+	: enqueue_position(0), dequeue_position(0), released_head(NULL)
+{
+	for(unsigned int k = 0; k < STATIC_SIGNAL_STREAM_REQUEST_QUEUE_SIZE; k++)
+		requests[k].sequence.store(k, std::memory_order_relaxed);
+
+	sem_init(&wake_up, 0, 0);
+
+	if(pthread_create(&thread, NULL, thread_entry, this) != 0) {
+		sem_destroy(&wake_up);
+		throw jException("Failed to create static signal prefetch thread.",
+				 jException::syscall_error);
+	}
+}
+
+bool StaticSignalStream::PrefetchThread::push(StaticSignalStream *stream, int page) {
+	Request *r;
+	unsigned int pos = enqueue_position.load(std::memory_order_relaxed);
+	while(1) {
+		r = &requests[pos & (STATIC_SIGNAL_STREAM_REQUEST_QUEUE_SIZE - 1)];
+		unsigned int seq = r->sequence.load(std::memory_order_acquire);
+		int diff = (int)seq - (int)pos;
+		if(diff == 0) {
+			if(enqueue_position.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if(diff < 0) {
+			return false;
+		} else {
+			pos = enqueue_position.load(std::memory_order_relaxed);
+		}
+	}
+	r->stream = stream;
+	r->page = page;
+	r->sequence.store(pos + 1, std::memory_order_release);
+
+	sem_post(&wake_up);
+	return true;
+}
+
+// only the prefetch thread pops, so we don't need the CAS loop here
+bool StaticSignalStream::PrefetchThread::pop(StaticSignalStream **stream, int *page) {
+	unsigned int pos = dequeue_position.load(std::memory_order_relaxed);
+	Request *r = &requests[pos & (STATIC_SIGNAL_STREAM_REQUEST_QUEUE_SIZE - 1)];
+	if(r->sequence.load(std::memory_order_acquire) != pos + 1)
+		return false;
+
+	*stream = r->stream;
+	*page = r->page;
+	dequeue_position.store(pos + 1, std::memory_order_relaxed);
+	r->sequence.store(pos + STATIC_SIGNAL_STREAM_REQUEST_QUEUE_SIZE, std::memory_order_release);
+	return true;
+}
+
+void StaticSignalStream::PrefetchThread::push_released(StaticSignalStream *stream) {
+	StaticSignalStream *head = released_head.load(std::memory_order_relaxed);
+	do {
+		stream->next_released = head;
+	} while(!released_head.compare_exchange_weak(head, stream,
+						     std::memory_order_release,
+						     std::memory_order_relaxed));
+	sem_post(&wake_up);
+}
+
+void StaticSignalStream::PrefetchThread::evict(unsigned int k) {
+	Page *p = cached[k];
+	StaticSignalStream *s = p->owner;
+
+	s->pages[p->index].store(NULL, std::memory_order_release);
+	s->page_state[p->index].store(_page_absent, std::memory_order_release);
+
+	cache_bytes -= (int64_t)p->frames * s->channels * sizeof(fp8p24_t);
+	stat_evicted++;
+
+	// a reader might still use the page during this cycle
+	p->retired_cycle = cycle.load();
+	retired.push_back(p);
+
+	cached[k] = cached.back();
+	cached.pop_back();
+}
+
+bool StaticSignalStream::PrefetchThread::make_room(int64_t bytes) {
+	while(cache_bytes + bytes > cache_limit) {
+		// find the least recently used page that was not used in this or the previous cycle
+		unsigned int now = cycle.load();
+		int victim = -1;
+		int oldest = 0;
+		for(unsigned int k = 0; k < cached.size(); k++) {
+			int age = (int)(now - cached[k]->last_used.load(std::memory_order_relaxed));
+			if(age >= STATIC_SIGNAL_STREAM_GRACE_CYCLES && age >= oldest) {
+				oldest = age;
+				victim = k;
+			}
+		}
+		if(victim < 0) return false; // everything is in use
+
+		evict(victim);
+	}
+	return true;
+}
+
+void StaticSignalStream::PrefetchThread::load_page(StaticSignalStream *s, int page) {
+	if(s->released || s->page_state[page].load() != _page_requested) return;
+
+	int start = page * STATIC_SIGNAL_STREAM_PAGE_FRAMES;
+	int frames = s->frames - start;
+	if(frames > STATIC_SIGNAL_STREAM_PAGE_FRAMES) frames = STATIC_SIGNAL_STREAM_PAGE_FRAMES;
+	int64_t bytes = (int64_t)frames * s->channels * sizeof(fp8p24_t);
+
+	if(!make_room(bytes)) {
+		// the reader will request it again
+		SATAN_DEBUG("StaticSignalStream - cache is full, could not load page %d.\n", page);
+		s->page_state[page].store(_page_absent);
+		return;
+	}
+
+	Page *p = new Page();
+	p->owner = s;
+	p->index = page;
+	p->frames = frames;
+	p->last_used = cycle.load();
+	p->retired_cycle = 0;
+	p->data = (fp8p24_t *)malloc(bytes);
+
+	if(p->data == NULL || !s->load_from_file(start, frames, p->data)) {
+		SATAN_ERROR("StaticSignalStream - failed to load page %d.\n", page);
+		if(p->data) free(p->data);
+		delete p;
+		s->page_state[page].store(_page_failed);
+		return;
+	}
+
+	cached.push_back(p);
+	cache_bytes += bytes;
+	stat_prefetched++;
+
+	s->pages[page].store(p, std::memory_order_release);
+	s->page_state[page].store(_page_resident, std::memory_order_release);
+}
+
+void StaticSignalStream::PrefetchThread::collect_garbage(unsigned int now) {
+	for(unsigned int k = 0; k < retired.size(); ) {
+		if((int)(now - retired[k]->retired_cycle) >= STATIC_SIGNAL_STREAM_GRACE_CYCLES) {
+			free(retired[k]->data);
+			delete retired[k];
+			retired[k] = retired.back();
+			retired.pop_back();
+		} else {
+			k++;
+		}
+	}
+
+	StaticSignalStream *s = released_head.exchange(NULL, std::memory_order_acquire);
+	while(s != NULL) {
+		releasing.push_back(s);
+		s = s->next_released;
+	}
+
+	for(unsigned int k = 0; k < releasing.size(); ) {
+		s = releasing[k];
+		if((int)(now - s->release_cycle) < STATIC_SIGNAL_STREAM_GRACE_CYCLES) {
+			k++;
+			continue;
+		}
+
+		// no reader can see the stream anymore, and the request queue
+		// has been drained, so we can free everything directly
+		for(unsigned int c = 0; c < cached.size(); ) {
+			Page *p = cached[c];
+			if(p->owner == s) {
+				cache_bytes -= (int64_t)p->frames * s->channels * sizeof(fp8p24_t);
+				free(p->data);
+				delete p;
+				cached[c] = cached.back();
+				cached.pop_back();
+			} else {
+				c++;
+			}
+		}
+		delete s;
+
+		releasing[k] = releasing.back();
+		releasing.pop_back();
+	}
+}
+
+void *StaticSignalStream::PrefetchThread::thread_entry(void *pt) {
+	((PrefetchThread *)pt)->thread_body();
+	return NULL;
+}
+
+void StaticSignalStream::PrefetchThread::thread_body() {
+	while(1) {
+		struct timespec timeout;
+		clock_gettime(CLOCK_REALTIME, &timeout);
+		timeout.tv_nsec += STATIC_SIGNAL_STREAM_IDLE_TIMEOUT * 1000000;
+		if(timeout.tv_nsec >= 1000000000) {
+			timeout.tv_sec++;
+			timeout.tv_nsec -= 1000000000;
+		}
+		while(sem_timedwait(&wake_up, &timeout) != 0 && errno == EINTR);
+
+		// read before draining the queue, see collect_garbage()
+		unsigned int now = cycle.load();
+
+		StaticSignalStream *s;
+		int page;
+		while(pop(&s, &page))
+			load_page(s, page);
+
+		collect_garbage(now);
+	}
+}
+
+/*****************************
+ *
+ * Creation and destruction
+ *
+ *****************************/
+
+StaticSignalStream::StaticSignalStream(const std::string &path, off_t _data_offset,
+				       SourceFormat _format, int _bits_per_sample,
+				       int _channels, int _frames)
+	: fd(-1), data_offset(_data_offset), format(_format)
+	, bits_per_sample(_bits_per_sample), channels(_channels), frames(_frames)
+	, resident(NULL), resident_frames(0), page_count(0), pages(NULL), page_state(NULL)
+	, released(false), release_cycle(0), next_released(NULL)
+{
+	if(channels <= 0 || frames <= 0)
+		throw jException("Static signal stream is empty.", jException::sanity_error);
+	if(!convert(format, bits_per_sample, NULL, NULL, 0))
+		throw jException("Static signal stream - unsupported sample format.", jException::sanity_error);
+
+	source_frame_size = channels * bits_per_sample / 8;
+
+	// make sure the prefetch thread is running before anyone can call read()
+	(void)PrefetchThread::get();
+
+	fd = open(path.c_str(), O_RDONLY);
+	if(fd == -1)
+		throw jException("Failed to open static signal stream.", jException::syscall_error);
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 ||
+	   st.st_size < data_offset + (off_t)frames * source_frame_size) {
+		close(fd);
+		throw jException("Static signal stream - file is incomplete on disk.", jException::sanity_error);
+	}
+
+	resident_frames = STATIC_SIGNAL_STREAM_RESIDENT_PAGES * STATIC_SIGNAL_STREAM_PAGE_FRAMES;
+	if(resident_frames > frames) resident_frames = frames;
+
+	resident = (fp8p24_t *)malloc(resident_frames * channels * sizeof(fp8p24_t));
+	if(resident == NULL || !load_from_file(0, resident_frames, resident)) {
+		if(resident) free(resident);
+		close(fd);
+		throw jException("Failed to read static signal stream.", jException::syscall_error);
+	}
+
+	page_count = (frames + STATIC_SIGNAL_STREAM_PAGE_FRAMES - 1) / STATIC_SIGNAL_STREAM_PAGE_FRAMES;
+	pages = new std::atomic<Page *>[page_count];
+	page_state = new std::atomic<int>[page_count];
+	for(int k = 0; k < page_count; k++) {
+		pages[k].store(NULL, std::memory_order_relaxed);
+		page_state[k].store(
+			k < STATIC_SIGNAL_STREAM_RESIDENT_PAGES ? _page_resident : _page_absent,
+			std::memory_order_relaxed);
+	}
+
+	open_streams++;
+}
+
+StaticSignalStream::~StaticSignalStream() {
+	open_streams--;
+
+	delete[] pages;
+	delete[] page_state;
+	free(resident);
+	close(fd);
+}
+
+void StaticSignalStream::release() {
+	release_cycle = cycle.load();
+	released = true;
+	PrefetchThread::instance->push_released(this);
+}
+
+/*****************************
+ *
+ * Reading
+ *
+ *****************************/
+
+int StaticSignalStream::get_channels() {
+	return channels;
+}
+
+int StaticSignalStream::get_frames() {
+	return frames;
+}
+
+fp8p24_t *StaticSignalStream::get_resident() {
+	return resident;
+}
+
+int StaticSignalStream::get_resident_frames() {
+	return resident_frames;
+}
+
+void StaticSignalStream::request(int page) {
+	int expected = _page_absent;
+	if(page_state[page].compare_exchange_strong(expected, _page_requested)) {
+		if(!PrefetchThread::instance->push(this, page))
+			page_state[page].store(_page_absent); // queue full, try again later
+	}
+}
+
+void StaticSignalStream::request_ahead(int page) {
+	for(int k = page; k < page + STATIC_SIGNAL_STREAM_PREFETCH_PAGES && k < page_count; k++) {
+		if(page_state[k].load(std::memory_order_relaxed) == _page_absent)
+			request(k);
+	}
+}
+
+int StaticSignalStream::read(int frame, fp8p24_t **data) {
+	if(frame < 0 || frame >= frames) {
+		*data = NULL;
+		return 0;
+	}
+
+	if(frame < resident_frames) {
+		// get the first streamed pages ready while we play the attack
+		request_ahead(STATIC_SIGNAL_STREAM_RESIDENT_PAGES);
+		*data = &resident[frame * channels];
+		return resident_frames - frame;
+	}
+
+	int page = frame / STATIC_SIGNAL_STREAM_PAGE_FRAMES;
+	int offset = frame - page * STATIC_SIGNAL_STREAM_PAGE_FRAMES;
+
+	request_ahead(page + 1);
+
+	Page *p = pages[page].load(std::memory_order_acquire);
+	if(p != NULL) {
+		p->last_used.store(cycle.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		stat_hits.fetch_add(1, std::memory_order_relaxed);
+		*data = &(p->data[offset * channels]);
+		return p->frames - offset;
+	}
+
+	request(page);
+
+	if(blocking_reads.load(std::memory_order_relaxed)) {
+		for(int k = 0; k < STATIC_SIGNAL_STREAM_BLOCKING_TIMEOUT &&
+			    page_state[page].load() != _page_failed; k++) {
+			usleep(1000);
+			if((p = pages[page].load(std::memory_order_acquire)) != NULL) {
+				p->last_used.store(cycle.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				*data = &(p->data[offset * channels]);
+				return p->frames - offset;
+			}
+			// the queue was full, or the page did not fit in the cache
+			if(page_state[page].load(std::memory_order_relaxed) == _page_absent)
+				request(page);
+		}
+	}
+
+	stat_misses.fetch_add(1, std::memory_order_relaxed);
+
+	int page_end = (page + 1) * STATIC_SIGNAL_STREAM_PAGE_FRAMES;
+	if(page_end > frames) page_end = frames;
+	*data = NULL;
+	return frame - page_end;
+}
+
+void StaticSignalStream::read_frames(int frame, int count, fp8p24_t *destination) {
+	if(frame < 0 || count < 0 || frame + count > frames)
+		throw jException("Static signal stream - read out of range.", jException::sanity_error);
+
+	if(frame < resident_frames) {
+		int n = resident_frames - frame;
+		if(n > count) n = count;
+		memcpy(destination, &resident[frame * channels], n * channels * sizeof(fp8p24_t));
+		frame += n;
+		count -= n;
+		destination += n * channels;
+	}
+
+	if(count > 0 && !load_from_file(frame, count, destination))
+		throw jException("Failed to read static signal stream.", jException::syscall_error);
+}
+
+bool StaticSignalStream::load_from_file(int frame, int count, fp8p24_t *destination) {
+	std::vector<uint8_t> raw((size_t)count * source_frame_size);
+	off_t position = data_offset + (off_t)frame * source_frame_size;
+	size_t done = 0;
+
+	while(done < raw.size()) {
+		ssize_t r = pread(fd, &raw[done], raw.size() - done, position + done);
+		if(r < 0 && errno == EINTR) continue;
+		if(r <= 0) return false;
+		done += r;
+	}
+
+	return convert(format, bits_per_sample, raw.data(), destination, count * channels);
+}
+
+bool StaticSignalStream::convert(SourceFormat format, int bits_per_sample,
+				 const uint8_t *_byte, fp8p24_t *destination, int count) {
+	if(format == _fp8p24_be) {
+		if(bits_per_sample != 32) return false;
+		for(int k = 0; k < count; k++) {
+			uint32_t tmp =
+				(((uint32_t)_byte[4 * k + 0]) << 24) |
+				(((uint32_t)_byte[4 * k + 1]) << 16) |
+				(((uint32_t)_byte[4 * k + 2]) << 8) |
+				(((uint32_t)_byte[4 * k + 3]) << 0);
+			destination[k] = (fp8p24_t)tmp;
+		}
+		return true;
+	}
+
+	if(format == _fp8p24_le) {
+		if(bits_per_sample != 32) return false;
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+		memcpy(destination, _byte, count * sizeof(fp8p24_t));
+#else
+		for(int k = 0; k < count; k++) {
+			uint32_t tmp =
+				(((uint32_t)_byte[4 * k + 3]) << 24) |
+				(((uint32_t)_byte[4 * k + 2]) << 16) |
+				(((uint32_t)_byte[4 * k + 1]) << 8) |
+				(((uint32_t)_byte[4 * k + 0]) << 0);
+			destination[k] = (fp8p24_t)tmp;
+		}
+#endif
+		return true;
+	}
+
+	for(int k = 0; k < count; k++) {
+		uint32_t tmp = 0;
+		int32_t *tmp_signed = (int32_t *)&tmp;
+
+		switch(bits_per_sample) {
+		case 8:
+			tmp = ((uint32_t)_byte[k]) << 24;
+			break;
+
+		case 16:
+			tmp =
+				(((uint32_t)_byte[2 * k + 1]) << 24)
+				|
+				(((uint32_t)_byte[2 * k + 0]) << 16)
+				;
+			break;
+
+		case 24:
+			tmp =
+				(((uint32_t)_byte[3 * k + 2]) << 24)
+				|
+				(((uint32_t)_byte[3 * k + 1]) << 16)
+				|
+				(((uint32_t)_byte[3 * k + 0]) << 8)
+				;
+			break;
+
+		case 32:
+			tmp =
+				(((uint32_t)_byte[4 * k + 3]) << 24)
+				|
+				(((uint32_t)_byte[4 * k + 2]) << 16)
+				|
+				(((uint32_t)_byte[4 * k + 1]) << 8)
+				|
+				(((uint32_t)_byte[4 * k + 0]) << 0)
+				;
+			break;
+
+		default:
+			return false; // can't understand this resolution...
+		}
+
+		destination[k] = (*tmp_signed) >> 8; // shift it down to a value between -1.0 to 1.0
+	}
+	return true;
+}
+
+/*****************************
+ *
+ * Cycles and statistics
+ *
+ *****************************/
+
+void StaticSignalStream::advance_cycle() {
+	cycle.fetch_add(1);
+}
+
+StaticSignalStream::Statistics StaticSignalStream::get_statistics() {
+	Statistics s;
+	s.hits = stat_hits;
+	s.misses = stat_misses;
+	s.prefetched = stat_prefetched;
+	s.evicted = stat_evicted;
+	s.cache_bytes = cache_bytes;
+	s.cache_limit = cache_limit;
+	s.streams = open_streams;
+	return s;
+}
+
+void StaticSignalStream::clear_statistics() {
+	stat_hits = 0;
+	stat_misses = 0;
+	stat_prefetched = 0;
+	stat_evicted = 0;
+}
+
+void StaticSignalStream::set_blocking_reads(bool blocking) {
+	blocking_reads = blocking;
+}
+
+void StaticSignalStream::set_cache_limit(size_t bytes) {
+	cache_limit = bytes;
+}
@@ -0,0 +1,171 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#ifndef __STATIC_SIGNAL_STREAM
+#define __STATIC_SIGNAL_STREAM
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#else
+#error "CAN'T FIND config.h"
+#endif
+
+#include "fixedpointmath.h"
+
+// static signals with more data than this, after conversion to fp8p24_t,
+// are streamed from disk instead of loaded into RAM
+// (30 seconds of 2 channel data at 44100 samples / second)
+#define STATIC_SIGNAL_STREAM_THRESHOLD (44100 * 2 * sizeof(fp8p24_t) * 30)
+
+// frames per cache page
+#define STATIC_SIGNAL_STREAM_PAGE_FRAMES 8192
+
+// number of pages at the start of a signal that are always kept in RAM
+#define STATIC_SIGNAL_STREAM_RESIDENT_PAGES 2
+
+// number of pages to request ahead of the play head
+#define STATIC_SIGNAL_STREAM_PREFETCH_PAGES 2
+
+// default size of the page cache, shared by all streams
+#define STATIC_SIGNAL_STREAM_DEFAULT_CACHE_SIZE (16 * 1024 * 1024)
+
+/*
+ * A StaticSignalStream keeps the first pages (the attack) of a static
+ * signal in RAM, and loads the rest from disk on demand. Pages are loaded by
+ * a background prefetch thread into a bounded cache that is shared by all
+ * streams, least recently used pages are evicted when the cache is full.
+ *
+ * read() is lock-free and never blocks or allocates memory, so it can be
+ * called from execute(). If the requested page is not in the cache yet it
+ * returns a negative frame count, which the caller should play as silence.
+ *
+ * Pages that are evicted, and streams that are released, are not freed
+ * until advance_cycle() has been called twice - so a pointer returned
+ * by read() is valid until the end of the current render cycle.
+ */
+class StaticSignalStream {
+public:
+	enum SourceFormat {
+		_wav_pcm_le, // little endian signed PCM (8 bit data is unsigned, as in WAV files)
+		_fp8p24_be, // big endian fp8p24_t, the format of static_sig_nr_X.dat
+		_fp8p24_le // little endian fp8p24_t, the format of raw StaticSignalFile data
+	};
+
+	class Statistics {
+	public:
+		int64_t hits; // read() found the data in RAM
+		int64_t misses; // read() had to return silence
+		int64_t prefetched; // pages loaded by the prefetch thread
+		int64_t evicted; // pages evicted to make room for new pages
+		int64_t cache_bytes; // current size of the page cache
+		int64_t cache_limit;
+		int streams; // number of open streams
+	};
+
+	// opens the file and loads the resident pages. Throws jException on failure.
+	StaticSignalStream(const std::string &path, off_t data_offset,
+			   SourceFormat format, int bits_per_sample,
+			   int channels, int frames);
+
+	int get_channels();
+	int get_frames();
+
+	// the resident part, in fp8p24_t format
+	fp8p24_t *get_resident();
+	int get_resident_frames();
+
+	// Realtime safe. Returns the number of contiguous frames available at frame and
+	// points *data to the first one. If they are not in RAM *data is set to NULL and the
+	// negated number of missing frames is returned. 0 means frame is out of range.
+	int read(int frame, fp8p24_t **data);
+
+	// Blocking, reads directly from the file without using the cache. Throws jException on failure.
+	void read_frames(int frame, int count, fp8p24_t *destination);
+
+	// Realtime safe. The stream will be deleted by the prefetch thread, do not use it after this call.
+	void release();
+
+	// convert count source values into fp8p24_t, returns false if the bit depth is not supported
+	static bool convert(SourceFormat format, int bits_per_sample,
+			    const uint8_t *source, fp8p24_t *destination, int count);
+
+	// must be called by the audio thread once per render cycle, before any machine is executed
+	static void advance_cycle();
+
+	static Statistics get_statistics();
+	static void clear_statistics();
+	static void set_cache_limit(size_t bytes);
+
+	// While set read() waits for missing pages instead of returning silence,
+	// used when rendering faster than realtime. Not for the audio thread.
+	static void set_blocking_reads(bool blocking);
+
+private:
+	enum PageState {
+		_page_absent, _page_requested, _page_resident, _page_failed
+	};
+
+	class Page {
+	public:
+		StaticSignalStream *owner;
+		int index;
+		int frames;
+		fp8p24_t *data;
+		std::atomic<unsigned int> last_used;
+		unsigned int retired_cycle;
+	};
+
+	class PrefetchThread;
+	friend class PrefetchThread;
+
+	int fd;
+	off_t data_offset;
+	SourceFormat format;
+	int bits_per_sample, channels, frames;
+	int source_frame_size;
+
+	fp8p24_t *resident;
+	int resident_frames;
+
+	int page_count;
+	std::atomic<Page *> *pages;
+	std::atomic<int> *page_state;
+
+	std::atomic<bool> released;
+	unsigned int release_cycle;
+	StaticSignalStream *next_released;
+
+	~StaticSignalStream();
+
+	// not realtime safe, returns false on failure
+	bool load_from_file(int frame, int count, fp8p24_t *destination);
+
+	void request(int page);
+	void request_ahead(int page);
+
+	static std::atomic<unsigned int> cycle;
+};
+
+#endif
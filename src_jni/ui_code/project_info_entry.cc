@@ -31,6 +31,7 @@
 #include "project_info_entry.hh"
 #include "machine.hh"
 #include "machine_sequencer.hh"
+#include "recording_sink.hh"
 #include "jngldrum/jthread.hh"
 #include "common.hh"
 
@@ -93,6 +94,7 @@ void get_project_info(void *data) {
 	gue->genre = trim(genre->get_text());
 
 	Machine::set_record_file_name(std::string(DEFAULT_EXPORT_PATH) + "/" + gue->title);
+	RecordingSink::set_tags(gue->title, gue->artist, gue->genre);
 
 	q->push_event(gue);
 }
@@ -149,6 +151,7 @@ void set_project_info(void *data) {
 	} else {
 		Machine::set_record_file_name(std::string(DEFAULT_EXPORT_PATH) + "/" + trim(s->title));
 	}
+	RecordingSink::set_tags(trim(s->title), trim(s->artist), trim(s->genre));
 
 	delete s;
 }
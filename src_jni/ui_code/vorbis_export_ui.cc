@@ -51,68 +51,77 @@
 #include <errno.h>
 
 #include <jngldrum/jinformer.hh>
+#include <jngldrum/jexception.hh>
 
 #include "machine.hh"
-#include "vorbis_encoder.hh"
+#include "recording_sink.hh"
 
 //#define __DO_SATAN_DEBUG
 #include "satan_debug.hh"
 
 class BusyExportData {
 public:
-	FILE *input, *output;
-
+	std::string file_name; // without the extension
 	std::string title, artist, genre;
 };
 
-static void busy_export_ogg(void *data) {
+// progress is logged for every 10% of the song
+#define EXPORT_PROGRESS_STEP 10
+
+static void busy_export_ogg(void *data, KammoGUI::CancelIndicator &cid) {
 	BusyExportData *beo_data = (BusyExportData *)data;
 	if(beo_data == NULL) {
 		jInformer::inform("Sorry, internal insanity error in ogg export.");
 		return;
 	}
-	
-	FILE *input = beo_data->input;
-	FILE *output = beo_data->output;
 
-	std::string title, artist, genre;
-	title = beo_data->title;
-	artist = beo_data->artist;
-	genre = beo_data->genre;
-	
+	// render the song faster than realtime, straight to OGG
+	Machine::OfflineRenderSettings settings;
+	settings.file_name = beo_data->file_name;
+	settings.title = beo_data->title;
+	settings.artist = beo_data->artist;
+	settings.genre = beo_data->genre;
+	settings.formats = RecordingSink::_vorbis;
+
 	delete beo_data;
-	
-	if(input == NULL || output == NULL) {
-		jInformer::inform("Sorry, two counts of internal insanity error in ogg export.");
+
+	int last_step = 0;
+	try {
+		// called on the render thread, the busy work waits for it below
+		Machine::start_offline_render(
+			settings,
+			[&cid, &last_step](const Machine::OfflineRenderProgress &p) -> bool {
+				if(p.lines_total > 0) {
+					int step = (EXPORT_PROGRESS_STEP * p.lines_rendered) / p.lines_total;
+					if(step != last_step) {
+						last_step = step;
+						SATAN_DEBUG("OGG export - %d%% (%f seconds)\n",
+							    (100 / EXPORT_PROGRESS_STEP) * step, p.seconds_rendered);
+					}
+				}
+				return !cid.is_cancelled();
+			});
+	} catch(jException e) {
+		jInformer::inform("Sorry, OGG export failed: " + e.message);
 		return;
+	}
+
+	Machine::OfflineRenderProgress result = Machine::wait_for_offline_render();
+	std::string path = settings.file_name + ".ogg";
+
+	if(result.error != "") {
+		unlink(path.c_str());
+		jInformer::inform("Sorry, OGG export failed: " + result.error);
+	} else if(result.cancelled) {
+		// don't leave a truncated file behind
+		unlink(path.c_str());
+		jInformer::inform("OGG export cancelled.");
 	} else {
-		int result = vorbis_encoder(
-			input, output, title, artist, genre
-			);
-		
-		fclose(input); fclose(output);
-		
-		switch(result) {
-		case 0:
-			// A-O-K, nothing to do
-			break;
-			
-		case -1:
-			jInformer::inform("Sorry, input file is too short.");
-			break;
-			
-		case -2:
-			jInformer::inform("Sorry, input file is not correct.");
-			break;
-			
-		case 1:
-			jInformer::inform("Sorry, vorbis init failed.");
-			break;
-			
-		default:
-			jInformer::inform("Sorry, OGG encoder returned an error.");
-			break;
-		}
+		char bfr[128];
+		snprintf(bfr, sizeof(bfr), "Exported %d:%02d in %.1f seconds.",
+			 (int)result.seconds_rendered / 60, (int)result.seconds_rendered % 60,
+			 result.seconds_elapsed);
+		jInformer::inform(bfr);
 	}
 }
 
@@ -124,59 +133,29 @@ static void yes(void *ignored) {
 	if(Machine::is_it_playing()) {
 		KammoGUI::display_notification("Disabled:",
 					       "Cannot export vorbis while playback is activated.");
+	} else if(Machine::is_rendering_offline()) {
+		KammoGUI::display_notification("Busy:",
+					       "An export is already in progress.");
 	} else {
-		SATAN_DEBUG("wav file: %s\n", Machine::get_record_fname().c_str());
-		
-		FILE *input = NULL, *output = NULL;
-		
-		std::string iname = Machine::get_record_file_name();
-		iname += ".wav";
-		input = fopen(
-			iname.c_str(),
-			"r");
-		
-		if(input == NULL) {
-			KammoGUI::display_notification(
-				"No WAV source found:",
-				"Did you record a wav for this project?");
-		} else {
-			output = fopen(
-				export_path.c_str(),
-				"w");
-			
-			if(output == NULL) {
-				fclose(input);
-				KammoGUI::display_notification(
-					"Output failure:",
-					"Could not write output");
-			} else {
-				BusyExportData *beo_data = new BusyExportData();
-				if(beo_data == NULL) {
-					fclose(input);
-					fclose(output);
-				} else {					
-					beo_data->input = input;
-					beo_data->output = output;
-					
-					static KammoGUI::Entry *title = NULL;
-					KammoGUI::get_widget((KammoGUI::Widget **)&title, "saveUI_titleEntry");
-					static KammoGUI::Entry *artist = NULL;
-					KammoGUI::get_widget((KammoGUI::Widget **)&artist, "saveUI_artistEntry");
-					static KammoGUI::Entry *genre = NULL;
-					KammoGUI::get_widget((KammoGUI::Widget **)&genre, "saveUI_genreEntry");
-					
-					if(title && artist && genre) {
-						beo_data->title = title->get_text();
-						beo_data->artist = artist->get_text();
-						beo_data->genre = genre->get_text();
-					}
-					
-					
-					KammoGUI::do_busy_work("Exporting OGG...", "This may take a while....",
-							       busy_export_ogg, beo_data);
-				}
-			}
+		BusyExportData *beo_data = new BusyExportData();
+
+		beo_data->file_name = Machine::get_record_file_name();
+
+		static KammoGUI::Entry *title = NULL;
+		KammoGUI::get_widget((KammoGUI::Widget **)&title, "saveUI_titleEntry");
+		static KammoGUI::Entry *artist = NULL;
+		KammoGUI::get_widget((KammoGUI::Widget **)&artist, "saveUI_artistEntry");
+		static KammoGUI::Entry *genre = NULL;
+		KammoGUI::get_widget((KammoGUI::Widget **)&genre, "saveUI_genreEntry");
+
+		if(title && artist && genre) {
+			beo_data->title = title->get_text();
+			beo_data->artist = artist->get_text();
+			beo_data->genre = genre->get_text();
 		}
+
+		KammoGUI::do_cancelable_busy_work("Exporting OGG...", "Rendering the song, press back to cancel.",
+						  busy_export_ogg, beo_data);
 	}
 }
 
@@ -37,37 +37,185 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
-#include <vorbis/vorbisenc.h>
 #include <iostream>
 
+#include "vorbis_encoder.hh"
+
 //#define __DO_SATAN_DEBUG
 #include "satan_debug.hh"
 
+// frames submitted to libvorbis at a time
 #define READ 1024
 signed char readbuffer[READ*4+44]; /* out of the data segment, not the stack */
 
+VorbisEncoder::VorbisEncoder() : output(NULL), channels(0), is_open(false) {}
+
+VorbisEncoder::~VorbisEncoder() {
+	clear();
+}
+
+void VorbisEncoder::clear() {
+	if(!is_open) return;
+
+	/* clean up. vorbis_info_clear() must be called last */
+	ogg_stream_clear(&os);
+	vorbis_block_clear(&vb);
+	vorbis_dsp_clear(&vd);
+	vorbis_comment_clear(&vc);
+	vorbis_info_clear(&vi);
+
+	/* ogg_page and ogg_packet structs always point to storage in
+	   libvorbis.  They're never freed or manipulated directly */
+	is_open = false;
+}
+
+int VorbisEncoder::open(FILE *output_file, int _channels, int sample_rate,
+			const std::string &title,
+			const std::string &artist,
+			const std::string &genre) {
+	clear();
+
+	output = output_file;
+	channels = _channels;
+
+	/********** Encode setup ************/
+
+	vorbis_info_init(&vi);
+
+	/* Encoding using a VBR quality mode.  The usable range is -.1
+	   (lowest quality, smallest file) to 1. (highest quality, largest file).
+	   Example quality mode .4: 44kHz stereo coupled, roughly 128kbps VBR */
+	int ret=vorbis_encode_init_vbr(&vi,channels,sample_rate,0.75);
+
+	/* do not continue if setup failed; this can happen if we ask for a
+	   mode that libVorbis does not support (eg, too low a bitrate, etc,
+	   will return 'OV_EIMPL') */
+	if(ret) {
+		vorbis_info_clear(&vi);
+		return 1;
+	}
+
+	/* add a comment */
+	vorbis_comment_init(&vc);
+	vorbis_comment_add_tag(&vc,"ENCODER","VuKNOB");
+	vorbis_comment_add_tag(&vc,"TITLE", title.c_str());
+	vorbis_comment_add_tag(&vc,"ARTIST", artist.c_str());
+	vorbis_comment_add_tag(&vc,"GENRE", genre.c_str());
+
+	/* set up the analysis state and auxiliary encoding storage */
+	vorbis_analysis_init(&vd,&vi);
+	vorbis_block_init(&vd,&vb);
+
+	/* set up our packet->stream encoder */
+	/* pick a random serial number; that way we can more likely build
+	   chained streams just by concatenation */
+	srand(time(NULL));
+	ogg_stream_init(&os,rand());
+
+	is_open = true;
+
+	/* Vorbis streams begin with three headers; the initial header (with
+	   most of the codec setup parameters) which is mandated by the Ogg
+	   bitstream spec.  The second header holds any comment fields.  The
+	   third header holds the bitstream codebook.  We merely need to
+	   make the headers, then pass them to libvorbis one at a time;
+	   libvorbis handles the additional Ogg bitstream constraints */
+	ogg_packet header;
+	ogg_packet header_comm;
+	ogg_packet header_code;
+
+	vorbis_analysis_headerout(&vd,&vc,&header,&header_comm,&header_code);
+	ogg_stream_packetin(&os,&header); /* automatically placed in its own
+					     page */
+	ogg_stream_packetin(&os,&header_comm);
+	ogg_stream_packetin(&os,&header_code);
+
+	/* This ensures the actual
+	 * audio data will start on a new page, as per spec
+	 */
+	return write_pages(true);
+}
+
+int VorbisEncoder::write_pages(bool flush) {
+	ogg_page og; /* one Ogg bitstream page.  Vorbis packets are inside */
+
+	while(flush ? ogg_stream_flush(&os,&og) : ogg_stream_pageout(&os,&og)) {
+		if(fwrite(og.header,1,og.header_len,output) != (size_t)og.header_len ||
+		   fwrite(og.body,1,og.body_len,output) != (size_t)og.body_len)
+			return -3;
+		if(ogg_page_eos(&og)) break;
+	}
+	return 0;
+}
+
+int VorbisEncoder::encode_blocks() {
+	ogg_packet op; /* one raw packet of data for decode */
+
+	/* vorbis does some data preanalysis, then divvies up blocks for
+	   more involved (potentially parallel) processing.  Get a single
+	   block for encoding now */
+	while(vorbis_analysis_blockout(&vd,&vb)==1){
+
+		/* analysis, assume we want to use bitrate management */
+		vorbis_analysis(&vb,NULL);
+		vorbis_bitrate_addblock(&vb);
+
+		while(vorbis_bitrate_flushpacket(&vd,&op)){
+			/* weld the packet into the bitstream */
+			ogg_stream_packetin(&os,&op);
+
+			/* write out pages (if any) */
+			if(write_pages(false)) return -3;
+		}
+	}
+	return 0;
+}
+
+int VorbisEncoder::write(const int16_t *interleaved, int frames) {
+	if(!is_open) return 1;
+
+	while(frames > 0) {
+		int k, c, n = frames < READ ? frames : READ;
+
+		/* expose the buffer to submit data */
+		float **buffer=vorbis_analysis_buffer(&vd,n);
+
+		/* uninterleave samples */
+		for(k = 0; k < n; k++)
+			for(c = 0; c < channels; c++)
+				buffer[c][k] = interleaved[k * channels + c] / 32768.f;
+
+		/* tell the library how much we actually submitted */
+		vorbis_analysis_wrote(&vd,n);
+		if(encode_blocks()) return -3;
+
+		interleaved += n * channels;
+		frames -= n;
+	}
+	return 0;
+}
+
+int VorbisEncoder::finish() {
+	if(!is_open) return 1;
+
+	/* Tell the library we're at end of stream so that it can handle
+	   the last frame and mark end of stream in the output properly */
+	vorbis_analysis_wrote(&vd,0);
+	int retval = encode_blocks();
+	if(retval == 0) retval = write_pages(true);
+
+	clear();
+	return retval;
+}
+
 int vorbis_encoder(FILE *input_file, FILE *output_file,
 		   const std::string &title,
 		   const std::string &artist,
 		   const std::string &genre
 	){
-	ogg_stream_state os; /* take physical pages, weld into a logical
-				stream of packets */
-	ogg_page         og; /* one Ogg bitstream page.  Vorbis packets are inside */
-	ogg_packet       op; /* one raw packet of data for decode */
-
-	vorbis_info      vi; /* struct that stores all the static vorbis bitstream
-				settings */
-	vorbis_comment   vc; /* struct that stores all the user comments */
-
-	vorbis_dsp_state vd; /* central working state for the packet->PCM decoder */
-	vorbis_block     vb; /* local working space for packet->PCM decode */
-
 	uint32_t sample_rate; // this is read from the RIFF/WAVE file
 	uint32_t byte_rate; // this is read from the file
 	
-	int eos=0,ret;
-	
 	/*
 	 * We expect a 44 byte block of data before the
 	 * PCM encoded audio data.
@@ -181,163 +329,25 @@ int vorbis_encoder(FILE *input_file, FILE *output_file,
 
 	if(failure != 0) return -2;
 	
-	/********** Encode setup ************/
-
-	vorbis_info_init(&vi);
-
-	/* choose an encoding mode.  A few possibilities commented out, one
-	   actually used: */
-
-	/*********************************************************************
-   Encoding using a VBR quality mode.  The usable range is -.1
-   (lowest quality, smallest file) to 1. (highest quality, largest file).
-   Example quality mode .4: 44kHz stereo coupled, roughly 128kbps VBR
-
-   ret = vorbis_encode_init_vbr(&vi,2,44100,.4);
-
-   ---------------------------------------------------------------------
-
-   Encoding using an average bitrate mode (ABR).
-   example: 44kHz stereo coupled, average 128kbps VBR
-
-   ret = vorbis_encode_init(&vi,2,44100,-1,128000,-1);
-
-   ---------------------------------------------------------------------
+	VorbisEncoder encoder;
+	int retval = encoder.open(output_file, 2, sample_rate, title, artist, genre);
 
-   Encode using a quality mode, but select that quality mode by asking for
-   an approximate bitrate.  This is not ABR, it is true VBR, but selected
-   using the bitrate interface, and then turning bitrate management off:
-
-   ret = ( vorbis_encode_setup_managed(&vi,2,44100,-1,128000,-1) ||
-           vorbis_encode_ctl(&vi,OV_ECTL_RATEMANAGE2_SET,NULL) ||
-           vorbis_encode_setup_init(&vi));
-
-	*********************************************************************/
-
-	ret=vorbis_encode_init_vbr(&vi,2,sample_rate,0.75);
-
-	/* do not continue if setup failed; this can happen if we ask for a
-	   mode that libVorbis does not support (eg, too low a bitrate, etc,
-	   will return 'OV_EIMPL') */
-
-	if(ret) return 1;
-
-	/* add a comment */
-	vorbis_comment_init(&vc);
-	vorbis_comment_add_tag(&vc,"ENCODER","VuKNOB");
-	vorbis_comment_add_tag(&vc,"TITLE", title.c_str());
-	vorbis_comment_add_tag(&vc,"ARTIST", artist.c_str());
-	vorbis_comment_add_tag(&vc,"GENRE", genre.c_str());
-	
-	/* set up the analysis state and auxiliary encoding storage */
-	vorbis_analysis_init(&vd,&vi);
-	vorbis_block_init(&vd,&vb);
-
-	/* set up our packet->stream encoder */
-	/* pick a random serial number; that way we can more likely build
-	   chained streams just by concatenation */
-	srand(time(NULL));
-	ogg_stream_init(&os,rand());
-
-	/* Vorbis streams begin with three headers; the initial header (with
-	   most of the codec setup parameters) which is mandated by the Ogg
-	   bitstream spec.  The second header holds any comment fields.  The
-	   third header holds the bitstream codebook.  We merely need to
-	   make the headers, then pass them to libvorbis one at a time;
-	   libvorbis handles the additional Ogg bitstream constraints */
-
-	{
-		ogg_packet header;
-		ogg_packet header_comm;
-		ogg_packet header_code;
-
-		vorbis_analysis_headerout(&vd,&vc,&header,&header_comm,&header_code);
-		ogg_stream_packetin(&os,&header); /* automatically placed in its own
-						     page */
-		ogg_stream_packetin(&os,&header_comm);
-		ogg_stream_packetin(&os,&header_code);
-
-		/* This ensures the actual
-		 * audio data will start on a new page, as per spec
-		 */
-		while(!eos){
-			int result=ogg_stream_flush(&os,&og);
-			if(result==0)break;
-			fwrite(og.header,1,og.header_len,output_file);
-			fwrite(og.body,1,og.body_len,output_file);
-		}
-
-	}
-
-	while(!eos){
-		long i;
+	while(retval == 0) {
 		long bytes=fread(readbuffer,1,READ*4,input_file); /* stereo hardwired here */
+		int16_t pcm[READ * 2];
+		long i;
 
-		if(bytes==0){
-			/* end of file.  this can be done implicitly in the mainline,
-			   but it's easier to see here in non-clever fashion.
-			   Tell the library we're at end of stream so that it can handle
-			   the last frame and mark end of stream in the output properly */
-			vorbis_analysis_wrote(&vd,0);
-
-		}else{
-			/* data to encode */
-
-			/* expose the buffer to submit data */
-			float **buffer=vorbis_analysis_buffer(&vd,READ);
-
-			/* uninterleave samples */
-			for(i=0;i<bytes/4;i++){
-				buffer[0][i]=((readbuffer[i*4+1]<<8)|
-					      (0x00ff&(int)readbuffer[i*4]))/32768.f;
-				buffer[1][i]=((readbuffer[i*4+3]<<8)|
-					      (0x00ff&(int)readbuffer[i*4+2]))/32768.f;
-			}
-
-			/* tell the library how much we actually submitted */
-			vorbis_analysis_wrote(&vd,i);
+		if(bytes==0) {
+			/* end of file */
+			return encoder.finish();
 		}
 
-		/* vorbis does some data preanalysis, then divvies up blocks for
-		   more involved (potentially parallel) processing.  Get a single
-		   block for encoding now */
-		while(vorbis_analysis_blockout(&vd,&vb)==1){
-
-			/* analysis, assume we want to use bitrate management */
-			vorbis_analysis(&vb,NULL);
-			vorbis_bitrate_addblock(&vb);
-
-			while(vorbis_bitrate_flushpacket(&vd,&op)){
-
-				/* weld the packet into the bitstream */
-				ogg_stream_packetin(&os,&op);
-
-				/* write out pages (if any) */
-				while(!eos){
-					int result=ogg_stream_pageout(&os,&og);
-					if(result==0)break;
-					fwrite(og.header,1,og.header_len,output_file);
-					fwrite(og.body,1,og.body_len,output_file);
-
-					/* this could be set above, but for illustrative purposes, I do
-					   it here (to show that vorbis does know where the stream ends) */
-
-					if(ogg_page_eos(&og))eos=1;
-				}
-			}
+		/* the file is little endian */
+		for(i=0;i<bytes/2;i++){
+			pcm[i]=(readbuffer[i*2+1]<<8)|(0x00ff&(int)readbuffer[i*2]);
 		}
+		retval = encoder.write(pcm, bytes / 4);
 	}
 
-	/* clean up and exit.  vorbis_info_clear() must be called last */
-
-	ogg_stream_clear(&os);
-	vorbis_block_clear(&vb);
-	vorbis_dsp_clear(&vd);
-	vorbis_comment_clear(&vc);
-	vorbis_info_clear(&vi);
-
-	/* ogg_page and ogg_packet structs always point to storage in
-	   libvorbis.  They're never freed or manipulated directly */
-
-	return 0;
+	return retval;
 }
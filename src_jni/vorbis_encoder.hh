@@ -1,5 +1,51 @@
+#ifndef __VORBIS_ENCODER
+#define __VORBIS_ENCODER
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vorbis/vorbisenc.h>
+
+/* Encodes interleaved 16 bit PCM into an Ogg/Vorbis stream, a block at a
+ * time, so that it can be fed while the audio is produced.
+ *
+ * open(), write() and finish() return 0 on success, 1 if the vorbis
+ * initialization failed and -3 if the output could not be written.
+ */
+class VorbisEncoder {
+public:
+	VorbisEncoder();
+	~VorbisEncoder();
+
+	int open(FILE *output_file, int channels, int sample_rate,
+		 const std::string &title,
+		 const std::string &artist,
+		 const std::string &genre);
+	int write(const int16_t *interleaved, int frames);
+	// writes the last pages, the output file is not closed
+	int finish();
+
+private:
+	FILE *output;
+	int channels;
+	bool is_open;
+
+	ogg_stream_state os;
+	vorbis_info vi;
+	vorbis_comment vc;
+	vorbis_dsp_state vd;
+	vorbis_block vb;
+
+	int write_pages(bool flush);
+	int encode_blocks();
+	void clear();
+};
+
+// transcodes a stereo 16 bit RIFF/WAVE file
 int vorbis_encoder(FILE *input_file, FILE *output_file,
 		   const std::string &title,
 		   const std::string &artist,
 		   const std::string &genre
 	);
+
+#endif
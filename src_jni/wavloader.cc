@@ -46,14 +46,11 @@
 #endif
 
 #include "fixedpointmath.h"
+#include "static_signal_stream.hh"
 
 //#define __DO_SATAN_DEBUG
 #include "satan_debug.hh"
 
-// 30 seconds of 2 channel, 2 byte data at 44100 samples / second
-// this we use as a limit of RAM size of statically loaded signals
-#define __STATIC_SIGNAL_RAM_SIZE_LIMIT 44100 * 2 * 2 * 30
-
 /*****************************
  *                           *
  * class WavLoader::Chunk    *
@@ -252,6 +249,12 @@ uint8_t *WavLoader::MemoryMappedWave::get_data_pointer() {
 	return NULL;
 }
 
+off_t WavLoader::MemoryMappedWave::get_data_offset() {
+	if(data)
+		return data->data - mapped;
+	return 0;
+}
+
 WavLoader::MemoryMappedWave *WavLoader::MemoryMappedWave::get(const std::string &fname) {
 	return new MemoryMappedWave(fname);
 }
@@ -292,61 +295,6 @@ bool WavLoader::is_signal_valid(const std::string &fname) {
 	return true;
 }
 
-// this function converts a wav file into fixed point data (f8p24_t)
-static int load_to_ram(fp8p24_t *ram_buffer, void *data, int channels, int samples, int bits_per_sample) {
-	uint8_t *_byte = (uint8_t *)data;
-	
-	for(int k = 0; k < samples; k++) {
-		for(int c = 0; c < channels; c++) {
-			uint32_t tmp = 0;
-			int32_t *tmp_signed = (int32_t *)&tmp;
-			
-			switch(bits_per_sample) {
-			case 8:
-				tmp = ((uint32_t)_byte[k * channels + c]) << 24;
- 				break;
-
-			case 16:
-				tmp =
-					(((uint32_t)_byte[2 * (k * channels + c) + 1]) << 24)
-					|
-					(((uint32_t)_byte[2 * (k * channels + c) + 0]) << 16)
-					;
- 				break;
-
-			case 24:
-				tmp =
-					(((uint32_t)_byte[3 * (k * channels + c) + 2]) << 24)
-					|
-					(((uint32_t)_byte[3 * (k * channels + c) + 1]) << 16)
-					|
-					(((uint32_t)_byte[3 * (k * channels + c) + 0]) << 8)
-					;
- 				break;
-
-			case 32:
-				tmp =
-					(((uint32_t)_byte[4 * (k * channels + c) + 3]) << 24)
-					|
-					(((uint32_t)_byte[4 * (k * channels + c) + 2]) << 16)
-					|
-					(((uint32_t)_byte[4 * (k * channels + c) + 1]) << 8)
-					|
-					(((uint32_t)_byte[4 * (k * channels + c) + 0]) << 0)
-					;
- 				break;
-
-			default:
-				return 0; // can't understand this resolution...
-			}
-			
-			ram_buffer[k * channels + c] = (*tmp_signed) >> 8; // shift it down to a value between -1.0 to 1.0
-		}
-	}
-	
-	return -1; // success
-}
-
 void WavLoader::load_static_signal(const std::string &fname, bool only_preview, int static_index) {
 
 	std::string basename = fname;
@@ -362,38 +310,53 @@ void WavLoader::load_static_signal(const std::string &fname, bool only_preview,
 		throw jException("Unable to allocate mmap wave.", jException::sanity_error);
 	}
 	
-	uint32_t ram_size =
-		mmap_wave->get_bits_per_sample() *
-		mmap_wave->get_length_in_samples() / 8;
-	
-	if(ram_size > __STATIC_SIGNAL_RAM_SIZE_LIMIT) {
-		// limit static signals to predefined ammount of RAM data...
-		delete mmap_wave;
-
-		throw jException("Static signal is larger than built-in threshold - refusing to load.", jException::sanity_error);
-	}
-
 	uint16_t channels = mmap_wave->get_channels_per_sample();
 	uint32_t sample_rate = mmap_wave->get_sample_rate();
 	uint16_t bits_per_sample = mmap_wave->get_bits_per_sample();
 	uint32_t samples = mmap_wave->get_length_in_samples();
 
+	size_t ram_size = (size_t)samples * channels * sizeof(fp8p24_t);
+
+	if(ram_size > STATIC_SIGNAL_STREAM_THRESHOLD) {
+		if(only_preview) {
+			// we only preview the part that would be resident
+			uint32_t resident = STATIC_SIGNAL_STREAM_RESIDENT_PAGES * STATIC_SIGNAL_STREAM_PAGE_FRAMES;
+			if(samples > resident) samples = resident;
+		} else {
+			// the signal is too large to keep in RAM, stream it from the file instead
+			off_t data_offset = mmap_wave->get_data_offset();
+			delete mmap_wave;
+
+			StaticSignalStream *stream =
+				new StaticSignalStream(fname, data_offset,
+						       StaticSignalStream::_wav_pcm_le, bits_per_sample,
+						       channels, samples);
+			replace_signal(static_index, _0D, sample_rate,
+				       fname, basename, stream);
+			return;
+		}
+	}
+
 	// convert 8, 16, 24 or 32 into fp8p24 fixed point values
 	fp8p24_t *ram_buffer = (fp8p24_t *)malloc(samples * channels * sizeof(fp8p24_t));
-	if(ram_buffer) {
-		if(load_to_ram(ram_buffer, mmap_wave->get_data_pointer(), channels, samples, bits_per_sample)) {
-			if(only_preview) {
-				preview_signal(_0D, _fx8p24bit, channels, samples, sample_rate, ram_buffer);
-			} else {
-				replace_signal(static_index, _0D, _fx8p24bit, channels, samples, sample_rate,
-					       fname, basename, ram_buffer);
-			}
-			delete mmap_wave;
+	if(ram_buffer == NULL) {
+		delete mmap_wave;
+		throw jException("Not enough memory to load static signal.", jException::sanity_error);
+	}
+
+	if(StaticSignalStream::convert(StaticSignalStream::_wav_pcm_le, bits_per_sample,
+				       mmap_wave->get_data_pointer(), ram_buffer, samples * channels)) {
+		if(only_preview) {
+			preview_signal(_0D, _fx8p24bit, channels, samples, sample_rate, ram_buffer);
 		} else {
-			free(ram_buffer);
-			delete mmap_wave;
-			throw jException("File is not in expected format.",
-					 jException::sanity_error);
+			replace_signal(static_index, _0D, _fx8p24bit, channels, samples, sample_rate,
+				       fname, basename, ram_buffer);
 		}
-	}	
+		delete mmap_wave;
+	} else {
+		free(ram_buffer);
+		delete mmap_wave;
+		throw jException("File is not in expected format.",
+				 jException::sanity_error);
+	}
 }
@@ -88,6 +88,7 @@ public:
 		uint32_t get_length_in_samples();
 		
 		uint8_t *get_data_pointer();
+		off_t get_data_offset(); // offset of the data in the file
 
 		static MemoryMappedWave *get(const std::string &fname);		
 	};
@@ -0,0 +1,114 @@
+/*
+ * VuKNOB
+ * Copyright (C) 2014 by Anton Persson
+ *
+ * http://www.vuknob.com/
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program;
+ * if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __WRITE_QUEUE
+#define __WRITE_QUEUE
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+
+/*
+ * Outgoing messages of one connection, written in the order they were queued.
+ *
+ * Messages with a payload larger than the bulk threshold are taken alone,
+ * to be written one chunk at a time, and messages queued after them wait
+ * until the last chunk has been written. An update with a supersede key
+ * drops the previous update for the same object and key if it is still
+ * waiting, the new one is queued last so it does not overtake anything.
+ *
+ * Not thread safe, only used from the context thread.
+ */
+template <class MessageType>
+class WriteQueue {
+public:
+	typedef std::shared_ptr<MessageType> MessagePointer;
+
+	// payloads larger than threshold are taken alone
+	void set_bulk_threshold(size_t threshold) {
+		bulk_threshold = threshold;
+	}
+
+	// returns true if a waiting update was dropped
+	bool push(const MessagePointer &msg) {
+		bool superseded = false;
+		const std::string &key = msg->get_supersede_key();
+
+		if(key.size() > 0 && !msg->is_awaiting_reply() && msg->has_value("id")) {
+			std::string slot_key = msg->get_value("id") + ":" + key;
+
+			auto found = supersedable.find(slot_key);
+			if(found != supersedable.end() && found->second >= first) {
+				auto &previous = msgs[found->second - first];
+				if(previous) {
+					previous.reset();
+					waiting--;
+					superseded = true;
+				}
+			}
+			supersedable[slot_key] = first + msgs.size();
+		}
+
+		msgs.push_back(msg);
+		waiting++;
+		return superseded;
+	}
+
+	// Move the next messages to write into batch, which must be empty, but no more than max_batch.
+	// Returns true if batch holds a single message with a bulk payload, false for whole messages.
+	bool take(std::vector<MessagePointer> &batch, size_t max_batch) {
+		bool bulk = false;
+		while(!bulk && !msgs.empty() && batch.size() < max_batch) {
+			auto &msg = msgs.front();
+			if(msg) {
+				bulk = msg->get_payload_length() > bulk_threshold;
+				// a bulk payload goes out alone, after everything queued before it
+				if(bulk && batch.size() > 0) {
+					bulk = false;
+					break;
+				}
+
+				batch.push_back(std::move(msg));
+				waiting--;
+			}
+			msgs.pop_front();
+			first++;
+		}
+		if(msgs.empty())
+			supersedable.clear(); // nothing left to supersede
+		return bulk;
+	}
+
+	// number of messages waiting, not counting superseded ones
+	size_t size() const {
+		return waiting;
+	}
+
+private:
+	std::deque<MessagePointer> msgs; // superseded updates leave an empty slot behind
+	size_t waiting = 0; // msgs that are not empty slots
+	uint64_t first = 0; // sequence number of msgs.front()
+	std::unordered_map<std::string, uint64_t> supersedable; // id:key -> sequence number
+	size_t bulk_threshold = SIZE_MAX;
+};
+
+#endif